@@ -54,6 +54,16 @@ static bool dcc_cmd_notify(intptr_t, const char *msg)
 }
 
 
+// function to get adc log blocks; written to the console as-is (binary, no
+// newline translation), for capture and offline analysis
+static void dcc_cmd_adc_log(intptr_t, const DccAdcTrace::Blk &blk)
+{
+    const uint8_t *b = (const uint8_t *)&blk;
+    for (size_t i = 0; i < sizeof(blk); i++)
+        putchar_raw(b[i]);
+}
+
+
 static inline uint32_t usec_to_msec(uint64_t us)
 {
     return (uint32_t)((us + 500) / 1000);
@@ -87,6 +97,8 @@ int main()
 
     DccApi::notify(dcc_cmd_notify);
 
+    DccApi::adc_log(dcc_cmd_adc_log);
+
     printf("\n");
     cmd_help();
     printf("\n");
@@ -593,6 +605,7 @@ static void debug_help()
 {
     print_help("D <code> G", "get debug value for code");
     print_help("D <code> S <value>", "set debug value for code");
+    print_help("D 2 S 1", "start adc log (binary blocks to console)");
 }
 
 
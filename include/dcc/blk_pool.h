@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Pool of result blocks shared by the cores
+//
+// For results too big for a response slot in rsp_queue (a status dump, all
+// of a set of counters): dcc_srv (core 1) takes a free block with alloc(),
+// fills it in, and sends just its handle in the response; DccApi (core 0)
+// reads the result right out of the block and gives it back with release().
+// Nothing is copied through the ring.
+//
+// Each block has a busy flag that only core 1 sets and only core 0 clears,
+// so like MsgRing there's no lock, just loads and stores with
+// acquire/release ordering: core 0 is done with a block before release()
+// says it's free, and the response (through rsp_queue, also release/
+// acquire) comes after the block is filled in.
+//
+// If core 0 holds on to all of them, alloc() fails, and so does the request.
+
+template <int len_max, int cnt_max>
+class BlkPool
+{
+public:
+
+    static_assert(cnt_max > 0 && cnt_max <= 255, "handles are uint8_t");
+
+    static constexpr int len = len_max;
+
+    BlkPool()
+    {
+        for (int i = 0; i < cnt_max; i++)
+            _busy[i].store(false, std::memory_order_relaxed);
+    }
+
+    // core 1 /////////////////////////////////////////////////////////////////
+
+    // A free block's handle, or -1 if none are free
+    int alloc()
+    {
+        for (int h = 0; h < cnt_max; h++) {
+            if (!_busy[h].load(std::memory_order_acquire)) {
+                _busy[h].store(true, std::memory_order_relaxed);
+                return h;
+            }
+        }
+        return -1;
+    }
+
+    // core 0 /////////////////////////////////////////////////////////////////
+
+    void release(int h)
+    {
+        if (valid(h))
+            _busy[h].store(false, std::memory_order_release);
+    }
+
+    // both ///////////////////////////////////////////////////////////////////
+
+    bool valid(int h) const
+    {
+        return 0 <= h && h < cnt_max;
+    }
+
+    void *blk(int h)
+    {
+        return valid(h) ? _blk[h] : nullptr;
+    }
+
+    // blocks in use (for tests and debug)
+    int busy_cnt() const
+    {
+        int n = 0;
+        for (int h = 0; h < cnt_max; h++)
+            if (_busy[h].load(std::memory_order_relaxed))
+                n++;
+        return n;
+    }
+
+private:
+
+    std::atomic<bool> _busy[cnt_max];
+
+    alignas(4) uint8_t _blk[cnt_max][len_max];
+
+}; // class BlkPool
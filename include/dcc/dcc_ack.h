@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstdint>
+
+// Service mode ack detection
+//
+// When we start looking for an ack (after the initial resets), arm() is
+// called with the baseline track current (the long average), and the
+// threshold is set to that plus inc_ma. After that, check() is called with
+// the short average each time there are new samples. If the short average
+// reaches the threshold, that's an ack. The next get_packet_* call sees it
+// with ack(), which clears it and disarms.
+//
+// Decoders vary a lot in how big their ack pulses are, and 60 mA over the
+// long average is conservative. While the initial resets are going out (the
+// decoder is powered up and idle), learn() is called with the short average
+// to get the mean and variance of the track current. If enough was learned,
+// arm() sets the threshold a few standard deviations above the baseline (but
+// at least inc_min_ma, and no more than inc_ma). The baseline is still the
+// long average passed to arm(), since the current can drift during a read,
+// but no lower than the learned mean. The height of the first ack pulse is
+// also remembered; later thresholds are at least half of that, so a decoder
+// with big pulses doesn't get a hair trigger. If nothing was learned, it's
+// the fixed threshold.
+//
+// There's no hardware access in here so the same code can be driven by
+// recorded traces in the native ack bench.
+
+class DccAck
+{
+public:
+
+    static constexpr uint16_t inc_ma_def = 60;
+
+    // adaptive threshold is this many standard deviations over the mean
+    static constexpr int sd_mul = 5;
+
+    // but at least this much over the mean
+    static constexpr uint16_t inc_min_ma = 20;
+
+    // need this many learn() calls before it's used
+    static constexpr int learn_min = 32;
+
+    DccAck(uint16_t inc_ma = inc_ma_def);
+
+    void reset()
+    {
+        _ack_ma = ack_ma_inv;
+        _ack = false;
+    }
+
+    // Forget what was learned (start of a service mode operation)
+    void learn_reset();
+
+    // Track current while idle, to learn the noise
+    void learn(uint16_t track_ma)
+    {
+        _learn_cnt++;
+        _learn_sum += track_ma;
+        _learn_sq += uint32_t(track_ma) * track_ma;
+    }
+
+    bool learned() const
+    {
+        return _learn_cnt >= learn_min;
+    }
+
+    uint16_t noise_mean_ma() const;
+    uint16_t noise_sd_ma() const;
+
+    // height of the first ack pulse seen since learn_reset(), 0 if none
+    uint16_t pulse_ma() const
+    {
+        return _pulse_ma;
+    }
+
+    // When we start looking for an ack, set the threshold
+    void arm(uint16_t base_ma);
+
+    bool armed() const
+    {
+        return _ack_ma != ack_ma_inv;
+    }
+
+    // Look for ack and trigger if we see one
+    bool check(uint16_t track_ma)
+    {
+        if (_peak_ma != 0)
+            peak(track_ma);
+
+        if (armed() && track_ma >= _ack_ma) {
+            // ack!
+            if (learned() && _pulse_ma == 0)
+                _peak_ma = track_ma; // measure this one
+            _ack_ma = ack_ma_inv;
+            _ack = true;
+            return true;
+        } else {
+            // no ack
+            return false;
+        }
+    }
+
+    // See if we have an ack, and clear it if so
+    bool ack()
+    {
+        if (_ack) {
+            reset();
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    uint16_t inc_ma() const
+    {
+        return _inc_ma;
+    }
+
+    void inc_ma(uint16_t inc_ma)
+    {
+        _inc_ma = inc_ma;
+    }
+
+    // threshold, or UINT16_MAX if not armed
+    uint16_t ack_ma() const
+    {
+        return _ack_ma;
+    }
+
+private:
+
+    uint16_t _inc_ma;
+
+    uint16_t _ack_ma;
+    static constexpr uint16_t ack_ma_inv = UINT16_MAX;
+
+    bool _ack;
+
+    int _learn_cnt;
+    uint32_t _learn_sum;
+    uint64_t _learn_sq;
+
+    uint16_t _base_ma; // baseline used in the last arm()
+
+    // While measuring an ack pulse, the highest current seen so far (else 0)
+    uint16_t _peak_ma;
+    uint16_t _pulse_ma;
+
+    void peak(uint16_t track_ma);
+
+}; // class DccAck
@@ -2,6 +2,9 @@
 
 #include <cstdint>
 #include "misc/dbg_gpio.h"
+#include "pico/util/queue.h"
+#include "dcc/dcc_adc_avg.h"
+#include "dcc/dcc_adc_trace.h"
 
 class DccAdc
 {
@@ -18,14 +21,32 @@ public:
     uint16_t short_avg_ma() const;
     uint16_t long_avg_ma() const;
 
+    // Average over the newest fast_cnt samples, for the overcurrent trip
+    uint16_t fast_avg_ma() const;
+    static const int fast_cnt = 3; // 300 usec
+
+    // The adc log streams every sample (and marks) in blocks to a queue,
+    // for core 0 to write out (see dcc_adc_trace.h). There's no limit on
+    // how long it runs; if core 0 doesn't keep up, blocks are dropped and
+    // counted.
     bool logging() const
     {
-        return _log != nullptr;
+        return _log_queue != nullptr;
     }
 
-    void log_init(int samples = sample_rate);
-    void log_reset();
-    void log_show() const;
+    void log_start(queue_t *q); // q's element size is sizeof(DccAdcTrace::Blk)
+    void log_stop();
+    void log_mark(uint8_t mark, int a, int b); // called in interrupt context
+
+    uint32_t log_blk_cnt() const // blocks made since log_start()
+    {
+        return _log_blk_cnt;
+    }
+
+    uint32_t log_drop_cnt() const // of those, dropped because queue full
+    {
+        return _log_drop_cnt;
+    }
 
     void dbg_loop(int dbg_loop_gpio)
     {
@@ -33,21 +54,21 @@ public:
         DbgGpio::init(_dbg_loop_gpio);
     }
 
-private:
+    static uint16_t raw_to_ma(uint16_t raw)
+    {
+        return mv_to_ma(raw_to_mv(raw));
+    }
 
-    int _gpio;
+    static const uint32_t sample_rate = 10000; // 10 KHz = 100 usec per sample
 
-    uint16_t avg_raw(int cnt) const;
+    // The DMA writes samples into a ring of this many entries. It must be a
+    // power of 2 (the DMA wraps the write address), and big enough that
+    // loop() can be late by a few msec without losing samples.
+    static constexpr int ring_len = 256; // 25.6 msec at 10 KHz
 
-    uint16_t short_avg_raw() const
-    {
-        return avg_raw(short_cnt);
-    }
+private:
 
-    uint16_t long_avg_raw() const
-    {
-        return avg_raw(long_cnt);
-    }
+    int _gpio;
 
     static uint16_t raw_to_mv(uint16_t raw)
     {
@@ -70,24 +91,40 @@ private:
     }
 
     static const uint32_t clock_rate = 48000000;
-    static const uint32_t sample_rate = 10000; // 10 KHz = 100 usec per sample
 
     static const int avg_max =
         sample_rate / 60; // 1 cycle of 60 Hz noise (166 for 10 KHz)
-    uint16_t _avg[avg_max];
-    int _avg_idx;
 
     static const int short_cnt = 16;
 
     static const int long_cnt = avg_max;
 
-    int _err_cnt;
+    DccAdcAvg _avg;
+
+    // DMA channel streaming the ADC FIFO into the ring, -1 if not claimed
+    int _dma_chan;
+
+    // The DMA is started with this transfer count, so the number of samples
+    // written so far is dma_cnt minus the channel's current transfer count.
+    static constexpr uint32_t dma_cnt = 0x0fffffff; // ~7.4 hours at 10 KHz
+
+    uint32_t _ring_rd; // samples consumed from the ring (wraps)
+
+    void dma_start();
+
+    void block(const uint16_t *raw, int cnt);
+
+    int _err_cnt; // ADC conversion errors (error bit set in sample)
+    int _ovr_cnt; // times loop() was so late the DMA lapped the ring
+
+    // Log block being filled. It's sent when full, or before a mark.
+    queue_t *volatile _log_queue;
+    DccAdcTrace::Blk _log_blk;
+    uint16_t _log_seq;
+    uint32_t _log_blk_cnt;
+    uint32_t _log_drop_cnt;
 
-    // The log is allocated on the heap in log_init(). It should never be
-    // freed and reallocated repeatedly, so shouldn't lead to fragmentation.
-    int _log_max;
-    int _log_idx;
-    uint16_t *_log;
+    void log_send(); // called in interrupt context
 
     int _dbg_loop_gpio;
 
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+
+// Sliding-window averages of raw 12-bit ADC samples.
+//
+// Samples are added in blocks (whatever the DMA has written since the last
+// time we looked), and a running sum is kept for each window so getting an
+// average does not depend on the window length. There is no hardware access
+// in here, so it can be used in native tests and host-side tools the same as
+// it is used by DccAdc.
+
+class DccAdcAvg
+{
+public:
+
+    // Largest window. Must be a power of 2 (it's the size of the history).
+    static constexpr int win_max = 256;
+
+    DccAdcAvg(int short_cnt, int long_cnt);
+
+    void reset();
+
+    void add(uint16_t raw)
+    {
+        raw &= raw_mask;
+        uint16_t short_old = _hist[(_idx - _short_cnt) & hist_mask];
+        uint16_t long_old = _hist[(_idx - _long_cnt) & hist_mask];
+        _hist[_idx & hist_mask] = raw;
+        _idx++;
+        _short_sum += raw - short_old;
+        _long_sum += raw - long_old;
+    }
+
+    void add(const uint16_t *raw, int cnt)
+    {
+        for (int i = 0; i < cnt; i++)
+            add(raw[i]);
+    }
+
+    int short_cnt() const
+    {
+        return _short_cnt;
+    }
+
+    int long_cnt() const
+    {
+        return _long_cnt;
+    }
+
+    // Change the short window; history is kept, the sum is recalculated.
+    void short_cnt(int cnt);
+
+    uint16_t short_avg_raw() const
+    {
+        return (_short_sum + _short_cnt / 2) / _short_cnt;
+    }
+
+    uint16_t long_avg_raw() const
+    {
+        return (_long_sum + _long_cnt / 2) / _long_cnt;
+    }
+
+    // Average of the newest cnt samples, added up each time (for small cnt)
+    uint16_t recent_avg_raw(int cnt) const
+    {
+        return (sum(cnt) + cnt / 2) / cnt;
+    }
+
+private:
+
+    static constexpr int hist_mask = win_max - 1;
+    static_assert((win_max & hist_mask) == 0, "win_max must be a power of 2");
+
+    static constexpr uint16_t raw_mask = 0x0fff;
+
+    uint16_t _hist[win_max];
+    uint32_t _idx; // total samples added; wraps, only low bits used
+
+    int _short_cnt;
+    int _long_cnt;
+
+    // Running sums. The history starts zeroed, so these are right from the
+    // start (a window that has not filled yet averages in zeros).
+    int32_t _short_sum;
+    int32_t _long_sum;
+
+    int32_t sum(int cnt) const;
+
+}; // class DccAdcAvg
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// ADC trace file format
+//
+// The native ack bench (test_native/ack_bench.cpp) replays traces through the
+// same averaging and ack detection code used on the target. A trace is text
+// (below), or the binary adc log (further below) as captured from the
+// console; the bench reads either.
+//
+// Text, one item per line:
+//
+//   dcc_adc_trace <version> <sample_rate>    first line
+//   # anything                               comment
+//   <raw>                                    one 12-bit sample (decimal)
+//   w <verify> <val>                         ack window starts (ack armed)
+//   r <ok> <cv_val>                          service mode operation done
+//   g <blocks> 0                             samples lost here
+//   end                                      last line
+//
+// Marks ('w', 'r', and 'g' lines) apply at the point between samples where
+// they appear.
+//
+// <verify> says what the command packets in the window are:
+//   0..7   bit-verify of that bit, <val> is the bit value being verified
+//   8      byte-verify, <val> is the byte value being verified
+//   9      write (byte or bit), <val> is unused
+//
+// The 'r' mark has <ok> 1 if the operation succeeded. For a CV read, <cv_val>
+// is the value read; for a bit read, it is the bit value in its position
+// (e.g. bit 5 read as 1 is 0x20). Given a successful read, whether each
+// window should have had an ack can be worked out afterwards. Windows in
+// writes or in failed reads are "don't know", as are windows in an operation
+// where samples were lost ('g').
+//
+// Binary (adc log):
+//
+// With the adc log on, DccAdc packs samples into fixed size blocks (Blk) and
+// sends them to core 0 through a queue as they fill. Core 0 writes them out
+// as-is (dcc_cmd writes them to the console). Each block starts with
+// blk_sync, which never appears in console text, so text printed between
+// blocks is skipped when reading. Blocks are:
+//
+//   blk_start    log turned on; data is version (1 byte), sample_rate (4)
+//   blk_samples  cnt samples, 12 bits each, two packed in three bytes
+//   blk_mark     data is mark (1 byte), a (2), b (2), as in the text format
+//   blk_end      log turned off; data is err_cnt, ovr_cnt, drop_cnt (4 each)
+//
+// seq counts every block made, including ones dropped because the queue was
+// full, so a gap in seq is where samples were lost. Multi-byte values are
+// little-endian (both the rp2040 and the host are).
+
+namespace DccAdcTrace {
+
+constexpr int version = 2; // 2 adds the gap mark and binary blocks
+
+enum Mark : uint8_t {
+    mark_win = 'w',
+    mark_res = 'r',
+    mark_gap = 'g',
+};
+
+constexpr int verify_byte = 8;
+constexpr int verify_write = 9;
+
+constexpr uint8_t blk_sync = 0xdc;
+
+enum BlkType : uint8_t {
+    blk_start = 'S',
+    blk_samples = 'D',
+    blk_mark = 'M',
+    blk_end = 'E',
+};
+
+constexpr int blk_data_len = 59;
+
+constexpr int blk_samples_max = (blk_data_len * 2) / 3; // 39
+
+struct Blk {
+    uint8_t sync; // blk_sync
+    uint8_t type; // BlkType
+    uint16_t seq;
+    uint8_t cnt; // samples in a blk_samples block
+    uint8_t data[blk_data_len];
+};
+
+static_assert(sizeof(Blk) == 64, "Blk should be 64 bytes");
+
+inline void blk_init(Blk &b, uint8_t type, uint16_t seq)
+{
+    b.sync = blk_sync;
+    b.type = type;
+    b.seq = seq;
+    b.cnt = 0;
+    memset(b.data, 0, sizeof(b.data));
+}
+
+// Sample i is in bytes 3*(i/2) and the next one or two:
+//   even i: low 8 bits, then high 4 bits in the low nibble of the next byte
+//   odd i:  low 4 bits in the high nibble of that byte, then high 8 bits
+inline void blk_put(Blk &b, int i, uint16_t raw)
+{
+    uint8_t *d = &b.data[(i >> 1) * 3];
+    if ((i & 1) == 0) {
+        d[0] = raw;
+        d[1] = (d[1] & 0xf0) | ((raw >> 8) & 0x0f);
+    } else {
+        d[1] = (d[1] & 0x0f) | ((raw << 4) & 0xf0);
+        d[2] = raw >> 4;
+    }
+}
+
+inline uint16_t blk_get(const Blk &b, int i)
+{
+    const uint8_t *d = &b.data[(i >> 1) * 3];
+    if ((i & 1) == 0)
+        return d[0] | ((d[1] & 0x0f) << 8);
+    else
+        return (d[1] >> 4) | (d[2] << 4);
+}
+
+inline void blk_u16_put(Blk &b, int off, uint16_t v)
+{
+    memcpy(&b.data[off], &v, sizeof(v));
+}
+
+inline uint16_t blk_u16_get(const Blk &b, int off)
+{
+    uint16_t v;
+    memcpy(&v, &b.data[off], sizeof(v));
+    return v;
+}
+
+inline void blk_u32_put(Blk &b, int off, uint32_t v)
+{
+    memcpy(&b.data[off], &v, sizeof(v));
+}
+
+inline uint32_t blk_u32_get(const Blk &b, int off)
+{
+    uint32_t v;
+    memcpy(&v, &b.data[off], sizeof(v));
+    return v;
+}
+
+}; // namespace DccAdcTrace
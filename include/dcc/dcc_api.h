@@ -2,7 +2,11 @@
 
 #include <cstdint>
 
+#include "dcc/dcc_adc_trace.h"
+#include "dcc/dcc_lat.h"
+#include "dcc/dcc_pkt.h"
 #include "dcc/dcc_srv.h"
+#include "dcc/railcom_stats.h"
 #include "hardware/uart.h"
 
 namespace DccApi {
@@ -24,45 +28,161 @@ typedef bool(NotifyFunc)(intptr_t arg, const char *msg);
 
 void notify(NotifyFunc *func, intptr_t arg = 0);
 
+// Notifications loop() has handed out, and how many it knows were missed
+// (dcc_srv numbers them; see dcc_notify.h). Loco speed, loco dyn values and
+// track current reports only ever have the latest value waiting, so a
+// report that was replaced by a newer one before it was sent isn't counted
+// as missed; debug_get(7, ...) and the raw "D 7 G" have dcc_srv's counts.
+void notify_stats(uint32_t &cnt, uint32_t &lost);
+
+// adc log
+//
+// debug_set(2, 1) starts the adc log and debug_set(2, 0) stops it. While it
+// runs, func is called (from loop(), or while waiting for a response) with
+// each block, to be written out for offline analysis (see dcc_adc_trace.h).
+// debug_get(2, on) says whether it's on (the raw response "D 2 G" also has
+// the block and dropped block counts).
+
+typedef void(AdcLogFunc)(intptr_t arg, const DccAdcTrace::Blk &blk);
+
+void adc_log(AdcLogFunc *func, intptr_t arg = 0);
+
 constexpr int32_t forever_us = INT32_MAX;
 
+// request ids and pipelining
+//
+// Most calls come as a *_start/*_check pair, plus one that does both and
+// waits. Each *_start gives its request an id, which req_id() returns
+// right after. Several requests can be outstanding: while a service mode
+// operation (or another track on/off) is running, dcc_srv holds back only
+// service mode and track on/off requests, and answers the rest (e.g. loco
+// speed and functions) right away. A *_check waits for the response to the
+// request with the given id, or the last one started if it's 0; responses
+// for other outstanding requests that come in meanwhile are kept until
+// their *_check is called. Up to req_out_max can be outstanding; past that
+// the oldest is forgotten.
+
+typedef uint16_t ReqId;
+
+constexpr int req_out_max = 32;
+
+ReqId req_id();
+
+// completions
+//
+// Instead of waiting in *_check, a request can be left outstanding with a
+// done function, which loop() calls once the response is in (s is Ok) or
+// timeout_us has gone by (s is Timeout). With the response in, func calls
+// the request's *_check (with end_us 0 and the id it's given) to get it,
+// and that returns right away. Requests with a done function are never
+// forgotten; with req_out_max of them outstanding, *_start gives Error.
+// Or, ready() says (without waiting) whether a request's response is in,
+// for callers that would rather poll.
+//
+// For example:
+//
+//   loco_speed_get_start(3, time_us_32() + loco_op_timeout_us);
+//   done(req_id(), speed_done, 3, loco_op_timeout_us);
+//   ...
+//   void speed_done(intptr_t arg, ReqId id, Status s)
+//   {
+//       int speed;
+//       if (s == Status::Ok &&
+//           loco_speed_get_check(speed, 0, id) == Status::Ok)
+//           ...
+//   }
+//
+// Retries (as loco_cv_val_get() etc. do) are up to the done function.
+
+typedef void(DoneFunc)(intptr_t arg, ReqId id, Status s);
+
+Status done(ReqId id, DoneFunc *func, intptr_t arg, int32_t timeout_us);
+bool ready(ReqId id);
+
 // raw send/receive (for testing)
 
 Status raw_req(const char *req_msg, int32_t timeout_us = 0);
 Status raw_rsp(char *rsp_msg, int rsp_max, int32_t timeout_us = 0);
 Status raw_not(char *not_msg, int not_max, int32_t timeout_us = 0);
 
+// round trip times
+//
+// Time from sending a request to getting its response, in usec, for
+// requests sent as text (bin false) and binary requests (bin true; see
+// dcc_msg.h). Text requests include the long ones (e.g. service mode), so
+// their max is mostly those. dcc_srv's side of it (time from getting a
+// request to answering it) is in the raw responses to "D 5 G" (text) and
+// "D 6 G" (binary).
+
+struct Rtt {
+    uint32_t cnt;
+    uint32_t us_avg;
+    uint32_t us_max;
+};
+
+void rtt_get(bool bin, Rtt &rtt);
+void rtt_reset();
+
 // track power
 
 constexpr int32_t track_timeout_us = 100'000;
 
 Status track_get_start(int32_t end_us);
-Status track_get_check(bool &on, int32_t end_us);
+Status track_get_check(bool &on, int32_t end_us, ReqId id = 0);
 Status track_get(bool &on, int32_t timeout_us = track_timeout_us);
 
 Status track_set_start(bool on, int32_t end_us);
-Status track_set_check(int32_t end_us);
+Status track_set_check(int32_t end_us, ReqId id = 0);
 Status track_set(bool on, int32_t timeout_us = track_timeout_us);
 
+// track current and overcurrent trip (ops mode)
+//
+// With reports on, notifications "T I <ma>" come every report_ms. On
+// overcurrent, "T O T <ma>" (tripped, power off), "T O R <ma>" (power on
+// again after retry_ms), and "T O L <ma>" (locked out after retry_max trips
+// in a row; track_set(true) turns it back on) are sent.
+
+Status track_current_get_start(int32_t end_us);
+Status track_current_get_check(int &ma, int32_t end_us, ReqId id = 0);
+Status track_current_get(int &ma, int32_t timeout_us = track_timeout_us);
+
+Status track_current_report_start(int report_ms, int32_t end_us);
+Status track_current_report_check(int32_t end_us, ReqId id = 0);
+Status track_current_report(int report_ms,
+                            int32_t timeout_us = track_timeout_us);
+
+Status track_limit_get_start(int32_t end_us);
+Status track_limit_get_check(int &limit_ma, int &retry_ms, int &retry_max,
+                             int32_t end_us, ReqId id = 0);
+Status track_limit_get(int &limit_ma, int &retry_ms, int &retry_max,
+                       int32_t timeout_us = track_timeout_us);
+
+Status track_limit_set_start(int limit_ma, int retry_ms, int retry_max,
+                             int32_t end_us);
+Status track_limit_set_check(int32_t end_us, ReqId id = 0);
+Status track_limit_set(int limit_ma, int retry_ms, int retry_max,
+                       int32_t timeout_us = track_timeout_us);
+
 // service mode, cv access
 
 constexpr int32_t cv_get_timeout_us = 2'000'000;
 constexpr int32_t cv_set_timeout_us = 2'000'000;
 
 Status cv_val_get_start(int cv_num, int32_t end_us);
-Status cv_val_get_check(int &cv_val, int32_t end_us = cv_get_timeout_us);
+Status cv_val_get_check(int &cv_val, int32_t end_us = cv_get_timeout_us,
+                        ReqId id = 0);
 Status cv_val_get(int cv_num, int &cv_val, int32_t timeout_us = cv_get_timeout_us);
 
 Status cv_val_set_start(int cv_num, int cv_val, int32_t end_us);
-Status cv_val_set_check(int32_t end_us);
+Status cv_val_set_check(int32_t end_us, ReqId id = 0);
 Status cv_val_set(int cv_num, int cv_val, int32_t timeout_us = cv_set_timeout_us);
 
 Status cv_bit_get_start(int cv_num, int b_num, int32_t end_us);
-Status cv_bit_get_check(int &b_val, int32_t end_us);
+Status cv_bit_get_check(int &b_val, int32_t end_us, ReqId id = 0);
 Status cv_bit_get(int cv_num, int b_num, int &b_val, int32_t timeout_us = cv_get_timeout_us);
 
 Status cv_bit_set_start(int cv_num, int b_num, int b_val, int32_t end_us);
-Status cv_bit_set_check(int32_t end_us);
+Status cv_bit_set_check(int32_t end_us, ReqId id = 0);
 Status cv_bit_set(int cv_num, int b_num, int b_val, int32_t timeout_us = cv_set_timeout_us);
 
 // service mode, loco address
@@ -71,11 +191,11 @@ constexpr int32_t addr_get_timeout_us = 5'000'000;
 constexpr int32_t addr_set_timeout_us = 5'000'000;
 
 Status addr_get_start(int32_t end_us);
-Status addr_get_check(int &addr, int32_t end_us);
+Status addr_get_check(int &addr, int32_t end_us, ReqId id = 0);
 Status addr_get(int &addr, int32_t timeout_us = addr_get_timeout_us);
 
 Status addr_set_start(int addr, int32_t end_us);
-Status addr_set_check(int32_t end_us);
+Status addr_set_check(int32_t end_us, ReqId id = 0);
 Status addr_set(int addr, int32_t timeout_us = addr_set_timeout_us);
 
 // loco control
@@ -84,46 +204,221 @@ Status addr_set(int addr, int32_t timeout_us = addr_set_timeout_us);
 constexpr int32_t loco_op_timeout_us = 100'000;
 
 Status loco_create_start(int addr, int32_t end_us);
-Status loco_create_check(int32_t end_us);
+Status loco_create_check(int32_t end_us, ReqId id = 0);
 Status loco_create(int addr, int32_t timeout_us = loco_op_timeout_us);
 
 Status loco_delete_start(int addr, int32_t end_us);
-Status loco_delete_check(int32_t end_us);
+Status loco_delete_check(int32_t end_us, ReqId id = 0);
 Status loco_delete(int addr, int32_t timeout_us = loco_op_timeout_us);
 
 Status loco_func_get_start(int addr, int func, int32_t end_us);
-Status loco_func_get_check(bool &on, int32_t end_us);
+Status loco_func_get_check(bool &on, int32_t end_us, ReqId id = 0);
 Status loco_func_get(int addr, int func, bool &on, int32_t timeout_us = loco_op_timeout_us);
 
 Status loco_func_set_start(int addr, int func, bool on, int32_t end_us);
-Status loco_func_set_check(int32_t end_us);
+Status loco_func_set_check(int32_t end_us, ReqId id = 0);
 Status loco_func_set(int addr, int func, bool on, int32_t timeout_us = loco_op_timeout_us);
 
 Status loco_speed_get_start(int addr, int32_t end_us);
-Status loco_speed_get_check(int &speed, int32_t end_us);
+Status loco_speed_get_check(int &speed, int32_t end_us, ReqId id = 0);
 Status loco_speed_get(int addr, int &speed, int32_t timeout_us = loco_op_timeout_us);
 
 Status loco_speed_set_start(int addr, int speed, int32_t end_us);
-Status loco_speed_set_check(int32_t end_us);
+Status loco_speed_set_check(int32_t end_us, ReqId id = 0);
 Status loco_speed_set(int addr, int speed, int32_t timeout_us = loco_op_timeout_us);
 
+// Speed and/or one function for several locos (up to loco_batch_max) in
+// one request, applied all together or not at all. speed loco_speed_keep
+// leaves the speed alone, func loco_func_none changes no function; a loco
+// can be listed more than once.
+
+constexpr int loco_batch_max = 8;
+constexpr int loco_speed_keep = INT16_MIN;
+constexpr int loco_func_none = -1;
+
+struct LocoUpdate {
+    int addr;
+    int speed;
+    int func;
+    bool on;
+};
+
+Status loco_batch_start(const LocoUpdate *upd, int cnt, int32_t end_us);
+Status loco_batch_check(int32_t end_us, ReqId id = 0);
+Status loco_batch(const LocoUpdate *upd, int cnt,
+                  int32_t timeout_us = loco_op_timeout_us);
+
+// Address, speed and functions of the locos (in address order) from the
+// start'th on, all in one response (dcc_srv puts them in a result block, see
+// dcc_msg.h). cnt is how many went in ls (up to ls_max), and more is how
+// many there are after those. loco_list() gets them all (up to ls_max),
+// asking again from where the last one left off if they didn't all fit.
+// A response in a block holds it until it's checked; if unchecked ones hold
+// them all, starting another of these (or railcom_stats_get_start() etc.)
+// forgets the oldest, as when too many requests are outstanding.
+
+struct LocoStatus {
+    int addr;
+    int speed;
+    bool func[DccPkt::function_max + 1];
+};
+
+Status loco_list_start(int start, int32_t end_us);
+Status loco_list_check(LocoStatus *ls, int ls_max, int &cnt, int &more,
+                       int32_t end_us, ReqId id = 0);
+Status loco_list(LocoStatus *ls, int ls_max, int &cnt,
+                 int32_t timeout_us = loco_op_timeout_us);
+
 // XXX speed change notify
 
+// railcom channel 2 frames received after the loco's packets: all good, good
+// messages followed by junk, and nothing usable
+
+Status loco_railcom_get_start(int addr, int32_t end_us);
+Status loco_railcom_get_check(int &full, int &partial, int &rejected,
+                              int32_t end_us, ReqId id = 0);
+Status loco_railcom_get(int addr, int &full, int &partial, int &rejected,
+                        int32_t timeout_us = loco_op_timeout_us);
+
+// one railcom counter (0...RailComStats::cnt-1) for the cutouts after the
+// loco's packets
+
+Status loco_railcom_stat_get_start(int addr, int stat, int32_t end_us);
+Status loco_railcom_stat_get_check(uint32_t &stat_val, int32_t end_us,
+                                   ReqId id = 0);
+Status loco_railcom_stat_get(int addr, int stat, uint32_t &stat_val,
+                             int32_t timeout_us = loco_op_timeout_us);
+
+// all of them at once (one request, so they're from the same moment)
+
+Status loco_railcom_stats_get_start(int addr, int32_t end_us);
+Status loco_railcom_stats_get_check(RailComStats &stats, int32_t end_us,
+                                    ReqId id = 0);
+Status loco_railcom_stats_get(int addr, RailComStats &stats,
+                              int32_t timeout_us = loco_op_timeout_us);
+
+// railcom dynamic variables (RailComSpec::DynId) the loco has sent: the
+// latest value and how long ago. With reports on, a notification comes when
+// the value changes (at most every min_ms), which loco_dyn_event() picks
+// apart (false if it's some other notification).
+
+Status loco_dyn_get_start(int addr, int dyn_id, int32_t end_us);
+Status loco_dyn_get_check(int &dyn_val, int &age_ms, int32_t end_us,
+                          ReqId id = 0);
+Status loco_dyn_get(int addr, int dyn_id, int &dyn_val, int &age_ms,
+                    int32_t timeout_us = loco_op_timeout_us);
+
+Status loco_dyn_report_start(int addr, int dyn_id, bool on, int min_ms,
+                             int32_t end_us);
+Status loco_dyn_report_check(int32_t end_us, ReqId id = 0);
+Status loco_dyn_report(int addr, int dyn_id, bool on, int min_ms = 0,
+                       int32_t timeout_us = loco_op_timeout_us);
+
+bool loco_dyn_event(const char *not_msg, int &addr, int &dyn_id, int &dyn_val,
+                    int &time_ms);
+
+// ops mode cv access tuning for the loco: how many times a packet is sent
+// (at most), how many packets to wait after a write, and cv read times (see
+// DccLoco::ops_tune_get()). Setting it turns tuning on or off, starting over.
+
+Status loco_ops_tune_get_start(int addr, int32_t end_us);
+Status loco_ops_tune_get_check(int &send_cnt, int &lockout, int &read_ms,
+                               int &read_max_ms, int32_t end_us, ReqId id = 0);
+Status loco_ops_tune_get(int addr, int &send_cnt, int &lockout, int &read_ms,
+                         int &read_max_ms,
+                         int32_t timeout_us = loco_op_timeout_us);
+
+Status loco_ops_tune_set_start(int addr, bool on, int32_t end_us);
+Status loco_ops_tune_set_check(int32_t end_us, ReqId id = 0);
+Status loco_ops_tune_set(int addr, bool on,
+                         int32_t timeout_us = loco_op_timeout_us);
+
 // operations that require a railcom response from loco on track
 constexpr int32_t loco_cv_op_timeout_us = 1'000'000;
 
 Status loco_cv_val_get_start(int addr, int cv_num, int32_t end_us);
-Status loco_cv_val_get_check(int &cv_val, int32_t end_us);
+Status loco_cv_val_get_check(int &cv_val, int32_t end_us, ReqId id = 0);
 Status loco_cv_val_get(int addr, int cv_num, int &cv_val, int attempts = 5);
 
 Status loco_cv_val_set_start(int addr, int cv_num, int cv_val, int32_t end_us);
-Status loco_cv_val_set_check(int32_t end_us);
+Status loco_cv_val_set_check(int32_t end_us, ReqId id = 0);
 Status loco_cv_val_set(int addr, int cv_num, int cv_val, int attempts = 5);
 
 Status loco_cv_bit_set_start(int addr, int cv_num, int b_num, int b_val, int32_t end_us);
-Status loco_cv_bit_set_check(int32_t end_us);
+Status loco_cv_bit_set_check(int32_t end_us, ReqId id = 0);
 Status loco_cv_bit_set(int addr, int cv_num, int b_num, int b_val, int attempts = 5);
 
+// Queued ops mode cv access, to run on several locos at once. The caller
+// picks an id (1-65535) for each; the response only says it was queued (a
+// few can be queued per loco). The result comes later as a notification,
+// which loco_cv_result() picks apart (false if it's some other
+// notification). There is no retry; a failed access can be queued again.
+
+Status loco_cv_val_get_queue_start(int addr, int cv_num, int id,
+                                   int32_t end_us);
+Status loco_cv_val_get_queue_check(int32_t end_us, ReqId id = 0);
+Status loco_cv_val_get_queue(int addr, int cv_num, int id,
+                             int32_t timeout_us = loco_op_timeout_us);
+
+Status loco_cv_val_set_queue_start(int addr, int cv_num, int cv_val, int id,
+                                   int32_t end_us);
+Status loco_cv_val_set_queue_check(int32_t end_us, ReqId id = 0);
+Status loco_cv_val_set_queue(int addr, int cv_num, int cv_val, int id,
+                             int32_t timeout_us = loco_op_timeout_us);
+
+Status loco_cv_bit_set_queue_start(int addr, int cv_num, int b_num, int b_val,
+                                   int id, int32_t end_us);
+Status loco_cv_bit_set_queue_check(int32_t end_us, ReqId id = 0);
+Status loco_cv_bit_set_queue(int addr, int cv_num, int b_num, int b_val, int id,
+                             int32_t timeout_us = loco_op_timeout_us);
+
+bool loco_cv_result(const char *not_msg, int &addr, int &id, bool &ok,
+                    int &cv_val, int &time_ms);
+
+// loco addresses heard in railcom channel 1 (ops mode)
+//
+// railcom_addr_cnt_get() says how many there are, then railcom_addr_get()
+// gets each (0...cnt-1); an Error from that can mean one has just gone. With
+// reports on, a notification comes when an address shows up or goes away,
+// which railcom_addr_event() picks apart (false if it's some other
+// notification).
+
+constexpr int32_t railcom_timeout_us = 100'000;
+
+Status railcom_addr_cnt_get_start(int32_t end_us);
+Status railcom_addr_cnt_get_check(int &cnt, int32_t end_us, ReqId id = 0);
+Status railcom_addr_cnt_get(int &cnt, int32_t timeout_us = railcom_timeout_us);
+
+Status railcom_addr_get_start(int idx, int32_t end_us);
+Status railcom_addr_get_check(int &addr, int &conf, int &age_ms, int32_t end_us,
+                              ReqId id = 0);
+Status railcom_addr_get(int idx, int &addr, int &conf, int &age_ms,
+                        int32_t timeout_us = railcom_timeout_us);
+
+Status railcom_addr_report_start(bool on, int32_t end_us);
+Status railcom_addr_report_check(int32_t end_us, ReqId id = 0);
+Status railcom_addr_report(bool on, int32_t timeout_us = railcom_timeout_us);
+
+bool railcom_addr_event(const char *not_msg, int &addr, bool &present);
+
+// railcom counters for all cutouts, one at a time (0...RailComStats::cnt-1)
+// or all of them (one request, so they're from the same moment)
+
+Status railcom_stat_get_start(int stat, int32_t end_us);
+Status railcom_stat_get_check(uint32_t &stat_val, int32_t end_us, ReqId id = 0);
+Status railcom_stat_get(int stat, uint32_t &stat_val,
+                        int32_t timeout_us = railcom_timeout_us);
+
+Status railcom_stats_get_start(int32_t end_us);
+Status railcom_stats_get_check(RailComStats &stats, int32_t end_us,
+                               ReqId id = 0);
+Status railcom_stats_get(RailComStats &stats,
+                         int32_t timeout_us = railcom_timeout_us);
+
+Status railcom_stats_reset_start(int32_t end_us);
+Status railcom_stats_reset_check(int32_t end_us, ReqId id = 0);
+Status railcom_stats_reset(int32_t timeout_us = railcom_timeout_us);
+
 constexpr int32_t debug_timeout_us = 100'000;
 
 enum DebugCode {
@@ -131,11 +426,32 @@ enum DebugCode {
 };
 
 Status debug_get_start(int code, int32_t end_us);
-Status debug_get_check(int &val, int32_t end_us);
+Status debug_get_check(int &val, int32_t end_us, ReqId id = 0);
 Status debug_get(int code, int &val, int32_t timeout_us = debug_timeout_us);
 
 Status debug_set_start(int code, int val, int32_t end_us);
-Status debug_set_check(int32_t end_us);
+Status debug_set_check(int32_t end_us, ReqId id = 0);
 Status debug_set(int code, int val, int32_t timeout_us = debug_timeout_us);
 
+// Latency from calling DccApi to the packet with the change going out on the
+// track (dcc_lat.h), for one kind of request and stage (Whole is all of it);
+// the raw "D 10 G <stage>" etc. Each loco in a batch counts once. Times are
+// usec. Changes that weren't timed are counted in missed (the same for every
+// stage). lat_reset() resets all of them.
+
+struct LatStats {
+    uint32_t cnt;
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+    uint32_t missed;
+};
+
+Status lat_get_start(DccLat::Kind kind, DccLat::Stage stage, int32_t end_us);
+Status lat_get_check(LatStats &lat, int32_t end_us, ReqId id = 0);
+Status lat_get(DccLat::Kind kind, DccLat::Stage stage, LatStats &lat,
+               int32_t timeout_us = debug_timeout_us);
+
+Status lat_reset(int32_t timeout_us = debug_timeout_us);
+
 } // namespace DccApi
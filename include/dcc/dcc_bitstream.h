@@ -25,6 +25,17 @@ public:
 
     Timer int_timer;
 
+    // Interrupt latency: how far into the bit (PWM counter, usec) the
+    // handler gets to run, over all bits since the last reset
+    struct IrqLat {
+        uint32_t cnt;
+        uint64_t us;
+        uint32_t us_max;
+    };
+
+    IrqLat irq_lat() const;
+    void irq_lat_reset();
+
     // log DCC packets sent to BufLog
     bool show_dcc() const
     {
@@ -35,6 +46,15 @@ public:
         _show_dcc = en;
     }
 
+    // Track power (enable channel) on or off while the bitstream keeps
+    // running. Off takes effect at the start of the next bit; on, at the next
+    // bit that is not part of a railcom cutout. start_*() turns it on.
+    void power(bool on); // called in interrupt context
+    bool power() const
+    {
+        return !_pwr_off;
+    }
+
     // log railcom packets received to BufLog
     bool show_railcom() const
     {
@@ -45,6 +65,30 @@ public:
         _show_railcom = en;
     }
 
+    const RailCom &railcom() const
+    {
+        return _railcom;
+    }
+
+    RailCom &railcom()
+    {
+        return _railcom;
+    }
+
+    // Packets sent, kept so railcom data can be matched to the packet (loco
+    // and request ID) that came right before the cutout it arrived in.
+    // sent(0) is the packet going out now (or, during the cutout and the
+    // preamble after it, the one just sent), sent(1) is the one before that,
+    // and so on. nullptr if i is past what's kept or what's been sent.
+    static constexpr int sent_max = 8; // power of 2
+
+    const DccPkt2 *sent(int i) const
+    {
+        if (i < 0 || i >= sent_max || uint32_t(i) >= _sent_cnt)
+            return nullptr;
+        return &_sent[(_sent_cnt - 1 - i) & (sent_max - 1)];
+    }
+
 private:
 
     bool _show_dcc;
@@ -56,7 +100,13 @@ private:
 
     int _pwr_gpio;
 
-    DccPkt2 _current2;
+    DccPkt2 _sent[sent_max];
+    uint32_t _sent_cnt; // total; the newest is _sent[(_sent_cnt - 1) % sent_max]
+
+    DccPkt2 &current() // called in interrupt context
+    {
+        return _sent[(_sent_cnt - 1) & (sent_max - 1)];
+    }
 
     int _preamble_bits;
 
@@ -67,11 +117,15 @@ private:
     static constexpr int byte_num_preamble = -1;
 
     // ...then 0 and up are the data bytes
-    int _byte_num;  // -2 for cutout, -1 for preamble, then index in _current2
+    int _byte_num;  // -2 for cutout, -1 for preamble, then index in current()
     int _bit_num;   // counts down bit in cutout, preamble, or data byte
 
     bool _use_railcom;   // railcom cutout or not
 
+    volatile bool _pwr_off; // power forced off (overcurrent)
+
+    IrqLat _irq_lat;
+
     void start(int preamble_bits, bool cutout = true);
 
     // PWM programming: we always program a 50% duty cycle, changing the
@@ -99,16 +153,17 @@ private:
         int half_us = (b == 0 ? DccSpec::t0_nom_us : DccSpec::t1_nom_us);
         pwm_set_wrap(_slice, 2 * half_us - 1);
         pwm_set_chan_level(_slice, _channel, half_us);
-        // power on
-        pwm_set_chan_level(_slice, 1 - _channel, 2 * half_us);
+        // power on (unless forced off)
+        pwm_set_chan_level(_slice, 1 - _channel, _pwr_off ? 0 : 2 * half_us);
     }
 
     void prog_bit_cutout_start() // called in interrupt context
     {
         pwm_set_wrap(_slice, 2 * DccSpec::t1_nom_us - 1);
         pwm_set_chan_level(_slice, _channel, DccSpec::t1_nom_us);
-        // power on for a quarter-bit (half-bit / 2)
-        pwm_set_chan_level(_slice, 1 - _channel, DccSpec::t1_nom_us / 2);
+        // power on for a quarter-bit (half-bit / 2) (unless forced off)
+        pwm_set_chan_level(_slice, 1 - _channel,
+                           _pwr_off ? 0 : DccSpec::t1_nom_us / 2);
     }
 
     void prog_bit_cutout() // called in interrupt context
@@ -5,10 +5,12 @@
 #include <list>
 
 #include "misc/buf_log.h"
+#include "dcc/dcc_ack.h"
 #include "dcc/dcc_bitstream.h"
 #include "dcc/dcc_loco.h"
 #include "dcc/dcc_pkt.h"
 #include "dcc/dcc_pkt2.h"
+#include "dcc/dcc_trip.h"
 #include "hardware/uart.h"
 
 #undef INCLUDE_ACK_DBG
@@ -58,12 +60,64 @@ public:
 
     void loop();
 
+    // Ops mode track current. The adc runs in ops mode, and the overcurrent
+    // trip (DccTrip) turns track power off and on. The callback is called in
+    // interrupt context when the trip does something, and every report_ms
+    // with the long average current if report_ms is not zero.
+
+    enum class CurrentEvent {
+        Report,
+        Trip,
+        Retry,
+        Lockout,
+    };
+
+    typedef void(CurrentCb)(CurrentEvent ev, uint16_t ma);
+
+    void current_cb_set(CurrentCb *cb)
+    {
+        _current_cb = cb;
+    }
+
+    // longest report_ms; it's timed in usec, in 32 bits (about 71 minutes)
+    static constexpr uint32_t report_ms_max = UINT32_MAX / 1000;
+
+    // report_ms over report_ms_max is taken as report_ms_max
+    void current_report(uint32_t report_ms)
+    {
+        _report_ms = (report_ms < report_ms_max) ? report_ms : report_ms_max;
+    }
+
+    uint32_t current_report() const
+    {
+        return _report_ms;
+    }
+
+    // long average track current, 0 if track is off
+    uint16_t track_ma() const;
+
+    const DccTrip &trip() const
+    {
+        return _trip;
+    }
+
+    bool trip_config(uint16_t limit_ma, uint32_t retry_ms, int retry_max);
+
+    // Power back on after lockout
+    void trip_reset();
+
     DccLoco *find_loco(int address);
     DccLoco *create_loco(int address = DccPkt::address_default);
     DccLoco *delete_loco(DccLoco *loco);
     DccLoco *delete_loco(int address);
     void restart_locos();
 
+    // in address order; only changed in thread context
+    const std::list<DccLoco *> &locos() const
+    {
+        return _locos;
+    }
+
     void show();
 
     DccBitstream &bitstream()
@@ -132,6 +186,13 @@ private:
 
     void get_packet_ops(DccPkt2 &pkt);
 
+    DccTrip _trip;
+    CurrentCb *_current_cb;
+    uint32_t _report_ms;
+    uint32_t _report_us; // time of last report
+
+    void loop_ops();
+
     // used by write_cv(), write_bit(), read_cv(), and read_bit()
     void svc_start();
 
@@ -144,49 +205,21 @@ private:
 
     CvOp _svc_status, _svc_status_next;
 
-    // When in service mode, we check for ack in the bit loop. _ack_ma is
-    // initialized to ack_ma_inv and _ack false. After the initial resets, we
-    // set _ack_ma to the long average + ack_inc_ma. In the bit loop, if
-    // _ack_ma is not ack_ma_invalid, and the short average is larger than
-    // _ack_ma, we set _ack true. The next get_packet_* call sees that,
-    // handles it, and sets _ack_ma to ack_ma_invalid.
-    uint16_t _ack_ma;
-    static constexpr uint16_t ack_ma_inv = UINT16_MAX;
-    static constexpr uint16_t ack_inc_ma = 60;
-    bool _ack;
-
-    void ack_reset()
-    {
-        _ack_ma = ack_ma_inv;
-        _ack = false;
-    }
+    // When in service mode, we check for ack in the bit loop (see DccAck).
+    DccAck _ack;
 
-    // When we start looking for an ack, set the threshold
-    void ack_arm(uint16_t ack_ma)
-    {
-        _ack_ma = ack_ma;
-        _ack = false;
-    }
+    // When we start looking for an ack, set the threshold from the current
+    // long average. 'verify' and 'val' say what the commands coming up are;
+    // they only go in the adc log (see dcc_adc_trace.h).
+    void ack_arm(int verify, int val);
 
-    // Look for ack and trigger if we see one
-    bool ack_check(uint16_t track_ma)
-    {
-        if (_ack_ma != ack_ma_inv && track_ma >= _ack_ma) {
-            // ack!
-            _ack_ma = ack_ma_inv;
-            _ack = true;
-            return true;
-        } else {
-            // no ack
-            return false;
-        }
-    }
+    // Log the result of a service mode operation in the adc log
+    void svc_log_result();
 
     // See if we have an ack, and clear it if so
     bool ack()
     {
-        if (_ack) {
-            ack_reset();
+        if (_ack.ack()) {
             if (_show_acks) {
                 char *b = BufLog::write_line_get();
                 if (b != nullptr) {
@@ -209,6 +242,14 @@ private:
     SvcCmdStep _svc_cmd_step;
     int _svc_cmd_cnt;
 
+    // The ack detector learns the idle current during this many of the
+    // initial resets (the last ones).
+    static constexpr int svc_learn_cnt = 10;
+
+    // After a clear ack in a bit-verify, send this many resets (instead of
+    // the rest of the verifies and resets) before the next bit.
+    static constexpr int svc_settle_cnt = 3;
+
     DccPktReset _pkt_reset;
 
     // for service mode write byte or bit
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+
+// Latency from a DccApi call to the track
+//
+// For requests that change what goes out on the track (loco speed and
+// function sets, and batches of them), four times (time_us_32()) are taken:
+//
+//   submit  DccApi sending it (req_submit())
+//   deq     dcc_srv taking it out of req_queue
+//   pick    DccLoco::next_packet() picking the loco's next speed/function
+//           packet, the first one with the change in it
+//   track   the packet's start bit going out (DccBitstream::next_bit())
+//
+// The request ID ties the submit time to the request; the loco carries the
+// rest from the request to the packet. Each request adds one sample per loco
+// to a histogram for each stage (submit to deq, deq to pick, pick to track,
+// and submit to track, the whole thing), by kind of request. The first stage
+// is added when the loco gets the change (start()); the rest when the packet
+// goes out (add()). Changes that go out in the same packet share its pick
+// and track times, so the loco keeps one of them, picked at random, and adds
+// it n times, once for each (DccLoco::lat_start()).
+//
+// Histogram buckets are 1 usec up to 8 usec, then four per power of two, so a
+// percentile is at most 25% high (it is the top of its bucket, but no more
+// than the max). Times past ~16 sec all go in the last bucket.
+//
+// A change that never goes out (the track goes off or the loco is deleted
+// first; see DccLoco::lat_clear()) is counted as missed instead, so every
+// change is either a sample or a miss.
+//
+// start(), add() and miss() are called in interrupt context (or with
+// interrupts off), so readers take a copy with interrupts off.
+
+class DccLat
+{
+public:
+
+    enum class Kind : uint8_t {
+        Speed = 0, // LocoSpeedSet, "L <addr> S S <speed>"
+        Func,      // LocoFuncSet, "L <addr> F <f_num> S 0|1"
+        Batch,     // LocoBatch
+    };
+
+    static constexpr int kind_cnt = 3;
+
+    enum class Stage : uint8_t {
+        Srv = 0, // submit to deq
+        Pick,    // deq to pick
+        Track,   // pick to track
+        Whole,   // submit to track
+    };
+
+    static constexpr int stage_cnt = 4;
+
+    struct Times {
+        uint16_t req_id;
+        Kind kind;
+        uint32_t submit_us;
+        uint32_t deq_us;
+        uint32_t pick_us;
+        uint32_t track_us;
+    };
+
+    class Hist
+    {
+    public:
+
+        Hist() { reset(); }
+
+        void reset();
+
+        void add(uint32_t us, uint32_t n = 1); // n samples of us
+
+        uint32_t cnt() const { return _cnt; }
+        uint32_t max() const { return _max; }
+
+        // percentile pct (1-100); 0 if empty
+        uint32_t pct(int pct) const;
+
+        static constexpr int exact_max = 8;  // 0...7 have their own bucket
+        static constexpr int sub_cnt = 4;    // buckets per power of two
+        static constexpr int pow_max = 24;   // 2^24 usec and up in the last
+        static constexpr int bucket_cnt =
+            exact_max + (pow_max - 3) * sub_cnt;
+
+        static int bucket(uint32_t us);
+        static uint32_t bucket_top(int b);
+
+    private:
+
+        uint32_t _cnt;
+        uint32_t _max;
+        uint32_t _bucket[bucket_cnt];
+    };
+
+    DccLat() = default;
+
+    void start(const Times &t);               // called in interrupt context
+    void add(const Times &t, uint32_t n = 1); // called in interrupt context
+    void miss(Kind kind, uint32_t n = 1);     // called in interrupt context
+
+    struct Pct {
+        uint32_t cnt;
+        uint32_t p50;
+        uint32_t p99;
+        uint32_t max;
+        uint32_t missed; // of this kind, not timed
+    };
+
+    Pct get(Kind kind, Stage stage) const; // taken with interrupts off
+
+    void reset();
+
+private:
+
+    Hist _hist[kind_cnt][stage_cnt];
+    uint32_t _missed[kind_cnt] = {};
+
+}; // class DccLat
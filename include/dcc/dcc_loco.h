@@ -2,7 +2,10 @@
 
 #include <cstdint>
 
+#include "dcc/dcc_lat.h"
 #include "dcc/dcc_pkt.h"
+#include "dcc/railcom.h"
+#include "dcc/railcom_stats.h"
 
 class RailComMsg;
 
@@ -23,14 +26,70 @@ public:
     bool get_function(int func) const;
     void set_function(int func, bool on);
 
-    typedef void(OpsCvCb)(DccLoco *loco, bool success, uint8_t cv_val);
+    // Ops mode cv access. These are queued (up to ops_cv_q_max per loco;
+    // false if the queue is full) and done one at a time, in order, between
+    // the loco's speed and function packets. cb is called (in interrupt
+    // context) when each is done, with the caller's id.
 
-    void read_cv(int cv_num, OpsCvCb *cb);
+    struct OpsCvDone {
+        uint16_t id;
+        bool success;
+        uint8_t cv_val;
+        uint32_t op_us; // from queued to done
+    };
 
-    void write_cv(int cv_num, uint8_t cv_val, OpsCvCb *cb);
-    void write_bit(int cv_num, int bit_num, int bit_val, OpsCvCb *cb);
+    typedef void(OpsCvCb)(DccLoco *loco, const OpsCvDone &done);
 
-    void set_adrs_new(int adrs_new, OpsCvCb *cb);
+    static constexpr int ops_cv_q_max = 4; // power of 2
+
+    bool read_cv(int cv_num, OpsCvCb *cb, uint16_t id = 0);
+
+    bool write_cv(int cv_num, uint8_t cv_val, OpsCvCb *cb, uint16_t id = 0);
+    bool write_bit(int cv_num, int bit_num, int bit_val, OpsCvCb *cb,
+                   uint16_t id = 0);
+
+    bool set_adrs_new(int adrs_new, OpsCvCb *cb, uint16_t id = 0);
+
+    // cv accesses queued or in progress
+    int ops_cv_pending() const;
+
+    // Fail all of them (through cb, as if unanswered), e.g. before the loco
+    // is deleted
+    void ops_cv_cancel();
+
+    // How many times a cv access packet is sent (at most) and how many
+    // packets to wait after a write are adjusted for each loco from how it
+    // answers. Each access answered makes note of how many packets it took;
+    // the send count comes down (a packet at a time, after a run of answered
+    // accesses) to one more than that, and goes up by two when an access
+    // isn't answered. The first access after a write's lockout tells whether
+    // the decoder answered right away (the lockout comes down by one) or not
+    // (it goes up by four). With tuning off, the counts are the defaults.
+    //
+    // Reads also keep the time from first packet sent to response.
+
+    static constexpr int ops_send_cnt_def = 5;
+    static constexpr int ops_send_cnt_min = 2; // decoder needs two (RCN-214)
+    static constexpr int ops_send_cnt_max = 10;
+
+    static constexpr int ops_lockout_def = 12;
+    static constexpr int ops_lockout_max = 24;
+
+    struct OpsTune {
+        int send_cnt;         // times a cv access packet is sent, at most
+        int lockout;          // packets to wait after a write
+        uint16_t rsp_pkts_16; // packets to get a response, average (x16)
+        uint32_t ok;          // accesses answered
+        uint32_t fail;        // accesses not answered
+        uint32_t read_cnt;    // reads answered
+        uint32_t read_us_avg; // first packet to response
+        uint32_t read_us_max;
+    };
+
+    OpsTune ops_tune_get() const; // a copy, taken with interrupts off
+
+    // turn tuning on or off, starting over from the defaults
+    void ops_tune_set(bool on);
 
     typedef void (SpeedCb)(DccLoco *loco, uint32_t time_ms, int speed);
 
@@ -44,11 +103,70 @@ public:
         return _rc_speed_cb;
     }
 
+    // result of the last cv access done (false if one has been queued since)
     bool ops_done(bool &result, uint8_t &value);
 
     DccPkt next_packet();
 
-    void railcom(const RailComMsg *msg, int msg_cnt);
+    // Request ID of the packet next_packet() just returned, nonzero if it is
+    // part of an ops mode cv access
+    uint16_t last_req_id() const
+    {
+        return _pkt_last_req_id;
+    }
+
+    void railcom(const RailCom &rc, uint16_t req_id);
+
+    // RailCom counts for the cutouts after this loco's packets (a copy,
+    // taken with interrupts off)
+    RailComStats rc_stats() const;
+
+    void rc_stats_reset();
+
+    // RailCom dynamic variables (DYN) received from the loco, kept for each
+    // id RCN-217 defines (RailComSpec::DynId); reserved ids are ignored.
+    // Times are time_us_64() in msec.
+    static constexpr int dyn_id_max = RailComSpec::dyn_time + 1;
+
+    // false if the loco hasn't sent it
+    bool dyn_get(int id, uint8_t &val, uint32_t &rx_ms) const;
+
+    // With reports on for an id, cb is called (in interrupt context) when its
+    // value changes, but not more than once every min_ms. A change inside
+    // that is held and reported (latest value) when min_ms is up. Turning
+    // reports on reports the current value, if there is one. Returns false
+    // if id is out of range.
+    typedef void(DynCb)(DccLoco *loco, int id, uint8_t val, uint32_t rx_ms);
+
+    void dyn_cb_set(DynCb *cb)
+    {
+        _dyn_cb = cb;
+    }
+
+    bool dyn_report(int id, bool on, uint16_t min_ms = 0);
+
+    // Latency (dcc_lat.h): the speed change (func < 0) or function change
+    // just made is from the request in t (submit and deq times filled in).
+    // It's on the track when the next packet with it goes out: the speed
+    // packet, or the function's group. (A batch entry with both waits for
+    // the speed packet, which set_function() puts after the function one.)
+    // lat_start() adds the first stage to lat right away. Every change
+    // waiting for the same packet gets that packet's pick and track times,
+    // so for each packet and kind only one of them is kept, picked at random
+    // (each with the same chance), and when the packet's start bit goes out,
+    // lat_on_track() adds it to lat once for each of them. So every change
+    // is timed however many come between packets, and the times aren't
+    // skewed toward the oldest or newest. Any still waiting when the track
+    // goes off or the loco is deleted (lat_clear()) are counted as missed.
+    void lat_start(DccLat *lat, const DccLat::Times &t, int func = -1);
+
+    void lat_on_track() // called in interrupt context
+    {
+        if (_lat_picked)
+            lat_done();
+    }
+
+    void lat_clear();
 
     // reset packet sequence to start (typically for debug purposes)
     void restart()
@@ -121,34 +239,76 @@ private:
     // last packet returned by next_packet, saved so we can match received
     // railcom data with the packet it came after
     DccPkt *_pkt_last;
+    uint16_t _pkt_last_req_id;
 
     DccPktReadCv _pkt_read_cv;
-    static const int read_cv_send_cnt = 5; // how many times to send it
-    int _read_cv_cnt; // times left to send it (5, 4, ... 1, 0)
 
     // There is no ops "read bit" command
 
     DccPktWriteCv _pkt_write_cv;
-    static const int write_cv_send_cnt = 5; // how many times to send it
-    int _write_cv_cnt; // times left to send it (5, 4, ... 1, 0)
 
     DccPktWriteBit _pkt_write_bit;
-    static const int write_bit_send_cnt = 5; // how many times to send it
-    int _write_bit_cnt; // times left to send it (5, 4, ... 1, 0)
 
     DccPktSetAdrs _pkt_set_adrs;
-    static const int set_adrs_send_cnt = 5; // how many times to send it
-    int _set_adrs_cnt; // times left to send it (5, 4, ... 1, 0)
+
+    enum class OpsCv : uint8_t {
+        None,
+        ReadCv,
+        WriteCv,
+        WriteBit,
+        SetAdrs,
+    };
+
+    struct OpsCvReq {
+        OpsCv op;
+        uint16_t cv_num;
+        uint8_t cv_val; // or bit value
+        uint8_t bit_num;
+        int adrs_new;
+        OpsCvCb *cb;
+        uint16_t id;
+        uint32_t start_us; // queued
+        uint32_t send_us;  // first packet sent
+    };
+
+    // queued by read_cv() etc., taken off by next_packet()
+    OpsCvReq _ops_cv_q[ops_cv_q_max];
+    uint32_t _ops_cv_q_wr;
+    uint32_t _ops_cv_q_rd;
+
+    OpsCvReq _ops_cv; // in progress (op is None if nothing is)
+    // times left to send it; starts at _ops_tune.send_cnt + 1 (3 to 11) and
+    // counts down to 0
+    int _ops_cv_cnt;
 
     bool _ops_cv_done;
     bool _ops_cv_status;
     uint8_t _ops_cv_val;
-    OpsCvCb *_ops_cv_cb;
-    OpsCvCb *_ops_cv_next_cb;
 
-    static constexpr int ops_cv_read_lockout = 4;
-    static constexpr int ops_cv_write_lockout = 12;
-    int _ops_cv_lockout;
+    int _ops_cv_lockout; // packets left to wait
+
+    // tuning (see ops_tune_get()); _ops_tune.send_cnt and .lockout are used
+    // whether tuning is on or not
+    bool _ops_tune_on;
+    OpsTune _ops_tune;
+    int _ops_tune_run;   // accesses answered in a row
+    bool _ops_tune_probe; // access in progress is the first after a lockout
+    uint64_t _ops_tune_read_us; // sum of read times (for the average)
+
+    // how many in a row answered before the send count comes down
+    static constexpr int ops_tune_run = 4;
+
+    // request ID of the cv access in progress (0 if none), next one to use,
+    // and how many of its packets have been sent
+    uint16_t _ops_req_id;
+    uint16_t _ops_req_id_next;
+    int _ops_req_sent;
+
+    bool ops_cv_add(const OpsCvReq &req);
+    void ops_cv_next();                          // called in interrupt context
+    void ops_cv_end(bool success, uint8_t cv_val); // called in interrupt context
+    void ops_tune_end(bool success);               // called in interrupt context
+    DccPkt *ops_cv_pkt();                        // called in interrupt context
 
     // speed reported in railcom data, if any
     uint8_t _rc_speed;
@@ -156,4 +316,42 @@ private:
     bool _show_rc_speed;
     SpeedCb *_rc_speed_cb;
 
+    RailComStats _rc_stats;
+
+    // dynamic variables; bit n in the masks is id n
+    uint32_t _dyn_valid; // received at least once
+    uint32_t _dyn_chg;   // changed since last reported
+    uint32_t _dyn_sub;   // reports on
+    uint8_t _dyn_val[dyn_id_max];
+    uint32_t _dyn_rx_ms[dyn_id_max];  // last received
+    uint32_t _dyn_not_ms[dyn_id_max]; // last reported
+    uint16_t _dyn_min_ms[dyn_id_max];
+    DynCb *_dyn_cb;
+
+    static_assert(dyn_id_max <= 32);
+
+    void dyn_rx(int id, uint8_t val, uint32_t now_ms); // called in interrupt context
+    void dyn_flush(uint32_t now_ms);                   // called in interrupt context
+
+    // latency of changes not on the track yet (lat_start()), by packet (0
+    // for speed, then the function groups in seq order) and kind; each is
+    // one of cnt changes, and cnt 0 is none
+    struct LatPend {
+        uint32_t submit_us;
+        uint32_t deq_us;
+        uint32_t cnt;
+    };
+    static constexpr int lat_pkt_max = seq_max / 2 + 1;
+    DccLat *_lat;
+    LatPend _lat_pend[lat_pkt_max][DccLat::kind_cnt];
+    // the ones in the packet next_packet() picked, waiting for it to go out
+    LatPend _lat_fly[DccLat::kind_cnt];
+    bool _lat_picked;
+    uint32_t _lat_pick_us;
+    uint32_t _lat_rand; // xorshift state, for picking which one is kept
+
+    static int lat_pkt(int func);
+    void lat_pick(int seq); // called in interrupt context
+    void lat_done();        // called in interrupt context
+
 }; // class DccLoco
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <cstdint>
+
+#include "dcc/dcc_pkt.h"
+#include "dcc/dcc_srv.h"
+
+// Binary inter-core messages
+//
+// A request in req_queue (and its response in rsp_queue) is either ASCII
+// text (see the @req comments in dcc_srv.cpp), as dcc_raw sends, or one of
+// these. ASCII messages start with a command letter; binary ones start with
+// bin_sync, which is never printable, so dcc_srv can tell them apart by the
+// first byte.
+//
+// A binary request has an opcode and typed fields, so dcc_srv doesn't have
+// to tokenize it or walk the command letters, and DccApi doesn't have to
+// format the request or scan the response. The response has the request's
+// opcode and id, so DccApi can tell it is the answer to what it sent and
+// not something left over. err is 0 on success, or dcc_srv's line number,
+// like "ERROR <line>" in an ASCII response. ASCII requests and responses
+// carry an id too, as a "#<id> " prefix, when the sender gives one.
+//
+// Only the frequent requests that don't wait on the track have binary
+// forms; everything else is ASCII only, and LocoBatch (several loco speed
+// and function changes at once) is binary only. Both cores are the same
+// cpu, so the structs are copied as they are.
+//
+// RailComStats and LocoList (also binary only) have results too big for a
+// response; dcc_srv puts the result in a block from rsp_blk_pool
+// (blk_pool.h) and the response has its handle (blk). Whoever takes the
+// response from rsp_queue owns the block and has to release it, even if it
+// throws the response away (has_blk()).
+
+namespace DccMsg {
+
+constexpr uint8_t bin_sync = 0x01;
+
+enum class Op : uint8_t {
+    TrackGet = 1,  // -> track
+    TrackSet,      // track ->
+    LocoCreate,    // loco ->
+    LocoDelete,    // loco ->
+    LocoFuncGet,   // loco_func -> loco_func
+    LocoFuncSet,   // loco_func ->
+    LocoSpeedGet,  // loco -> loco_speed
+    LocoSpeedSet,  // loco_speed ->
+    LocoDynGet,    // loco_dyn -> loco_dyn
+    LocoBatch,     // loco_batch ->
+    RailComStats,  // loco -> blk (RailComStats; addr 0 is all cutouts)
+    LocoList,      // loco_list -> blk (LocoStatus[])
+};
+
+struct Track {
+    bool on;
+};
+
+struct Loco {
+    uint16_t addr;
+};
+
+struct LocoFunc {
+    uint16_t addr;
+    uint8_t func;
+    bool on;
+};
+
+struct LocoSpeed {
+    uint16_t addr;
+    int16_t speed;
+};
+
+struct LocoDyn {
+    uint16_t addr;
+    uint8_t dyn_id;
+    uint8_t dyn_val;
+    uint32_t age_ms;
+};
+
+// Speed and/or one function for several locos, applied together (all or
+// none, between two packets). An address can be in more than once, e.g. for
+// more functions.
+
+constexpr int loco_batch_max = 8;
+constexpr int16_t speed_keep = INT16_MIN; // leave the speed as it is
+constexpr uint8_t func_none = 0xff;       // no function change
+
+struct LocoBatch {
+    uint8_t cnt;
+    struct {
+        uint16_t addr;
+        int16_t speed; // or speed_keep
+        uint8_t func;  // or func_none
+        bool on;
+    } loco[loco_batch_max];
+};
+
+// Locos from start on (in address order), as many as fit in a block; more
+// says how many there are after those
+struct LocoList {
+    uint16_t start;
+};
+
+struct LocoStatus {
+    uint16_t addr;
+    int16_t speed;
+    uint8_t func[DccPkt::function_max / 8 + 1]; // bit n%8 of func[n/8] is fn
+};
+
+// A result in rsp_blk_pool
+struct Blk {
+    uint8_t handle;
+    uint16_t len;  // bytes
+    uint16_t more; // LocoList
+};
+
+struct Req {
+    uint8_t sync; // bin_sync
+    Op op;
+    uint16_t id;
+    union {
+        Track track;
+        Loco loco;
+        LocoFunc loco_func;
+        LocoSpeed loco_speed;
+        LocoDyn loco_dyn;
+        LocoBatch loco_batch;
+        LocoList loco_list;
+    };
+};
+
+struct Rsp {
+    uint8_t sync; // bin_sync
+    Op op;
+    uint16_t id;
+    uint16_t err; // 0 is ok
+    union {
+        Track track;
+        LocoFunc loco_func;
+        LocoSpeed loco_speed;
+        LocoDyn loco_dyn;
+        Blk blk;
+    };
+};
+
+inline bool has_blk(const Rsp &rsp)
+{
+    return rsp.err == 0 &&
+           (rsp.op == Op::RailComStats || rsp.op == Op::LocoList);
+}
+
+static_assert(sizeof(Req) <= req_msg_len_max, "Req too big for req_queue");
+static_assert(sizeof(Rsp) <= rsp_msg_len_max, "Rsp too big for rsp_queue");
+
+// What goes in the queues: the whole element is copied, so a Req or Rsp is
+// sent from one of these
+union Buf {
+    char ascii[req_msg_len_max];
+    Req req;
+    Rsp rsp;
+};
+
+static_assert(sizeof(Buf) == req_msg_len_max, "Buf should be a queue element");
+
+inline bool is_bin(const char *msg)
+{
+    return uint8_t(msg[0]) == bin_sync;
+}
+
+// ASCII messages can start with a number: "#<id> " on requests and their
+// responses (see dcc_srv.cpp), and "@<seq> " on notifications. text() skips
+// over it.
+
+inline const char *text(const char *msg)
+{
+    if (msg[0] != '#' && msg[0] != '@')
+        return msg;
+    const char *p = msg + 1;
+    while (*p >= '0' && *p <= '9')
+        p++;
+    return *p == ' ' ? p + 1 : msg;
+}
+
+// The number after c at the start of msg (false if it's not there)
+inline bool text_num(const char *msg, char c, uint16_t &num)
+{
+    if (msg[0] != c || text(msg) == msg)
+        return false;
+    uint32_t n = 0;
+    for (const char *p = msg + 1; *p != ' '; p++) {
+        n = n * 10 + (*p - '0');
+        if (n > UINT16_MAX)
+            return false;
+    }
+    num = n;
+    return true;
+}
+
+// A request's or response's id, or 0 if it doesn't have one
+inline uint16_t text_id(const char *msg)
+{
+    uint16_t id;
+    return text_num(msg, '#', id) ? id : 0;
+}
+
+// A notification's sequence number
+inline bool not_seq(const char *msg, uint16_t &seq)
+{
+    return text_num(msg, '@', seq);
+}
+
+} // namespace DccMsg
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+#include "dcc/dcc_srv.h"
+
+// Notifications from core 1 to core 0
+//
+// Each one put in not_queue starts with "@<seq> ", seq counting up (16 bits)
+// for every notification sent or dropped, so core 0 can see when it has
+// missed some. Events (ops cv results, overcurrent, railcom addresses) go in
+// as they happen, and are dropped if not_queue is full.
+//
+// Reports of a latest value (loco speed, loco dyn values, track current) are
+// coalesced instead: each key (kind, loco address, dyn id) has an entry
+// holding its latest message. That goes into not_queue only once the key's
+// last one has been taken out, so not_queue never has more than one per
+// key, and a newer value replaces one still waiting. flush() sends waiting
+// ones when there's room. If all val_max entries are in use, a report is
+// sent like an event.
+//
+// Called from interrupt handlers and thread code on core 1, so interrupts
+// are off while anything is changed.
+
+class DccNotify
+{
+public:
+
+    enum class Kind : uint8_t {
+        None = 0,
+        Current, // "T I"
+        Speed,   // "L <addr> S"
+        Dyn,     // "L <addr> Y <dyn_id>"
+    };
+
+    static constexpr int val_max = 32;
+
+    DccNotify(NotRing &q);
+
+    // msg is without the "@<seq> "
+    void event(const char *msg);
+    void report(Kind kind, uint16_t addr, uint8_t dyn_id, const char *msg);
+
+    // Send waiting reports whose last one has been taken, while there's room
+    void flush();
+
+    // Forget reports for a loco (it's been deleted)
+    void forget(uint16_t addr);
+
+    uint32_t sent() const { return _sent; }           // put in not_queue
+    uint32_t coalesced() const { return _coalesced; } // replaced while waiting
+    uint32_t dropped() const { return _dropped; }     // not_queue was full
+
+    void stats_reset();
+
+private:
+
+    NotRing &_q;
+
+    struct Val {
+        Kind kind; // None if not in use
+        uint16_t addr;
+        uint8_t dyn_id;
+        bool waiting; // msg not sent yet
+        bool queued;  // the last one sent is in _q, put in at pos
+        uint32_t pos; // _q.put_cnt() when it was put in
+        char msg[not_msg_len_max];
+    };
+
+    Val _val[val_max];
+    int _waiting_cnt;
+
+    uint16_t _seq;
+
+    uint32_t _sent;
+    uint32_t _coalesced;
+    uint32_t _dropped;
+
+    bool put(const char *msg);
+    bool taken(const Val &v) const;
+    void put_val(Val &v);
+
+}; // class DccNotify
@@ -9,6 +9,8 @@
 //   packet data (currently in DccPkt)
 //   overall length (in DccPkt)
 //   sending loco
+//   request ID (nonzero if the packet is part of a loco's ops mode CV
+//     access, so a response can be matched to the request)
 //
 // The objective is for DccBitstream to get one of these to send a packet, and
 // if a (RailCom) response is received, to be able to notify the loco of the
@@ -24,19 +26,20 @@ class DccPkt2
 
 public:
 
-    DccPkt2() : _pkt(), _loco(nullptr)
+    DccPkt2() : _pkt(), _loco(nullptr), _req_id(0)
     {
     }
 
-    DccPkt2(const DccPkt &pkt, DccLoco *loco = nullptr) :
-        _pkt(pkt), _loco(loco)
+    DccPkt2(const DccPkt &pkt, DccLoco *loco = nullptr, uint16_t req_id = 0) :
+        _pkt(pkt), _loco(loco), _req_id(req_id)
     {
     }
 
-    void set(DccPkt pkt, DccLoco *loco = nullptr)
+    void set(DccPkt pkt, DccLoco *loco = nullptr, uint16_t req_id = 0)
     {
         _pkt = pkt;
         _loco = loco;
+        _req_id = req_id;
     }
 
     DccLoco *get_loco() const
@@ -44,6 +47,11 @@ public:
         return _loco;
     }
 
+    uint16_t get_req_id() const
+    {
+        return _req_id;
+    }
+
     // length, including address, instruction, check byte
     int len() const
     {
@@ -68,4 +76,6 @@ private:
 
     DccLoco *_loco;
 
+    uint16_t _req_id;
+
 }; // class DccPkt2
@@ -4,19 +4,41 @@
 #include "pico/stdlib.h"
 #include "pico/util/queue.h"
 
-// max bytes per message
-constexpr int req_msg_len_max = 32; // request and response messages
+#include "dcc/blk_pool.h"
+#include "dcc/msg_ring.h"
+
+// max bytes per message; requests and responses have room for a "#<id> "
+// prefix (dcc_msg.h) in front of the longest one, and for the biggest
+// binary request (DccMsg::LocoBatch)
+constexpr int req_msg_len_max = 56; // request and response messages
 constexpr int rsp_msg_len_max = req_msg_len_max;
-constexpr int not_msg_len_max = 32; // notification messages
+constexpr int not_msg_len_max = 40; // notification messages, "@<seq> " too
 
 // max messages per queue
 constexpr int req_msg_cnt_max = 8;  // request and response queues
 constexpr int rsp_msg_cnt_max = req_msg_cnt_max;
 constexpr int not_msg_cnt_max = 32; // notification queue
 
-extern queue_t req_queue; // requests, core0 -> core1
-extern queue_t rsp_queue; // responses, core1 -> core0
-extern queue_t not_queue; // notifications, core1 -> core0
+// result blocks for binary responses too big for rsp_queue (blk_pool.h);
+// core 0 has them for as long as it takes to read one, so a few is plenty
+constexpr int rsp_blk_len_max = 512;
+constexpr int rsp_blk_cnt_max = 4;
+
+// adc log blocks (DccAdcTrace::Blk) in the log queue; at 10 KHz, a block is
+// about 4 msec, so core 0 has ~250 msec to get to them
+constexpr int log_blk_cnt_max = 64;
+
+// Requests, responses, and notifications go in lock-free rings (msg_ring.h);
+// the adc log (big blocks, not latency sensitive) uses a pico queue.
+typedef MsgRing<req_msg_len_max, req_msg_cnt_max> ReqRing; // and responses
+typedef MsgRing<not_msg_len_max, not_msg_cnt_max> NotRing;
+typedef BlkPool<rsp_blk_len_max, rsp_blk_cnt_max> RspBlkPool;
+
+extern ReqRing req_queue; // requests, core0 -> core1
+extern ReqRing rsp_queue; // responses, core1 -> core0
+extern NotRing not_queue; // notifications, core1 -> core0
+extern RspBlkPool rsp_blk_pool; // big results, core1 -> core0 (and back)
+extern queue_t log_queue; // adc log blocks, core1 -> core0
 
 // Fill in config before spawning dcc_srv.
 struct DccConfig {
@@ -30,3 +52,11 @@ struct DccConfig {
 extern DccConfig dcc_config;
 
 extern "C" void dcc_srv();
+
+// Core 0 calls this after adding to req_queue, to wake core 1 (dcc_srv
+// sleeps when it has nothing to do)
+void req_bell();
+
+// Core 0 calls this as it starts sending request id, for the latency from
+// there to the track (dcc_lat.h)
+void req_submit(uint16_t id);
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+
+// Main track overcurrent trip
+//
+// In ops mode, check() is called from the bit interrupt each time there are
+// new ADC samples, with the fast average (a few hundred usec) of the track
+// current. If it is at or over the limit, the track is tripped: the caller
+// turns power off (DccBitstream::power(false) takes effect at the next bit).
+//
+// After retry_ms, check() says to turn power back on. If it trips again
+// within clear_ms of coming back on, the wait doubles (up to retry_ms_max).
+// After retry_max trips in a row like that, it locks out and stays off until
+// reset(). Running clean for clear_ms forgets the earlier trips.
+//
+// Times are from time_us_32() (passed in) so this is usable in native tests.
+
+class DccTrip
+{
+public:
+
+    static constexpr uint16_t limit_ma_def = 2000; // DRV8874: 2.1A continuous
+    static constexpr uint32_t retry_ms_def = 250;
+    static constexpr uint32_t retry_ms_max = 8000;
+    static constexpr int retry_max_def = 4;
+    static constexpr uint32_t clear_ms = 2000;
+
+    DccTrip();
+
+    enum class Event {
+        None,
+        Trip,    // over limit, turn power off
+        Retry,   // done waiting, turn power back on
+        Lockout, // over limit too many times, power off until reset()
+    };
+
+    // Track power just turned on (or turned on again after lockout)
+    void reset(uint32_t now_us);
+
+    Event check(uint16_t track_ma, uint32_t now_us); // interrupt context
+
+    // true if the track should have power
+    bool power() const
+    {
+        return _state == State::On;
+    }
+
+    bool locked_out() const
+    {
+        return _state == State::Lockout;
+    }
+
+    uint16_t limit_ma() const
+    {
+        return _limit_ma;
+    }
+
+    uint32_t retry_ms() const
+    {
+        return _retry_ms;
+    }
+
+    int retry_max() const
+    {
+        return _retry_max;
+    }
+
+    // Returns false (and changes nothing) if something is out of range
+    bool config(uint16_t limit_ma, uint32_t retry_ms, int retry_max);
+
+    // total trips since constructed
+    uint32_t trip_cnt() const
+    {
+        return _trip_cnt;
+    }
+
+private:
+
+    uint16_t _limit_ma;
+    uint32_t _retry_ms;
+    int _retry_max;
+
+    enum class State {
+        On,
+        Off,     // tripped, waiting to retry
+        Lockout,
+    };
+
+    State _state;
+
+    uint32_t _on_us;   // when power last came on
+    uint32_t _off_us;  // when it tripped
+    uint32_t _wait_us; // how long to wait before retry
+
+    int _retry_cnt; // trips without running clean for clear_ms
+
+    uint32_t _trip_cnt;
+
+}; // class DccTrip
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+// Single producer, single consumer message ring
+//
+// For messages between the cores (requests, responses, notifications): one
+// side only adds, the other only takes. Each side only writes its own index
+// (_wr for the producer, _rd for the consumer), so there is no lock, and it
+// works from interrupt context. The indices are free-running counts; with
+// cnt_max a power of 2 they wrap cleanly. Only loads and stores are done on
+// them, with acquire/release ordering (a dmb on the M0+): the producer's
+// message is all in memory before _wr says it's there, and the consumer is
+// done with a slot before _rd gives it back.
+//
+// Messages are up to len_max bytes and go in fixed slots with their length.
+// claim()/commit() let the producer build a message in place (snprintf right
+// into the slot), and peek()/release() let the consumer use it in place;
+// put() and get() copy just the message's bytes in or out.
+//
+// "Single producer" is per ring: if thread code and an interrupt handler on
+// the same core both add to a ring, the thread code has to keep interrupts
+// off from claim() to commit() (see dcc_srv.cpp).
+
+template <int len_max, int cnt_max>
+class MsgRing
+{
+public:
+
+    static_assert(cnt_max > 0 && (cnt_max & (cnt_max - 1)) == 0,
+                  "cnt_max must be a power of 2");
+
+    MsgRing() :
+        _wr(0),
+        _rd(0)
+    {
+    }
+
+    // producer ///////////////////////////////////////////////////////////////
+
+    // Room for a message (len_max bytes), or nullptr if the ring is full
+    void *claim()
+    {
+        const uint32_t wr = _wr.load(std::memory_order_relaxed);
+        if ((wr - _rd.load(std::memory_order_acquire)) == cnt_max)
+            return nullptr;
+        return _slot[wr % cnt_max].msg;
+    }
+
+    // The claimed message is ready, len bytes
+    void commit(int len)
+    {
+        const uint32_t wr = _wr.load(std::memory_order_relaxed);
+        _slot[wr % cnt_max].len = len;
+        _wr.store(wr + 1, std::memory_order_release);
+    }
+
+    bool put(const void *msg, int len)
+    {
+        if (len > len_max)
+            return false;
+        void *p = claim();
+        if (p == nullptr)
+            return false;
+        memcpy(p, msg, len);
+        commit(len);
+        return true;
+    }
+
+    // consumer ///////////////////////////////////////////////////////////////
+
+    // The oldest message and its length, or nullptr if the ring is empty
+    const void *peek(int &len)
+    {
+        const uint32_t rd = _rd.load(std::memory_order_relaxed);
+        if (_wr.load(std::memory_order_acquire) == rd)
+            return nullptr;
+        len = _slot[rd % cnt_max].len;
+        return _slot[rd % cnt_max].msg;
+    }
+
+    // Done with the message from peek()
+    void release()
+    {
+        const uint32_t rd = _rd.load(std::memory_order_relaxed);
+        _rd.store(rd + 1, std::memory_order_release);
+    }
+
+    // Copy out the oldest message (msg has room for len_max bytes)
+    bool get(void *msg, int &len)
+    {
+        const void *p = peek(len);
+        if (p == nullptr)
+            return false;
+        memcpy(msg, p, len);
+        release();
+        return true;
+    }
+
+    bool get(void *msg)
+    {
+        int len;
+        return get(msg, len);
+    }
+
+    // either side ////////////////////////////////////////////////////////////
+
+    // Messages added and taken so far (free-running). A message put in when
+    // put_cnt() was n has been taken once get_cnt() - n > 0.
+    uint32_t put_cnt() const
+    {
+        return _wr.load(std::memory_order_acquire);
+    }
+
+    uint32_t get_cnt() const
+    {
+        return _rd.load(std::memory_order_acquire);
+    }
+
+    int level() const
+    {
+        return _wr.load(std::memory_order_acquire) -
+               _rd.load(std::memory_order_acquire);
+    }
+
+private:
+
+    struct Slot {
+        alignas(4) uint8_t msg[len_max];
+        uint16_t len;
+    };
+
+    Slot _slot[cnt_max];
+
+    std::atomic<uint32_t> _wr; // messages added, only written by the producer
+    std::atomic<uint32_t> _rd; // messages taken, only written by the consumer
+
+}; // class MsgRing
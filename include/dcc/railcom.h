@@ -3,8 +3,10 @@
 #include <cstdint>
 
 #include "hardware/uart.h"
+#include "dcc/railcom_addr_map.h"
 #include "dcc/railcom_msg.h"
 #include "dcc/railcom_spec.h"
+#include "dcc/railcom_stats.h"
 
 
 class RailCom
@@ -13,25 +15,112 @@ class RailCom
 public:
 
     RailCom(uart_inst_t *uart, int rx_gpio);
+    ~RailCom();
+
+    // Bytes are received by the uart interrupt (fifo off, so one interrupt
+    // per byte) and saved with their arrival time in one of two buffers.
+    // cutout_start() empties the receive buffer; start_us is the start of
+    // the cutout (the end of the packet end bit). read() swaps buffers, then
+    // decodes what came in since cutout_start(). Neither touches the uart.
+    void cutout_start(uint32_t start_us); // called in interrupt context
+
+    void read(); // called in interrupt context
+
+    // Split bytes into channel 1 and channel 2 by when they arrived, and
+    // parse messages from each
+    void parse(); // called in interrupt context
+
+    // How channel 2 is used when there is junk after some good messages.
+    // Full: all of channel 2 must parse or none of it is used.
+    // Partial: the messages before the first bad byte are used.
+    enum class Ch2Mode {
+        Full,
+        Partial,
+    };
+
+    Ch2Mode ch2_mode() const
+    {
+        return _ch2_mode;
+    }
+
+    void ch2_mode(Ch2Mode mode)
+    {
+        _ch2_mode = mode;
+    }
+
+    // What parse() found in channel 2
+    enum class Ch2Frame {
+        None,     // nothing received in channel 2
+        Full,     // all bytes parsed
+        Partial,  // one or more messages, then junk
+        Rejected, // junk from the start
+    };
+
+    Ch2Frame ch2_frame() const
+    {
+        return _ch2_frame;
+    }
+
+    // Byte received at now_us. Called from the uart interrupt handler; public
+    // so tests can feed bytes in.
+    void rx(uint8_t enc, uint32_t now_us); // called in interrupt context
+
+    // After read(): bytes received, and when each one finished arriving
+    // (usec after the start of the cutout)
+    int pkt_len() const
+    {
+        return _pkt_len;
+    }
+
+    int16_t pkt_us(int i) const
+    {
+        return _us[i];
+    }
+
+    // After read(): all the bytes decoded, with a validity mask and the data
+    // packed together
+    const RailComSpec::Frame &frame() const
+    {
+        return _frame;
+    }
+
+    // bytes thrown away because there were more than fit in a cutout
+    uint32_t rx_ovr_cnt() const
+    {
+        return _rx_ovr_cnt;
+    }
 
-    void reset() // called in interrupt context
+    // Counts for the last cutout parsed, and totals for all of them (a copy,
+    // taken with interrupts off). ch2_heur is how many would have had
+    // channel 2 using the old method (guess where channel 2 starts from
+    // whether channel 1 parses, then require exactly 6 good bytes), to
+    // compare.
+    const RailComStats &cutout_stats() const
     {
-        if (_uart == nullptr || _rx_gpio < 0) {
-            return;
-        }
-        uart_deinit(_uart);
-        uart_init(_uart, RailComSpec::baud);
+        return _cut;
     }
 
-    void read();
+    RailComStats stats() const;
 
-    void parse();
+    void stats_reset();
 
     char *dump(char *buf, int buf_len) const; // raw
 
     char *show(char *buf, int buf_len) const; // pretty
 
-    int get_ch2_msgs(const RailComMsg *&msgs) {
+    // Loco addresses heard in channel 1, updated by parse()
+    const RailComAddrMap &addr_map() const
+    {
+        return _addr_map;
+    }
+
+    RailComAddrMap &addr_map()
+    {
+        return _addr_map;
+    }
+
+    int get_ch2_msgs(const RailComMsg *&msgs) const
+    {
         msgs = _ch2_msg;
         return _ch2_msg_cnt;
     }
@@ -42,12 +131,37 @@ private:
 
     int _rx_gpio;
 
+    static constexpr int pkt_max = RailComSpec::ch1_bytes + RailComSpec::ch2_bytes;
+
+    ///// Receive buffers (written by the uart interrupt)
+
+    struct RxBuf {
+        uint8_t enc[pkt_max];
+        uint32_t us[pkt_max]; // time_us_32() when received
+        int cnt;
+    };
+
+    RxBuf _rx_buf[2];
+    volatile int _rx_wr; // index of buffer the uart interrupt writes to
+
+    uint32_t _cutout_us;  // start of the current cutout
+    uint32_t _rx_ovr_cnt;
+
+    // The uart interrupt handler has no argument, so it finds the object
+    // here by uart number.
+    static constexpr int uart_max = 2;
+    static RailCom *uart_railcom[uart_max];
+
+    static void uart_handler(); // called in interrupt context
+
     ///// Raw RailCom Data (4/8 encoded, and decoded bytes)
 
-    static constexpr int pkt_max = RailComSpec::ch1_bytes + RailComSpec::ch2_bytes;
-    uint8_t _enc[pkt_max]; // encoded (4/8 code)
-    uint8_t _dec[pkt_max]; // decoded (6 bits per byte) from decode[]
-    int _pkt_len;          // _enc[] and _dec[] are the same length
+    uint8_t _enc[pkt_max];     // encoded (4/8 code)
+    RailComSpec::Frame _frame; // decoded; _frame.dec[] is decode[] of _enc[]
+    int16_t _us[pkt_max];      // received, usec after cutout start
+    int _pkt_len;              // _enc[], _frame.dec[], and _us[] are the same length
+
+    static_assert(pkt_max <= RailComSpec::Frame::len_max);
 
     ///// Parsed RailCom Messages
 
@@ -59,11 +173,21 @@ private:
     // at most one message per byte (e.g. all ACK)
     static constexpr int ch2_msg_max = RailComSpec::ch2_bytes;
     RailComMsg _ch2_msg[ch2_msg_max];
-    int _ch2_msg_cnt; // 0...ch2_msg_max-1
+    int _ch2_msg_cnt; // 0...ch2_msg_max
 
     // true if there's no junk left over after parsing
     bool _parsed_all;
 
+    Ch2Mode _ch2_mode;
+    Ch2Frame _ch2_frame;
+
+    RailComStats _cut;   // last cutout
+    RailComStats _stats; // all cutouts
+
+    RailComAddrMap _addr_map;
+
+    bool ch2_heur() const; // called in interrupt context
+
     ///// Debug
 
 public:
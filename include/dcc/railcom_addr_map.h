@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+
+#include "dcc/railcom_msg.h"
+
+// Loco addresses heard in railcom channel 1
+//
+// A decoder with channel 1 on sends its address in every cutout, alternating
+// AHI (high byte) and ALO (low byte), whichever packet it's for. update() is
+// called after each cutout is parsed, with the channel 1 message if there
+// was one. An AHI and an ALO in cutouts within pair_us of each other make an
+// address: AHI 0 is a short address (ALO 1-127), and AHI 11xxxxxx is a long
+// address (the low 6 bits of AHI, then ALO), like the address bytes in a DCC
+// packet. Anything else (consist addresses etc.) is ignored.
+//
+// With more than one loco on the track they all talk in channel 1 at once and
+// it's usually junk, but one gets through now and then. AHI and ALO from
+// different locos can also pair up into an address nobody has, so an address
+// has a confidence (how many times it's been seen, up to conf_max) and only
+// counts as present once that gets to conf_min. It is dropped gone_ms after
+// it was last seen.
+//
+// The event callback is called when an address becomes present and when a
+// present address is dropped. The table has room for addr_max addresses;
+// when it's full, the one with the lowest confidence (oldest if a tie) goes.
+//
+// Times are from time_us_32() (passed in) so this is usable in native tests.
+
+class RailComAddrMap
+{
+public:
+
+    static constexpr int addr_max = 16;
+    static constexpr uint8_t conf_min = 3;
+    static constexpr uint8_t conf_max = 15;
+    static constexpr uint32_t pair_us = 50'000;
+    static constexpr uint32_t gone_ms = 2000;
+
+    RailComAddrMap();
+
+    struct Entry {
+        uint16_t addr;
+        uint8_t conf;
+        uint32_t seen_us; // last time it was seen
+    };
+
+    typedef void(EventCb)(uint16_t addr, bool present);
+
+    void event_cb_set(EventCb *cb)
+    {
+        _event_cb = cb;
+    }
+
+    // After a cutout; ch1 is the channel 1 message, nullptr if none
+    void update(const RailComMsg *ch1, uint32_t now_us); // interrupt context
+
+    // Forget everything, calling the event callback for present addresses
+    // (track off; there won't be any more cutouts to age them out)
+    void clear();
+
+    // Present addresses are numbered 0...present_cnt()-1, in no particular
+    // order. The numbering changes as addresses come and go.
+    int present_cnt() const;
+
+    // Returns false if there is no i'th present address
+    bool present_get(int i, Entry &entry) const;
+
+    // address seen, decoded from AHI and ALO (or 0 if invalid)
+    static uint16_t addr(uint8_t ahi, uint8_t alo);
+
+private:
+
+    Entry _entry[addr_max];
+    int _entry_cnt;
+
+    // the last AHI or ALO, waiting for the other one
+    RailComMsg::MsgId _half_id; // ahi or alo, or inv if nothing is waiting
+    uint8_t _half_val;
+    uint32_t _half_us;
+
+    EventCb *_event_cb;
+
+    void seen(uint16_t addr, uint32_t now_us); // interrupt context
+    void age(uint32_t now_us);                 // interrupt context
+    void drop(int i);                          // interrupt context
+
+}; // class RailComAddrMap
@@ -51,9 +51,9 @@ struct RailComMsg {
         } xpom;
     };
 
-    // extract message from 6-bit data buffer
-    bool parse1(const uint8_t *&d, const uint8_t *d_end);
-    bool parse2(const uint8_t *&d, const uint8_t *d_end);
+    // extract message from decoded frame f at byte i (before byte end)
+    bool parse1(const RailComSpec::Frame &f, int &i, int end);
+    bool parse2(const RailComSpec::Frame &f, int &i, int end);
 
     // pretty-print to buf
     int show(char *buf, int buf_len) const;
@@ -28,9 +28,64 @@ enum DecId : uint8_t {
 // Lookup table: index this by 8-bit encoded 4/8 code to get 6-bit decoded value
 extern const uint8_t decode[UINT8_MAX + 1];
 
+// A cutout's bytes decoded together. dec[] is decode[] of each byte, and bit
+// i of valid is set if dec[i] is data (6 bits). data has the 6-bit values
+// packed together, dec[0] in bits 47-42, dec[1] in bits 41-36, and so on;
+// anything that isn't data (or isn't there) is zero. An n-byte message
+// starting at byte i is all_valid(i, n) and its bits are field(i, n).
+struct Frame {
+    static constexpr int len_max = 8;
+
+    uint64_t data;
+    uint8_t dec[len_max];
+    uint8_t valid;
+    uint8_t len;
+
+    bool all_valid(int i, int n) const
+    {
+        const uint32_t m = ((1u << n) - 1) << i;
+        return (valid & m) == m;
+    }
+
+    uint64_t field(int i, int n) const
+    {
+        return (data >> (6 * (len_max - i - n))) &
+               ((uint64_t(1) << (6 * n)) - 1);
+    }
+};
+
+// Decode len (up to Frame::len_max) encoded bytes. The scalar version goes a
+// byte at a time; the swar one does the validity mask and packing for all
+// eight bytes at once in 64-bit registers, which is faster on a 64-bit host
+// but not on the RP2040 (no 64-bit registers, no fast multiply).
+void decode_frame_scalar(const uint8_t *enc, int len, Frame &f);
+void decode_frame_swar(const uint8_t *enc, int len, Frame &f);
+
+inline void decode_frame(const uint8_t *enc, int len, Frame &f)
+{
+#if PICO_ON_DEVICE
+    decode_frame_scalar(enc, len, f);
+#else
+    decode_frame_swar(enc, len, f);
+#endif
+}
+
 constexpr int ch1_bytes = 2;
 constexpr int ch2_bytes = 6;
 
+// Channel windows (RCN-217), usec from the end of the packet end bit (the
+// start of the cutout). A byte is 10 bits at 250 Kbaud, 40 usec.
+constexpr int ch1_start_us = 80;
+constexpr int ch1_end_us = 177;
+constexpr int ch2_start_us = 193;
+constexpr int ch2_end_us = 454;
+constexpr int byte_us = 40;
+
+// Bytes are timed when they finish arriving. The last channel 1 byte is done
+// by ch1_end_us, and the first channel 2 byte is not done before
+// ch2_start_us + byte_us; split halfway between.
+constexpr int ch_split_us = (ch1_end_us + ch2_start_us + byte_us) / 2; // 205
+
 // Packet IDs (4 bits).
 // These are the constants we look for when parsing the railcom data
 // (except for pkt_inv which is used to indicate an unset value).
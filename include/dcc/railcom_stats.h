@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+// RailCom counters
+//
+// RailCom::parse() counts each cutout into one of these (cutout_stats()),
+// then adds it to its totals for all cutouts. The loco the packet before the
+// cutout was for adds it to its own totals too, so bad track (everything
+// goes bad) can be told from a bad loco (only its counts go bad).
+//
+// Counts are only changed in interrupt context (the bit interrupt), so
+// readers on the same core take a copy with interrupts off.
+
+struct RailComStats {
+    uint32_t cutout;      // cutouts
+    uint32_t empty;       // cutouts with nothing received
+    uint32_t bytes;       // bytes received
+    uint32_t inv;         // bytes that aren't 4/8 codes (or are reserved)
+    uint32_t short_frame; // cutouts with some bytes, but not all 8
+    uint32_t ch1;         // channel 1 AHI/ALO parsed
+    uint32_t ch2;         // channel 2 messages used
+    uint32_t ch2_full;    // channel 2 all good
+    uint32_t ch2_part;    // channel 2 good messages, then junk
+    uint32_t ch2_rej;     // channel 2 junk from the start
+    uint32_t ack;         // ACK messages used
+    uint32_t nak;         // NAK messages used
+    uint32_t pom;         // POM messages used
+    uint32_t ch2_heur;    // would have had channel 2 by the old parse
+
+    static constexpr int cnt = 14;
+
+    // counters by number (0...cnt-1), in the order above
+    uint32_t get(int i) const;
+    void set(int i, uint32_t v);
+    static const char *name(int i);
+
+    void add(const RailComStats &s); // called in interrupt context
+
+    void reset();
+};
@@ -0,0 +1,94 @@
+#include "dcc/dcc_ack.h"
+
+#include <cstdint>
+
+
+DccAck::DccAck(uint16_t inc_ma) :
+    _inc_ma(inc_ma),
+    _ack_ma(ack_ma_inv),
+    _ack(false),
+    _learn_cnt(0),
+    _learn_sum(0),
+    _learn_sq(0),
+    _base_ma(0),
+    _peak_ma(0),
+    _pulse_ma(0)
+{
+}
+
+
+void DccAck::learn_reset()
+{
+    _learn_cnt = 0;
+    _learn_sum = 0;
+    _learn_sq = 0;
+    _peak_ma = 0;
+    _pulse_ma = 0;
+}
+
+
+uint16_t DccAck::noise_mean_ma() const
+{
+    if (_learn_cnt == 0)
+        return 0;
+    return (_learn_sum + _learn_cnt / 2) / _learn_cnt;
+}
+
+
+uint16_t DccAck::noise_sd_ma() const
+{
+    if (_learn_cnt == 0)
+        return 0;
+
+    // variance = E[x^2] - E[x]^2, all in integers (n * sum_sq - sum^2) / n^2
+    uint64_t n = _learn_cnt;
+    uint64_t sum = _learn_sum;
+    uint64_t num = n * _learn_sq - sum * sum;
+    uint32_t var = num / (n * n);
+
+    // integer square root
+    uint32_t sd = 0;
+    for (uint32_t bit = 1u << 15; bit != 0; bit >>= 1) {
+        uint32_t t = sd | bit;
+        if (t * t <= var)
+            sd = t;
+    }
+    return sd;
+}
+
+
+void DccAck::arm(uint16_t base_ma) // called in interrupt context
+{
+    uint16_t inc_ma = _inc_ma;
+
+    if (learned()) {
+        // the current can drift up during a read, so the long average is
+        // still the baseline; the learned mean is only a floor for it
+        if (base_ma < noise_mean_ma())
+            base_ma = noise_mean_ma();
+        uint32_t inc = sd_mul * noise_sd_ma();
+        if (inc < inc_min_ma)
+            inc = inc_min_ma;
+        if (inc < _pulse_ma / 2u)
+            inc = _pulse_ma / 2u;
+        if (inc < inc_ma)
+            inc_ma = inc;
+    }
+
+    _base_ma = base_ma;
+    _ack_ma = base_ma + inc_ma;
+    _ack = false;
+}
+
+
+// Follow an ack pulse until it's down to half its height; the height is
+// then the peak over the baseline.
+void DccAck::peak(uint16_t track_ma) // called in interrupt context
+{
+    if (track_ma > _peak_ma) {
+        _peak_ma = track_ma;
+    } else if (track_ma < _base_ma + (_peak_ma - _base_ma) / 2) {
+        _pulse_ma = _peak_ma - _base_ma;
+        _peak_ma = 0;
+    }
+}
@@ -1,40 +1,70 @@
 #include "dcc/dcc_adc.h"
 
-#include <cassert>
 #include <cstdint>
-#include <cstdio>
-#include <cstring>
 
 #include "misc/dbg_gpio.h"
+#include "dcc/dcc_adc_avg.h"
+#include "dcc/dcc_adc_trace.h"
 #include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/sync.h"
+#include "pico/util/queue.h"
+
+
+// The DMA ring. It is written by the DMA and read by loop(). The DMA ring
+// wrap requires it to be aligned to its size in bytes. There's only one ADC,
+// so this is not in the object (which is usually on the heap).
+static uint16_t adc_ring[DccAdc::ring_len]
+    __attribute__((aligned(DccAdc::ring_len * sizeof(uint16_t))));
+
+static constexpr uint32_t ring_mask = DccAdc::ring_len - 1;
+
+// log2 of the ring size in bytes, for channel_config_set_ring()
+static constexpr uint ring_bits = __builtin_ctz(sizeof(adc_ring));
+static_assert((1u << ring_bits) == sizeof(adc_ring),
+              "ring_len must be a power of 2");
+
+// If loop() finds more than this many new samples, the DMA might be about to
+// overwrite the oldest ones while we're looking at them.
+static constexpr uint32_t ring_margin = 16;
 
 
 DccAdc::DccAdc(int gpio) :
     _gpio(gpio),
-    _avg_idx(0),
+    _avg(short_cnt, long_cnt),
+    _dma_chan(-1),
+    _ring_rd(0),
     _err_cnt(0),
-    _log_max(0),
-    _log_idx(0),
-    _log(nullptr),
+    _ovr_cnt(0),
+    _log_queue(nullptr),
+    _log_seq(0),
+    _log_blk_cnt(0),
+    _log_drop_cnt(0),
     _dbg_loop_gpio(-1)
 {
     if (_gpio < 0)
         return;
 
-    for (int i = 0; i < avg_max; i++)
-        _avg[i] = 0;
-
     adc_init();
     adc_gpio_init(_gpio);         // e.g. 26
     adc_select_input(_gpio - 26); // e.g. 0; rp2040 GPIO 26 is ADC 0
-    adc_fifo_setup(true, false, 0, true, false); // err_in_fifo true
+    // fifo enabled, dreq enabled (threshold 1 sample), err_in_fifo true,
+    // no byte shift (DMA moves 16-bit samples)
+    adc_fifo_setup(true, true, 1, true, false);
     adc_set_clkdiv(clock_rate / sample_rate - 1);
+
+    _dma_chan = dma_claim_unused_channel(true);
 }
 
 
 DccAdc::~DccAdc()
 {
+    log_stop();
     stop();
+    if (_dma_chan >= 0) {
+        dma_channel_unclaim(_dma_chan);
+        _dma_chan = -1;
+    }
 }
 
 
@@ -43,6 +73,10 @@ void DccAdc::start()
     if (_gpio < 0)
         return;
 
+    adc_run(false);
+    dma_channel_abort(_dma_chan);
+    adc_fifo_drain();
+    dma_start();
     adc_run(true);
 }
 
@@ -53,17 +87,37 @@ void DccAdc::stop()
         return;
 
     adc_run(false);
+    dma_channel_abort(_dma_chan);
+    adc_fifo_drain();
 }
 
 
-// When the ADC FIFO is empty, this function takes about 250 ns; when there is
-// data, about 600 ns (by one particular measurement). Note that at 10 KHz, a
-// new sample is available every 100 usec. With the rp2040 4-sample fifo
-// (rp2350 is 8 samples), that means this must be called at least every 400
-// usec. Calling it once per DCC bit time should be fine (zeros are 200 usec).
-// Sometimes one call will get two samples, so make sure that works.
+// Start the DMA writing at the start of the ring. It runs until dma_cnt
+// samples have been written, with the write address wrapping in the ring.
+void DccAdc::dma_start()
+{
+    dma_channel_config c = dma_channel_get_default_config(_dma_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, ring_bits); // wrap write address
+    channel_config_set_dreq(&c, DREQ_ADC);
+    dma_channel_configure(_dma_chan, &c, adc_ring, &adc_hw->fifo, dma_cnt,
+                          true);
+    _ring_rd = 0;
+}
+
+
+// The DMA streams samples into the ring without any help, so this function
+// only has to look at whatever is new since the last call and fold it into
+// the averages (and log). It can be called as often or as seldom as is
+// convenient, as long as it's at least every (ring_len - ring_margin) sample
+// times (24 msec). The sample rate is not related to the DCC bit rate.
+//
+// If it does get called too late, the oldest samples are skipped (and
+// counted in _ovr_cnt); the averages are still from recent samples.
 //
-// Return number of samples read (0 or more).
+// Return number of samples processed (0 or more).
 int DccAdc::loop() // called in interrupt context
 {
     DbgGpio d(_dbg_loop_gpio);
@@ -71,106 +125,152 @@ int DccAdc::loop() // called in interrupt context
     if (_gpio < 0)
         return 0;
 
-    // This should be fine even if the fifo is deeper than four. (But is is
-    // related to the sample rate and DCC bit rate, so it'd be nice if it were
-    // calculated instead of being a magic number.)
-    constexpr int max_samples = 4;
+    // Samples written by the DMA since it was started. The top bits of
+    // transfer_count are the trigger mode on rp2350, so mask them off.
+    uint32_t ring_wr =
+        dma_cnt - (dma_channel_hw_addr(_dma_chan)->transfer_count & dma_cnt);
+
+    uint32_t cnt = ring_wr - _ring_rd;
 
-    int samples = 0;
+    if (cnt > (ring_len - ring_margin)) {
+        // The DMA has lapped us, or is about to. Use the newest half ring.
+        _ovr_cnt++;
+        cnt = ring_len / 2;
+        _ring_rd = ring_wr - cnt;
+    }
 
-    // adc_fifo_is_empty() and adc_fifo_get() are a few machine instructions each
+    // New samples might wrap around the end of the ring, in which case it's
+    // two blocks.
+    uint32_t idx = _ring_rd & ring_mask;
+    uint32_t cnt1 = ring_len - idx;
+    if (cnt1 >= cnt) {
+        block(&adc_ring[idx], cnt);
+    } else {
+        block(&adc_ring[idx], cnt1);
+        block(&adc_ring[0], cnt - cnt1);
+    }
 
-    while (!adc_fifo_is_empty() && samples < max_samples) {
+    _ring_rd = ring_wr;
 
-        samples++;
+    // After dma_cnt samples (hours), the DMA stops; start it again.
+    if (ring_wr == dma_cnt)
+        dma_start();
 
-        uint16_t adc_val = adc_fifo_get();
+    return cnt;
+}
+
+
+// Process a block of samples from the ring
+void DccAdc::block(const uint16_t *raw, int cnt) // called in interrupt context
+{
+    for (int i = 0; i < cnt; i++) {
+
+        uint16_t adc_val = raw[i];
         if (adc_val & 0x8000)
             _err_cnt++;
 
         adc_val &= 0x0fff;
 
-        if (logging() && _log_idx < _log_max)
-            _log[_log_idx++] = adc_val;
+        if (logging()) {
+            DccAdcTrace::blk_put(_log_blk, _log_blk.cnt++, adc_val);
+            if (_log_blk.cnt == DccAdcTrace::blk_samples_max)
+                log_send();
+        }
 
-        _avg[_avg_idx] = adc_val;
-        _avg_idx++;
-        if (_avg_idx >= avg_max)
-            _avg_idx = 0;
+        _avg.add(adc_val);
     }
-
-    return samples;
 }
 
 
 uint16_t DccAdc::short_avg_ma() const
 {
-    uint16_t raw = short_avg_raw();
-    uint16_t mv = raw_to_mv(raw);
-    return mv_to_ma(mv);
+    return raw_to_ma(_avg.short_avg_raw());
 }
 
 
 uint16_t DccAdc::long_avg_ma() const
 {
-    uint16_t raw = long_avg_raw();
-    uint16_t mv = raw_to_mv(raw);
-    return mv_to_ma(mv);
+    return raw_to_ma(_avg.long_avg_raw());
 }
 
 
-void DccAdc::log_init(int samples)
+uint16_t DccAdc::fast_avg_ma() const
 {
-    if (_log != nullptr) {
-        delete[] _log;
-        _log = nullptr;
-        _log_max = 0;
-        _log_idx = 0;
-    }
-    if (samples > 0) {
-        _log = new uint16_t[samples];
-        assert(_log != nullptr);
-        _log_max = samples;
-        _log_idx = 0;
-    }
+    return raw_to_ma(_avg.recent_avg_raw(fast_cnt));
 }
 
 
-void DccAdc::log_reset()
+// Start streaming the log to q. Blocks are added to q in interrupt context,
+// so q must not be one that blocks.
+void DccAdc::log_start(queue_t *q)
 {
-    if (logging()) {
-        memset(_log, 0, _log_max * sizeof(_log[0]));
-        _log_idx = 0;
-    }
+    if (logging())
+        log_stop();
+
+    uint32_t save = save_and_disable_interrupts();
+
+    _log_seq = 0;
+    _log_blk_cnt = 0;
+    _log_drop_cnt = 0;
+    _log_queue = q;
+
+    DccAdcTrace::blk_init(_log_blk, DccAdcTrace::blk_start, _log_seq);
+    _log_blk.data[0] = DccAdcTrace::version;
+    DccAdcTrace::blk_u32_put(_log_blk, 1, sample_rate);
+    log_send();
+
+    restore_interrupts(save);
 }
 
 
-void DccAdc::log_show() const
+void DccAdc::log_stop()
 {
-    if (logging()) {
-        printf("\n");
-        printf("adc log: %d entries\n", _log_idx);
-        printf("\n");
-        printf("err_cnt = %d\n", _err_cnt);
-        printf("\n");
-        printf(" idx  raw\n");
-        //      ---- ----
-        for (int i = 0; i < _log_idx; i++) printf("%4d %4u\n", i, _log[i]);
-        printf("\n");
-    }
+    if (!logging())
+        return;
+
+    uint32_t save = save_and_disable_interrupts();
+
+    if (_log_blk.cnt > 0)
+        log_send();
+
+    DccAdcTrace::blk_init(_log_blk, DccAdcTrace::blk_end, _log_seq);
+    DccAdcTrace::blk_u32_put(_log_blk, 0, _err_cnt);
+    DccAdcTrace::blk_u32_put(_log_blk, 4, _ovr_cnt);
+    DccAdcTrace::blk_u32_put(_log_blk, 8, _log_drop_cnt);
+    log_send();
+
+    _log_queue = nullptr;
+
+    restore_interrupts(save);
 }
 
 
-uint16_t DccAdc::avg_raw(int cnt) const
+// Put a mark in the log between samples (e.g. "ack armed"). Samples so far
+// go out first, in a short block.
+void DccAdc::log_mark(uint8_t mark, int a, int b) // called in interrupt context
 {
-    // XXX lock _avg[]
-    uint32_t sum = 0;
-    int i = _avg_idx;
-    for (int j = 0; j < cnt; j++) {
-        i--;
-        if (i < 0)
-            i = avg_max - 1;
-        sum += _avg[i];
-    }
-    return (sum + cnt / 2) / cnt;
+    if (!logging())
+        return;
+
+    if (_log_blk.cnt > 0)
+        log_send();
+
+    DccAdcTrace::blk_init(_log_blk, DccAdcTrace::blk_mark, _log_seq);
+    _log_blk.data[0] = mark;
+    DccAdcTrace::blk_u16_put(_log_blk, 1, a);
+    DccAdcTrace::blk_u16_put(_log_blk, 3, b);
+    log_send();
+}
+
+
+// Send the current block and start a new (empty) samples block. If the queue
+// is full, the block is dropped, but still uses a sequence number so the gap
+// can be seen at the other end.
+void DccAdc::log_send() // called in interrupt context
+{
+    if (!queue_try_add(_log_queue, &_log_blk))
+        _log_drop_cnt++;
+    _log_blk_cnt++;
+    _log_seq++;
+    DccAdcTrace::blk_init(_log_blk, DccAdcTrace::blk_samples, _log_seq);
 }
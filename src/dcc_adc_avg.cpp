@@ -0,0 +1,45 @@
+#include "dcc/dcc_adc_avg.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+
+DccAdcAvg::DccAdcAvg(int short_cnt, int long_cnt) :
+    _idx(0),
+    _short_cnt(short_cnt),
+    _long_cnt(long_cnt),
+    _short_sum(0),
+    _long_sum(0)
+{
+    assert(0 < _short_cnt && _short_cnt <= win_max);
+    assert(0 < _long_cnt && _long_cnt <= win_max);
+    reset();
+}
+
+
+void DccAdcAvg::reset()
+{
+    memset(_hist, 0, sizeof(_hist));
+    _idx = 0;
+    _short_sum = 0;
+    _long_sum = 0;
+}
+
+
+void DccAdcAvg::short_cnt(int cnt)
+{
+    assert(0 < cnt && cnt <= win_max);
+    _short_cnt = cnt;
+    _short_sum = sum(_short_cnt);
+}
+
+
+// Sum of the most recent cnt samples
+int32_t DccAdcAvg::sum(int cnt) const
+{
+    int32_t s = 0;
+    for (int i = 1; i <= cnt; i++)
+        s += _hist[(_idx - i) & hist_mask];
+    return s;
+}
@@ -1,9 +1,10 @@
 
+#include <cassert>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
 // pico
-#include "hardware/sync.h" // __dmb()
+#include "hardware/sync.h" // __dmb(), __sev()
 #include "pico/multicore.h"
 #include "pico/stdlib.h"
 #include "pico/util/queue.h"
@@ -11,7 +12,9 @@
 #include "misc/buf_log.h" // XXX
 #include "misc/str_ops.h" // strxcpy()
 // dcc
+#include "dcc/dcc_adc_trace.h"
 #include "dcc/dcc_api.h"
+#include "dcc/dcc_msg.h"
 #include "dcc/dcc_srv.h"
 
 // This runs on core 0, and is responsible for creating the inter-core message
@@ -50,55 +53,320 @@ const char *status(Status s)
 }
 
 
+// Round trip times (req_send to rsp_recv), for ASCII and binary requests;
+// see rtt_get()
+static Rtt rtt_ascii;
+static Rtt rtt_bin;
+static uint64_t rtt_ascii_us; // sums, for the averages
+static uint64_t rtt_bin_us;
+
+
+// Outstanding requests
+//
+// Each request sent gets an id (1-65535, then around again) that comes back
+// in its response (see dcc_srv.cpp); it goes in a binary request's id field,
+// or in front of an ASCII one as "#<id> ". Responses can come back in a
+// different order than the requests went out (dcc_srv answers most requests
+// while a service mode operation runs), so one that comes in while waiting
+// for another is kept here until its *_check asks for it.
+//
+// A request can also have a done function (see done()), which loop() calls
+// when its response comes in or it times out.
+//
+// If the table is full when a request is sent, the oldest one without a
+// done function is forgotten (its response is thrown away if it ever
+// comes). If they all have one, the request isn't sent.
+
+static struct {
+    uint16_t id; // 0 if not in use
+    bool bin;
+    bool have_rsp;
+    uint32_t sent_us;
+    DoneFunc *done; // nullptr if none
+    intptr_t done_arg;
+    int32_t done_end_us;
+    bool done_busy; // done function running; the entry isn't to be reused
+    DccMsg::Buf rsp;
+} req_out[req_out_max];
+
+static int done_cnt = 0; // entries with a done function
+
+static uint16_t req_id_next = 1;
+static ReqId req_id_last = 0;
+
+
+static int req_out_find(uint16_t id)
+{
+    for (int i = 0; i < req_out_max; i++)
+        if (req_out[i].id == id)
+            return i;
+    return -1;
+}
+
+
+// Give back the result block a response has, if it has one (dcc_msg.h); for
+// responses that are thrown away without being looked at
+static void blk_drop(const DccMsg::Buf &msg)
+{
+    if (DccMsg::is_bin(msg.ascii) && DccMsg::has_blk(msg.rsp))
+        rsp_blk_pool.release(msg.rsp.blk.handle);
+}
+
+
+// A free entry, or the oldest one without a done function (-1 if none)
+static int req_out_new()
+{
+    int old = -1;
+    for (int i = 0; i < req_out_max; i++) {
+        if (req_out[i].id == 0)
+            return i;
+        if (req_out[i].done != nullptr || req_out[i].done_busy)
+            continue;
+        if (old < 0 || uint16_t(req_id_next - req_out[i].id) >
+                           uint16_t(req_id_next - req_out[old].id))
+            old = i;
+    }
+    return old;
+}
+
+
+static bool rsp_take();
+
+
 // Send request (with timeout)
 //
 // This is intended to be internal; the following are handled by caller:
 // * req_msg must be at least req_msg_len_max characters
 // * end_us is time_us_32() + timeout_us (wrap is okay)
 //
-// Takes ~15 usec if there's room in the queue. The only way queue_try_add
-// fails is if the queue is full, which usually means something has gone
-// wrong.
+// The request is built right in req_queue (msg_ring.h). The only way that
+// fails is if the queue stays full. While waiting, responses are taken from
+// rsp_queue (and filed), since dcc_srv may be waiting for room there before
+// it takes more requests. The request gets the next id (req_id() after).
 //
 // Returns
 // @ Status::Ok
 // @ Status::Timeout
-static inline Status req_send(const char *req_msg, int32_t end_us)
+// @ Status::Error (req_out_max outstanding, all with done functions)
+static Status req_send(const char *req_msg, int32_t end_us)
 {
-    while (!queue_try_add(&req_queue, req_msg))
+    const uint16_t id = req_id_next;
+    const bool bin = DccMsg::is_bin(req_msg);
+
+    const int i = req_out_new();
+    if (i < 0)
+        return Status::Error;
+
+    req_submit(id); // latency starts here (dcc_lat.h)
+
+    DccMsg::Buf *msg;
+    while ((msg = (DccMsg::Buf *)req_queue.claim()) == nullptr) {
+        if (rsp_take())
+            continue;
         if ((int32_t(time_us_32()) - end_us) >= 0)
             return Status::Timeout;
+    }
+
+    if (bin) {
+        memcpy(&msg->req, req_msg, sizeof(DccMsg::Req));
+        msg->req.id = id;
+        req_queue.commit(sizeof(DccMsg::Req));
+    } else {
+        snprintf(msg->ascii, req_msg_len_max, "#%u %s", uint(id), req_msg);
+        req_queue.commit(strlen(msg->ascii) + 1);
+    }
+    req_bell();
+
+    if (++req_id_next == 0)
+        req_id_next = 1;
+    req_id_last = id;
+
+    if (req_out[i].id != 0 && req_out[i].have_rsp)
+        blk_drop(req_out[i].rsp); // forgetting the oldest
+
+    req_out[i].id = id;
+    req_out[i].bin = bin;
+    req_out[i].have_rsp = false;
+    req_out[i].sent_us = time_us_32();
+    req_out[i].done = nullptr;
+
     return Status::Ok;
 }
 
 
+static void rtt_add(bool bin, uint32_t sent_us)
+{
+    uint32_t us = time_us_32() - sent_us;
+    Rtt &r = bin ? rtt_bin : rtt_ascii;
+    uint64_t &sum = bin ? rtt_bin_us : rtt_ascii_us;
+    r.cnt++;
+    sum += us;
+    r.us_avg = sum / r.cnt;
+    if (us > r.us_max)
+        r.us_max = us;
+}
+
+
+// File a response from rsp_queue with its request (ASCII ones lose the
+// "#<id> "), or throw it away if it isn't for one we're waiting on. msg is
+// still in rsp_queue.
+static void rsp_file(const DccMsg::Buf &msg)
+{
+    const bool bin = DccMsg::is_bin(msg.ascii);
+    const uint16_t id = bin ? msg.rsp.id : DccMsg::text_id(msg.ascii);
+    int i = (id == 0) ? -1 : req_out_find(id);
+    if (i < 0 || req_out[i].have_rsp) {
+        blk_drop(msg);
+        return;
+    }
+
+    if (bin)
+        req_out[i].rsp = msg;
+    else
+        strxcpy(req_out[i].rsp.ascii, DccMsg::text(msg.ascii), rsp_msg_len_max);
+    req_out[i].have_rsp = true;
+    rtt_add(req_out[i].bin, req_out[i].sent_us);
+}
+
+
+// File everything in rsp_queue; false if it was empty
+static bool rsp_take()
+{
+    bool took = false;
+    int len;
+    const void *msg;
+    while ((msg = rsp_queue.peek(len)) != nullptr) {
+        rsp_file(*(const DccMsg::Buf *)msg);
+        rsp_queue.release();
+        took = true;
+    }
+    if (took)
+        __sev(); // dcc_srv might be holding a response until there's room
+    return took;
+}
+
+
+static void log_loop();
+static void done_loop();
+
+
 // Receive response (with timeout)
 //
 // This is intended to be internal; the following are handled by caller:
 // * rsp_msg must be at least rsp_msg_len_max characters
 // * end_us is time_us_32() + timeout_us (wrap is okay)
 //
-// queue_try_remove returns true if there's something in the queue, or false
-// if the queue is empty.
+// Waits for the response to request id (0 is the last one sent). Responses
+// to other requests that come first are kept for later.
 //
 // Returns
 // @ Status::Ok
 // @ Status::Timeout
-static inline Status rsp_recv(char *rsp_msg, int32_t end_us)
+// @ Status::Error (id isn't outstanding)
+static Status rsp_recv(ReqId id, char *rsp_msg, int32_t end_us)
 {
-    while (!queue_try_remove(&rsp_queue, rsp_msg)) {
+    if (id == 0)
+        id = req_id_last;
+
+    const int i = req_out_find(id);
+    if (id == 0 || i < 0)
+        return Status::Error;
+
+    while (!req_out[i].have_rsp) {
+        if (rsp_take())
+            continue;
         if ((int32_t(time_us_32()) - end_us) >= 0)
             return Status::Timeout;
         BufLog::loop();
+        log_loop(); // keep up with the adc log during long operations
+    }
+
+    memcpy(rsp_msg, req_out[i].rsp.ascii, rsp_msg_len_max);
+    if (req_out[i].done != nullptr)
+        done_cnt--;
+    req_out[i].id = 0;
+    return Status::Ok;
+}
+
+
+// Binary requests (dcc_msg.h)
+//
+// The caller fills in op and the fields, and bin_send the rest. bin_recv
+// gets the response and checks that it is for the right op, and worked.
+
+static Status bin_send(DccMsg::Buf &msg, int32_t end_us)
+{
+    msg.req.sync = DccMsg::bin_sync;
+    return req_send(msg.ascii, end_us);
+}
+
+
+static Status bin_recv(DccMsg::Op op, DccMsg::Rsp &rsp, int32_t end_us, ReqId id)
+{
+    DccMsg::Buf msg;
+    Status s = rsp_recv(id, msg.ascii, end_us);
+    if (s != Status::Ok)
+        return s;
+    if (!DccMsg::is_bin(msg.ascii) || msg.rsp.op != op || msg.rsp.err != 0) {
+        blk_drop(msg);
+        return Status::Error;
     }
+    rsp = msg.rsp;
     return Status::Ok;
 }
 
 
-// Same as rsp_recv, but for not_queue and not_msg_len_max
-static inline Status not_recv(char *not_msg, int32_t end_us)
+// Before a request whose result comes in a block: if responses nobody has
+// checked yet are holding all the blocks, forget the oldest (without a done
+// function), like req_out_new() does when the table is full. Otherwise
+// dcc_srv would have no block for it.
+static void blk_reclaim()
+{
+    rsp_take();
+    while (true) {
+        int held = 0;
+        int old = -1;
+        for (int i = 0; i < req_out_max; i++) {
+            if (req_out[i].id == 0 || !req_out[i].have_rsp ||
+                !DccMsg::is_bin(req_out[i].rsp.ascii) ||
+                !DccMsg::has_blk(req_out[i].rsp.rsp))
+                continue;
+            held++;
+            if (req_out[i].done != nullptr || req_out[i].done_busy)
+                continue;
+            if (old < 0 || uint16_t(req_id_next - req_out[i].id) >
+                               uint16_t(req_id_next - req_out[old].id))
+                old = i;
+        }
+        if (held < rsp_blk_cnt_max || old < 0)
+            return;
+        blk_drop(req_out[old].rsp);
+        req_out[old].id = 0;
+    }
+}
+
+
+// Results in a block (dcc_msg.h): bin_recv, then the block, which the caller
+// reads and then gives back with rsp_blk_pool.release(rsp.blk.handle)
+static const void *bin_recv_blk(DccMsg::Op op, DccMsg::Rsp &rsp,
+                                int32_t end_us, ReqId id, Status &s)
+{
+    s = bin_recv(op, rsp, end_us, id);
+    if (s != Status::Ok)
+        return nullptr;
+    const void *blk = rsp_blk_pool.blk(rsp.blk.handle);
+    if (blk == nullptr || rsp.blk.len > RspBlkPool::len)
+        s = Status::Error;
+    return blk;
+}
+
+
+// Take a message from a ring (with timeout); for notifications, and raw
+// responses
+template <typename Ring>
+static inline Status msg_recv(Ring &q, void *msg, int32_t end_us)
 {
-    while (!queue_try_remove(&not_queue, not_msg))
+    while (!q.get(msg))
         if ((int32_t(time_us_32()) - end_us) >= 0)
             return Status::Timeout;
     return Status::Ok;
@@ -110,9 +378,8 @@ void init(int sig_gpio, int pwr_gpio, int adc_gpio, //
 {
     // create message queues
     // void queue_init (queue_t *q, uint element_size, uint element_count)
-    queue_init(&req_queue, req_msg_len_max, req_msg_cnt_max);
-    queue_init(&rsp_queue, req_msg_len_max, req_msg_cnt_max);
-    queue_init(&not_queue, not_msg_len_max, not_msg_cnt_max);
+    // (req_queue, rsp_queue, and not_queue are ready to go; see msg_ring.h)
+    queue_init(&log_queue, sizeof(DccAdcTrace::Blk), log_blk_cnt_max);
 
     dcc_config.sig_gpio = sig_gpio;
     dcc_config.pwr_gpio = pwr_gpio;
@@ -146,16 +413,64 @@ void notify(NotifyFunc *func, intptr_t arg)
 }
 
 
+static AdcLogFunc *adc_log_func = nullptr;
+static intptr_t adc_log_arg = 0;
+
+
+void adc_log(AdcLogFunc *func, intptr_t arg)
+{
+    adc_log_arg = arg;
+    adc_log_func = func;
+}
+
+
+// Take everything in the log queue; it fills at ~250 blocks/sec while the
+// adc log is on. Blocks are thrown away if there's no log function.
+static void log_loop()
+{
+    DccAdcTrace::Blk blk;
+    while (queue_try_remove(&log_queue, &blk))
+        if (adc_log_func != nullptr)
+            adc_log_func(adc_log_arg, blk);
+}
+
+
+// Notifications taken by loop(), and ones missed (gaps in "@<seq> ")
+static uint32_t not_cnt = 0;
+static uint32_t not_lost = 0;
+static uint16_t not_seq_next;
+static bool not_seq_valid = false;
+
+
 void loop()
 {
     char msg[not_msg_len_max];
-    if (queue_try_remove(&not_queue, msg)) {
+    if (not_queue.get(msg)) {
+        uint16_t seq;
+        if (DccMsg::not_seq(msg, seq)) {
+            if (not_seq_valid)
+                not_lost += uint16_t(seq - not_seq_next);
+            not_seq_next = seq + 1;
+            not_seq_valid = true;
+        }
+        not_cnt++;
+        __sev(); // dcc_srv might be holding a report until this one's taken
         // call notify functions until one returns true
+        const char *text = DccMsg::text(msg);
         for (int i = 0; i < notify_func_cnt; i++) {
-            if (notify_func[i].func(notify_func[i].arg, msg))
+            if (notify_func[i].func(notify_func[i].arg, text))
                 break;
         }
     }
+    done_loop();
+    log_loop();
+}
+
+
+void notify_stats(uint32_t &cnt, uint32_t &lost)
+{
+    cnt = not_cnt;
+    lost = not_lost;
 }
 
 
@@ -163,22 +478,30 @@ void loop()
 
 // These send/receive raw messages, with the only help being they do so to a
 // local buffer of sufficient size (req_msg_len_max etc.) and calculate end_us
-// from timeout_us.
+// from timeout_us. Requests go as they are (no request id is added), and
+// responses come as they are (with "#<id> " if the request had one).
 
 Status raw_req(const char *req_msg, int32_t timeout_us)
 {
     char msg[req_msg_len_max];
     strxcpy(msg, req_msg, req_msg_len_max); // msg is always terminated
-    return req_send(msg, time_us_32() + timeout_us);
+    const int32_t end_us = time_us_32() + timeout_us;
+    while (!req_queue.put(msg, strlen(msg) + 1))
+        if ((int32_t(time_us_32()) - end_us) >= 0)
+            return Status::Timeout;
+    req_bell();
+    return Status::Ok;
 }
 
 
 Status raw_rsp(char *rsp_msg, int rsp_max, int32_t timeout_us)
 {
-    char msg[rsp_msg_len_max];
-    Status s = rsp_recv(msg, timeout_us);
-    if (s == Status::Ok)
-        strxcpy(rsp_msg, msg, rsp_max); // rsp_msg is always terminated
+    DccMsg::Buf msg;
+    Status s = msg_recv(rsp_queue, msg.ascii, time_us_32() + timeout_us);
+    if (s == Status::Ok) {
+        blk_drop(msg); // a binary one isn't any use here
+        strxcpy(rsp_msg, msg.ascii, rsp_max); // rsp_msg is always terminated
+    }
     return s;
 }
 
@@ -186,38 +509,126 @@ Status raw_rsp(char *rsp_msg, int rsp_max, int32_t timeout_us)
 Status raw_not(char *not_msg, int not_max, int32_t timeout_us)
 {
     char msg[not_msg_len_max];
-    Status s = not_recv(msg, timeout_us);
+    Status s = msg_recv(not_queue, msg, time_us_32() + timeout_us);
     if (s == Status::Ok)
         strxcpy(not_msg, msg, not_max); // not_msg is always terminated
     return s;
 }
 
 
+// req_id /////////////////////////////////////////////////////////////////////
+
+
+ReqId req_id()
+{
+    return req_id_last;
+}
+
+
+// done ///////////////////////////////////////////////////////////////////////
+
+
+Status done(ReqId id, DoneFunc *func, intptr_t arg, int32_t timeout_us)
+{
+    if (id == 0)
+        id = req_id_last;
+    const int i = req_out_find(id);
+    if (id == 0 || i < 0 || func == nullptr)
+        return Status::Error;
+    if (req_out[i].done == nullptr)
+        done_cnt++;
+    req_out[i].done = func;
+    req_out[i].done_arg = arg;
+    req_out[i].done_end_us = time_us_32() + timeout_us;
+    return Status::Ok;
+}
+
+
+bool ready(ReqId id)
+{
+    rsp_take();
+    const int i = req_out_find(id == 0 ? req_id_last : id);
+    return i >= 0 && req_out[i].have_rsp;
+}
+
+
+// Call done functions for requests that have their response, or have timed
+// out. A done function for a response usually calls the request's *_check
+// to get it; if it doesn't, it's thrown away after. A done function can
+// start more requests; the entry stays put until it returns, even with the
+// table full, so its *_check still finds the response.
+static void done_loop()
+{
+    if (done_cnt == 0)
+        return;
+
+    rsp_take();
+
+    const int32_t now_us = time_us_32();
+    for (int i = 0; i < req_out_max && done_cnt > 0; i++) {
+        const uint16_t id = req_out[i].id;
+        if (id == 0 || req_out[i].done == nullptr)
+            continue;
+        Status s;
+        if (req_out[i].have_rsp)
+            s = Status::Ok;
+        else if ((now_us - req_out[i].done_end_us) >= 0)
+            s = Status::Timeout;
+        else
+            continue;
+        DoneFunc *func = req_out[i].done;
+        req_out[i].done = nullptr;
+        done_cnt--;
+        if (s == Status::Timeout)
+            req_out[i].id = 0; // a late response is thrown away
+        req_out[i].done_busy = true;
+        func(req_out[i].done_arg, id, s);
+        req_out[i].done_busy = false;
+        if (req_out[i].id == id) {
+            blk_drop(req_out[i].rsp); // func didn't *_check it
+            req_out[i].id = 0;
+        }
+    }
+}
+
+
+// rtt ////////////////////////////////////////////////////////////////////////
+
+
+void rtt_get(bool bin, Rtt &rtt)
+{
+    rtt = bin ? rtt_bin : rtt_ascii;
+}
+
+
+void rtt_reset()
+{
+    rtt_ascii = {0, 0, 0};
+    rtt_bin = {0, 0, 0};
+    rtt_ascii_us = 0;
+    rtt_bin_us = 0;
+}
+
+
 // track_get //////////////////////////////////////////////////////////////////
 
 
 Status track_get_start(int32_t end_us)
 {
-    const char req_msg[req_msg_len_max] = "T G";
-    return req_send(req_msg, end_us);
+    DccMsg::Buf msg;
+    msg.req.op = DccMsg::Op::TrackGet;
+    return bin_send(msg, end_us);
 }
 
 
-Status track_get_check(bool &on, int32_t end_us)
+Status track_get_check(bool &on, int32_t end_us, ReqId id)
 {
-    char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    DccMsg::Rsp rsp;
+    Status s = bin_recv(DccMsg::Op::TrackGet, rsp, end_us, id);
     if (s != Status::Ok)
         return s;
-    if (strcmp(rsp_msg, "OK 0") == 0) {
-        on = false;
-        return Status::Ok;
-    } else if (strcmp(rsp_msg, "OK 1") == 0) {
-        on = true;
-        return Status::Ok;
-    } else {
-        return Status::Error;
-    }
+    on = rsp.track.on;
+    return Status::Ok;
 }
 
 
@@ -235,30 +646,157 @@ Status track_get(bool &on, int32_t timeout_us)
 
 
 Status track_set_start(bool on, int32_t end_us)
+{
+    DccMsg::Buf msg;
+    msg.req.op = DccMsg::Op::TrackSet;
+    msg.req.track.on = on;
+    return bin_send(msg, end_us);
+}
+
+
+Status track_set_check(int32_t end_us, ReqId id)
+{
+    DccMsg::Rsp rsp;
+    return bin_recv(DccMsg::Op::TrackSet, rsp, end_us, id);
+}
+
+
+Status track_set(bool on, int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = track_set_start(on, end_us);
+    if (s != Status::Ok)
+        return s;
+    return track_set_check(end_us);
+}
+
+
+// track_current_get //////////////////////////////////////////////////////////
+
+
+Status track_current_get_start(int32_t end_us)
+{
+    const char req_msg[req_msg_len_max] = "T I G";
+    return req_send(req_msg, end_us);
+}
+
+
+Status track_current_get_check(int &ma, int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    return sscanf(rsp_msg, "OK %d", &ma) == 1 ? Status::Ok : Status::Error;
+}
+
+
+Status track_current_get(int &ma, int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = track_current_get_start(end_us);
+    if (s != Status::Ok)
+        return s;
+    return track_current_get_check(ma, end_us);
+}
+
+
+// track_current_report ///////////////////////////////////////////////////////
+
+
+Status track_current_report_start(int report_ms, int32_t end_us)
 {
     char req_msg[req_msg_len_max];
-    snprintf(req_msg, req_msg_len_max, "T S %d", on);
+    snprintf(req_msg, req_msg_len_max, "T I R %d", report_ms);
     return req_send(req_msg, end_us);
 }
 
 
-Status track_set_check(int32_t end_us)
+Status track_current_report_check(int32_t end_us, ReqId id)
 {
     char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    Status s = rsp_recv(id, rsp_msg, end_us);
     if (s != Status::Ok)
         return s;
     return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
 }
 
 
-Status track_set(bool on, int32_t timeout_us)
+Status track_current_report(int report_ms, int32_t timeout_us)
 {
     int32_t end_us = time_us_32() + timeout_us;
-    Status s = track_set_start(on, end_us);
+    Status s = track_current_report_start(report_ms, end_us);
     if (s != Status::Ok)
         return s;
-    return track_set_check(end_us);
+    return track_current_report_check(end_us);
+}
+
+
+// track_limit_get ////////////////////////////////////////////////////////////
+
+
+Status track_limit_get_start(int32_t end_us)
+{
+    const char req_msg[req_msg_len_max] = "T L G";
+    return req_send(req_msg, end_us);
+}
+
+
+Status track_limit_get_check(int &limit_ma, int &retry_ms, int &retry_max,
+                             int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    if (sscanf(rsp_msg, "OK %d %d %d", &limit_ma, &retry_ms, &retry_max) != 3)
+        return Status::Error;
+    return Status::Ok;
+}
+
+
+Status track_limit_get(int &limit_ma, int &retry_ms, int &retry_max,
+                       int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = track_limit_get_start(end_us);
+    if (s != Status::Ok)
+        return s;
+    return track_limit_get_check(limit_ma, retry_ms, retry_max, end_us);
+}
+
+
+// track_limit_set ////////////////////////////////////////////////////////////
+
+
+Status track_limit_set_start(int limit_ma, int retry_ms, int retry_max,
+                             int32_t end_us)
+{
+    char req_msg[req_msg_len_max];
+    snprintf(req_msg, req_msg_len_max, "T L S %d %d %d", limit_ma, retry_ms,
+             retry_max);
+    return req_send(req_msg, end_us);
+}
+
+
+Status track_limit_set_check(int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
+}
+
+
+Status track_limit_set(int limit_ma, int retry_ms, int retry_max,
+                       int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = track_limit_set_start(limit_ma, retry_ms, retry_max, end_us);
+    if (s != Status::Ok)
+        return s;
+    return track_limit_set_check(end_us);
 }
 
 
@@ -273,10 +811,10 @@ Status cv_val_get_start(int cv_num, int32_t end_us)
 }
 
 
-Status cv_val_get_check(int &cv_val, int32_t end_us)
+Status cv_val_get_check(int &cv_val, int32_t end_us, ReqId id)
 {
     char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    Status s = rsp_recv(id, rsp_msg, end_us);
     if (s != Status::Ok)
         return s;
     return sscanf(rsp_msg, "OK %d", &cv_val) == 1 ? Status::Ok : Status::Error;
@@ -304,10 +842,10 @@ Status cv_val_set_start(int cv_num, int cv_val, int32_t end_us)
 }
 
 
-Status cv_val_set_check(int32_t end_us)
+Status cv_val_set_check(int32_t end_us, ReqId id)
 {
     char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    Status s = rsp_recv(id, rsp_msg, end_us);
     if (s != Status::Ok)
         return s;
     return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
@@ -335,10 +873,10 @@ Status cv_bit_get_start(int cv_num, int b_num, int32_t end_us)
 }
 
 
-Status cv_bit_get_check(int &b_val, int32_t end_us)
+Status cv_bit_get_check(int &b_val, int32_t end_us, ReqId id)
 {
     char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    Status s = rsp_recv(id, rsp_msg, end_us);
     if (s != Status::Ok)
         return s;
     return sscanf(rsp_msg, "OK %d", &b_val) == 1 ? Status::Ok : Status::Error;
@@ -366,10 +904,10 @@ Status cv_bit_set_start(int cv_num, int b_num, int b_val, int32_t end_us)
 }
 
 
-Status cv_bit_set_check(int32_t end_us)
+Status cv_bit_set_check(int32_t end_us, ReqId id)
 {
     char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    Status s = rsp_recv(id, rsp_msg, end_us);
     if (s != Status::Ok)
         return s;
     return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
@@ -396,10 +934,10 @@ Status addr_get_start(int32_t end_us)
 }
 
 
-Status addr_get_check(int &addr, int32_t end_us)
+Status addr_get_check(int &addr, int32_t end_us, ReqId id)
 {
     char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    Status s = rsp_recv(id, rsp_msg, end_us);
     if (s != Status::Ok)
         return s;
     return sscanf(rsp_msg, "OK %d", &addr) == 1 ? Status::Ok : Status::Error;
@@ -427,10 +965,10 @@ Status addr_set_start(int addr, int32_t end_us)
 }
 
 
-Status addr_set_check(int32_t end_us)
+Status addr_set_check(int32_t end_us, ReqId id)
 {
     char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    Status s = rsp_recv(id, rsp_msg, end_us);
     if (s != Status::Ok)
         return s;
     return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
@@ -452,19 +990,17 @@ Status addr_set(int addr, int32_t timeout_us)
 
 Status loco_create_start(int addr, int32_t end_us)
 {
-    char req_msg[req_msg_len_max];
-    snprintf(req_msg, req_msg_len_max, "L %d N", addr);
-    return req_send(req_msg, end_us);
+    DccMsg::Buf msg;
+    msg.req.op = DccMsg::Op::LocoCreate;
+    msg.req.loco.addr = addr;
+    return bin_send(msg, end_us);
 }
 
 
-Status loco_create_check(int32_t end_us)
+Status loco_create_check(int32_t end_us, ReqId id)
 {
-    char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
-    if (s != Status::Ok)
-        return s;
-    return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
+    DccMsg::Rsp rsp;
+    return bin_recv(DccMsg::Op::LocoCreate, rsp, end_us, id);
 }
 
 
@@ -483,19 +1019,17 @@ Status loco_create(int addr, int32_t timeout_us)
 
 Status loco_delete_start(int addr, int32_t end_us)
 {
-    char req_msg[req_msg_len_max];
-    snprintf(req_msg, req_msg_len_max, "L %d D", addr);
-    return req_send(req_msg, end_us);
+    DccMsg::Buf msg;
+    msg.req.op = DccMsg::Op::LocoDelete;
+    msg.req.loco.addr = addr;
+    return bin_send(msg, end_us);
 }
 
 
-Status loco_delete_check(int32_t end_us)
+Status loco_delete_check(int32_t end_us, ReqId id)
 {
-    char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
-    if (s != Status::Ok)
-        return s;
-    return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
+    DccMsg::Rsp rsp;
+    return bin_recv(DccMsg::Op::LocoDelete, rsp, end_us, id);
 }
 
 
@@ -514,28 +1048,21 @@ Status loco_delete(int addr, int32_t timeout_us)
 
 Status loco_func_get_start(int addr, int func, int32_t end_us)
 {
-    char req_msg[req_msg_len_max];
-    snprintf(req_msg, req_msg_len_max, "L %d F %d G", addr, func);
-    return req_send(req_msg, end_us);
+    DccMsg::Buf msg;
+    msg.req.op = DccMsg::Op::LocoFuncGet;
+    msg.req.loco_func = {uint16_t(addr), uint8_t(func), false};
+    return bin_send(msg, end_us);
 }
 
 
-Status loco_func_get_check(bool &on, int32_t end_us)
+Status loco_func_get_check(bool &on, int32_t end_us, ReqId id)
 {
-    char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    DccMsg::Rsp rsp;
+    Status s = bin_recv(DccMsg::Op::LocoFuncGet, rsp, end_us, id);
     if (s != Status::Ok)
         return s;
-
-    if (strcmp(rsp_msg, "OK 1") == 0) {
-        on = true;
-        return Status::Ok;
-    } else if (strcmp(rsp_msg, "OK 0") == 0) {
-        on = false;
-        return Status::Ok;
-    } else {
-        return Status::Error;
-    }
+    on = rsp.loco_func.on;
+    return Status::Ok;
 }
 
 
@@ -554,19 +1081,17 @@ Status loco_func_get(int addr, int func, bool &on, int32_t timeout_us)
 
 Status loco_func_set_start(int addr, int func, bool on, int32_t end_us)
 {
-    char req_msg[req_msg_len_max];
-    snprintf(req_msg, req_msg_len_max, "L %d F %d S %d", addr, func, on);
-    return req_send(req_msg, end_us);
+    DccMsg::Buf msg;
+    msg.req.op = DccMsg::Op::LocoFuncSet;
+    msg.req.loco_func = {uint16_t(addr), uint8_t(func), on};
+    return bin_send(msg, end_us);
 }
 
 
-Status loco_func_set_check(int32_t end_us)
+Status loco_func_set_check(int32_t end_us, ReqId id)
 {
-    char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
-    if (s != Status::Ok)
-        return s;
-    return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
+    DccMsg::Rsp rsp;
+    return bin_recv(DccMsg::Op::LocoFuncSet, rsp, end_us, id);
 }
 
 
@@ -585,19 +1110,21 @@ Status loco_func_set(int addr, int func, bool on, int32_t timeout_us)
 
 Status loco_speed_get_start(int addr, int32_t end_us)
 {
-    char req_msg[req_msg_len_max];
-    snprintf(req_msg, req_msg_len_max, "L %d S G", addr);
-    return req_send(req_msg, end_us);
+    DccMsg::Buf msg;
+    msg.req.op = DccMsg::Op::LocoSpeedGet;
+    msg.req.loco.addr = addr;
+    return bin_send(msg, end_us);
 }
 
 
-Status loco_speed_get_check(int &speed, int32_t end_us)
+Status loco_speed_get_check(int &speed, int32_t end_us, ReqId id)
 {
-    char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    DccMsg::Rsp rsp;
+    Status s = bin_recv(DccMsg::Op::LocoSpeedGet, rsp, end_us, id);
     if (s != Status::Ok)
         return s;
-    return sscanf(rsp_msg, "OK %d", &speed) == 1 ? Status::Ok : Status::Error;
+    speed = rsp.loco_speed.speed;
+    return Status::Ok;
 }
 
 
@@ -615,30 +1142,407 @@ Status loco_speed_get(int addr, int &speed, int32_t timeout_us)
 
 
 Status loco_speed_set_start(int addr, int speed, int32_t end_us)
+{
+    DccMsg::Buf msg;
+    msg.req.op = DccMsg::Op::LocoSpeedSet;
+    msg.req.loco_speed = {uint16_t(addr), int16_t(speed)};
+    return bin_send(msg, end_us);
+}
+
+
+Status loco_speed_set_check(int32_t end_us, ReqId id)
+{
+    DccMsg::Rsp rsp;
+    return bin_recv(DccMsg::Op::LocoSpeedSet, rsp, end_us, id);
+}
+
+
+Status loco_speed_set(int addr, int speed, int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = loco_speed_set_start(addr, speed, end_us);
+    if (s != Status::Ok)
+        return s;
+    return loco_speed_set_check(end_us);
+}
+
+
+// loco_batch /////////////////////////////////////////////////////////////////
+
+
+Status loco_batch_start(const LocoUpdate *upd, int cnt, int32_t end_us)
+{
+    static_assert(loco_batch_max == DccMsg::loco_batch_max);
+    static_assert(loco_speed_keep == DccMsg::speed_keep);
+
+    if (cnt < 1 || cnt > loco_batch_max)
+        return Status::Error;
+
+    DccMsg::Buf msg;
+    msg.req.op = DccMsg::Op::LocoBatch;
+    msg.req.loco_batch.cnt = cnt;
+    for (int i = 0; i < cnt; i++) {
+        const int func = upd[i].func;
+        if (func != loco_func_none && (func < 0 || func >= DccMsg::func_none))
+            return Status::Error;
+        msg.req.loco_batch.loco[i] = {
+            uint16_t(upd[i].addr), int16_t(upd[i].speed),
+            func == loco_func_none ? DccMsg::func_none : uint8_t(func),
+            upd[i].on};
+    }
+    return bin_send(msg, end_us);
+}
+
+
+Status loco_batch_check(int32_t end_us, ReqId id)
+{
+    DccMsg::Rsp rsp;
+    return bin_recv(DccMsg::Op::LocoBatch, rsp, end_us, id);
+}
+
+
+Status loco_batch(const LocoUpdate *upd, int cnt, int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = loco_batch_start(upd, cnt, end_us);
+    if (s != Status::Ok)
+        return s;
+    return loco_batch_check(end_us);
+}
+
+
+// loco_list //////////////////////////////////////////////////////////////////
+
+
+Status loco_list_start(int start, int32_t end_us)
+{
+    if (start < 0 || start > UINT16_MAX)
+        return Status::Error;
+    blk_reclaim();
+    DccMsg::Buf msg;
+    msg.req.op = DccMsg::Op::LocoList;
+    msg.req.loco_list.start = start;
+    return bin_send(msg, end_us);
+}
+
+
+Status loco_list_check(LocoStatus *ls, int ls_max, int &cnt, int &more,
+                       int32_t end_us, ReqId id)
+{
+    DccMsg::Rsp rsp;
+    Status s;
+    const DccMsg::LocoStatus *blk = (const DccMsg::LocoStatus *)bin_recv_blk(
+        DccMsg::Op::LocoList, rsp, end_us, id, s);
+    if (blk == nullptr)
+        return s;
+    if (s == Status::Ok) {
+        const int n = rsp.blk.len / sizeof(DccMsg::LocoStatus);
+        cnt = (n < ls_max) ? n : ls_max;
+        more = rsp.blk.more + (n - cnt);
+        for (int i = 0; i < cnt; i++) {
+            ls[i].addr = blk[i].addr;
+            ls[i].speed = blk[i].speed;
+            for (int f = 0; f <= DccPkt::function_max; f++)
+                ls[i].func[f] = (blk[i].func[f / 8] >> (f % 8)) & 1;
+        }
+    }
+    rsp_blk_pool.release(rsp.blk.handle);
+    return s;
+}
+
+
+Status loco_list(LocoStatus *ls, int ls_max, int &cnt, int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    cnt = 0;
+    int more;
+    do {
+        int n;
+        Status s = loco_list_start(cnt, end_us);
+        if (s != Status::Ok)
+            return s;
+        s = loco_list_check(ls + cnt, ls_max - cnt, n, more, end_us);
+        if (s != Status::Ok)
+            return s;
+        cnt += n;
+    } while (more > 0 && cnt < ls_max);
+    return Status::Ok;
+}
+
+
+// loco_railcom_get ///////////////////////////////////////////////////////////
+
+
+Status loco_railcom_get_start(int addr, int32_t end_us)
+{
+    char req_msg[req_msg_len_max];
+    snprintf(req_msg, req_msg_len_max, "L %d R G", addr);
+    return req_send(req_msg, end_us);
+}
+
+
+Status loco_railcom_get_check(int &full, int &partial, int &rejected,
+                              int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    return sscanf(rsp_msg, "OK %d %d %d", &full, &partial, &rejected) == 3
+               ? Status::Ok
+               : Status::Error;
+}
+
+
+Status loco_railcom_get(int addr, int &full, int &partial, int &rejected,
+                        int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = loco_railcom_get_start(addr, end_us);
+    if (s != Status::Ok)
+        return s;
+    return loco_railcom_get_check(full, partial, rejected, end_us);
+}
+
+
+// railcom stats in a block ///////////////////////////////////////////////////
+
+
+// All the counters for a loco, or all cutouts (addr 0)
+static Status rc_stats_start(int addr, int32_t end_us)
+{
+    blk_reclaim();
+    DccMsg::Buf msg;
+    msg.req.op = DccMsg::Op::RailComStats;
+    msg.req.loco.addr = addr;
+    return bin_send(msg, end_us);
+}
+
+
+static Status rc_stats_check(RailComStats &stats, int32_t end_us, ReqId id)
+{
+    DccMsg::Rsp rsp;
+    Status s;
+    const void *blk =
+        bin_recv_blk(DccMsg::Op::RailComStats, rsp, end_us, id, s);
+    if (blk == nullptr)
+        return s;
+    if (s == Status::Ok && rsp.blk.len == sizeof(RailComStats))
+        memcpy(&stats, blk, sizeof(RailComStats));
+    else
+        s = Status::Error;
+    rsp_blk_pool.release(rsp.blk.handle);
+    return s;
+}
+
+
+// loco_railcom_stat_get //////////////////////////////////////////////////////
+
+
+Status loco_railcom_stat_get_start(int addr, int stat, int32_t end_us)
+{
+    char req_msg[req_msg_len_max];
+    snprintf(req_msg, req_msg_len_max, "L %d R G %d", addr, stat);
+    return req_send(req_msg, end_us);
+}
+
+
+Status loco_railcom_stat_get_check(uint32_t &stat_val, int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    unsigned long v;
+    if (sscanf(rsp_msg, "OK %lu", &v) != 1)
+        return Status::Error;
+    stat_val = v;
+    return Status::Ok;
+}
+
+
+Status loco_railcom_stat_get(int addr, int stat, uint32_t &stat_val,
+                             int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = loco_railcom_stat_get_start(addr, stat, end_us);
+    if (s != Status::Ok)
+        return s;
+    return loco_railcom_stat_get_check(stat_val, end_us);
+}
+
+
+// loco_railcom_stats_get /////////////////////////////////////////////////////
+
+
+Status loco_railcom_stats_get_start(int addr, int32_t end_us)
+{
+    if (addr < DccPkt::address_min || addr > DccPkt::address_max)
+        return Status::Error; // (0 would be all cutouts)
+    return rc_stats_start(addr, end_us);
+}
+
+
+Status loco_railcom_stats_get_check(RailComStats &stats, int32_t end_us,
+                                    ReqId id)
+{
+    return rc_stats_check(stats, end_us, id);
+}
+
+
+Status loco_railcom_stats_get(int addr, RailComStats &stats,
+                              int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = loco_railcom_stats_get_start(addr, end_us);
+    if (s != Status::Ok)
+        return s;
+    return loco_railcom_stats_get_check(stats, end_us);
+}
+
+
+// loco_dyn_get ///////////////////////////////////////////////////////////////
+
+
+Status loco_dyn_get_start(int addr, int dyn_id, int32_t end_us)
+{
+    DccMsg::Buf msg;
+    msg.req.op = DccMsg::Op::LocoDynGet;
+    msg.req.loco_dyn = {uint16_t(addr), uint8_t(dyn_id), 0, 0};
+    return bin_send(msg, end_us);
+}
+
+
+Status loco_dyn_get_check(int &dyn_val, int &age_ms, int32_t end_us, ReqId id)
+{
+    DccMsg::Rsp rsp;
+    Status s = bin_recv(DccMsg::Op::LocoDynGet, rsp, end_us, id);
+    if (s != Status::Ok)
+        return s;
+    dyn_val = rsp.loco_dyn.dyn_val;
+    age_ms = rsp.loco_dyn.age_ms;
+    return Status::Ok;
+}
+
+
+Status loco_dyn_get(int addr, int dyn_id, int &dyn_val, int &age_ms,
+                    int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = loco_dyn_get_start(addr, dyn_id, end_us);
+    if (s != Status::Ok)
+        return s;
+    return loco_dyn_get_check(dyn_val, age_ms, end_us);
+}
+
+
+// loco_dyn_report ////////////////////////////////////////////////////////////
+
+
+Status loco_dyn_report_start(int addr, int dyn_id, bool on, int min_ms,
+                             int32_t end_us)
 {
     char req_msg[req_msg_len_max];
-    snprintf(req_msg, req_msg_len_max, "L %d S S %d", addr, speed);
+    snprintf(req_msg, req_msg_len_max, "L %d Y %d R %d %d", addr, dyn_id, on,
+             min_ms);
     return req_send(req_msg, end_us);
 }
 
 
-Status loco_speed_set_check(int32_t end_us)
+Status loco_dyn_report_check(int32_t end_us, ReqId id)
 {
     char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    Status s = rsp_recv(id, rsp_msg, end_us);
     if (s != Status::Ok)
         return s;
     return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
 }
 
 
-Status loco_speed_set(int addr, int speed, int32_t timeout_us)
+Status loco_dyn_report(int addr, int dyn_id, bool on, int min_ms,
+                       int32_t timeout_us)
 {
     int32_t end_us = time_us_32() + timeout_us;
-    Status s = loco_speed_set_start(addr, speed, end_us);
+    Status s = loco_dyn_report_start(addr, dyn_id, on, min_ms, end_us);
     if (s != Status::Ok)
         return s;
-    return loco_speed_set_check(end_us);
+    return loco_dyn_report_check(end_us);
+}
+
+
+bool loco_dyn_event(const char *not_msg, int &addr, int &dyn_id, int &dyn_val,
+                    int &time_ms)
+{
+    return sscanf(DccMsg::text(not_msg), "L %d Y %d V %d T %d", &addr, &dyn_id,
+                  &dyn_val, &time_ms) == 4;
+}
+
+
+// loco_ops_tune_get //////////////////////////////////////////////////////////
+
+
+Status loco_ops_tune_get_start(int addr, int32_t end_us)
+{
+    char req_msg[req_msg_len_max];
+    snprintf(req_msg, req_msg_len_max, "L %d O G", addr);
+    return req_send(req_msg, end_us);
+}
+
+
+Status loco_ops_tune_get_check(int &send_cnt, int &lockout, int &read_ms,
+                               int &read_max_ms, int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    return sscanf(rsp_msg, "OK %d %d %d %d", &send_cnt, &lockout, &read_ms,
+                  &read_max_ms) == 4
+               ? Status::Ok
+               : Status::Error;
+}
+
+
+Status loco_ops_tune_get(int addr, int &send_cnt, int &lockout, int &read_ms,
+                         int &read_max_ms, int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = loco_ops_tune_get_start(addr, end_us);
+    if (s != Status::Ok)
+        return s;
+    return loco_ops_tune_get_check(send_cnt, lockout, read_ms, read_max_ms,
+                                   end_us);
+}
+
+
+// loco_ops_tune_set //////////////////////////////////////////////////////////
+
+
+Status loco_ops_tune_set_start(int addr, bool on, int32_t end_us)
+{
+    char req_msg[req_msg_len_max];
+    snprintf(req_msg, req_msg_len_max, "L %d O S %d", addr, on);
+    return req_send(req_msg, end_us);
+}
+
+
+Status loco_ops_tune_set_check(int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
+}
+
+
+Status loco_ops_tune_set(int addr, bool on, int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = loco_ops_tune_set_start(addr, on, end_us);
+    if (s != Status::Ok)
+        return s;
+    return loco_ops_tune_set_check(end_us);
 }
 
 
@@ -653,10 +1557,10 @@ Status loco_cv_val_get_start(int addr, int cv_num, int32_t end_us)
 }
 
 
-Status loco_cv_val_get_check(int &cv_val, int32_t end_us)
+Status loco_cv_val_get_check(int &cv_val, int32_t end_us, ReqId id)
 {
     char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    Status s = rsp_recv(id, rsp_msg, end_us);
     if (s != Status::Ok)
         return s;
     return sscanf(rsp_msg, "OK %d", &cv_val) == 1 ? Status::Ok : Status::Error;
@@ -687,10 +1591,10 @@ Status loco_cv_val_set_start(int addr, int cv_num, int cv_val, int32_t end_us)
 }
 
 
-Status loco_cv_val_set_check(int32_t end_us)
+Status loco_cv_val_set_check(int32_t end_us, ReqId id)
 {
     char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    Status s = rsp_recv(id, rsp_msg, end_us);
     if (s != Status::Ok)
         return s;
     return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
@@ -723,10 +1627,10 @@ Status loco_cv_bit_set_start(int addr, int cv_num, int b_num, int b_val,
 }
 
 
-Status loco_cv_bit_set_check(int32_t end_us)
+Status loco_cv_bit_set_check(int32_t end_us, ReqId id)
 {
     char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    Status s = rsp_recv(id, rsp_msg, end_us);
     if (s != Status::Ok)
         return s;
     return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
@@ -747,6 +1651,326 @@ Status loco_cv_bit_set(int addr, int cv_num, int b_num, int b_val, int attempts)
 }
 
 
+// loco_cv_val_get_queue //////////////////////////////////////////////////////
+
+
+Status loco_cv_val_get_queue_start(int addr, int cv_num, int id, int32_t end_us)
+{
+    char req_msg[req_msg_len_max];
+    snprintf(req_msg, req_msg_len_max, "L %d C %d G %d", addr, cv_num, id);
+    return req_send(req_msg, end_us);
+}
+
+
+Status loco_cv_val_get_queue_check(int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
+}
+
+
+Status loco_cv_val_get_queue(int addr, int cv_num, int id, int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = loco_cv_val_get_queue_start(addr, cv_num, id, end_us);
+    if (s != Status::Ok)
+        return s;
+    return loco_cv_val_get_queue_check(end_us);
+}
+
+
+// loco_cv_val_set_queue //////////////////////////////////////////////////////
+
+
+Status loco_cv_val_set_queue_start(int addr, int cv_num, int cv_val, int id,
+                                   int32_t end_us)
+{
+    char req_msg[req_msg_len_max];
+    snprintf(req_msg, req_msg_len_max, "L %d C %d S %d %d", addr, cv_num,
+             cv_val, id);
+    return req_send(req_msg, end_us);
+}
+
+
+Status loco_cv_val_set_queue_check(int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
+}
+
+
+Status loco_cv_val_set_queue(int addr, int cv_num, int cv_val, int id,
+                             int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = loco_cv_val_set_queue_start(addr, cv_num, cv_val, id, end_us);
+    if (s != Status::Ok)
+        return s;
+    return loco_cv_val_set_queue_check(end_us);
+}
+
+
+// loco_cv_bit_set_queue //////////////////////////////////////////////////////
+
+
+Status loco_cv_bit_set_queue_start(int addr, int cv_num, int b_num, int b_val,
+                                   int id, int32_t end_us)
+{
+    char req_msg[req_msg_len_max];
+    snprintf(req_msg, req_msg_len_max, "L %d C %d B %d S %d %d", addr, cv_num,
+             b_num, b_val, id);
+    return req_send(req_msg, end_us);
+}
+
+
+Status loco_cv_bit_set_queue_check(int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
+}
+
+
+Status loco_cv_bit_set_queue(int addr, int cv_num, int b_num, int b_val,
+                             int id, int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s =
+        loco_cv_bit_set_queue_start(addr, cv_num, b_num, b_val, id, end_us);
+    if (s != Status::Ok)
+        return s;
+    return loco_cv_bit_set_queue_check(end_us);
+}
+
+
+// loco_cv_result /////////////////////////////////////////////////////////////
+
+
+bool loco_cv_result(const char *not_msg, int &addr, int &id, bool &ok,
+                    int &cv_val, int &time_ms)
+{
+    not_msg = DccMsg::text(not_msg);
+    if (sscanf(not_msg, "L %d C %d V %d T %d", &addr, &id, &cv_val,
+               &time_ms) == 4) {
+        ok = true;
+        return true;
+    }
+
+    if (sscanf(not_msg, "L %d C %d E T %d", &addr, &id, &time_ms) == 3) {
+        ok = false;
+        cv_val = 0;
+        return true;
+    }
+
+    return false;
+}
+
+
+// railcom_addr_cnt_get ///////////////////////////////////////////////////////
+
+
+Status railcom_addr_cnt_get_start(int32_t end_us)
+{
+    const char req_msg[req_msg_len_max] = "R A G";
+    return req_send(req_msg, end_us);
+}
+
+
+Status railcom_addr_cnt_get_check(int &cnt, int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    return sscanf(rsp_msg, "OK %d", &cnt) == 1 ? Status::Ok : Status::Error;
+}
+
+
+Status railcom_addr_cnt_get(int &cnt, int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = railcom_addr_cnt_get_start(end_us);
+    if (s != Status::Ok)
+        return s;
+    return railcom_addr_cnt_get_check(cnt, end_us);
+}
+
+
+// railcom_addr_get ///////////////////////////////////////////////////////////
+
+
+Status railcom_addr_get_start(int idx, int32_t end_us)
+{
+    char req_msg[req_msg_len_max];
+    snprintf(req_msg, req_msg_len_max, "R A G %d", idx);
+    return req_send(req_msg, end_us);
+}
+
+
+Status railcom_addr_get_check(int &addr, int &conf, int &age_ms,
+                              int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    return sscanf(rsp_msg, "OK %d %d %d", &addr, &conf, &age_ms) == 3
+               ? Status::Ok
+               : Status::Error;
+}
+
+
+Status railcom_addr_get(int idx, int &addr, int &conf, int &age_ms,
+                        int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = railcom_addr_get_start(idx, end_us);
+    if (s != Status::Ok)
+        return s;
+    return railcom_addr_get_check(addr, conf, age_ms, end_us);
+}
+
+
+// railcom_addr_report ////////////////////////////////////////////////////////
+
+
+Status railcom_addr_report_start(bool on, int32_t end_us)
+{
+    char req_msg[req_msg_len_max];
+    snprintf(req_msg, req_msg_len_max, "R A R %d", on);
+    return req_send(req_msg, end_us);
+}
+
+
+Status railcom_addr_report_check(int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
+}
+
+
+Status railcom_addr_report(bool on, int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = railcom_addr_report_start(on, end_us);
+    if (s != Status::Ok)
+        return s;
+    return railcom_addr_report_check(end_us);
+}
+
+
+bool railcom_addr_event(const char *not_msg, int &addr, bool &present)
+{
+    int p;
+    if (sscanf(DccMsg::text(not_msg), "R A %d %d", &addr, &p) != 2 ||
+        (p != 0 && p != 1))
+        return false;
+    present = (p == 1);
+    return true;
+}
+
+
+// railcom_stat_get ///////////////////////////////////////////////////////////
+
+
+Status railcom_stat_get_start(int stat, int32_t end_us)
+{
+    char req_msg[req_msg_len_max];
+    snprintf(req_msg, req_msg_len_max, "R S G %d", stat);
+    return req_send(req_msg, end_us);
+}
+
+
+Status railcom_stat_get_check(uint32_t &stat_val, int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    unsigned long v;
+    if (sscanf(rsp_msg, "OK %lu", &v) != 1)
+        return Status::Error;
+    stat_val = v;
+    return Status::Ok;
+}
+
+
+Status railcom_stat_get(int stat, uint32_t &stat_val, int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = railcom_stat_get_start(stat, end_us);
+    if (s != Status::Ok)
+        return s;
+    return railcom_stat_get_check(stat_val, end_us);
+}
+
+
+// railcom_stats_get //////////////////////////////////////////////////////////
+
+
+Status railcom_stats_get_start(int32_t end_us)
+{
+    return rc_stats_start(0, end_us);
+}
+
+
+Status railcom_stats_get_check(RailComStats &stats, int32_t end_us, ReqId id)
+{
+    return rc_stats_check(stats, end_us, id);
+}
+
+
+Status railcom_stats_get(RailComStats &stats, int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = railcom_stats_get_start(end_us);
+    if (s != Status::Ok)
+        return s;
+    return railcom_stats_get_check(stats, end_us);
+}
+
+
+// railcom_stats_reset ////////////////////////////////////////////////////////
+
+
+Status railcom_stats_reset_start(int32_t end_us)
+{
+    const char req_msg[req_msg_len_max] = "R S S 0";
+    return req_send(req_msg, end_us);
+}
+
+
+Status railcom_stats_reset_check(int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
+}
+
+
+Status railcom_stats_reset(int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = railcom_stats_reset_start(end_us);
+    if (s != Status::Ok)
+        return s;
+    return railcom_stats_reset_check(end_us);
+}
+
+
 // debug_get //////////////////////////////////////////////////////////////////
 
 
@@ -758,10 +1982,10 @@ Status debug_get_start(int code, int32_t end_us)
 }
 
 
-Status debug_get_check(int &val, int32_t end_us)
+Status debug_get_check(int &val, int32_t end_us, ReqId id)
 {
     char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    Status s = rsp_recv(id, rsp_msg, end_us);
     if (s != Status::Ok)
         return s;
     return sscanf(rsp_msg, "OK %d", &val) == 1 ? Status::Ok : Status::Error;
@@ -789,10 +2013,10 @@ Status debug_set_start(int code, int val, int32_t end_us)
 }
 
 
-Status debug_set_check(int32_t end_us)
+Status debug_set_check(int32_t end_us, ReqId id)
 {
     char rsp_msg[rsp_msg_len_max];
-    Status s = rsp_recv(rsp_msg, end_us);
+    Status s = rsp_recv(id, rsp_msg, end_us);
     if (s != Status::Ok)
         return s;
     return strncmp(rsp_msg, "OK", 2) == 0 ? Status::Ok : Status::Error;
@@ -809,4 +2033,49 @@ Status debug_set(int code, int val, int32_t timeout_us)
 }
 
 
+// lat_get ////////////////////////////////////////////////////////////////////
+
+
+Status lat_get_start(DccLat::Kind kind, DccLat::Stage stage, int32_t end_us)
+{
+    char req_msg[req_msg_len_max];
+    snprintf(req_msg, req_msg_len_max, "D %d G %d", 10 + int(kind),
+             int(stage));
+    return req_send(req_msg, end_us);
+}
+
+
+Status lat_get_check(LatStats &lat, int32_t end_us, ReqId id)
+{
+    char rsp_msg[rsp_msg_len_max];
+    Status s = rsp_recv(id, rsp_msg, end_us);
+    if (s != Status::Ok)
+        return s;
+    unsigned long cnt, p50_us, p99_us, max_us, missed;
+    if (sscanf(rsp_msg, "OK %lu %lu %lu %lu %lu", &cnt, &p50_us, &p99_us,
+               &max_us, &missed) != 5)
+        return Status::Error;
+    lat = {uint32_t(cnt), uint32_t(p50_us), uint32_t(p99_us),
+           uint32_t(max_us), uint32_t(missed)};
+    return Status::Ok;
+}
+
+
+Status lat_get(DccLat::Kind kind, DccLat::Stage stage, LatStats &lat,
+               int32_t timeout_us)
+{
+    int32_t end_us = time_us_32() + timeout_us;
+    Status s = lat_get_start(kind, stage, end_us);
+    if (s != Status::Ok)
+        return s;
+    return lat_get_check(lat, end_us);
+}
+
+
+Status lat_reset(int32_t timeout_us)
+{
+    return debug_set(10, 0, timeout_us);
+}
+
+
 } // namespace DccApi
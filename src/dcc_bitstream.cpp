@@ -7,6 +7,8 @@
 #include "hardware/clocks.h"
 #include "hardware/gpio.h"
 #include "hardware/pwm.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
 #include "hardware/uart.h"
 // misc
 #include "misc/pwm_extra.h"
@@ -62,12 +64,15 @@ DccBitstream::DccBitstream(DccCommand &command, int sig_gpio, int pwr_gpio,
     _command(command),
     _railcom(uart, rc_gpio),
     _pwr_gpio(pwr_gpio),
+    _sent_cnt(0),
     _preamble_bits(DccPkt::ops_preamble_bits),
     _slice(pwm_gpio_to_slice_num(sig_gpio)),
     _channel(pwm_gpio_to_channel(sig_gpio)),
     _byte_num(INT_MAX), // set in start_*()
     _bit_num(INT_MAX),  // set in start_*()
-    _use_railcom(false)
+    _use_railcom(false),
+    _pwr_off(false),
+    _irq_lat{0, 0, 0}
 {
     // Do not do PWM setup here since this might be a static object, and
     // other stuff is not fully initialized. In particular, clock_get_hz()
@@ -126,6 +131,7 @@ void DccBitstream::start(int preamble_bits, bool cutout)
 
     _preamble_bits = preamble_bits;
     _use_railcom = cutout;
+    _pwr_off = false;
 
     // first packet starts with preamble (no cutout, whether enabled or not)
     _byte_num = byte_num_preamble;
@@ -161,6 +167,17 @@ void DccBitstream::stop()
 } // void DccBitstream::stop()
 
 
+// The enable channel level set here is double-buffered like everything else,
+// so turning power off cuts the track at the end of the current bit. Turning
+// it back on waits for the next prog_bit() (the cutout stays off).
+void DccBitstream::power(bool on) // called in interrupt context
+{
+    _pwr_off = !on;
+    if (_pwr_off)
+        pwm_set_chan_level(_slice, 1 - _channel, 0);
+}
+
+
 // Called from start(), then the PWM IRQ handler in response to the end of
 // each bit. When this is called, a new bit has already started. Programming
 // in here affects the next bit, the one that will start at the next
@@ -192,8 +209,9 @@ void DccBitstream::next_bit() // called in interrupt context
             // first bit, power is on for a quarter bit time
             prog_bit_cutout_start();
             _bit_num--;
-            // reset uart in case it got glitched
-            _railcom.reset();
+            // The packet end bit has just started; the cutout starts when it
+            // ends, one bit time from now. Railcom timing is from there.
+            _railcom.cutout_start(time_us_32() + 2 * DccSpec::t1_nom_us);
         } else if (_bit_num > 0) {
             // continue cutout
             prog_bit_cutout();
@@ -220,7 +238,7 @@ void DccBitstream::next_bit() // called in interrupt context
                     if (b != nullptr) {
                         char *e = b + BufLog::line_len;
                         b += snprintf(b, e - b, ">> ");
-                        _current2.show(b, e - b);
+                        current().show(b, e - b);
                         BufLog::write_line_put();
                     }
                 }
@@ -238,13 +256,12 @@ void DccBitstream::next_bit() // called in interrupt context
                             BufLog::write_line_put();
                         }
                     }
-                    // _current2 changes at the end of the preamble
-                    DccLoco *loco = _current2.get_loco();
-                    if (loco != nullptr) {
-                        const RailComMsg *msg;
-                        int msg_cnt = _railcom.get_ch2_msgs(msg);
-                        loco->railcom(msg, msg_cnt);
-                    }
+                    // current() is still the packet before the cutout (the
+                    // next one is started at the end of the preamble)
+                    const DccPkt2 &pkt = current();
+                    DccLoco *loco = pkt.get_loco();
+                    if (loco != nullptr)
+                        loco->railcom(_railcom, pkt.get_req_id());
                 }
             }
             _bit_num--;
@@ -255,14 +272,15 @@ void DccBitstream::next_bit() // called in interrupt context
             _byte_num = 0; // first data byte
             _bit_num = 7;  // data goes msb first
             // get the next packet to send from DccCommand
-            _command.get_packet(_current2);
+            _command.get_packet(_sent[_sent_cnt & (sent_max - 1)]);
+            _sent_cnt++;
         }
     } else {
         assert(0 <= _byte_num);
         // _bit_num can be more than 7 when sending preamble, but not here
         assert(-1 <= _bit_num && _bit_num <= 7);
         // sending message bytes; _byte_num counts 0...msg_len-1
-        int msg_len = _current2.len();
+        int msg_len = current().len();
         assert(_byte_num < msg_len);
         // _bit_num = 7...0, then -1 means stop bit
         if (_bit_num == -1) {
@@ -288,7 +306,13 @@ void DccBitstream::next_bit() // called in interrupt context
             }
         } else {
             assert(0 <= _bit_num && _bit_num <= 7);
-            int b = (_current2.data(_byte_num) >> _bit_num) & 1;
+            if (_byte_num == 0 && _bit_num == 7) {
+                // the packet's start bit just started (latency, dcc_lat.h)
+                DccLoco *loco = current().get_loco();
+                if (loco != nullptr)
+                    loco->lat_on_track();
+            }
+            int b = (current().data(_byte_num) >> _bit_num) & 1;
             prog_bit(b);
             _bit_num--;
         }
@@ -310,5 +334,29 @@ void DccBitstream::pwm_handler(intptr_t arg) // called in interrupt context
 {
     DccBitstream *me = (DccBitstream *)arg;
 
+    // the counter is usec since the bit started (PWM wrap)
+    const uint32_t us = pwm_get_counter(me->_slice);
+    me->_irq_lat.cnt++;
+    me->_irq_lat.us += us;
+    if (us > me->_irq_lat.us_max)
+        me->_irq_lat.us_max = us;
+
     me->next_bit();
 }
+
+
+DccBitstream::IrqLat DccBitstream::irq_lat() const
+{
+    uint32_t save = save_and_disable_interrupts();
+    IrqLat lat = _irq_lat;
+    restore_interrupts(save);
+    return lat;
+}
+
+
+void DccBitstream::irq_lat_reset()
+{
+    uint32_t save = save_and_disable_interrupts();
+    _irq_lat = {0, 0, 0};
+    restore_interrupts(save);
+}
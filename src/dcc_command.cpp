@@ -7,11 +7,13 @@
 
 #include "misc/buf_log.h"
 #include "dcc/dcc_adc.h"
+#include "dcc/dcc_adc_trace.h"
 #include "dcc/dcc_bitstream.h"
 #include "dcc/dcc_loco.h"
 #include "dcc/dcc_pkt.h"
 #include "dcc/dcc_spec.h"
 #include "hardware/gpio.h"
+#include "hardware/sync.h"
 #include "hardware/timer.h"
 #include "hardware/uart.h"
 
@@ -24,6 +26,10 @@ DccCommand::DccCommand(int sig_gpio, int pwr_gpio, int slp_gpio, DccAdc *adc,
     _mode(Mode::OFF),
     _mode_svc(ModeSvc::NONE),
     _next_loco(_locos.begin()),
+    _trip(),
+    _current_cb(nullptr),
+    _report_ms(0),
+    _report_us(0),
     _svc_status(ERROR),
     _svc_status_next(ERROR),
     _svc_cmd_step(SvcCmdStep::NONE),
@@ -42,7 +48,7 @@ DccCommand::DccCommand(int sig_gpio, int pwr_gpio, int slp_gpio, DccAdc *adc,
         gpio_put(slp_gpio, 1);
         gpio_set_dir(slp_gpio, GPIO_OUT);
     }
-    ack_reset();
+    _ack.reset();
 }
 
 
@@ -63,6 +69,9 @@ void DccCommand::set_mode_off()
     _mode_svc = ModeSvc::NONE;
     _adc->stop();
     _bitstream.stop();
+    _bitstream.railcom().addr_map().clear();
+    for (DccLoco *loco : _locos)
+        loco->lat_clear();
 }
 
 
@@ -70,10 +79,42 @@ void DccCommand::set_mode_ops()
 {
     _mode = Mode::OPS;
     _mode_svc = ModeSvc::NONE;
+    _report_us = time_us_32();
+    _trip.reset(_report_us);
+    _adc->start();
     _bitstream.start_ops();
 }
 
 
+uint16_t DccCommand::track_ma() const
+{
+    if (_mode == Mode::OFF || !_bitstream.power())
+        return 0;
+    return _adc->long_avg_ma();
+}
+
+
+bool DccCommand::trip_config(uint16_t limit_ma, uint32_t retry_ms,
+                             int retry_max)
+{
+    uint32_t s = save_and_disable_interrupts();
+    bool ok = _trip.config(limit_ma, retry_ms, retry_max);
+    restore_interrupts(s);
+    return ok;
+}
+
+
+void DccCommand::trip_reset()
+{
+    uint32_t s = save_and_disable_interrupts();
+    if (_mode == Mode::OPS && !_trip.power()) {
+        _trip.reset(time_us_32());
+        _bitstream.power(true);
+    }
+    restore_interrupts(s);
+}
+
+
 void DccCommand::write_cv(int cv_num, uint8_t cv_val)
 {
     _pkt_svc_write_cv.set_cv(cv_num, cv_val);
@@ -119,6 +160,7 @@ void DccCommand::svc_start()
     assert(_svc_cmd_cnt == 0);
     _svc_cmd_step = SvcCmdStep::RESET1;
     _svc_cmd_cnt = DccSpec::svc_reset1_cnt;
+    _ack.learn_reset();
     _adc->start();
     _bitstream.start_svc();
 }
@@ -149,16 +191,85 @@ bool DccCommand::svc_done(bool &result, uint8_t &val)
 
 void DccCommand::loop() // called in interrupt context
 {
+    if (_mode == Mode::OPS) {
+        loop_ops();
+        return;
+    }
+
     if (_mode != Mode::SVC)
         return;
 
-    // The adc runs at 10 KHz, so there's a new sample every 100 usec. On each
-    // DCC bit (116 or 200 usec), there should usually be at either one or two
-    // samples. But depending on the interrupt timing, maybe there can be none
-    // or more than two.
+    // The adc runs at 10 KHz and the DMA streams samples into a ring, so on
+    // each DCC bit (116 or 200 usec) there are usually one or two new
+    // samples, but there might be none or more than two. The averages are
+    // updated for the whole block before we look at them.
+
+    if (_adc->loop() > 0) {
+        uint16_t ma = _adc->short_avg_ma();
+        // Learn the idle current over the last of the initial resets; the
+        // first ones might include the decoder powering up.
+        if (_svc_cmd_step == SvcCmdStep::RESET1 &&
+            _svc_cmd_cnt <= svc_learn_cnt)
+            _ack.learn(ma);
+        _ack.check(ma);
+    }
+}
+
+
+// Overcurrent check. This is called every bit, and the fast average covers
+// the last few samples, so a short is seen within a few hundred usec. Power
+// off takes effect at the end of the current bit.
+void DccCommand::loop_ops() // called in interrupt context
+{
+    if (_adc->loop() <= 0)
+        return;
 
-    if (_adc->loop() > 0)
-        ack_check(_adc->short_avg_ma());
+    uint32_t now_us = time_us_32();
+
+    DccTrip::Event ev = _trip.check(_adc->fast_avg_ma(), now_us);
+
+    if (ev != DccTrip::Event::None) {
+        CurrentEvent cev;
+        if (ev == DccTrip::Event::Retry) {
+            _bitstream.power(true);
+            cev = CurrentEvent::Retry;
+        } else {
+            _bitstream.power(false);
+            cev = ev == DccTrip::Event::Trip ? CurrentEvent::Trip
+                                             : CurrentEvent::Lockout;
+        }
+        if (_current_cb != nullptr)
+            _current_cb(cev, _adc->fast_avg_ma());
+    }
+
+    if (_report_ms != 0 && (now_us - _report_us) >= (_report_ms * 1000)) {
+        _report_us = now_us;
+        if (_current_cb != nullptr)
+            _current_cb(CurrentEvent::Report, track_ma());
+    }
+}
+
+
+void DccCommand::ack_arm(int verify, int val) // called in interrupt context
+{
+    _ack.arm(_adc->long_avg_ma());
+    if (_adc->logging())
+        _adc->log_mark(DccAdcTrace::mark_win, verify, val);
+}
+
+
+void DccCommand::svc_log_result() // called in interrupt context
+{
+    if (!_adc->logging())
+        return;
+
+    int val = _cv_val;
+    if (_mode_svc == ModeSvc::READ_BIT)
+        val = _cv_val << _verify_bit; // bit in its position
+    else if (_mode_svc != ModeSvc::READ_CV)
+        val = 0;
+
+    _adc->log_mark(DccAdcTrace::mark_res, _svc_status == SUCCESS ? 1 : 0, val);
 }
 
 
@@ -184,7 +295,9 @@ void DccCommand::get_packet_ops(DccPkt2 &pkt2) // called in interrupt context
     if (_next_loco == _locos.end()) {
         pkt2.set(_pkt_idle); // no locos
     } else {
-        pkt2.set((*_next_loco)->next_packet(), *_next_loco);
+        DccLoco *loco = *_next_loco;
+        DccPkt pkt = loco->next_packet();
+        pkt2.set(pkt, loco, loco->last_req_id());
         _next_loco++;
         if (_next_loco == _locos.end())
             _next_loco = _locos.begin();
@@ -210,7 +323,7 @@ void DccCommand::get_packet_svc_write(
             // Done with resets (second-to-last one has just started).
             // The long average adc reading is the baseline for
             // detecting an ack pulse.
-            ack_arm(_adc->long_avg_ma() + ack_inc_ma);
+            ack_arm(DccAdcTrace::verify_write, 0);
             // Next send write command.
             _svc_cmd_step = SvcCmdStep::COMMAND;
             _svc_cmd_cnt = DccSpec::svc_command_cnt;
@@ -265,6 +378,8 @@ void DccCommand::get_packet_svc_write(
         _svc_status_next = SUCCESS;
     }
 
+    svc_log_result();
+
     set_mode_off();
 
     _svc_cmd_step = SvcCmdStep::NONE;
@@ -284,7 +399,8 @@ void DccCommand::get_packet_svc_write(
 //      a. send out 5 bit-verifies (that the bit is one)
 //      b. send out 5 resets
 //      c. and if an ack is received during any of those 10 packets, a one bit
-//         is ORed into _cv_val
+//         is ORed into _cv_val (and if the ack detector learned the noise
+//         floor, the rest of the 10 packets are cut to svc_settle_cnt resets)
 //   3. after the last verify-bit (for bit 0), it sends out five byte-verifies
 //      for the cv with the built-up _cv_val, then five more resets
 //      a. if an ack is received during any of those 10 packets, we are done,
@@ -306,7 +422,7 @@ void DccCommand::get_packet_svc_read_cv(
             // Done with resets (second-to-last one has just started).
             // The long average adc reading is the baseline for
             // detecting an ack pulse.
-            ack_arm(_adc->long_avg_ma() + ack_inc_ma);
+            ack_arm(7, 1);
             // Now start bit-verifies for each bit in the CV.
             _verify_bit = 7;
             _verify_bit_val = 1;
@@ -321,10 +437,16 @@ void DccCommand::get_packet_svc_read_cv(
         if (_verify_bit < 8) {
             // This is an ack for a bit-verify
             _cv_val |= (1 << _verify_bit);
-            // It is probably okay to not send any more bit-verifies for the
-            // current bit and start the resets. It might even be possible to
-            // skip the resets and start the next bit verify. But for now we
-            // just keep going. It could save a few packets per 1-bit someday.
+            // If the threshold came from the learned noise, the ack is
+            // clear; don't send any more bit-verifies for this bit, and send
+            // just enough resets for the pulse to finish before the next
+            // bit. With the fixed threshold, keep going.
+            if (_ack.learned() && !_adc->logging() &&
+                (_svc_cmd_step == SvcCmdStep::COMMAND ||
+                 _svc_cmd_cnt > svc_settle_cnt)) {
+                _svc_cmd_step = SvcCmdStep::RESET2;
+                _svc_cmd_cnt = svc_settle_cnt;
+            }
         } else {
             // This is the ack for the byte-verify at the end
             // Don't send any more packets, and power off.
@@ -359,8 +481,11 @@ void DccCommand::get_packet_svc_read_cv(
             // Get a new long average adc reading and a new ack threshold
             // each time just before sending out the verify packets. The
             // current might not always hold steady through the whole
-            // sequence.
-            ack_arm(_adc->long_avg_ma() + ack_inc_ma);
+            // sequence. After the byte verify, there's nothing coming.
+            if (_verify_bit == 0)
+                ack_arm(DccAdcTrace::verify_byte, _cv_val);
+            else if (_verify_bit <= 7)
+                ack_arm(_verify_bit - 1, 1);
         }
         return;
     }
@@ -405,6 +530,8 @@ void DccCommand::get_packet_svc_read_cv(
         _svc_status_next = SUCCESS;
     }
 
+    svc_log_result();
+
     set_mode_off();
 
     _svc_cmd_step = SvcCmdStep::NONE;
@@ -425,7 +552,7 @@ void DccCommand::get_packet_svc_read_bit(
             // Done with resets (second-to-last one has just started).
             // The long average adc reading is the baseline for
             // detecting an ack pulse.
-            ack_arm(_adc->long_avg_ma() + ack_inc_ma);
+            ack_arm(_verify_bit, 0);
             // Next send bit-verify command.
             _svc_cmd_step = SvcCmdStep::COMMAND;
             _svc_cmd_cnt = DccSpec::svc_command_cnt;
@@ -475,7 +602,8 @@ void DccCommand::get_packet_svc_read_bit(
     // first bit we tried (0) and we didn't get an ack, try verifying a 1.
 
     if (_svc_status_next == IN_PROGRESS && _verify_bit_val == 0) {
-        // tried 0, got no ack, try 1
+        // tried 0, got no ack, try 1 (with a fresh baseline, as in read_cv)
+        ack_arm(_verify_bit, 1);
         _verify_bit_val = 1;
         _pkt_svc_verify_bit.set_bit(_verify_bit, _verify_bit_val);
         pkt2.set(_pkt_svc_verify_bit);
@@ -493,6 +621,8 @@ void DccCommand::get_packet_svc_read_bit(
         _svc_status_next = SUCCESS;
     }
 
+    svc_log_result();
+
     set_mode_off();
 
     _svc_cmd_step = SvcCmdStep::NONE;
@@ -534,6 +664,8 @@ DccLoco *DccCommand::create_loco(int address)
 
 DccLoco *DccCommand::delete_loco(DccLoco *loco)
 {
+    loco->ops_cv_cancel(); // whoever's waiting hears about it
+    loco->lat_clear();     // and changes not out yet are missed
     _locos.remove(loco);
     delete loco;
     restart_locos();
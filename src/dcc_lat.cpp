@@ -0,0 +1,121 @@
+#include "dcc/dcc_lat.h"
+
+#include <cassert>
+#include <cstdint>
+
+#include "hardware/sync.h"
+
+
+void DccLat::Hist::reset()
+{
+    _cnt = 0;
+    _max = 0;
+    for (int b = 0; b < bucket_cnt; b++)
+        _bucket[b] = 0;
+}
+
+
+int DccLat::Hist::bucket(uint32_t us)
+{
+    if (us < exact_max)
+        return us;
+    const int pow = 31 - __builtin_clz(us); // 3 or more
+    if (pow >= pow_max)
+        return bucket_cnt - 1;
+    const int sub = (us >> (pow - 2)) & (sub_cnt - 1);
+    return exact_max + (pow - 3) * sub_cnt + sub;
+}
+
+
+// Biggest time that goes in bucket b (the last one has no top)
+uint32_t DccLat::Hist::bucket_top(int b)
+{
+    assert(0 <= b && b < bucket_cnt);
+    if (b < exact_max)
+        return b;
+    if (b == bucket_cnt - 1)
+        return UINT32_MAX;
+    const int pow = 3 + (b - exact_max) / sub_cnt;
+    const int sub = (b - exact_max) % sub_cnt;
+    return (uint32_t(sub_cnt + sub + 1) << (pow - 2)) - 1;
+}
+
+
+void DccLat::Hist::add(uint32_t us, uint32_t n)
+{
+    _bucket[bucket(us)] += n;
+    _cnt += n;
+    if (us > _max)
+        _max = us;
+}
+
+
+uint32_t DccLat::Hist::pct(int pct) const
+{
+    assert(1 <= pct && pct <= 100);
+    if (_cnt == 0)
+        return 0;
+    // rank of the one we want, 1..._cnt
+    uint64_t rank = (uint64_t(_cnt) * pct + 99) / 100;
+    if (rank == 0)
+        rank = 1;
+    uint64_t sum = 0;
+    for (int b = 0; b < bucket_cnt; b++) {
+        sum += _bucket[b];
+        if (sum >= rank) {
+            const uint32_t top = bucket_top(b);
+            return top < _max ? top : _max;
+        }
+    }
+    return _max; // not reached
+}
+
+
+// The loco has the change (submit and deq times)
+void DccLat::start(const Times &t) // called in interrupt context
+{
+    const int k = int(t.kind);
+    assert(0 <= k && k < kind_cnt);
+    _hist[k][int(Stage::Srv)].add(t.deq_us - t.submit_us);
+}
+
+
+// The packet with the change went out (all times); it stands for n changes
+void DccLat::add(const Times &t, uint32_t n) // called in interrupt context
+{
+    const int k = int(t.kind);
+    assert(0 <= k && k < kind_cnt);
+    _hist[k][int(Stage::Pick)].add(t.pick_us - t.deq_us, n);
+    _hist[k][int(Stage::Track)].add(t.track_us - t.pick_us, n);
+    _hist[k][int(Stage::Whole)].add(t.track_us - t.submit_us, n);
+}
+
+
+void DccLat::miss(Kind kind, uint32_t n) // called in interrupt context
+{
+    assert(int(kind) < kind_cnt);
+    _missed[int(kind)] += n;
+}
+
+
+DccLat::Pct DccLat::get(Kind kind, Stage stage) const
+{
+    assert(int(kind) < kind_cnt && int(stage) < stage_cnt);
+    uint32_t irq = save_and_disable_interrupts();
+    const Hist h = _hist[int(kind)][int(stage)];
+    const uint32_t missed = _missed[int(kind)];
+    restore_interrupts(irq);
+    return {h.cnt(), h.pct(50), h.pct(99), h.max(), missed};
+}
+
+
+void DccLat::reset()
+{
+    uint32_t irq = save_and_disable_interrupts();
+    for (int k = 0; k < kind_cnt; k++) {
+        for (int s = 0; s < stage_cnt; s++)
+            _hist[k][s].reset();
+        _missed[k] = 0;
+    }
+    restore_interrupts(irq);
+}
@@ -7,6 +7,7 @@
 
 #include "misc/buf_log.h"
 #include "dcc/dcc_pkt.h"
+#include "hardware/sync.h"
 #include "hardware/timer.h"
 #include "dcc/railcom_msg.h"
 #include "dcc/railcom_spec.h"
@@ -14,22 +15,41 @@
 DccLoco::DccLoco(int address) :
     _seq(0),
     _pkt_last(nullptr),
-    _read_cv_cnt(0),
-    _write_cv_cnt(0),
-    _write_bit_cnt(0),
-    _set_adrs_cnt(0),
+    _pkt_last_req_id(0),
+    _ops_cv_q_wr(0),
+    _ops_cv_q_rd(0),
+    _ops_cv{OpsCv::None, 0, 0, 0, 0, nullptr, 0, 0, 0},
+    _ops_cv_cnt(0),
     _ops_cv_done(false),
     _ops_cv_status(false),
     _ops_cv_val(0),
-    _ops_cv_cb(nullptr),
-    _ops_cv_next_cb(nullptr),
     _ops_cv_lockout(0),
+    _ops_tune_on(true),
+    _ops_tune{},
+    _ops_tune_run(0),
+    _ops_tune_probe(false),
+    _ops_tune_read_us(0),
+    _ops_req_id(0),
+    _ops_req_id_next(1),
+    _ops_req_sent(0),
     _rc_speed(0),
     _rc_speed_us(UINT64_MAX),
     _show_rc_speed(false),
-    _rc_speed_cb(nullptr)
+    _rc_speed_cb(nullptr),
+    _rc_stats{},
+    _dyn_valid(0),
+    _dyn_chg(0),
+    _dyn_sub(0),
+    _dyn_cb(nullptr),
+    _lat(nullptr),
+    _lat_pend{},
+    _lat_fly{},
+    _lat_picked(false),
+    _lat_pick_us(0),
+    _lat_rand(0x9e3779b9u ^ uint32_t(address))
 {
     set_address(address);
+    ops_tune_set(true);
 }
 
 DccLoco::~DccLoco()
@@ -178,42 +198,230 @@ void DccLoco::set_function(int num, bool on)
 }
 
 // ops mode cv access
+//
+// read_cv() etc. run in thread context and add to the queue; next_packet()
+// (interrupt context) takes the next one off when nothing is in progress.
+
+bool DccLoco::ops_cv_add(const OpsCvReq &req)
+{
+    uint32_t save = save_and_disable_interrupts();
+    bool ok = (_ops_cv_q_wr - _ops_cv_q_rd) < uint32_t(ops_cv_q_max);
+    if (ok) {
+        _ops_cv_q[_ops_cv_q_wr % ops_cv_q_max] = req;
+        _ops_cv_q[_ops_cv_q_wr % ops_cv_q_max].start_us = time_us_32();
+        _ops_cv_q_wr++;
+        _ops_cv_done = false;
+        _ops_cv_status = false;
+    }
+    restore_interrupts(save);
+    return ok;
+}
 
-void DccLoco::read_cv(int cv_num, OpsCvCb *cb)
+bool DccLoco::read_cv(int cv_num, OpsCvCb *cb, uint16_t id)
 {
-    _pkt_read_cv.set_cv(cv_num);
-    _ops_cv_done = false;
-    _ops_cv_status = false;
-    // +1 because when it decrements to zero it's an error
-    _read_cv_cnt = read_cv_send_cnt + 1;
-    _ops_cv_next_cb = cb;
+    return ops_cv_add({OpsCv::ReadCv, uint16_t(cv_num), 0, 0, 0, cb, id, 0, 0});
+}
+
+bool DccLoco::write_cv(int cv_num, uint8_t cv_val, OpsCvCb *cb, uint16_t id)
+{
+    return ops_cv_add(
+        {OpsCv::WriteCv, uint16_t(cv_num), cv_val, 0, 0, cb, id, 0, 0});
+}
+
+bool DccLoco::write_bit(int cv_num, int bit_num, int bit_val, OpsCvCb *cb,
+                        uint16_t id)
+{
+    return ops_cv_add({OpsCv::WriteBit, uint16_t(cv_num), uint8_t(bit_val),
+                       uint8_t(bit_num), 0, cb, id, 0, 0});
+}
+
+bool DccLoco::set_adrs_new(int adrs_new, OpsCvCb *cb, uint16_t id)
+{
+    return ops_cv_add({OpsCv::SetAdrs, 0, 0, 0, adrs_new, cb, id, 0, 0});
+}
+
+int DccLoco::ops_cv_pending() const
+{
+    uint32_t save = save_and_disable_interrupts();
+    int cnt = _ops_cv_q_wr - _ops_cv_q_rd;
+    if (_ops_cv.op != OpsCv::None)
+        cnt++;
+    restore_interrupts(save);
+    return cnt;
+}
+
+void DccLoco::ops_cv_cancel()
+{
+    uint32_t save = save_and_disable_interrupts();
+    const uint32_t now_us = time_us_32();
+    if (_ops_cv.op != OpsCv::None) {
+        if (_ops_cv.cb != nullptr)
+            _ops_cv.cb(this, {_ops_cv.id, false, 0, now_us - _ops_cv.start_us});
+        _ops_cv.op = OpsCv::None;
+        _ops_req_id = 0;
+    }
+    while (_ops_cv_q_rd != _ops_cv_q_wr) {
+        const OpsCvReq &req = _ops_cv_q[_ops_cv_q_rd % ops_cv_q_max];
+        _ops_cv_q_rd++;
+        if (req.cb != nullptr)
+            req.cb(this, {req.id, false, 0, now_us - req.start_us});
+    }
+    restore_interrupts(save);
+}
+
+// Start the next queued cv access, if there is one
+void DccLoco::ops_cv_next() // called in interrupt context
+{
+    if (_ops_cv_q_rd == _ops_cv_q_wr)
+        return;
+
+    _ops_cv = _ops_cv_q[_ops_cv_q_rd % ops_cv_q_max];
+    _ops_cv_q_rd++;
+
+    if (_ops_cv.op == OpsCv::ReadCv) {
+        _pkt_read_cv.set_cv(_ops_cv.cv_num);
+    } else if (_ops_cv.op == OpsCv::WriteCv) {
+        _pkt_write_cv.set_cv(_ops_cv.cv_num, _ops_cv.cv_val);
+    } else if (_ops_cv.op == OpsCv::WriteBit) {
+        _pkt_write_bit.set_cv_bit(_ops_cv.cv_num, _ops_cv.bit_num,
+                                  _ops_cv.cv_val);
+    } else {
+        assert(_ops_cv.op == OpsCv::SetAdrs);
+        _pkt_set_adrs.set_adrs_new(_ops_cv.adrs_new);
+    }
+
+    // Send count is +1 because when it decrements to zero there was no
+    // response, and the access failed.
+    _ops_cv_cnt = _ops_tune.send_cnt + 1;
+    _ops_cv.send_us = time_us_32();
+
+    // Each access gets a new request ID; its packets are tagged with it so
+    // a response can be matched to it (see next_packet())
+    _ops_req_id = _ops_req_id_next++;
+    if (_ops_req_id_next == 0)
+        _ops_req_id_next = 1; // 0 means no request
+    _ops_req_sent = 0;
+}
+
+// The cv access in progress is done, with a response or not
+void DccLoco::ops_cv_end(bool success,
+                         uint8_t cv_val) // called in interrupt context
+{
+    _ops_cv_done = true;
+    _ops_cv_status = success;
+    _ops_cv_val = cv_val;
+
+    ops_tune_end(success);
+
+    if (success && _ops_cv.op != OpsCv::ReadCv) {
+        _ops_cv_lockout = _ops_tune.lockout;
+        _ops_tune_probe = true; // the next access (if right away) tells
+    }
+
+    if (_ops_cv.cb != nullptr) {
+        OpsCvDone done = {_ops_cv.id, success, cv_val,
+                          time_us_32() - _ops_cv.start_us};
+        _ops_cv.cb(this, done);
+    }
+
+    _ops_cv.op = OpsCv::None;
+    _ops_req_id = 0;
 }
 
-void DccLoco::write_cv(int cv_num, uint8_t cv_val, OpsCvCb *cb)
+// Tuning, for the cv access in progress just ending (see ops_tune_get())
+void DccLoco::ops_tune_end(bool success) // called in interrupt context
 {
-    _pkt_write_cv.set_cv(cv_num, cv_val);
-    _ops_cv_done = false;
-    _ops_cv_status = false;
-    _write_cv_cnt = write_cv_send_cnt;
-    _ops_cv_next_cb = cb;
+    OpsTune &t = _ops_tune;
+
+    if (success) {
+        t.ok++;
+        if (_ops_cv.op == OpsCv::ReadCv) {
+            uint32_t read_us = time_us_32() - _ops_cv.send_us;
+            t.read_cnt++;
+            _ops_tune_read_us += read_us;
+            t.read_us_avg = _ops_tune_read_us / t.read_cnt;
+            if (read_us > t.read_us_max)
+                t.read_us_max = read_us;
+        }
+    } else {
+        t.fail++;
+    }
+
+    if (!_ops_tune_on) {
+        _ops_tune_probe = false;
+        return;
+    }
+
+    // packets it usually takes, rounded up
+    const int rsp_pkts = (t.rsp_pkts_16 + 15) / 16;
+
+    if (_ops_tune_probe) {
+        // first access after a write's lockout: answered as soon as usual?
+        if (success && _ops_req_sent <= rsp_pkts) {
+            if (t.lockout > 0)
+                t.lockout--;
+        } else {
+            t.lockout += 4;
+            if (t.lockout > ops_lockout_max)
+                t.lockout = ops_lockout_max;
+        }
+        _ops_tune_probe = false;
+    }
+
+    if (success) {
+        // average moves a quarter of the way to this one
+        t.rsp_pkts_16 += (_ops_req_sent * 16 - int(t.rsp_pkts_16)) / 4;
+        if (++_ops_tune_run >= ops_tune_run) {
+            _ops_tune_run = 0;
+            int send_cnt = (t.rsp_pkts_16 + 15) / 16 + 1; // one spare
+            if (send_cnt < ops_send_cnt_min)
+                send_cnt = ops_send_cnt_min;
+            if (t.send_cnt > send_cnt)
+                t.send_cnt--;
+        }
+    } else {
+        _ops_tune_run = 0;
+        t.send_cnt += 2;
+        if (t.send_cnt > ops_send_cnt_max)
+            t.send_cnt = ops_send_cnt_max;
+    }
+
+} // DccLoco::ops_tune_end
+
+
+DccLoco::OpsTune DccLoco::ops_tune_get() const
+{
+    uint32_t save = save_and_disable_interrupts();
+    OpsTune t = _ops_tune;
+    restore_interrupts(save);
+    return t;
 }
 
-void DccLoco::write_bit(int cv_num, int bit_num, int bit_val, OpsCvCb *cb)
+
+void DccLoco::ops_tune_set(bool on)
 {
-    _pkt_write_bit.set_cv_bit(cv_num, bit_num, bit_val);
-    _ops_cv_done = false;
-    _ops_cv_status = false;
-    _write_bit_cnt = write_bit_send_cnt;
-    _ops_cv_next_cb = cb;
+    uint32_t save = save_and_disable_interrupts();
+    _ops_tune_on = on;
+    _ops_tune = {};
+    _ops_tune.send_cnt = ops_send_cnt_def;
+    _ops_tune.lockout = ops_lockout_def;
+    _ops_tune.rsp_pkts_16 = 2 * 16; // the second packet, at best
+    _ops_tune_run = 0;
+    _ops_tune_probe = false;
+    _ops_tune_read_us = 0;
+    restore_interrupts(save);
 }
 
-void DccLoco::set_adrs_new(int adrs_new, OpsCvCb *cb)
+DccPkt *DccLoco::ops_cv_pkt() // called in interrupt context
 {
-    _pkt_set_adrs.set_adrs_new(adrs_new);
-    _ops_cv_done = false;
-    _ops_cv_status = false;
-    _set_adrs_cnt = set_adrs_send_cnt;
-    _ops_cv_next_cb = cb;
+    if (_ops_cv.op == OpsCv::ReadCv)
+        return &_pkt_read_cv;
+    else if (_ops_cv.op == OpsCv::WriteCv)
+        return &_pkt_write_cv;
+    else if (_ops_cv.op == OpsCv::WriteBit)
+        return &_pkt_write_bit;
+    else
+        return &_pkt_set_adrs;
 }
 
 bool DccLoco::ops_done(bool &result, uint8_t &value)
@@ -245,23 +453,23 @@ bool DccLoco::ops_done(bool &result, uint8_t &value)
 // 18. Speed    19. F61-F68
 //
 // CV access: The spec says the decoder must get two CV access packets back
-// to back (9.2.1, 2.3.7.3). We send more than that (typically 5) to allow
-// for errors. When a response is received via railcom, we stop sending.
-// However, because the responses are delayed by one packet, and we can't
-// tell which response packet goes with which request packet, we have to
-// space out the requests a little so we don't get them confused. Further,
-// when a CV write is done, the decoder (ESU LokPilot) seems to stop sending
-// railcom responses for a few packets starting several packets after the
-// write is acknowledged, so we wait long enough for that time to go by too.
+// to back (9.2.1, 2.3.7.3). We send more than that to allow for errors
+// (5 to start with, then tuned for the loco; see ops_tune_get()). When a
+// response is received via railcom, we stop sending.
+//
+// Each packet returned is tagged (last_req_id()) with the request it is part
+// of, or 0 for speed and function packets. DccBitstream keeps the tag with
+// the packet and gives it back with the railcom data from the cutout right
+// after it, so a POM is only taken as the response to a request if it came
+// after that request's second or later packet. A POM after anything else is
+// left over from an earlier request (or is the decoder answering one packet
+// late) and is ignored. That's what used to need a lockout after each read.
 //
-// Heuristics:
-// (1) To avoid getting confused about which response goes with which request,
-// we always wait at least 'ops_cv_read_lockout' packets after a read response
-// is received before sending another read request.
-// (2) To avoid that no-response time after cv writes, we wait at least
-// 'ops_cv_write_lockout' packets after a write response is received before
-// sending another write request.
-// 'ops_cv_lockout' set from one of those and counts down after a cv access.
+// When a CV write is done, the decoder (ESU LokPilot) seems to stop sending
+// railcom responses for a few packets starting several packets after the
+// write is acknowledged. To avoid that no-response time, we wait some
+// packets (12 to start with, then tuned) after a write response is received
+// before sending another cv access; '_ops_cv_lockout' counts that down.
 //
 DccPkt DccLoco::next_packet()
 {
@@ -270,57 +478,26 @@ DccPkt DccLoco::next_packet()
     if (_ops_cv_lockout == 0) {
         // can send an ops cv packet if needed
 
-        if (_ops_cv_next_cb != nullptr) {
-            _ops_cv_cb = _ops_cv_next_cb;
-            _ops_cv_next_cb = nullptr;
+        if (_ops_cv.op == OpsCv::None) {
+            ops_cv_next();
+            if (_ops_cv.op == OpsCv::None)
+                _ops_tune_probe = false; // nothing right after the lockout
         }
 
-        if (_read_cv_cnt > 0) {
-            _read_cv_cnt--;
-            if (_read_cv_cnt == 0) {
-                // No response. Since CV read requires railcom, this is an error.
-                _ops_cv_done = true;
-                _ops_cv_status = false;
-                _ops_cv_val = 0x00; // arbitrary, seems better to set it
-                if (_ops_cv_cb != nullptr) {
-                    _ops_cv_cb(this, false, 0);
-                    _ops_cv_cb = nullptr;
-                }
-                _ops_cv_lockout = ops_cv_read_lockout;
-#if 0
-                char *b = BufLog::write_line_get();
-                if (b != nullptr) {
-                    char *e = b + BufLog::line_len;
-                    b += snprintf(b, e - b, "%d: lockout=%d", __LINE__,
-                                  _ops_cv_lockout);
-                    BufLog::write_line_put();
-                }
-#endif
+        if (_ops_cv.op != OpsCv::None) {
+            if (--_ops_cv_cnt == 0) {
+                // No response. A read requires railcom, so it failed; a
+                // write might have worked, but we can't tell.
+                ops_cv_end(false, 0x00);
                 // continue on below to return a different packet
             } else {
-                _pkt_last = &_pkt_read_cv;
-                return _pkt_read_cv;
+                _pkt_last = ops_cv_pkt();
+                _pkt_last_req_id = _ops_req_id;
+                _ops_req_sent++;
+                return *_pkt_last;
             }
         }
 
-        if (_write_cv_cnt > 0) {
-            _write_cv_cnt--;
-            _pkt_last = &_pkt_write_cv;
-            return _pkt_write_cv;
-        }
-
-        if (_write_bit_cnt > 0) {
-            _write_bit_cnt--;
-            _pkt_last = &_pkt_write_bit;
-            return _pkt_write_bit;
-        }
-
-        if (_set_adrs_cnt > 0) {
-            _set_adrs_cnt--;
-            _pkt_last = &_pkt_set_adrs;
-            return _pkt_set_adrs;
-        }
-
     } else {
         assert(_ops_cv_lockout > 0);
         _ops_cv_lockout--;
@@ -339,11 +516,15 @@ DccPkt DccLoco::next_packet()
     // send, or _ops_cv_lockout was nonzero and we're waiting the lockout
     // time. Send the next speed/function packet in the sequence.
 
+    _pkt_last_req_id = 0;
+
     int seq = _seq;
 
     if (++_seq >= seq_max)
         _seq = 0;
 
+    lat_pick(seq);
+
     if ((seq & 1) == 0) { // if _seq even
         _pkt_last = &_pkt_speed;
         return _pkt_speed;
@@ -394,14 +575,23 @@ DccPkt DccLoco::next_packet()
     }
 }
 
-// This is called (at interrupt level) if any railcom channel2 messages are
-// received in the cutout following a DCC message from this loco.
+// This is called (at interrupt level) after each cutout following a DCC
+// message from this loco, once rc has parsed it. The channel 2 messages (if
+// any) are used, and the cutout's counts are added to the loco's. 'req_id'
+// is the tag next_packet() gave the packet before the cutout.
 
-void DccLoco::railcom(const RailComMsg *const msg,
-                      int msg_cnt) // called in interrupt context
+void DccLoco::railcom(const RailCom &rc,
+                      uint16_t req_id) // called in interrupt context
 {
     constexpr int verbosity = 0;
 
+    const uint32_t now_ms = time_us_64() / 1000;
+
+    const RailComMsg *msg;
+    const int msg_cnt = rc.get_ch2_msgs(msg);
+
+    _rc_stats.add(rc.cutout_stats());
+
     // verbosity 9: print all dcc sent and railcom received
     // verbosity 1: print only railcom pom received
 
@@ -462,90 +652,16 @@ void DccLoco::railcom(const RailComMsg *const msg,
 
     for (int i = 0; i < msg_cnt; i++) {
         if (msg[i].id == RailComMsg::MsgId::pom) {
-            if (_ops_cv_lockout == 0) {
-                if (_read_cv_cnt > 0) {
-                    assert(_write_cv_cnt == 0 && _write_bit_cnt == 0 &&
-                           _set_adrs_cnt == 0);
-                    _ops_cv_done = true;
-                    _ops_cv_status = true;
-                    _ops_cv_val = msg[i].pom.val;
-                    _read_cv_cnt = 0;
-                    _ops_cv_lockout = ops_cv_read_lockout;
-#if 0
-                    char *b = BufLog::write_line_get();
-                    if (b != nullptr) {
-                        char *e = b + BufLog::line_len;
-                        b += snprintf(b, e - b, "%d: lockout=%d", __LINE__,
-                                      _ops_cv_lockout);
-                        BufLog::write_line_put();
-                    }
-#endif
-                    if (_ops_cv_cb != nullptr) {
-                        _ops_cv_cb(this, true, msg[i].pom.val);
-                        _ops_cv_cb = nullptr;
-                    }
-                } else if (_write_cv_cnt > 0) {
-                    assert(_write_bit_cnt == 0 && _set_adrs_cnt == 0);
-                    _ops_cv_done = true;
-                    _ops_cv_status = true;
-                    _ops_cv_val = msg[i].pom.val;
-                    _write_cv_cnt = 0;
-                    _ops_cv_lockout = ops_cv_write_lockout;
-#if 0
-                    char *b = BufLog::write_line_get();
-                    if (b != nullptr) {
-                        char *e = b + BufLog::line_len;
-                        b += snprintf(b, e - b, "%d: lockout=%d", __LINE__,
-                                      _ops_cv_lockout);
-                        BufLog::write_line_put();
-                    }
-#endif
-                    if (_ops_cv_cb != nullptr) {
-                        _ops_cv_cb(this, true, msg[i].pom.val);
-                        _ops_cv_cb = nullptr;
-                    }
-                } else if (_write_bit_cnt > 0) {
-                    assert(_set_adrs_cnt == 0);
-                    _ops_cv_done = true;
-                    _ops_cv_status = true;
-                    _ops_cv_val = msg[i].pom.val;
-                    _write_bit_cnt = 0;
-                    _ops_cv_lockout = ops_cv_write_lockout;
-#if 0
-                    char *b = BufLog::write_line_get();
-                    if (b != nullptr) {
-                        char *e = b + BufLog::line_len;
-                        b += snprintf(b, e - b, "%d: lockout=%d", __LINE__,
-                                      _ops_cv_lockout);
-                        BufLog::write_line_put();
-                    }
-#endif
-                    if (_ops_cv_cb != nullptr) {
-                        _ops_cv_cb(this, true, msg[i].pom.val);
-                        _ops_cv_cb = nullptr;
-                    }
-                } else if (_set_adrs_cnt > 0) {
-                    _ops_cv_done = true;
-                    _ops_cv_status = true;
-                    //_ops_cv_val = msg[i].pom.val;
-                    _set_adrs_cnt = 0;
-                    _ops_cv_lockout = ops_cv_write_lockout;
-#if 0
-                    char *b = BufLog::write_line_get();
-                    if (b != nullptr) {
-                        char *e = b + BufLog::line_len;
-                        b += snprintf(b, e - b, "%d: lockout=%d", __LINE__,
-                                      _ops_cv_lockout);
-                        BufLog::write_line_put();
-                    }
-#endif
-                    if (_ops_cv_cb != nullptr) {
-                        _ops_cv_cb(this, true, 0); // XXX
-                        _ops_cv_cb = nullptr;
-                    }
-                }
+            // response to the current request, after its second packet?
+            if (req_id != 0 && req_id == _ops_req_id && _ops_req_sent >= 2) {
+                if (_ops_cv.op == OpsCv::SetAdrs)
+                    ops_cv_end(true, 0); // XXX
+                else
+                    ops_cv_end(true, msg[i].pom.val);
             }
         } else if (msg[i].id == RailComMsg::MsgId::dyn) {
+            if (msg[i].dyn.id < dyn_id_max)
+                dyn_rx(msg[i].dyn.id, msg[i].dyn.val, now_ms);
             if (msg[i].dyn.id == RailComSpec::DynId::dyn_speed_1) {
                 if (msg[i].dyn.val != _rc_speed) {
                     // loco's self-reported speed has changed
@@ -567,7 +683,178 @@ void DccLoco::railcom(const RailComMsg *const msg,
         }
     }
 
-} // void DccLoco::railcom(const RailComMsg *msg, int msg_cnt)
+    // this is also where held dyn changes go out when their time is up
+    if ((_dyn_chg & _dyn_sub) != 0)
+        dyn_flush(now_ms);
+
+} // void DccLoco::railcom(const RailCom &rc, uint16_t req_id)
+
+
+RailComStats DccLoco::rc_stats() const
+{
+    uint32_t s = save_and_disable_interrupts();
+    RailComStats st = _rc_stats;
+    restore_interrupts(s);
+    return st;
+}
+
+
+void DccLoco::rc_stats_reset()
+{
+    uint32_t s = save_and_disable_interrupts();
+    _rc_stats.reset();
+    restore_interrupts(s);
+}
+
+
+void DccLoco::dyn_rx(int id, uint8_t val,
+                     uint32_t now_ms) // called in interrupt context
+{
+    const uint32_t bit = 1u << id;
+    if ((_dyn_valid & bit) == 0 || _dyn_val[id] != val)
+        _dyn_chg |= bit;
+    _dyn_valid |= bit;
+    _dyn_val[id] = val;
+    _dyn_rx_ms[id] = now_ms;
+}
+
+
+// Report changes that are subscribed to and not held by min_ms
+void DccLoco::dyn_flush(uint32_t now_ms) // called in interrupt context
+{
+    uint32_t due = _dyn_chg & _dyn_sub;
+    for (int id = 0; due != 0; id++, due >>= 1) {
+        if ((due & 1) == 0 || (now_ms - _dyn_not_ms[id]) < _dyn_min_ms[id])
+            continue;
+        _dyn_chg &= ~(1u << id);
+        _dyn_not_ms[id] = now_ms;
+        if (_dyn_cb != nullptr)
+            _dyn_cb(this, id, _dyn_val[id], _dyn_rx_ms[id]);
+    }
+}
+
+
+bool DccLoco::dyn_get(int id, uint8_t &val, uint32_t &rx_ms) const
+{
+    if (id < 0 || id >= dyn_id_max)
+        return false;
+    uint32_t s = save_and_disable_interrupts();
+    bool valid = (_dyn_valid & (1u << id)) != 0;
+    val = _dyn_val[id];
+    rx_ms = _dyn_rx_ms[id];
+    restore_interrupts(s);
+    return valid;
+}
+
+
+bool DccLoco::dyn_report(int id, bool on, uint16_t min_ms)
+{
+    if (id < 0 || id >= dyn_id_max)
+        return false;
+    const uint32_t bit = 1u << id;
+    uint32_t s = save_and_disable_interrupts();
+    if (on) {
+        _dyn_min_ms[id] = min_ms;
+        // not held by min_ms; the current value goes out with the next
+        // railcom data
+        _dyn_not_ms[id] = uint32_t(time_us_64() / 1000) - min_ms;
+        _dyn_chg |= (_dyn_valid & bit);
+        _dyn_sub |= bit;
+    } else {
+        _dyn_sub &= ~bit;
+    }
+    restore_interrupts(s);
+    return true;
+}
+
+
+// Which of _lat_pend[] a change to func (< 0 for speed) waits in; it's the
+// packet next_packet() sends for _seq = 0 (speed) or 2 * n - 1 (function
+// group n), the same as set_function() sets
+int DccLoco::lat_pkt(int func)
+{
+    if (func < 0)
+        return 0;
+    else if (func <= 4)
+        return 1;
+    else if (func <= 12)
+        return 2 + (func - 5) / 4;
+    else
+        return 4 + (func - 13) / 8;
+}
+
+
+void DccLoco::lat_start(DccLat *lat, const DccLat::Times &t, int func)
+{
+    const int pkt = lat_pkt(func);
+    assert(pkt < lat_pkt_max);
+    uint32_t s = save_and_disable_interrupts();
+    _lat = lat;
+    lat->start(t);
+    // keep this one with chance 1/cnt; each of the cnt so far then has the
+    // same chance of being the one kept
+    LatPend &p = _lat_pend[pkt][int(t.kind)];
+    p.cnt++;
+    _lat_rand ^= _lat_rand << 13;
+    _lat_rand ^= _lat_rand >> 17;
+    _lat_rand ^= _lat_rand << 5;
+    if ((_lat_rand % p.cnt) == 0) {
+        p.submit_us = t.submit_us;
+        p.deq_us = t.deq_us;
+    }
+    restore_interrupts(s);
+}
+
+
+// next_packet() picked the packet for seq
+void DccLoco::lat_pick(int seq) // called in interrupt context
+{
+    if (_lat_picked)
+        return; // the last one picked hasn't gone out (not on the track)
+    const int pkt = (seq & 1) != 0 ? (seq + 1) / 2 : 0;
+    for (int k = 0; k < DccLat::kind_cnt; k++) {
+        _lat_fly[k] = _lat_pend[pkt][k];
+        _lat_pend[pkt][k].cnt = 0;
+        if (_lat_fly[k].cnt > 0)
+            _lat_picked = true;
+    }
+    if (_lat_picked)
+        _lat_pick_us = time_us_32();
+}
+
+
+// The packet next_packet() picked is going out
+void DccLoco::lat_done() // called in interrupt context
+{
+    const uint32_t now_us = time_us_32();
+    for (int k = 0; k < DccLat::kind_cnt; k++) {
+        const LatPend &p = _lat_fly[k];
+        if (p.cnt > 0)
+            _lat->add({0, DccLat::Kind(k), p.submit_us, p.deq_us,
+                       _lat_pick_us, now_us},
+                      p.cnt);
+    }
+    _lat_picked = false;
+}
+
+
+// The track is off or the loco is going away; nothing waiting will go out
+void DccLoco::lat_clear()
+{
+    uint32_t s = save_and_disable_interrupts();
+    for (int k = 0; k < DccLat::kind_cnt; k++) {
+        for (int pkt = 0; pkt < lat_pkt_max; pkt++) {
+            if (_lat_pend[pkt][k].cnt > 0)
+                _lat->miss(DccLat::Kind(k), _lat_pend[pkt][k].cnt);
+            _lat_pend[pkt][k].cnt = 0;
+        }
+        if (_lat_picked && _lat_fly[k].cnt > 0)
+            _lat->miss(DccLat::Kind(k), _lat_fly[k].cnt);
+    }
+    _lat_picked = false;
+    restore_interrupts(s);
+}
+
 
 void DccLoco::show()
 {
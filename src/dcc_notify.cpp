@@ -0,0 +1,156 @@
+#include "dcc/dcc_notify.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "hardware/sync.h"
+#include "misc/str_ops.h" // strxcpy()
+
+
+DccNotify::DccNotify(NotRing &q) :
+    _q(q),
+    _waiting_cnt(0),
+    _seq(0),
+    _sent(0),
+    _coalesced(0),
+    _dropped(0)
+{
+    for (int i = 0; i < val_max; i++) {
+        _val[i].kind = Kind::None;
+        _val[i].waiting = false;
+        _val[i].queued = false;
+    }
+}
+
+
+// Put msg in _q with the next seq; interrupts are off
+bool DccNotify::put(const char *msg)
+{
+    const uint16_t seq = _seq++;
+    char *p = (char *)_q.claim();
+    if (p == nullptr) {
+        _dropped++;
+        return false;
+    }
+    snprintf(p, not_msg_len_max, "@%u %s", unsigned(seq), msg);
+    _q.commit(strlen(p) + 1);
+    _sent++;
+    return true;
+}
+
+
+// Whether v's last message has been taken out of _q
+bool DccNotify::taken(const Val &v) const
+{
+    return !v.queued || int32_t(_q.get_cnt() - v.pos) > 0;
+}
+
+
+void DccNotify::put_val(Val &v)
+{
+    v.pos = _q.put_cnt();
+    v.queued = put(v.msg);
+}
+
+
+void DccNotify::event(const char *msg)
+{
+    uint32_t irq = save_and_disable_interrupts();
+    put(msg);
+    restore_interrupts(irq);
+}
+
+
+void DccNotify::report(Kind kind, uint16_t addr, uint8_t dyn_id,
+                       const char *msg)
+{
+    uint32_t irq = save_and_disable_interrupts();
+
+    // its entry, or one that's free
+    Val *v = nullptr;
+    Val *free = nullptr;
+    for (int i = 0; i < val_max; i++) {
+        Val &e = _val[i];
+        if (e.kind == kind && e.addr == addr && e.dyn_id == dyn_id) {
+            v = &e;
+            break;
+        }
+        if (free == nullptr &&
+            (e.kind == Kind::None || (!e.waiting && taken(e))))
+            free = &e;
+    }
+
+    if (v == nullptr) {
+        if (free == nullptr) {
+            put(msg); // nowhere to hold it
+            restore_interrupts(irq);
+            return;
+        }
+        v = free;
+        v->kind = kind;
+        v->addr = addr;
+        v->dyn_id = dyn_id;
+        v->waiting = false;
+        v->queued = false;
+    }
+
+    strxcpy(v->msg, msg, not_msg_len_max);
+    if (v->waiting) {
+        _coalesced++; // the one waiting is replaced
+    } else if (taken(*v) && _q.level() < not_msg_cnt_max) {
+        put_val(*v);
+    } else {
+        v->waiting = true;
+        _waiting_cnt++;
+    }
+
+    restore_interrupts(irq);
+
+} // DccNotify::report
+
+
+void DccNotify::flush()
+{
+    if (_waiting_cnt == 0)
+        return;
+
+    uint32_t irq = save_and_disable_interrupts();
+    for (int i = 0; i < val_max && _waiting_cnt > 0; i++) {
+        if (_q.level() >= not_msg_cnt_max)
+            break;
+        Val &v = _val[i];
+        if (v.waiting && taken(v)) {
+            put_val(v);
+            v.waiting = false;
+            _waiting_cnt--;
+        }
+    }
+    restore_interrupts(irq);
+}
+
+
+void DccNotify::forget(uint16_t addr)
+{
+    uint32_t irq = save_and_disable_interrupts();
+    for (int i = 0; i < val_max; i++) {
+        Val &v = _val[i];
+        if ((v.kind == Kind::Speed || v.kind == Kind::Dyn) && v.addr == addr) {
+            if (v.waiting)
+                _waiting_cnt--;
+            v.kind = Kind::None;
+            v.waiting = false;
+        }
+    }
+    restore_interrupts(irq);
+}
+
+
+void DccNotify::stats_reset()
+{
+    uint32_t irq = save_and_disable_interrupts();
+    _sent = 0;
+    _coalesced = 0;
+    _dropped = 0;
+    restore_interrupts(irq);
+}
@@ -1,9 +1,13 @@
 #include <ctype.h> // toupper
 #include <strings.h>
 
+#include <atomic>
 #include <cassert>
+#include <cinttypes>
+#include <cstdarg>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 // pico
 #include "hardware/sync.h"
 #include "pico/stdio.h"
@@ -20,15 +24,25 @@
 #include "dcc/dcc_bitstream.h"
 #include "dcc/dcc_command.h"
 #include "dcc/dcc_cv.h"
+#include "dcc/dcc_lat.h"
 #include "dcc/dcc_loco.h"
+#include "dcc/dcc_msg.h"
+#include "dcc/dcc_notify.h"
 #include "dcc/dcc_pkt.h"
 #include "dcc/dcc_srv.h"
+#include "dcc/dcc_trip.h"
 #include "dcc/railcom.h"
+#include "dcc/railcom_addr_map.h"
+#include "dcc/railcom_stats.h"
 
 
-queue_t req_queue; // requests, core0 -> core1
-queue_t rsp_queue; // responses, core1 -> core0
-queue_t not_queue; // notifications, core1 -> core0
+ReqRing req_queue; // requests, core0 -> core1
+ReqRing rsp_queue; // responses, core1 -> core0
+NotRing not_queue; // notifications, core1 -> core0
+queue_t log_queue; // adc log blocks, core1 -> core0
+RspBlkPool rsp_blk_pool; // big results, core1 -> core0 (and back)
+
+static DccNotify notify(not_queue); // coalescing, seq, counts
 
 // Some commands, mainly service-mode reads and writes, take a while (a few
 // hundred msec) to complete. When one of these is started, a function pointer
@@ -51,6 +65,28 @@ static struct {
 
 static loop_func *active = &loop_nop;
 
+// Request ids
+//
+// A request can have an id (1-65535) so its response can be told from
+// others: a binary request has it in its id field, and an ASCII request can
+// start with "#<id> ". The response has the same id (an ASCII one starts with
+// the same "#<id> "). Requests without an id (e.g. typed into dcc_raw) get
+// responses without one.
+//
+// Responses don't always come back in the order the requests were sent.
+// While an "active" operation is running, the requests that need the track
+// to themselves (service mode, and turning the track on or off) are put
+// aside in waiting[] until it's done, but everything else is still done
+// right away, so a speed change never waits on a service mode read. If
+// waiting[] is full, the request gets an error.
+
+static uint16_t req_id = 0;    // of the request being done
+static uint16_t active_id = 0; // of the request that started "active"
+
+static constexpr int waiting_max = 4;
+static DccMsg::Buf waiting[waiting_max];
+static int waiting_cnt = 0;
+
 // Commands are single letters + arguments.
 // Top level (first character):
 static inline bool cmd_is_track(char cmd) { return cmd == 'T' || cmd == 't'; }
@@ -67,17 +103,38 @@ static inline bool cmd_is_del(char cmd) { return cmd == 'D' || cmd == 'd'; }
 static inline bool cmd_is_func(char cmd) { return cmd == 'F' || cmd == 'f'; }
 static inline bool cmd_is_speed(char cmd) { return cmd == 'S' || cmd == 's'; }
 static inline bool cmd_is_read(char cmd) { return cmd == 'R' || cmd == 'r'; }
+static inline bool cmd_is_current(char cmd) { return cmd == 'I' || cmd == 'i'; }
+static inline bool cmd_is_limit(char cmd) { return cmd == 'L' || cmd == 'l'; }
+static inline bool cmd_is_railcom(char cmd) { return cmd == 'R' || cmd == 'r'; }
+static inline bool cmd_is_dyn(char cmd) { return cmd == 'Y' || cmd == 'y'; }
+static inline bool cmd_is_stats(char cmd) { return cmd == 'S' || cmd == 's'; }
+static inline bool cmd_is_ops(char cmd) { return cmd == 'O' || cmd == 'o'; }
 
 // These functions look at commands and see if there are any valid commands
 // to process.
 
+static void req_do(DccMsg::Buf &msg);
+static bool req_waits(const DccMsg::Buf &msg);
+static void rsp_put(const void *msg, int len);
+static void rsp_send(uint16_t id, const char *rsp);
+static void rsp_send_irq(uint16_t id, const char *rsp);
+static void rsp_flush();
+static void not_send(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+static void not_report(DccNotify::Kind kind, uint16_t addr, uint8_t dyn_id,
+                       const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
 static bool process_msg(const Args &a, char *rsp);
+static void bin_msg(const DccMsg::Req &req, DccMsg::Rsp &rsp);
 static bool track_msg(const Args &a, char *rsp);
 static bool cv_msg(const Args &a, char *rsp);
 static bool address_msg(const Args &a, char *rsp);
 static bool loco_msg(const Args &a, char *rsp);
+static bool railcom_msg(const Args &a, char *rsp);
 static bool debug_msg(const Args &a, char *rsp);
 
+static void track_current_cb(DccCommand::CurrentEvent ev, uint16_t ma);
+
 // DCC interface
 
 static DccAdc *adc = nullptr;
@@ -93,6 +150,106 @@ static inline uint32_t usec_to_msec(uint32_t us)
     return (us + 500) / 1000;
 }
 
+// Time spent on each request (taking it apart, doing it, and making the
+// response), for ASCII and binary requests; see debug codes 5 and 6.
+struct ReqTime {
+    uint32_t cnt;
+    uint64_t us;
+    uint32_t us_max;
+};
+
+static ReqTime req_time_ascii;
+static ReqTime req_time_bin;
+
+static void req_time_add(ReqTime &t, uint32_t start_us)
+{
+    uint32_t us = time_us_32() - start_us;
+    t.cnt++;
+    t.us += us;
+    if (us > t.us_max)
+        t.us_max = us;
+}
+
+// Sleeping
+//
+// With nothing to do (no request, no long operation going), core 1 waits in
+// __wfe() instead of spinning. Any interrupt wakes it (the bitstream's, every
+// bit, and the adc's and railcom's); core 0 wakes it with req_bell() after
+// adding a request, and with __sev() after taking a notification (in case
+// notify is holding one back). An event that comes between looking at
+// req_queue and the __wfe() isn't lost; the __wfe() returns right away.
+//
+// Debug code 8 switches between sleeping and spinning, and has the time from
+// req_bell() to dcc_srv taking the request. Debug code 9 has the bitstream's
+// interrupt latency, which the main loop can affect.
+
+static bool srv_sleep = true;
+
+static std::atomic<uint32_t> bell_us(0);  // when it last rang
+static std::atomic<uint32_t> bell_cnt(0); // written after bell_us
+static uint32_t bell_seen = 0;            // bell_cnt last measured
+
+static ReqTime wake_time;
+
+// called on core 0
+void req_bell()
+{
+    bell_us.store(time_us_32(), std::memory_order_relaxed);
+    bell_cnt.store(bell_cnt.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+    __sev();
+}
+
+// A request was just taken; time from the bell, if it rang since last time
+static void wake_time_add()
+{
+    const uint32_t cnt = bell_cnt.load(std::memory_order_acquire);
+    if (cnt == bell_seen)
+        return;
+    bell_seen = cnt;
+    req_time_add(wake_time, bell_us.load(std::memory_order_relaxed));
+}
+
+// Latency from DccApi to the track (dcc_lat.h); see debug codes 10-12
+//
+// DccApi calls req_submit() as it sends each request, which notes the time
+// by request ID. req_do() notes when it starts on one (deq_us), and
+// lat_start() hands both to the loco the change is for, which takes it from
+// there. Requests that didn't come through DccApi (no ID, or a slot that
+// has some other ID) aren't timed.
+
+static DccLat lat;
+
+struct Submit {
+    uint16_t id;
+    uint32_t us;
+};
+
+// more than DccApi has outstanding; written by core 0 before the request
+// goes in req_queue, so it's there when core 1 takes the request
+static constexpr int submit_max = 64;
+static Submit submit[submit_max];
+
+static uint32_t deq_us = 0; // when req_do() started the current request
+
+// called on core 0
+void req_submit(uint16_t id)
+{
+    Submit &s = submit[id % submit_max];
+    s.us = time_us_32();
+    s.id = id;
+}
+
+// func is the function changed, or -1 for speed
+static void lat_start(DccLoco *loco, DccLat::Kind kind, uint16_t id,
+                      int func = -1)
+{
+    const Submit &s = submit[id % submit_max];
+    if (id == 0 || s.id != id)
+        return;
+    loco->lat_start(&lat, {id, kind, s.us, deq_us, 0, 0}, func);
+}
+
 // Fill this in before spawning dcc_srv
 DccConfig dcc_config;
 
@@ -104,7 +261,7 @@ extern "C" void dcc_srv()
     command = new DccCommand(dcc_config.sig_gpio, dcc_config.pwr_gpio, -1, adc,
                              dcc_config.rcom_uart, dcc_config.rcom_gpio);
 
-    adc->log_reset(); // logging must be enabled by calling adc.log_init()
+    command->current_cb_set(track_current_cb);
 
     while (true) {
 
@@ -112,26 +269,213 @@ extern "C" void dcc_srv()
         if (!(*active)())
             active = &loop_nop; // loop_* returning false means it's done
 
-        // Check for new message if we're not in the middle of something
-        if (active == &loop_nop) {
-            // Get message if available.
-            char msg[req_msg_len_max];
-            if (queue_try_remove(&req_queue, msg)) {
-                // If process_msg returns true, it has filled in a response
-                // and we should send it. Otherwise, it has started something
-                // that will send a response later.
-                // Note that process_msg uses the Args object as input, and
-                // reuses the msg buffer for the response (if needed).
-                Args a(msg);
-                if (process_msg(a, msg))
-                    queue_add_blocking(&rsp_queue, msg);
+        notify.flush();
+        rsp_flush();
+
+        DccMsg::Buf msg;
+        if (active == &loop_nop && waiting_cnt > 0) {
+            // something put aside can go now (oldest first)
+            msg = waiting[0];
+            waiting_cnt--;
+            for (int i = 0; i < waiting_cnt; i++)
+                waiting[i] = waiting[i + 1];
+            req_do(msg);
+        } else if (req_queue.get(&msg)) {
+            wake_time_add();
+            if (active != &loop_nop && req_waits(msg)) {
+                if (waiting_cnt < waiting_max) {
+                    waiting[waiting_cnt++] = msg;
+                } else if (DccMsg::is_bin(msg.ascii)) {
+                    msg.rsp.sync = DccMsg::bin_sync;
+                    msg.rsp.err = __LINE__;
+                    rsp_put(&msg, sizeof(DccMsg::Rsp));
+                } else {
+                    char rsp[rsp_msg_len_max];
+                    snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+                    rsp_send(DccMsg::text_id(msg.ascii), rsp);
+                }
+            } else {
+                req_do(msg);
             }
+        } else if (srv_sleep && active == &loop_nop) {
+            __wfe(); // nothing to do
         }
 
     } // while (true)
 }
 
 
+// Do one request from core 0
+static void req_do(DccMsg::Buf &msg)
+{
+    const uint32_t start_us = time_us_32();
+    deq_us = start_us;
+    if (DccMsg::is_bin(msg.ascii)) {
+        // binary requests always have an immediate response
+        const DccMsg::Req req = msg.req;
+        bin_msg(req, msg.rsp);
+        req_time_add(req_time_bin, start_us);
+        rsp_put(&msg, sizeof(DccMsg::Rsp));
+    } else {
+        // If process_msg returns true, it has filled in a response and we
+        // should send it. Otherwise, it has started something that will send
+        // a response later (with req_id).
+        req_id = DccMsg::text_id(msg.ascii);
+        Args a(DccMsg::text(msg.ascii));
+        char rsp[rsp_msg_len_max];
+        bool done = process_msg(a, rsp);
+        req_time_add(req_time_ascii, start_us);
+        if (done)
+            rsp_send(req_id, rsp);
+        else if (active != &loop_nop)
+            active_id = req_id;
+        req_id = 0;
+    }
+}
+
+
+// Whether a request has to wait for the active operation to finish: service
+// mode operations and track on/off.
+static bool req_waits(const DccMsg::Buf &msg)
+{
+    if (DccMsg::is_bin(msg.ascii))
+        return msg.req.op == DccMsg::Op::TrackSet;
+
+    Args a(DccMsg::text(msg.ascii));
+    if (a.argc() < 1 || a[0].t != Args::Type::CHAR)
+        return false; // will just get an error
+    const char cmd = a[0].c;
+    if (cmd_is_cv(cmd) || cmd_is_address(cmd))
+        return true;
+    return cmd_is_track(cmd) && a.argc() >= 2 &&
+           a[1].t == Args::Type::CHAR && cmd_is_set(a[1].c);
+}
+
+
+// Responses come from here and from interrupt handlers (ops mode cv
+// access), so interrupts are off while a slot in rsp_queue is claimed (see
+// msg_ring.h). If rsp_queue is full, this waits for core 0 to take some
+// (with interrupts on in between, so the bitstream keeps going); interrupt
+// handlers use rsp_send_irq() instead, which never waits.
+static void *rsp_claim(uint32_t &irq)
+{
+    while (true) {
+        irq = save_and_disable_interrupts();
+        void *p = rsp_queue.claim();
+        if (p != nullptr)
+            return p;
+        restore_interrupts(irq);
+    }
+}
+
+
+static void rsp_put(const void *msg, int len)
+{
+    uint32_t irq;
+    memcpy(rsp_claim(irq), msg, len);
+    rsp_queue.commit(len);
+    restore_interrupts(irq);
+}
+
+
+// Send an ASCII response, with "#<id> " in front if the request had an id
+static void rsp_send(uint16_t id, const char *rsp)
+{
+    uint32_t irq;
+    char *msg = (char *)rsp_claim(irq);
+    if (id == 0)
+        strxcpy(msg, rsp, rsp_msg_len_max);
+    else
+        snprintf(msg, rsp_msg_len_max, "#%u %s", uint(id), rsp);
+    rsp_queue.commit(strlen(msg) + 1);
+    restore_interrupts(irq);
+}
+
+
+// Responses from interrupt handlers
+//
+// An interrupt handler can't wait for room in rsp_queue (the bitstream, the
+// railcom capture and the overcurrent trip would all stop), so if it's full
+// the response is held here and rsp_flush() in the main loop sends it when
+// core 0 has taken some (core 0 does an __sev() after taking responses). If
+// this fills too, the response is dropped and counted (debug code 13); the
+// requester times out. Once something is held, later ones are held behind it
+// so they go out in order.
+
+static constexpr int rsp_held_max = 8;
+static char rsp_held[rsp_held_max][rsp_msg_len_max];
+static int rsp_held_cnt = 0;
+static uint32_t rsp_held_tot = 0; // ever held
+static uint32_t rsp_dropped = 0;
+
+// called in interrupt context
+static void rsp_send_irq(uint16_t id, const char *rsp)
+{
+    uint32_t irq = save_and_disable_interrupts();
+    char *msg = (rsp_held_cnt == 0) ? (char *)rsp_queue.claim() : nullptr;
+    const bool held = (msg == nullptr);
+    if (held && rsp_held_cnt < rsp_held_max) {
+        msg = rsp_held[rsp_held_cnt++];
+        rsp_held_tot++;
+    }
+    if (msg == nullptr) {
+        rsp_dropped++;
+    } else {
+        if (id == 0)
+            strxcpy(msg, rsp, rsp_msg_len_max);
+        else
+            snprintf(msg, rsp_msg_len_max, "#%u %s", uint(id), rsp);
+        if (!held)
+            rsp_queue.commit(strlen(msg) + 1);
+    }
+    restore_interrupts(irq);
+}
+
+
+// Send held responses while there's room
+static void rsp_flush()
+{
+    if (rsp_held_cnt == 0)
+        return;
+    uint32_t irq = save_and_disable_interrupts();
+    int sent = 0;
+    while (sent < rsp_held_cnt && rsp_queue.put(rsp_held[sent],
+                                                strlen(rsp_held[sent]) + 1))
+        sent++;
+    rsp_held_cnt -= sent;
+    for (int i = 0; i < rsp_held_cnt; i++)
+        memcpy(rsp_held[i], rsp_held[i + sent], rsp_msg_len_max);
+    restore_interrupts(irq);
+}
+
+
+// Notifications (see dcc_notify.h); these just format them
+
+// Send an event notification
+static void not_send(const char *fmt, ...)
+{
+    char msg[not_msg_len_max];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, args);
+    va_end(args);
+    notify.event(msg);
+}
+
+
+// Send (or hold) a value report
+static void not_report(DccNotify::Kind kind, uint16_t addr, uint8_t dyn_id,
+                       const char *fmt, ...)
+{
+    char msg[not_msg_len_max];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, args);
+    va_end(args);
+    notify.report(kind, addr, dyn_id, msg);
+}
+
+
 static bool process_msg(const Args &a, char *rsp)
 {
     if (a.argc() < 1 || a[0].t != Args::Type::CHAR) {
@@ -148,6 +492,8 @@ static bool process_msg(const Args &a, char *rsp)
         return address_msg(a, rsp);
     } else if (cmd_is_loco(cmd)) {
         return loco_msg(a, rsp);
+    } else if (cmd_is_railcom(cmd)) {
+        return railcom_msg(a, rsp);
     } else if (cmd_is_debug(cmd)) {
         return debug_msg(a, rsp);
     } else {
@@ -158,14 +504,272 @@ static bool process_msg(const Args &a, char *rsp)
 } // process_msg
 
 
+// bin_msg ///////////////////////////////////////////////////////////////////
+//
+// Binary requests (dcc_msg.h), each the same as an ASCII one:
+//
+//   TrackGet       "T G"
+//   TrackSet       "T S 0|1"
+//   LocoCreate     "L <addr> N"
+//   LocoDelete     "L <addr> D"
+//   LocoFuncGet    "L <addr> F <f_num> G"
+//   LocoFuncSet    "L <addr> F <f_num> S 0|1"
+//   LocoSpeedGet   "L <addr> S G"
+//   LocoSpeedSet   "L <addr> S S <speed>"
+//   LocoDynGet     "L <addr> Y <dyn_id> G"
+//
+// except these, which are only binary:
+//
+//   LocoBatch      several LocoSpeedSet and LocoFuncSet at once, checked
+//                  first and then applied with interrupts off, so the packets
+//                  that go out next all have the new speeds and functions
+//   RailComStats   all of "R S G <stat>" (addr 0) or "L <addr> R G <stat>"
+//                  at once, in a block from rsp_blk_pool
+//   LocoList       the address, speed and functions of each loco (from
+//                  start on), in a block from rsp_blk_pool
+//
+// The response has rsp.err set to the line number where it went wrong (like
+// "ERROR <line>"), or 0 with the result filled in.
+//
+
+static DccLoco *bin_loco(uint16_t addr)
+{
+    if (addr < DccPkt::address_min || addr > DccPkt::address_max)
+        return nullptr;
+    return command->find_loco(addr);
+}
+
+
+static void bin_msg(const DccMsg::Req &req, DccMsg::Rsp &rsp)
+{
+    rsp.sync = DccMsg::bin_sync;
+    rsp.op = req.op;
+    rsp.id = req.id;
+    rsp.err = 0;
+
+    DccLoco *loco;
+
+    switch (req.op) {
+
+        case DccMsg::Op::TrackGet:
+            rsp.track.on = command->mode() != DccCommand::Mode::OFF;
+            break;
+
+        case DccMsg::Op::TrackSet:
+            if (!req.track.on) {
+                if (command->mode() == DccCommand::Mode::OPS)
+                    command->set_mode_off();
+            } else {
+                if (command->mode() == DccCommand::Mode::OFF)
+                    command->set_mode_ops();
+                else if (command->mode() == DccCommand::Mode::OPS)
+                    command->trip_reset(); // in case it's locked out
+            }
+            break;
+
+        case DccMsg::Op::LocoCreate:
+            if (req.loco.addr < DccPkt::address_min ||
+                req.loco.addr > DccPkt::address_max ||
+                command->find_loco(req.loco.addr) != nullptr ||
+                command->create_loco(req.loco.addr) == nullptr)
+                rsp.err = __LINE__;
+            break;
+
+        case DccMsg::Op::LocoDelete:
+            if (bin_loco(req.loco.addr) == nullptr) {
+                rsp.err = __LINE__;
+            } else {
+                command->delete_loco(req.loco.addr);
+                notify.forget(req.loco.addr);
+            }
+            break;
+
+        case DccMsg::Op::LocoFuncGet:
+        case DccMsg::Op::LocoFuncSet:
+            loco = bin_loco(req.loco_func.addr);
+            if (loco == nullptr || req.loco_func.func > DccPkt::function_max) {
+                rsp.err = __LINE__;
+            } else if (req.op == DccMsg::Op::LocoFuncGet) {
+                rsp.loco_func = req.loco_func;
+                rsp.loco_func.on = loco->get_function(req.loco_func.func);
+            } else {
+                loco->set_function(req.loco_func.func, req.loco_func.on);
+                lat_start(loco, DccLat::Kind::Func, req.id,
+                          req.loco_func.func);
+            }
+            break;
+
+        case DccMsg::Op::LocoSpeedGet:
+            loco = bin_loco(req.loco.addr);
+            if (loco == nullptr) {
+                rsp.err = __LINE__;
+            } else {
+                rsp.loco_speed.addr = req.loco.addr;
+                rsp.loco_speed.speed = loco->get_speed();
+            }
+            break;
+
+        case DccMsg::Op::LocoSpeedSet:
+            loco = bin_loco(req.loco_speed.addr);
+            if (loco == nullptr || req.loco_speed.speed < DccPkt::speed_min ||
+                req.loco_speed.speed > DccPkt::speed_max) {
+                rsp.err = __LINE__;
+            } else {
+                loco->set_speed(req.loco_speed.speed);
+                lat_start(loco, DccLat::Kind::Speed, req.id);
+            }
+            break;
+
+        case DccMsg::Op::LocoDynGet: {
+            loco = bin_loco(req.loco_dyn.addr);
+            uint8_t val;
+            uint32_t rx_ms;
+            if (loco == nullptr || req.loco_dyn.dyn_id >= DccLoco::dyn_id_max ||
+                !loco->dyn_get(req.loco_dyn.dyn_id, val, rx_ms)) {
+                rsp.err = __LINE__;
+            } else {
+                rsp.loco_dyn = req.loco_dyn;
+                rsp.loco_dyn.dyn_val = val;
+                rsp.loco_dyn.age_ms = uint32_t(time_us_64() / 1000) - rx_ms;
+            }
+            break;
+        }
+
+        case DccMsg::Op::LocoBatch: {
+            // check them all first, so it's all or nothing
+            const DccMsg::LocoBatch &b = req.loco_batch;
+            DccLoco *locos[DccMsg::loco_batch_max];
+            if (b.cnt == 0 || b.cnt > DccMsg::loco_batch_max) {
+                rsp.err = __LINE__;
+                break;
+            }
+            for (int i = 0; i < b.cnt && rsp.err == 0; i++) {
+                locos[i] = bin_loco(b.loco[i].addr);
+                if (locos[i] == nullptr)
+                    rsp.err = __LINE__;
+                else if (b.loco[i].speed != DccMsg::speed_keep &&
+                         (b.loco[i].speed < DccPkt::speed_min ||
+                          b.loco[i].speed > DccPkt::speed_max))
+                    rsp.err = __LINE__;
+                else if (b.loco[i].func != DccMsg::func_none &&
+                         b.loco[i].func > DccPkt::function_max)
+                    rsp.err = __LINE__;
+            }
+            if (rsp.err != 0)
+                break;
+            // interrupts off, so the next packets out have all of it
+            uint32_t irq = save_and_disable_interrupts();
+            for (int i = 0; i < b.cnt; i++) {
+                if (b.loco[i].speed != DccMsg::speed_keep)
+                    locos[i]->set_speed(b.loco[i].speed);
+                if (b.loco[i].func != DccMsg::func_none)
+                    locos[i]->set_function(b.loco[i].func, b.loco[i].on);
+                // a loco listed more than once is timed once, by its last
+                // entry; with both a speed and a function, the speed packet
+                // goes out after the function one (DccLoco::set_function())
+                bool last = true;
+                for (int j = i + 1; j < b.cnt && last; j++)
+                    last = locos[j] != locos[i];
+                if (!last)
+                    continue;
+                if (b.loco[i].speed != DccMsg::speed_keep)
+                    lat_start(locos[i], DccLat::Kind::Batch, req.id);
+                else if (b.loco[i].func != DccMsg::func_none)
+                    lat_start(locos[i], DccLat::Kind::Batch, req.id,
+                              b.loco[i].func);
+            }
+            restore_interrupts(irq);
+            break;
+        }
+
+        case DccMsg::Op::RailComStats: {
+            RailComStats st;
+            if (req.loco.addr == 0) {
+                st = command->bitstream().railcom().stats();
+            } else if ((loco = bin_loco(req.loco.addr)) != nullptr) {
+                st = loco->rc_stats();
+            } else {
+                rsp.err = __LINE__;
+                break;
+            }
+            const int h = rsp_blk_pool.alloc();
+            if (h < 0) {
+                rsp.err = __LINE__; // core 0 has them all
+                break;
+            }
+            memcpy(rsp_blk_pool.blk(h), &st, sizeof(st));
+            rsp.blk = {uint8_t(h), uint16_t(sizeof(st)), 0};
+            break;
+        }
+
+        case DccMsg::Op::LocoList: {
+            constexpr int ls_max = RspBlkPool::len / sizeof(DccMsg::LocoStatus);
+            const int h = rsp_blk_pool.alloc();
+            if (h < 0) {
+                rsp.err = __LINE__; // core 0 has them all
+                break;
+            }
+            DccMsg::LocoStatus *ls = (DccMsg::LocoStatus *)rsp_blk_pool.blk(h);
+            int i = 0;
+            int n = 0;
+            int more = 0;
+            for (DccLoco *l : command->locos()) {
+                if (i++ < req.loco_list.start)
+                    continue;
+                if (n == ls_max) {
+                    more++;
+                    continue;
+                }
+                ls[n].addr = l->get_address();
+                ls[n].speed = l->get_speed();
+                memset(ls[n].func, 0, sizeof(ls[n].func));
+                for (int f = DccPkt::function_min; f <= DccPkt::function_max; f++)
+                    if (l->get_function(f))
+                        ls[n].func[f / 8] |= 1 << (f % 8);
+                n++;
+            }
+            rsp.blk = {uint8_t(h), uint16_t(n * sizeof(DccMsg::LocoStatus)),
+                       uint16_t(more)};
+            break;
+        }
+
+        default:
+            rsp.err = __LINE__;
+            break;
+    }
+
+} // bin_msg
+
+
 // track_msg /////////////////////////////////////////////////////////////////
 //
 // @req "T G" -> "OK 0|1"
 // @req "T S 0|1" -> "OK"
+// @req "T I G" -> "OK <ma>"
+// @req "T I R <report_ms>" -> "OK"
+// @req "T L G" -> "OK <limit_ma> <retry_ms> <retry_max>"
+// @req "T L S <limit_ma> <retry_ms> <retry_max>" -> "OK"
+//
+// @not "T I <ma>"
+// @not "T O T|R|L <ma>"
+//
+// @arg ma:            0-         track current, mA
+// @arg report_ms:     0-         current report interval, 0 = off (longer
+//                                than 4294967, about 71 minutes, is taken
+//                                as that)
+// @arg limit_ma:      1-65535    overcurrent trip level
+// @arg retry_ms:      1-8000     wait after trip before power on again
+// @arg retry_max:     0-         trips in a row before lockout
+//
+// "T S 1" when the track is on but locked out (after overcurrent) turns
+// power back on. The "T O" notification is sent on overcurrent trip (T),
+// power on again after a trip (R), and lockout (L).
 //
 
 static bool track_get_msg(const Args &a, char *rsp);
 static bool track_set_msg(const Args &a, char *rsp);
+static bool track_current_msg(const Args &a, char *rsp);
+static bool track_limit_msg(const Args &a, char *rsp);
 
 static bool track_msg(const Args &a, char *rsp)
 {
@@ -173,7 +777,7 @@ static bool track_msg(const Args &a, char *rsp)
     assert(a.argc() >= 1);
     assert(a[0].t == Args::Type::CHAR && cmd_is_track(a[0].c));
 
-    // a[1] is cmd ('G' or 'S')
+    // a[1] is cmd ('G', 'S', 'I', or 'L')
     if (a.argc() < 2 || a[1].t != Args::Type::CHAR) {
         snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
         return true;
@@ -184,6 +788,10 @@ static bool track_msg(const Args &a, char *rsp)
         return track_get_msg(a, rsp);
     } else if (cmd_is_set(cmd)) {
         return track_set_msg(a, rsp);
+    } else if (cmd_is_current(cmd)) {
+        return track_current_msg(a, rsp);
+    } else if (cmd_is_limit(cmd)) {
+        return track_limit_msg(a, rsp);
     } else {
         snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
         return true;
@@ -230,12 +838,126 @@ static bool track_set_msg(const Args &a, char *rsp)
     } else if (setting == 1) {
         if (command->mode() == DccCommand::Mode::OFF)
             command->set_mode_ops();
+        else if (command->mode() == DccCommand::Mode::OPS)
+            command->trip_reset(); // in case it's locked out
+        strcpy(rsp, "OK");
+        return true;
+    } else {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+}
+
+
+static bool track_current_msg(const Args &a, char *rsp)
+{
+    // already checked "T I ..."
+    assert(a.argc() >= 2);
+    assert(a[0].t == Args::Type::CHAR && cmd_is_track(a[0].c));
+    assert(a[1].t == Args::Type::CHAR && cmd_is_current(a[1].c));
+
+    // a[2] is subcmd ('G' or 'R')
+    if (a.argc() < 3 || a[2].t != Args::Type::CHAR) {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+    const char subcmd = a[2].c;
+
+    if (cmd_is_get(subcmd)) {
+
+        if (a.argc() != 3) {
+            snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+            return true;
+        }
+
+        snprintf(rsp, rsp_msg_len_max, "OK %u", uint(command->track_ma()));
+        return true;
+
+    } else if (cmd_is_read(subcmd)) {
+
+        if (a.argc() != 4 || a[3].t != Args::Type::INT || a[3].i < 0) {
+            snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+            return true;
+        }
+
+        command->current_report(a[3].i);
+        strcpy(rsp, "OK");
+        return true;
+
+    } else {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+} // track_current_msg
+
+
+static bool track_limit_msg(const Args &a, char *rsp)
+{
+    // already checked "T L ..."
+    assert(a.argc() >= 2);
+    assert(a[0].t == Args::Type::CHAR && cmd_is_track(a[0].c));
+    assert(a[1].t == Args::Type::CHAR && cmd_is_limit(a[1].c));
+
+    // a[2] is subcmd ('G' or 'S')
+    if (a.argc() < 3 || a[2].t != Args::Type::CHAR) {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+    const char subcmd = a[2].c;
+
+    if (cmd_is_get(subcmd)) {
+
+        if (a.argc() != 3) {
+            snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+            return true;
+        }
+
+        const DccTrip &trip = command->trip();
+        snprintf(rsp, rsp_msg_len_max, "OK %u %" PRIu32 " %d",
+                 uint(trip.limit_ma()), trip.retry_ms(), trip.retry_max());
+        return true;
+
+    } else if (cmd_is_set(subcmd)) {
+
+        if (a.argc() != 6 || a[3].t != Args::Type::INT || //
+            a[4].t != Args::Type::INT || a[5].t != Args::Type::INT || //
+            a[3].i < 1 || a[3].i > UINT16_MAX || a[4].i < 1) {
+            snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+            return true;
+        }
+
+        if (!command->trip_config(a[3].i, a[4].i, a[5].i)) {
+            snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+            return true;
+        }
+
         strcpy(rsp, "OK");
         return true;
+
     } else {
         snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
         return true;
     }
+
+} // track_limit_msg
+
+
+// careful: this is called at interrupt level in the DccBitstream's next_bit
+static void track_current_cb(DccCommand::CurrentEvent ev, uint16_t ma)
+{
+    if (ev == DccCommand::CurrentEvent::Report) {
+        not_report(DccNotify::Kind::Current, 0, 0, "T I %u", uint(ma));
+    } else {
+        char e = 'T';
+        if (ev == DccCommand::CurrentEvent::Retry)
+            e = 'R';
+        else if (ev == DccCommand::CurrentEvent::Lockout)
+            e = 'L';
+        not_send("T O %c %u", e, uint(ma));
+    }
 }
 
 
@@ -568,6 +1290,16 @@ static bool address_set_msg(const Args &a, char *rsp)
 // @req "L <addr> C <cv_num> G" -> "OK <cv_val> in <time_ms> ms"
 // @req "L <addr> C <cv_num> S <cv_val>" -> "OK <cv_val> in <time_ms> ms"
 // @req "L <addr> C <cv_num> B <bit_num> S <bit_val>" -> "OK <cv_val> in <time_ms> ms"
+// @req "L <addr> C <cv_num> G <id>" -> "OK"
+// @req "L <addr> C <cv_num> S <cv_val> <id>" -> "OK"
+// @req "L <addr> C <cv_num> B <bit_num> S <bit_val> <id>" -> "OK"
+// @req "L <addr> R G" -> "OK <full> <partial> <rejected>"
+// @req "L <addr> R G <stat>" -> "OK <stat_val>"
+// @req "L <addr> R S 0" -> "OK"
+// @req "L <addr> Y <dyn_id> G" -> "OK <dyn_val> <age_ms>"
+// @req "L <addr> Y <dyn_id> R 0|1 [<min_ms>]" -> "OK"
+// @req "L <addr> O G" -> "OK <send_cnt> <lockout> <read_ms> <read_max_ms>"
+// @req "L <addr> O S 0|1" -> "OK"
 //
 // @arg addr:          1-10239    loco address
 // @arg f_num:         0-31       function number
@@ -576,6 +1308,43 @@ static bool address_set_msg(const Args &a, char *rsp)
 // @arg cv_val:        0-255      CV value
 // @arg bit_num:       0-7        bit number
 // @arg bit_val:       0-1        bit value
+// @arg id:            1-65535    request ID
+// @arg full:                     railcom channel 2 frames all good
+// @arg partial:                  frames with good messages, then junk
+// @arg rejected:                 frames with nothing usable
+// @arg stat:          0-13       railcom counter (as "R S G <stat>")
+// @arg stat_val:      0-         its count, for cutouts after this loco's
+//                                packets
+// @arg dyn_id:        0-23       railcom dynamic variable (RailComSpec::DynId)
+// @arg dyn_val:       0-255      its value
+// @arg age_ms:        0-         since the loco sent it
+// @arg min_ms:        0-65535    least time between reports (default 0)
+// @arg send_cnt:      2-10       times a cv access packet is sent, at most
+// @arg lockout:       0-24       packets to wait after a cv write
+// @arg read_ms:       0-         cv read time, average (first packet sent to
+//                                response)
+// @arg read_max_ms:   0-         cv read time, longest
+//
+// Ops mode cv accesses given an id are queued on the loco (a few can be
+// queued per loco, and any number of locos can have them going at once), and
+// the response just says it was queued. The result is a notification:
+//
+// @not "L <addr> C <id> V <cv_val> T <time_ms>"
+// @not "L <addr> C <id> E T <time_ms>"
+//
+// Without an id, the response comes when the access is done.
+//
+// With reports on for a dynamic variable, there's a notification when the
+// loco sends a new value (and right away with the current one, if there is
+// one). A change within min_ms of the last report is held until min_ms is
+// up, then reported with the latest value.
+//
+// @not "L <addr> Y <dyn_id> V <dyn_val> T <time_ms>"
+//
+// The send count and lockout for ops mode cv accesses are tuned for each
+// loco from how it answers. "L <addr> O S 0" turns that off (the defaults,
+// 5 and 12, are used), and "L <addr> O S 1" turns it back on; either starts
+// over from the defaults and clears the read times.
 //
 
 static bool loco_new_msg(const Args &a, char *rsp, int addr);
@@ -583,6 +1352,9 @@ static bool loco_del_msg(const Args &a, char *rsp, DccLoco *loco);
 static bool loco_func_msg(const Args &a, char *rsp, DccLoco *loco);
 static bool loco_speed_msg(const Args &a, char *rsp, DccLoco *loco);
 static bool loco_cv_msg(const Args &a, char *rsp, DccLoco *loco);
+static bool loco_railcom_msg(const Args &a, char *rsp, DccLoco *loco);
+static bool loco_dyn_msg(const Args &a, char *rsp, DccLoco *loco);
+static bool loco_ops_msg(const Args &a, char *rsp, DccLoco *loco);
 
 static bool loco_msg(const Args &a, char *rsp)
 {
@@ -620,6 +1392,12 @@ static bool loco_msg(const Args &a, char *rsp)
         return loco_speed_msg(a, rsp, loco);
     } else if (cmd_is_cv(cmd)) {
         return loco_cv_msg(a, rsp, loco);
+    } else if (cmd_is_railcom(cmd)) {
+        return loco_railcom_msg(a, rsp, loco);
+    } else if (cmd_is_dyn(cmd)) {
+        return loco_dyn_msg(a, rsp, loco);
+    } else if (cmd_is_ops(cmd)) {
+        return loco_ops_msg(a, rsp, loco);
     } else {
         snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
         return true;
@@ -674,7 +1452,9 @@ static bool loco_del_msg(const Args &a, char *rsp, DccLoco *loco)
         return true;
     }
 
-    command->delete_loco(loco->get_address());
+    const int addr = loco->get_address();
+    command->delete_loco(addr);
+    notify.forget(addr);
     loco = nullptr;
 
     strcpy(rsp, "OK");
@@ -733,6 +1513,7 @@ static bool loco_func_msg(const Args &a, char *rsp, DccLoco *loco)
 
         const int setting = a[5].i;
         loco->set_function(fnum, setting == 1);
+        lat_start(loco, DccLat::Kind::Func, req_id, fnum);
         strcpy(rsp, "OK");
         return true;
 
@@ -747,12 +1528,8 @@ static bool loco_func_msg(const Args &a, char *rsp, DccLoco *loco)
 // careful: this is called at interrupt level in the DccBitstream's get_packet
 static void loco_speed_cb(DccLoco *loco, uint32_t time_ms, int speed)
 {
-    char msg[not_msg_len_max];
-
-    snprintf(msg, sizeof(msg), "L %d S %d T %lu", //
-             loco->get_address(), speed, time_ms);
-
-    queue_try_add(&not_queue, msg);
+    not_report(DccNotify::Kind::Speed, loco->get_address(), 0,
+               "L %d S %d T %" PRIu32, loco->get_address(), speed, time_ms);
 }
 
 
@@ -797,6 +1574,7 @@ static bool loco_speed_msg(const Args &a, char *rsp, DccLoco *loco)
 
         const int speed = a[4].i;
         loco->set_speed(speed);
+        lat_start(loco, DccLat::Kind::Speed, req_id);
 
         strcpy(rsp, "OK");
         return true;
@@ -826,6 +1604,170 @@ static bool loco_speed_msg(const Args &a, char *rsp, DccLoco *loco)
 } // loco_speed_msg
 
 
+static bool loco_railcom_msg(const Args &a, char *rsp, DccLoco *loco)
+{
+    // already checked "L <addr> R ..."
+    assert(a.argc() >= 3);
+    assert(a[0].t == Args::Type::CHAR && cmd_is_loco(a[0].c));
+    assert(a[1].t == Args::Type::INT);
+    assert(a[2].t == Args::Type::CHAR && cmd_is_railcom(a[2].c));
+
+    if (loco == nullptr) {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+    // a[3] is subcmd ('G' or 'S')
+    if (a.argc() < 4 || a[3].t != Args::Type::CHAR) {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+    const char subcmd = a[3].c;
+
+    if (cmd_is_get(subcmd) && a.argc() == 4) {
+        const RailComStats st = loco->rc_stats();
+        snprintf(rsp, rsp_msg_len_max, "OK %" PRIu32 " %" PRIu32 " %" PRIu32,
+                 st.ch2_full, st.ch2_part, st.ch2_rej);
+    } else if (cmd_is_get(subcmd) && a.argc() == 5 &&
+               a[4].t == Args::Type::INT && 0 <= a[4].i &&
+               a[4].i < RailComStats::cnt) {
+        snprintf(rsp, rsp_msg_len_max, "OK %" PRIu32,
+                 loco->rc_stats().get(a[4].i));
+    } else if (cmd_is_set(subcmd) && a.argc() == 5 &&
+               a[4].t == Args::Type::INT && a[4].i == 0) {
+        loco->rc_stats_reset();
+        strcpy(rsp, "OK");
+    } else {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+    }
+    return true;
+
+} // loco_railcom_msg
+
+
+// careful: this is called at interrupt level in the DccBitstream's next_bit
+static void loco_dyn_cb(DccLoco *loco, int id, uint8_t val, uint32_t rx_ms)
+{
+    not_report(DccNotify::Kind::Dyn, loco->get_address(), id,
+               "L %d Y %d V %u T %" PRIu32, loco->get_address(), id, uint(val),
+               rx_ms);
+}
+
+
+static bool loco_dyn_msg(const Args &a, char *rsp, DccLoco *loco)
+{
+    // already checked "L <addr> Y ..."
+    assert(a.argc() >= 3);
+    assert(a[0].t == Args::Type::CHAR && cmd_is_loco(a[0].c));
+    assert(a[1].t == Args::Type::INT);
+    assert(a[2].t == Args::Type::CHAR && cmd_is_dyn(a[2].c));
+
+    if (loco == nullptr) {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+    // a[3] is dyn_id
+    if (a.argc() < 4 || a[3].t != Args::Type::INT || //
+        a[3].i < 0 || a[3].i >= DccLoco::dyn_id_max) {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+    const int id = a[3].i;
+
+    // a[4] is subcmd ('G' or 'R')
+    if (a.argc() < 5 || a[4].t != Args::Type::CHAR) {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+    const char subcmd = a[4].c;
+
+    if (cmd_is_get(subcmd)) {
+
+        uint8_t val;
+        uint32_t rx_ms;
+        if (a.argc() != 5 || !loco->dyn_get(id, val, rx_ms)) {
+            snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+            return true;
+        }
+
+        uint32_t age_ms = uint32_t(time_us_64() / 1000) - rx_ms;
+        snprintf(rsp, rsp_msg_len_max, "OK %u %" PRIu32, uint(val), age_ms);
+        return true;
+
+    } else if (cmd_is_read(subcmd)) {
+
+        // a[5] is 0|1, then optional min_ms
+        if (a.argc() < 6 || a.argc() > 7 || a[5].t != Args::Type::INT || //
+            (a[5].i != 0 && a[5].i != 1)) {
+            snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+            return true;
+        }
+
+        int min_ms = 0;
+        if (a.argc() == 7) {
+            if (a[6].t != Args::Type::INT || a[6].i < 0 || a[6].i > UINT16_MAX) {
+                snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+                return true;
+            }
+            min_ms = a[6].i;
+        }
+
+        loco->dyn_cb_set(loco_dyn_cb);
+        loco->dyn_report(id, a[5].i == 1, min_ms);
+
+        strcpy(rsp, "OK");
+        return true;
+
+    } else {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+} // loco_dyn_msg
+
+
+static bool loco_ops_msg(const Args &a, char *rsp, DccLoco *loco)
+{
+    // already checked "L <addr> O ..."
+    assert(a.argc() >= 3);
+    assert(a[0].t == Args::Type::CHAR && cmd_is_loco(a[0].c));
+    assert(a[1].t == Args::Type::INT);
+    assert(a[2].t == Args::Type::CHAR && cmd_is_ops(a[2].c));
+
+    if (loco == nullptr) {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+    // a[3] is subcmd ('G' or 'S')
+    if (a.argc() < 4 || a[3].t != Args::Type::CHAR) {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+    const char subcmd = a[3].c;
+
+    if (cmd_is_get(subcmd) && a.argc() == 4) {
+        const DccLoco::OpsTune t = loco->ops_tune_get();
+        snprintf(rsp, rsp_msg_len_max, "OK %d %d %" PRIu32 " %" PRIu32,
+                 t.send_cnt, t.lockout, usec_to_msec(t.read_us_avg),
+                 usec_to_msec(t.read_us_max));
+    } else if (cmd_is_set(subcmd) && a.argc() == 5 &&
+               a[4].t == Args::Type::INT && (a[4].i == 0 || a[4].i == 1)) {
+        loco->ops_tune_set(a[4].i == 1);
+        strcpy(rsp, "OK");
+    } else {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+    }
+    return true;
+
+} // loco_ops_msg
+
+
 static bool loco_cv_get_msg(const Args &a, char *rsp, DccLoco *loco);
 static bool loco_cv_set_msg(const Args &a, char *rsp, DccLoco *loco);
 static bool loco_cv_bit_msg(const Args &a, char *rsp, DccLoco *loco);
@@ -878,19 +1820,80 @@ static bool loco_cv_msg(const Args &a, char *rsp, DccLoco *loco)
 } // loco_cv_msg
 
 
+// Ops mode cv access done, without a cv id: the response to the request,
+// done.id being the request id (if any).
 // careful: this is called at interrupt level in the DccBitstream's get_packet
-static void loco_cv_done([[maybe_unused]] DccLoco *loco, bool success, uint8_t cv_val)
+static void loco_cv_rsp(DccLoco *, const DccLoco::OpsCvDone &done)
 {
+    const uint32_t op_ms = usec_to_msec(done.op_us);
+
     char rsp[rsp_msg_len_max];
+    if (done.success)
+        snprintf(rsp, sizeof(rsp), "OK %u in %" PRIu32 " ms", uint(done.cv_val),
+                 op_ms);
+    else
+        snprintf(rsp, sizeof(rsp), "ERROR in %" PRIu32 " ms", op_ms);
+    rsp_send_irq(done.id, rsp);
+}
+
 
-    const uint32_t op_ms = usec_to_msec(time_us_32() - start_us);
+// Ops mode cv access done, with a cv id (done.id): a notification.
+// careful: this is called at interrupt level in the DccBitstream's get_packet
+static void loco_cv_not(DccLoco *loco, const DccLoco::OpsCvDone &done)
+{
+    const uint32_t op_ms = usec_to_msec(done.op_us);
 
-    if (success)
-        snprintf(rsp, sizeof(rsp), "OK %u in %lu ms", uint(cv_val), op_ms);
+    if (done.success)
+        not_send("L %d C %u V %u T %" PRIu32, loco->get_address(),
+                 uint(done.id), uint(done.cv_val), op_ms);
     else
-        snprintf(rsp, sizeof(rsp), "ERROR in %lu ms", op_ms);
+        not_send("L %d C %u E T %" PRIu32, loco->get_address(), uint(done.id),
+                 op_ms);
+}
+
 
-    queue_add_blocking(&rsp_queue, rsp);
+// The callback and id for DccLoco: with a cv id, a notification with that;
+// without, a response with the request's id.
+static inline DccLoco::OpsCvCb *loco_cv_cb(uint16_t id)
+{
+    return id != 0 ? loco_cv_not : loco_cv_rsp;
+}
+
+static inline uint16_t loco_cv_cb_id(uint16_t id)
+{
+    return id != 0 ? id : req_id;
+}
+
+
+// Optional request ID at a[idx]; false if it's there and no good
+static bool loco_cv_id(const Args &a, int idx, uint16_t &id)
+{
+    id = 0;
+    if (a.argc() == idx)
+        return true;
+    if (a.argc() != (idx + 1) || a[idx].t != Args::Type::INT || //
+        a[idx].i < 1 || a[idx].i > UINT16_MAX)
+        return false;
+    id = a[idx].i;
+    return true;
+}
+
+
+// After queuing a cv access: with an id, the response is now; without one,
+// it's sent by loco_cv_rsp (unless it couldn't be queued).
+static bool loco_cv_queued(char *rsp, bool queued, uint16_t id)
+{
+    if (!queued) {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+    if (id != 0) {
+        strcpy(rsp, "OK");
+        return true;
+    }
+
+    return false; // response sent later by loco_cv_rsp
 }
 
 
@@ -905,20 +1908,17 @@ static bool loco_cv_get_msg(const Args &a, char *rsp, DccLoco *loco)
     assert(a[4].t == Args::Type::CHAR && cmd_is_get(a[4].c));
     assert(loco != nullptr);
 
-    if (a.argc() != 5) {
+    uint16_t id;
+    if (!loco_cv_id(a, 5, id)) {
         snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
         return true;
     }
 
     const int cv_num = a[3].i;
-    loco->read_cv(cv_num, loco_cv_done);
 
     // it takes ~20 msec to read a CV via railcom
-
-    // start_us is unreliable if multiple locos do this at once
-    start_us = time_us_32();
-
-    return false; // response sent later by loco_cv_done
+    return loco_cv_queued(
+        rsp, loco->read_cv(cv_num, loco_cv_cb(id), loco_cv_cb_id(id)), id);
 
 } // loco_cv_get_msg
 
@@ -934,21 +1934,20 @@ static bool loco_cv_set_msg(const Args &a, char *rsp, DccLoco *loco)
     assert(a[4].t == Args::Type::CHAR && cmd_is_set(a[4].c));
     assert(loco != nullptr);
 
-    if (a.argc() != 6 || a[5].t != Args::Type::INT) {
+    uint16_t id;
+    if (a.argc() < 6 || a[5].t != Args::Type::INT || !loco_cv_id(a, 6, id)) {
         snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
         return true;
     }
 
     const int cv_num = a[3].i;
     const int cv_val = a[5].i;
-    loco->write_cv(cv_num, cv_val, loco_cv_done);
 
     // it takes ~20 msec to write a CV via railcom
-
-    // start_us is unreliable if multiple locos do this at once
-    start_us = time_us_32();
-
-    return false; // response sent later by loco_cv_done
+    return loco_cv_queued(rsp,
+                          loco->write_cv(cv_num, cv_val, loco_cv_cb(id),
+                                         loco_cv_cb_id(id)),
+                          id);
 
 } // loco_cv_set_msg
 
@@ -978,9 +1977,10 @@ static bool loco_cv_bit_msg(const Args &a, char *rsp, DccLoco *loco)
         return true;
     }
 
-    // a[7] is bit_val (0 or 1)
-    if (a.argc() != 8 || a[7].t != Args::Type::INT || //
-        (a[7].i != 0 && a[7].i != 1)) {
+    // a[7] is bit_val (0 or 1), then optional id
+    uint16_t id;
+    if (a.argc() < 8 || a[7].t != Args::Type::INT || //
+        (a[7].i != 0 && a[7].i != 1) || !loco_cv_id(a, 8, id)) {
         snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
         return true;
     }
@@ -988,21 +1988,202 @@ static bool loco_cv_bit_msg(const Args &a, char *rsp, DccLoco *loco)
     const int cv_num = a[3].i;
     const int bit_num = a[5].i;
     const int bit_val = a[7].i;
-    loco->write_bit(cv_num, bit_num, bit_val, loco_cv_done);
 
     // it takes ~20 msec to write a CV bit via railcom
+    return loco_cv_queued(
+        rsp,
+        loco->write_bit(cv_num, bit_num, bit_val, loco_cv_cb(id),
+                        loco_cv_cb_id(id)),
+        id);
 
-    // start_us is unreliable if multiple locos do this at once
-    start_us = time_us_32();
+} // loco_cv_bit_msg
 
-    return false; // response sent later by loco_cv_done
 
-} // loco_cv_bit_msg
+// railcom_msg ///////////////////////////////////////////////////////////////
+//
+// @req "R A G" -> "OK <cnt>"
+// @req "R A G <idx>" -> "OK <addr> <conf> <age_ms>"
+// @req "R A R 0|1" -> "OK"
+// @req "R S G <stat>" -> "OK <stat_val>"
+// @req "R S S 0" -> "OK"
+//
+// @not "R A <addr> 1|0"
+//
+// @arg cnt:           0-16       loco addresses heard in railcom channel 1
+// @arg idx:           0-         which one, less than cnt
+// @arg addr:          1-10239    loco address
+// @arg conf:          3-15       times seen (recently), more is surer
+// @arg age_ms:        0-         since last seen
+// @arg stat:          0-13       railcom counter:
+//                                  0 cutouts
+//                                  1 cutouts with nothing received
+//                                  2 bytes received
+//                                  3 bytes that aren't 4/8 codes
+//                                  4 short frames (some bytes, not all 8)
+//                                  5 channel 1 address messages
+//                                  6 cutouts with channel 2 messages used
+//                                  7 channel 2 frames all good
+//                                  8 channel 2 good messages, then junk
+//                                  9 channel 2 nothing usable
+//                                 10 ACKs
+//                                 11 NAKs
+//                                 12 POM responses
+//                                 13 channel 2 by the old (heuristic) parse
+// @arg stat_val:      0-         its count, since the last reset
+//
+// Locos on the track with railcom channel 1 on say their address after every
+// packet (whoever it's for), so this finds them without asking each address.
+// The numbering of addresses changes as they come and go; if one is gone
+// between "R A G" and "R A G <idx>", there's an ERROR. With reports on
+// ("R A R 1"), there's a notification when an address shows up (1) and when
+// it hasn't been heard for a couple of seconds or the track is turned off
+// (0).
+//
+// The counters are for all cutouts; "L <addr> R G <stat>" has the same ones
+// for a single loco's cutouts. A count that goes up everywhere points at the
+// track or the booster, one that goes up for one loco points at the loco.
+//
+
+static bool railcom_addr_msg(const Args &a, char *rsp);
+static bool railcom_stats_msg(const Args &a, char *rsp);
+
+static bool railcom_msg(const Args &a, char *rsp)
+{
+    // already checked "R ..."
+    assert(a.argc() >= 1);
+    assert(a[0].t == Args::Type::CHAR && cmd_is_railcom(a[0].c));
+
+    // a[1] is cmd ('A' or 'S')
+    if (a.argc() < 2 || a[1].t != Args::Type::CHAR) {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+    const char cmd = a[1].c;
+    if (cmd_is_address(cmd)) {
+        return railcom_addr_msg(a, rsp);
+    } else if (cmd_is_stats(cmd)) {
+        return railcom_stats_msg(a, rsp);
+    } else {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+} // railcom_msg
+
+
+// careful: this is called at interrupt level in the DccBitstream's next_bit
+// (or from DccCommand::set_mode_off)
+static void railcom_addr_cb(uint16_t addr, bool present)
+{
+    not_send("R A %u %d", uint(addr), present ? 1 : 0);
+}
+
+
+static bool railcom_addr_msg(const Args &a, char *rsp)
+{
+    // already checked "R A ..."
+    assert(a.argc() >= 2);
+    assert(a[0].t == Args::Type::CHAR && cmd_is_railcom(a[0].c));
+    assert(a[1].t == Args::Type::CHAR && cmd_is_address(a[1].c));
+
+    // a[2] is subcmd ('G' or 'R')
+    if (a.argc() < 3 || a[2].t != Args::Type::CHAR) {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+    const char subcmd = a[2].c;
+    RailComAddrMap &map = command->bitstream().railcom().addr_map();
+
+    if (cmd_is_get(subcmd) && a.argc() == 3) {
+
+        snprintf(rsp, rsp_msg_len_max, "OK %d", map.present_cnt());
+
+    } else if (cmd_is_get(subcmd) && a.argc() == 4 &&
+               a[3].t == Args::Type::INT) {
+
+        RailComAddrMap::Entry e;
+        if (!map.present_get(a[3].i, e)) {
+            snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+            return true;
+        }
+        uint32_t age_ms = usec_to_msec(time_us_32() - e.seen_us);
+        snprintf(rsp, rsp_msg_len_max, "OK %u %u %" PRIu32, uint(e.addr),
+                 uint(e.conf), age_ms);
+
+    } else if (cmd_is_read(subcmd) && a.argc() == 4 &&
+               a[3].t == Args::Type::INT && (a[3].i == 0 || a[3].i == 1)) {
+
+        map.event_cb_set(a[3].i == 1 ? railcom_addr_cb : nullptr);
+        strcpy(rsp, "OK");
+
+    } else {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+    }
+    return true;
+
+} // railcom_addr_msg
+
+
+static bool railcom_stats_msg(const Args &a, char *rsp)
+{
+    // already checked "R S ..."
+    assert(a.argc() >= 2);
+    assert(a[0].t == Args::Type::CHAR && cmd_is_railcom(a[0].c));
+    assert(a[1].t == Args::Type::CHAR && cmd_is_stats(a[1].c));
+
+    // a[2] is subcmd ('G' or 'S'), a[3] is <stat> or 0
+    if (a.argc() != 4 || a[2].t != Args::Type::CHAR ||
+        a[3].t != Args::Type::INT) {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+        return true;
+    }
+
+    const char subcmd = a[2].c;
+    RailCom &railcom = command->bitstream().railcom();
+
+    if (cmd_is_get(subcmd) && 0 <= a[3].i && a[3].i < RailComStats::cnt) {
+        snprintf(rsp, rsp_msg_len_max, "OK %" PRIu32,
+                 railcom.stats().get(a[3].i));
+    } else if (cmd_is_set(subcmd) && a[3].i == 0) {
+        railcom.stats_reset();
+        strcpy(rsp, "OK");
+    } else {
+        snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+    }
+    return true;
+
+} // railcom_stats_msg
 
 
 ///// debug functions ////////////////////////////////////////////////////////
 
 
+// Debug codes:
+//   0  show dcc packets sent (BufLog)
+//   1  show railcom packets received (BufLog)
+//   2  adc log to log_queue; get is "OK <on> <blocks> <dropped>"
+//   3  railcom stats; get is "OK <rx> <ch1> <ch2> <ch2_part> <ch2_heur>"
+//      (rx is cutouts with something received), set 0 resets; "R S ..." has
+//      the rest
+//   4  railcom channel 2 partial frames; 1 uses good messages before junk
+//   5  ascii request time; get is "OK <cnt> <avg_ns> <max_us>", set 0 resets
+//   6  binary request time; same as 5
+//   7  notifications; get is "OK <sent> <coalesced> <dropped>", set 0 resets
+//   8  sleep when idle (1) or spin (0); get is "OK <sleep> <cnt> <avg_ns>
+//      <max_us>" for the time from req_bell() to taking the request, set
+//      resets that
+//   9  bitstream interrupt latency; same as 5
+//  10  loco speed set latency, DccApi call to the packet on the track
+//      (dcc_lat.h); get is "OK <cnt> <p50_us> <p99_us> <max_us> <missed>",
+//      and "D 10 G <stage>" has one stage (DccLat::Stage: 0 to dcc_srv, 1
+//      to picked, 2 to on the track, 3 all of it, the default); set 0
+//      resets 10-12
+//  11  loco function set latency; same as 10
+//  12  loco batch latency (each loco); same as 10
+//  13  responses from interrupt handlers that found rsp_queue full; get is
+//      "OK <held> <dropped>", set 0 resets
 static bool debug_msg(const Args &a, char *rsp)
 {
     // already checked "D ..."
@@ -1025,6 +2206,11 @@ static bool debug_msg(const Args &a, char *rsp)
 
     const char subcmd = a[2].c;
 
+    // latency codes can get one stage
+    const bool lat_code = (10 <= code && code < 10 + DccLat::kind_cnt);
+    const bool lat_stage = lat_code && cmd_is_get(subcmd) && a.argc() == 4 &&
+                           a[3].t == Args::Type::INT;
+
     if (cmd_is_set(subcmd)) {
         // a[3] is <val>
         if (a.argc() != 4 || a[3].t != Args::Type::INT) {
@@ -1036,17 +2222,102 @@ static bool debug_msg(const Args &a, char *rsp)
             } else if (code == 1) {
                 command->show_railcom(a[3].i != 0);
                 strcpy(rsp, "OK");
+            } else if (code == 2) {
+                if (a[3].i != 0)
+                    adc->log_start(&log_queue);
+                else
+                    adc->log_stop();
+                strcpy(rsp, "OK");
+            } else if (code == 3 && a[3].i == 0) {
+                command->bitstream().railcom().stats_reset();
+                strcpy(rsp, "OK");
+            } else if (code == 4) {
+                command->bitstream().railcom().ch2_mode(
+                    a[3].i != 0 ? RailCom::Ch2Mode::Partial
+                                : RailCom::Ch2Mode::Full);
+                strcpy(rsp, "OK");
+            } else if ((code == 5 || code == 6) && a[3].i == 0) {
+                (code == 5 ? req_time_ascii : req_time_bin) = {0, 0, 0};
+                strcpy(rsp, "OK");
+            } else if (code == 7 && a[3].i == 0) {
+                notify.stats_reset();
+                strcpy(rsp, "OK");
+            } else if (code == 8) {
+                srv_sleep = a[3].i != 0;
+                wake_time = {0, 0, 0};
+                strcpy(rsp, "OK");
+            } else if (code == 9 && a[3].i == 0) {
+                command->bitstream().irq_lat_reset();
+                strcpy(rsp, "OK");
+            } else if (lat_code && a[3].i == 0) {
+                lat.reset();
+                strcpy(rsp, "OK");
+            } else if (code == 13 && a[3].i == 0) {
+                rsp_held_tot = 0;
+                rsp_dropped = 0;
+                strcpy(rsp, "OK");
             } else {
                 snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
             }
         }
     } else if (cmd_is_get(subcmd)) {
-        if (a.argc() != 3) {
+        if (a.argc() != 3 && !lat_stage) {
             snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
         } else if (code == 0) {
             snprintf(rsp, rsp_msg_len_max, "OK %d", command->show_dcc());
         } else if (code == 1) {
             snprintf(rsp, rsp_msg_len_max, "OK %d", command->show_railcom());
+        } else if (code == 2) {
+            snprintf(rsp, rsp_msg_len_max, "OK %d %" PRIu32 " %" PRIu32,
+                     adc->logging(), adc->log_blk_cnt(), adc->log_drop_cnt());
+        } else if (code == 3) {
+            const RailComStats st = command->bitstream().railcom().stats();
+            snprintf(rsp, rsp_msg_len_max,
+                     "OK %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32
+                     " %" PRIu32,
+                     st.cutout - st.empty, st.ch1, st.ch2, st.ch2_part,
+                     st.ch2_heur);
+        } else if (code == 4) {
+            snprintf(rsp, rsp_msg_len_max, "OK %d",
+                     command->bitstream().railcom().ch2_mode() ==
+                         RailCom::Ch2Mode::Partial);
+        } else if (code == 5 || code == 6) {
+            const ReqTime &t = (code == 5) ? req_time_ascii : req_time_bin;
+            uint32_t avg_ns = (t.cnt == 0) ? 0 : uint32_t(t.us * 1000 / t.cnt);
+            snprintf(rsp, rsp_msg_len_max,
+                     "OK %" PRIu32 " %" PRIu32 " %" PRIu32,
+                     t.cnt, avg_ns, t.us_max);
+        } else if (code == 7) {
+            snprintf(rsp, rsp_msg_len_max,
+                     "OK %" PRIu32 " %" PRIu32 " %" PRIu32,
+                     notify.sent(), notify.coalesced(), notify.dropped());
+        } else if (code == 8) {
+            const ReqTime &t = wake_time;
+            uint32_t avg_ns = (t.cnt == 0) ? 0 : uint32_t(t.us * 1000 / t.cnt);
+            snprintf(rsp, rsp_msg_len_max,
+                     "OK %d %" PRIu32 " %" PRIu32 " %" PRIu32, int(srv_sleep),
+                     t.cnt, avg_ns, t.us_max);
+        } else if (code == 9) {
+            const DccBitstream::IrqLat t = command->bitstream().irq_lat();
+            uint32_t avg_ns = (t.cnt == 0) ? 0 : uint32_t(t.us * 1000 / t.cnt);
+            snprintf(rsp, rsp_msg_len_max,
+                     "OK %" PRIu32 " %" PRIu32 " %" PRIu32,
+                     t.cnt, avg_ns, t.us_max);
+        } else if (lat_code) {
+            const int stage = lat_stage ? a[3].i : int(DccLat::Stage::Whole);
+            if (stage < 0 || stage >= DccLat::stage_cnt) {
+                snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
+            } else {
+                const DccLat::Pct p =
+                    lat.get(DccLat::Kind(code - 10), DccLat::Stage(stage));
+                snprintf(rsp, rsp_msg_len_max,
+                         "OK %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32
+                         " %" PRIu32,
+                         p.cnt, p.p50, p.p99, p.max, p.missed);
+            }
+        } else if (code == 13) {
+            snprintf(rsp, rsp_msg_len_max, "OK %" PRIu32 " %" PRIu32,
+                     rsp_held_tot, rsp_dropped);
         } else {
             snprintf(rsp, rsp_msg_len_max, "ERROR %d", __LINE__);
         }
@@ -1080,11 +2351,12 @@ static bool loop_svc_cv_get()
     char msg[rsp_msg_len_max];
 
     if (result)
-        snprintf(msg, sizeof(msg), "OK %u in %lu ms", uint(value), op_ms);
+        snprintf(msg, sizeof(msg), "OK %u in %" PRIu32 " ms", uint(value),
+                 op_ms);
     else
-        snprintf(msg, sizeof(msg), "ERROR in %lu ms", op_ms);
+        snprintf(msg, sizeof(msg), "ERROR in %" PRIu32 " ms", op_ms);
 
-    queue_add_blocking(&rsp_queue, msg);
+    rsp_send(active_id, msg);
 
     return false; // done!
 }
@@ -1101,12 +2373,12 @@ static bool loop_svc_cv_set()
     char msg[rsp_msg_len_max];
 
     if (result) {
-        snprintf(msg, sizeof(msg), "OK in %lu ms", op_ms);
+        snprintf(msg, sizeof(msg), "OK in %" PRIu32 " ms", op_ms);
     } else {
-        snprintf(msg, sizeof(msg), "ERROR in %lu ms", op_ms);
+        snprintf(msg, sizeof(msg), "ERROR in %" PRIu32 " ms", op_ms);
     }
 
-    queue_add_blocking(&rsp_queue, msg);
+    rsp_send(active_id, msg);
 
     return false; // done!
 }
@@ -1125,8 +2397,8 @@ static bool loop_svc_address_get()
     char rsp[rsp_msg_len_max];
 
     if (!result) {
-        snprintf(rsp, sizeof(rsp), "ERROR in %lu ms", op_ms);
-        queue_add_blocking(&rsp_queue, rsp);
+        snprintf(rsp, sizeof(rsp), "ERROR in %" PRIu32 " ms", op_ms);
+        rsp_send(active_id, rsp);
         return false; // done!
     }
 
@@ -1145,8 +2417,9 @@ static bool loop_svc_address_get()
 
     } else if (loop_svc_address_state.cv_num == DccCv::address) {
         // reading CV1 (value is address)
-        snprintf(rsp, sizeof(rsp), "OK %u in %lu ms", uint(value), op_ms);
-        queue_add_blocking(&rsp_queue, rsp);
+        snprintf(rsp, sizeof(rsp), "OK %u in %" PRIu32 " ms", uint(value),
+                 op_ms);
+        rsp_send(active_id, rsp);
         return false; // done!
 
     } else if (loop_svc_address_state.cv_num == DccCv::address_hi) {
@@ -1159,8 +2432,8 @@ static bool loop_svc_address_get()
     } else if (loop_svc_address_state.cv_num == DccCv::address_lo) {
         // reading CV18 (value is address_lo)
         int address = (loop_svc_address_state.address << 8) | value;
-        snprintf(rsp, sizeof(rsp), "OK %u in %lu ms", address, op_ms);
-        queue_add_blocking(&rsp_queue, rsp);
+        snprintf(rsp, sizeof(rsp), "OK %u in %" PRIu32 " ms", address, op_ms);
+        rsp_send(active_id, rsp);
         loop_svc_address_state.cv_num = DccCv::invalid;
         return false; // done!
     }
@@ -1183,8 +2456,8 @@ static bool loop_svc_address_set()
     char rsp[rsp_msg_len_max];
 
     if (!result) {
-        snprintf(rsp, sizeof(rsp), "ERROR in %lu ms", op_ms);
-        queue_add_blocking(&rsp_queue, rsp);
+        snprintf(rsp, sizeof(rsp), "ERROR in %" PRIu32 " ms", op_ms);
+        rsp_send(active_id, rsp);
         return false; // done!
     }
 
@@ -1209,8 +2482,8 @@ static bool loop_svc_address_set()
 
     } else if (loop_svc_address_state.cv_num == DccCv::config) {
         // wrote CV29[5], done
-        snprintf(rsp, sizeof(rsp), "OK in %lu ms", op_ms);
-        queue_add_blocking(&rsp_queue, rsp);
+        snprintf(rsp, sizeof(rsp), "OK in %" PRIu32 " ms", op_ms);
+        rsp_send(active_id, rsp);
         loop_svc_address_state.cv_num = DccCv::invalid;
         return false; // done!
     }
@@ -0,0 +1,89 @@
+#include "dcc/dcc_trip.h"
+
+#include <cstdint>
+
+
+DccTrip::DccTrip() :
+    _limit_ma(limit_ma_def),
+    _retry_ms(retry_ms_def),
+    _retry_max(retry_max_def),
+    _state(State::On),
+    _on_us(0),
+    _off_us(0),
+    _wait_us(0),
+    _retry_cnt(0),
+    _trip_cnt(0)
+{
+}
+
+
+void DccTrip::reset(uint32_t now_us)
+{
+    _state = State::On;
+    _on_us = now_us;
+    _retry_cnt = 0;
+}
+
+
+bool DccTrip::config(uint16_t limit_ma, uint32_t retry_ms, int retry_max)
+{
+    if (limit_ma == 0 || retry_ms == 0 || retry_ms > retry_ms_max ||
+        retry_max < 0)
+        return false;
+
+    _limit_ma = limit_ma;
+    _retry_ms = retry_ms;
+    _retry_max = retry_max;
+    return true;
+}
+
+
+DccTrip::Event DccTrip::check(uint16_t track_ma,
+                              uint32_t now_us) // called in interrupt context
+{
+    if (_state == State::On) {
+
+        if (track_ma < _limit_ma)
+            return Event::None;
+
+        _trip_cnt++;
+
+        // tripped again soon after retrying?
+        if ((now_us - _on_us) < clear_ms * 1000)
+            _retry_cnt++;
+        else
+            _retry_cnt = 1;
+
+        if (_retry_cnt > _retry_max) {
+            _state = State::Lockout;
+            return Event::Lockout;
+        }
+
+        // wait retry_ms, doubling for each trip in a row
+        uint32_t wait_ms = _retry_ms;
+        for (int i = 1; i < _retry_cnt && wait_ms < retry_ms_max; i++)
+            wait_ms *= 2;
+        if (wait_ms > retry_ms_max)
+            wait_ms = retry_ms_max;
+
+        _state = State::Off;
+        _off_us = now_us;
+        _wait_us = wait_ms * 1000;
+        return Event::Trip;
+
+    } else if (_state == State::Off) {
+
+        if ((now_us - _off_us) < _wait_us)
+            return Event::None;
+
+        _state = State::On;
+        _on_us = now_us;
+        return Event::Retry;
+
+    } else {
+
+        return Event::None; // locked out
+
+    }
+
+} // DccTrip::check
@@ -8,6 +8,9 @@
 
 #include "misc/dbg_gpio.h"
 #include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
 #include "hardware/uart.h"
 #include "dcc/railcom_msg.h"
 #include "dcc/railcom_spec.h"
@@ -18,23 +21,62 @@ int RailCom::dbg_junk __attribute((weak)) = -1;
 int RailCom::dbg_short __attribute((weak)) = -1;
 
 
+RailCom *RailCom::uart_railcom[uart_max] = {nullptr, nullptr};
+
+
 RailCom::RailCom(uart_inst_t *uart, int rx_gpio) :
     _uart(uart),
     _rx_gpio(rx_gpio),
+    _rx_wr(0),
+    _cutout_us(0),
+    _rx_ovr_cnt(0),
     _pkt_len(0),
     _ch1_msg_cnt(0),
     _ch2_msg_cnt(0),
-    _parsed_all(false)
+    _parsed_all(false),
+    _ch2_mode(Ch2Mode::Partial),
+    _ch2_frame(Ch2Frame::None),
+    _cut{},
+    _stats{}
 {
+    _rx_buf[0].cnt = 0;
+    _rx_buf[1].cnt = 0;
+
     if (_uart == nullptr || _rx_gpio < 0)
         return;
 
     gpio_set_function(_rx_gpio, UART_FUNCSEL_NUM(_uart, _rx_gpio));
     uart_init(_uart, RailComSpec::baud);
 
+    // With the fifo off, the rx interrupt is as soon as each byte arrives,
+    // so its time is known within a few usec. It's higher priority than the
+    // pwm interrupt so the bit interrupt doesn't delay it (or make it miss
+    // a byte; there's only 40 usec before the next one).
+    uart_set_fifo_enabled(_uart, false);
+
+    uart_railcom[uart_get_index(_uart)] = this;
+    uint irq = UART_IRQ_NUM(_uart);
+    irq_set_exclusive_handler(irq, uart_handler);
+    irq_set_priority(irq, PICO_HIGHEST_IRQ_PRIORITY);
+    irq_set_enabled(irq, true);
+    uart_set_irq_enables(_uart, true, false); // rx, not tx
+
 } // RailCom::RailCom
 
 
+RailCom::~RailCom()
+{
+    if (_uart == nullptr || _rx_gpio < 0)
+        return;
+
+    uart_set_irq_enables(_uart, false, false);
+    uint irq = UART_IRQ_NUM(_uart);
+    irq_set_enabled(irq, false);
+    irq_remove_handler(irq, uart_handler);
+    uart_railcom[uart_get_index(_uart)] = nullptr;
+}
+
+
 void RailCom::dbg_init()
 {
     DbgGpio::init(dbg_read);
@@ -43,25 +85,75 @@ void RailCom::dbg_init()
 }
 
 
+void RailCom::uart_handler() // called in interrupt context
+{
+    uint32_t now_us = time_us_32();
+    for (int u = 0; u < uart_max; u++) {
+        RailCom *me = uart_railcom[u];
+        if (me == nullptr)
+            continue;
+        while (uart_is_readable(me->_uart))
+            me->rx(uart_getc(me->_uart), now_us);
+    }
+}
+
+
+void RailCom::rx(uint8_t enc, uint32_t now_us) // called in interrupt context
+{
+    RxBuf &b = _rx_buf[_rx_wr];
+    if (b.cnt < pkt_max) {
+        b.enc[b.cnt] = enc;
+        b.us[b.cnt] = now_us;
+        b.cnt++;
+    } else {
+        _rx_ovr_cnt++;
+    }
+}
+
+
+// Anything received between cutouts (there shouldn't be anything) is
+// dropped here.
+void RailCom::cutout_start(uint32_t start_us) // called in interrupt context
+{
+    _cutout_us = start_us;
+    _rx_buf[_rx_wr].cnt = 0;
+}
+
+
+// The uart interrupt is higher priority, so it either finishes storing a byte
+// before the swap or stores it after (in the other buffer).
 void RailCom::read() // called in interrupt context
 {
     DbgGpio d(dbg_read);
 
-    _pkt_len = 0;
+    int rd = _rx_wr;
+    _rx_wr = 1 - rd;
+    _rx_buf[1 - rd].cnt = 0;
+
+    const RxBuf &b = _rx_buf[rd];
+
     _ch1_msg_cnt = 0;
     _ch2_msg_cnt = 0;
     _parsed_all = false;
+    _ch2_frame = Ch2Frame::None;
+
+    for (_pkt_len = 0; _pkt_len < b.cnt; _pkt_len++) {
+        _enc[_pkt_len] = b.enc[_pkt_len];
+        _us[_pkt_len] = int16_t(b.us[_pkt_len] - _cutout_us);
+    }
+
+    RailComSpec::decode_frame(_enc, _pkt_len, _frame);
 
-    for (_pkt_len = 0; _pkt_len < pkt_max && uart_is_readable(_uart); _pkt_len++) {
-        _enc[_pkt_len] = uart_getc(_uart);
-        _dec[_pkt_len] = RailComSpec::decode[_enc[_pkt_len]];
-        // debug: trigger on invalid data received
-        if (dbg_junk >= 0 && _dec[_pkt_len] == RailComSpec::DecId::dec_inv) {
-            DbgGpio d(dbg_junk);
-            // XXX this seems to be needed to force construction of DbgGpio
-            [[maybe_unused]] volatile int i = 0;
+    // debug: trigger on invalid data received
+    if (dbg_junk >= 0) {
+        for (int i = 0; i < _pkt_len; i++) {
+            if (_frame.dec[i] == RailComSpec::DecId::dec_inv) {
+                DbgGpio d(dbg_junk);
+                // XXX this seems to be needed to force construction of DbgGpio
+                [[maybe_unused]] volatile int v = 0;
+            }
         }
-    } // for (_pkt_len...)
+    }
 
     // debug: trigger on not receiving all bytes
     if (dbg_junk >= 0 && _pkt_len != pkt_max) {
@@ -77,7 +169,6 @@ void RailCom::read() // called in interrupt context
 // Channel 1 is by default always sent by all decoders that support RailCom,
 // but that can be disabled in the decoder. If there is more than one loco on
 // the same track, they will both send channel 1 and it will likely be junk.
-// We don't use it, but decoding it helps figure out where channel 2 starts.
 //
 // Channel 2 is only sent by the DCC-addressed decoder. If there is no decoder
 // at the DCC address of DCC packet, there will be no channel 2 data. If there
@@ -86,72 +177,128 @@ void RailCom::read() // called in interrupt context
 // extra ones in the 4/8 encoding, implying the decoder was trying to send a
 // zero (>10 mA), but it did not get through (e.g. because of dirty track).
 // Multiple decoders at the same DCC address would also cause corruption, but
-// with excess zeros instead of excess ones. Channel 2 often does not need
-// the full 6 bytes. It would be possible to use information from channel 2
-// with only one byte, e.g. an ack, but a choice here is to require 6 valid
-// bytes to consider anything in channel 2 valid.
-//
-// If we got at least 2 bytes, see if the first two are valid channel 1 data.
-//
-// If we got a valid channel 1,
-//   try extracting 6 bytes of channel 2 data starting at byte 2,
-// else (channel 1 invalid),
-//   try extracting 6 bytes of channel 2 data starting at byte 0.
+// with excess zeros instead of excess ones.
 //
-// If channel 1 failed due to corruption, channel 2 will also fail due to
-// corruption. If channel 1 failed because no decoder sent it (i.e. it is
-// disabled), we probably got 6 bytes and it's all channel 2.
+// Each byte's arrival time says which channel it's in, so junk in channel 1
+// (or no channel 1 at all) doesn't affect channel 2. Channel 1 must be
+// exactly one ALO or AHI message. Channel 2 can be any number of bytes (ESU
+// LokSound 5 fills it out to 6, but the spec doesn't require that).
 //
-// XXX Can we get less than 6 bytes of channel 2 data? ESU LokSound 5 fills
-//     out channel 2 to 6 bytes, but I don't think the spec requires that.
+// Corruption in channel 2 is usually toward the end (e.g. the filler ACKs
+// after a POM). In Partial mode, the messages before the first bad byte are
+// used and the rest is dropped; a message is only accepted if all of its
+// bytes decode, so a POM is either complete or not there. Nothing after a
+// bad byte is used since we don't know where the next message would start.
+// In Full mode, if there's anything in channel 2 we don't understand, we
+// don't use any of it.
 
 void RailCom::parse() // called in interrupt context
 {
-    const uint8_t *d = _dec;
-    const uint8_t *d_end = d + _pkt_len;
-
-    // Attempt to extract channel 1.
-    //
-    // It must be the first two bytes, and it must contain either an ALO or
-    // AHI message. Anything else, and we try to parse channel 2 starting at
-    // the first byte below.  It is possible no decoder sent any channel 1
-    // data and we only have 6 bytes of channel 2. It is also possible we have
-    // good channel 1 data, but channel 2 not there or is corrupted; we still
-    // use channel 1.
-
-    if (_ch1_msg.parse1(d, d_end))
+    int ch1_len = 0;
+    while (ch1_len < _pkt_len && _us[ch1_len] <= RailComSpec::ch_split_us)
+        ch1_len++;
+
+    int i = 0;
+
+    if (ch1_len == RailComSpec::ch1_bytes && _ch1_msg.parse1(_frame, i, ch1_len))
         _ch1_msg_cnt = 1;
     else
         _ch1_msg_cnt = 0;
 
-    // Attempt to extract channel 2.
-    //
-    // We must have exactly 6 bytes remaining to look at - either channel 1
-    // was parsed above and we have 6 left, or we have 6 total because no
-    // decoder sent channel 1. All 6 bytes must decode correctly. If channel 1
-    // was corrupted, we won't get channel 2 because we'll restart here with
-    // the corrupt data. If there's anything in channel 2 we don't understand,
-    // we don't use any of it. (An alternative would be to use what we can
-    // understand.)
+    i = ch1_len;
 
+    // Late channel 1 bytes (or no channel 1) can leave up to pkt_max bytes
+    // here, more than a real channel 2; the ones that don't fit are junk.
     _ch2_msg_cnt = 0;
-    if ((d_end - d) == RailComSpec::ch2_bytes) {
-        while (d < d_end) {
-            assert(_ch2_msg_cnt < ch2_msg_max);
-            if (_ch2_msg[_ch2_msg_cnt].parse2(d, d_end)) {
-                _ch2_msg_cnt++;
-            } else {
-                _ch2_msg_cnt = 0;
-                break;
-            }
-        }
+    while (i < _pkt_len && _ch2_msg_cnt < ch2_msg_max) {
+        if (!_ch2_msg[_ch2_msg_cnt].parse2(_frame, i, _pkt_len))
+            break;
+        _ch2_msg_cnt++;
+    }
+
+    if (i == ch1_len) {
+        _ch2_frame = (i == _pkt_len) ? Ch2Frame::None : Ch2Frame::Rejected;
+    } else if (i == _pkt_len) {
+        _ch2_frame = Ch2Frame::Full;
+    } else {
+        _ch2_frame = Ch2Frame::Partial;
+        if (_ch2_mode == Ch2Mode::Full)
+            _ch2_msg_cnt = 0;
     }
 
-    _parsed_all = (d == d_end);
+    _parsed_all = (ch1_len == 0 || _ch1_msg_cnt == 1) && i == _pkt_len;
+
+    // count this cutout
+    RailComStats &c = _cut;
+    c.reset();
+    c.cutout = 1;
+    c.empty = (_pkt_len == 0) ? 1 : 0;
+    c.bytes = _pkt_len;
+    for (int j = 0; j < _pkt_len; j++)
+        if (_frame.dec[j] >= RailComSpec::DecId::dec_res)
+            c.inv++;
+    c.short_frame = (_pkt_len > 0 && _pkt_len < pkt_max) ? 1 : 0;
+    c.ch1 = _ch1_msg_cnt;
+    c.ch2 = (_ch2_msg_cnt > 0) ? 1 : 0;
+    c.ch2_full = (_ch2_frame == Ch2Frame::Full) ? 1 : 0;
+    c.ch2_part = (_ch2_frame == Ch2Frame::Partial) ? 1 : 0;
+    c.ch2_rej = (_ch2_frame == Ch2Frame::Rejected) ? 1 : 0;
+    for (int m = 0; m < _ch2_msg_cnt; m++) {
+        if (_ch2_msg[m].id == RailComMsg::MsgId::ack)
+            c.ack++;
+        else if (_ch2_msg[m].id == RailComMsg::MsgId::nak)
+            c.nak++;
+        else if (_ch2_msg[m].id == RailComMsg::MsgId::pom)
+            c.pom++;
+    }
+    c.ch2_heur = ch2_heur() ? 1 : 0;
+
+    _stats.add(c);
+
+    _addr_map.update(_ch1_msg_cnt > 0 ? &_ch1_msg : nullptr, _cutout_us);
 
 } // RailCom::parse()
 
 
+RailComStats RailCom::stats() const
+{
+    uint32_t s = save_and_disable_interrupts();
+    RailComStats st = _stats;
+    restore_interrupts(s);
+    return st;
+}
+
+
+void RailCom::stats_reset()
+{
+    uint32_t s = save_and_disable_interrupts();
+    _stats.reset();
+    restore_interrupts(s);
+}
+
+
+// Would the old parse (before byte times) have found channel 2? That was: if
+// the first two bytes are a valid channel 1, channel 2 starts after them,
+// otherwise at the first byte, and there must be exactly 6 bytes of it, all
+// good.
+bool RailCom::ch2_heur() const // called in interrupt context
+{
+    int i = 0;
+
+    RailComMsg msg;
+    msg.parse1(_frame, i, _pkt_len); // skips channel 1 if it's good
+
+    if ((_pkt_len - i) != RailComSpec::ch2_bytes)
+        return false;
+
+    while (i < _pkt_len)
+        if (!msg.parse2(_frame, i, _pkt_len))
+            return false;
+
+    return true;
+}
+
+
 // for each encoded byte:
 //   if byte decodes to 6-bit binary, print bits (bbbbbb)
 //   else if byte is special (ack, nak, bsy), print text (AK, NK, BZ)
@@ -164,16 +311,17 @@ char *RailCom::dump(char *buf, int buf_len) const
     char *e = buf + buf_len;
 
     for (int i = 0; i < _pkt_len; i++) {
-        if (_dec[i] < RailComSpec::DecId::dec_max) {
+        if (_frame.dec[i] < RailComSpec::DecId::dec_max) {
             // encoded value is valid data - print decoded value in binary
             for (uint8_t m = 0x20; m != 0; m >>= 1)
-                b += snprintf(b, e - b, "%c", (_dec[i] & m) != 0 ? '1' : '0');
-        } else if (_dec[i] == RailComSpec::DecId::dec_ack) {
+                b += snprintf(b, e - b, "%c",
+                              (_frame.dec[i] & m) != 0 ? '1' : '0');
+        } else if (_frame.dec[i] == RailComSpec::DecId::dec_ack) {
             b += snprintf(b, e - b, "AK");
-        } else if (_dec[i] == RailComSpec::DecId::dec_nak) {
+        } else if (_frame.dec[i] == RailComSpec::DecId::dec_nak) {
             b += snprintf(b, e - b, "NK");
 #if RAILCOMSPEC_VERSION == 2012
-        } else if (_dec[i] == RailComSpec::DecId::dec_bsy) {
+        } else if (_frame.dec[i] == RailComSpec::DecId::dec_bsy) {
             b += snprintf(b, e - b, "BZ");
 #endif
         } else {
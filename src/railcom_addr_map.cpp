@@ -0,0 +1,161 @@
+#include "dcc/railcom_addr_map.h"
+
+#include <cstdint>
+
+#include "hardware/sync.h"
+#include "dcc/dcc_pkt.h"
+#include "dcc/railcom_msg.h"
+
+
+RailComAddrMap::RailComAddrMap() :
+    _entry_cnt(0),
+    _half_id(RailComMsg::MsgId::inv),
+    _half_val(0),
+    _half_us(0),
+    _event_cb(nullptr)
+{
+}
+
+
+// RCN-217 section 5.2: AHI/ALO are the address as it is sent in a DCC
+// packet, short (AHI 0) or long (AHI 11xxxxxx)
+uint16_t RailComAddrMap::addr(uint8_t ahi, uint8_t alo)
+{
+    if (ahi == 0) {
+        if (alo < DccPkt::address_min || alo > 127)
+            return 0;
+        return alo;
+    } else if ((ahi & 0xc0) == 0xc0) {
+        int a = ((ahi & 0x3f) << 8) | alo;
+        if (a < DccPkt::address_min || a > DccPkt::address_max)
+            return 0;
+        return a;
+    } else {
+        return 0;
+    }
+}
+
+
+void RailComAddrMap::update(const RailComMsg *ch1,
+                            uint32_t now_us) // called in interrupt context
+{
+    if (ch1 != nullptr &&
+        (ch1->id == RailComMsg::MsgId::ahi || ch1->id == RailComMsg::MsgId::alo)) {
+
+        uint8_t val = (ch1->id == RailComMsg::MsgId::ahi) ? ch1->ahi.ahi //
+                                                            : ch1->alo.alo;
+
+        // the other half, recent enough?
+        if (_half_id != RailComMsg::MsgId::inv && _half_id != ch1->id &&
+            (now_us - _half_us) < pair_us) {
+            uint16_t a = (ch1->id == RailComMsg::MsgId::ahi) ? addr(val, _half_val)
+                                                              : addr(_half_val, val);
+            if (a != 0)
+                seen(a, now_us);
+        }
+
+        // this one can pair with the next one too
+        _half_id = ch1->id;
+        _half_val = val;
+        _half_us = now_us;
+    }
+
+    age(now_us);
+
+} // RailComAddrMap::update
+
+
+void RailComAddrMap::seen(uint16_t addr,
+                          uint32_t now_us) // called in interrupt context
+{
+    int i;
+    for (i = 0; i < _entry_cnt; i++)
+        if (_entry[i].addr == addr)
+            break;
+
+    if (i == _entry_cnt) {
+        if (_entry_cnt == addr_max) {
+            // full; replace the least sure (then the oldest)
+            i = 0;
+            for (int j = 1; j < _entry_cnt; j++) {
+                if (_entry[j].conf < _entry[i].conf ||
+                    (_entry[j].conf == _entry[i].conf &&
+                     int32_t(_entry[j].seen_us - _entry[i].seen_us) < 0))
+                    i = j;
+            }
+            drop(i);
+            i = _entry_cnt;
+        }
+        _entry[i].addr = addr;
+        _entry[i].conf = 0;
+        _entry_cnt++;
+    }
+
+    Entry &e = _entry[i];
+    e.seen_us = now_us;
+    if (e.conf < conf_max) {
+        e.conf++;
+        if (e.conf == conf_min && _event_cb != nullptr)
+            _event_cb(e.addr, true);
+    }
+}
+
+
+void RailComAddrMap::age(uint32_t now_us) // called in interrupt context
+{
+    int i = 0;
+    while (i < _entry_cnt) {
+        if ((now_us - _entry[i].seen_us) >= gone_ms * 1000)
+            drop(i); // last one moved to i
+        else
+            i++;
+    }
+}
+
+
+// Remove _entry[i], moving the last one into its place
+void RailComAddrMap::drop(int i) // called in interrupt context
+{
+    if (_entry[i].conf >= conf_min && _event_cb != nullptr)
+        _event_cb(_entry[i].addr, false);
+    _entry_cnt--;
+    _entry[i] = _entry[_entry_cnt];
+}
+
+
+// Only called with no cutouts going (track off), so no interrupts to worry
+// about
+void RailComAddrMap::clear()
+{
+    while (_entry_cnt > 0)
+        drop(_entry_cnt - 1);
+    _half_id = RailComMsg::MsgId::inv;
+}
+
+
+int RailComAddrMap::present_cnt() const
+{
+    uint32_t s = save_and_disable_interrupts();
+    int cnt = 0;
+    for (int i = 0; i < _entry_cnt; i++)
+        if (_entry[i].conf >= conf_min)
+            cnt++;
+    restore_interrupts(s);
+    return cnt;
+}
+
+
+bool RailComAddrMap::present_get(int i, Entry &entry) const
+{
+    bool found = false;
+    uint32_t s = save_and_disable_interrupts();
+    for (int j = 0; j < _entry_cnt; j++) {
+        if (_entry[j].conf >= conf_min && i-- == 0) {
+            entry = _entry[j];
+            found = true;
+            break;
+        }
+    }
+    restore_interrupts(s);
+    return found;
+}
@@ -6,163 +6,117 @@
 #include <cstdio>
 #include <cstring>
 
-// Extract one message from decoded 6-bit data
+// Extract one message from a decoded frame, starting at byte i (and before
+// byte end). A message is only taken if all of its bytes are data
+// (f.all_valid()), and its bits come from f.field(), so nothing here looks at
+// one byte at a time except the special (non-data) ones in channel 2.
 // Return true if message extracted, false on error
-// Update d to point to next unused data
+// Update i to the next unused byte
 
 
 // channel 1 messages
-bool RailComMsg::parse1(const uint8_t *&d, const uint8_t *d_end) // called in interrupt context
+bool RailComMsg::parse1(const RailComSpec::Frame &f, int &i, int end) // called in interrupt context
 {
-    int len = d_end - d; // 6-bit datum available
-    if (len < 1) {
+    // 12 bit (2 byte) message
+    if ((end - i) < 2 || !f.all_valid(i, 2))
         return false;
-    }
 
-    uint8_t b0 = d[0];
-    if (b0 < RailComSpec::DecId::dec_max) {
-        // b0 was successfully decoded to 6 bits of data
-        RailComSpec::PktId pkt_id = RailComSpec::PktId((b0 >> 2) & 0x0f);
-        if (pkt_id == RailComSpec::PktId::pkt_ahi) {
-            // 12 bit (2 byte) message
-            if (len >= 2) {
-                id = MsgId::ahi;
-                ahi.ahi = ((b0 << 6) | d[1]) & 0xff;
-                d += 2;
-                return true;
-            }
-        } else if (pkt_id == RailComSpec::PktId::pkt_alo) {
-            // 12 bit (2 byte) message
-            if (len >= 2) {
-                id = MsgId::alo;
-                alo.alo = ((b0 << 6) | d[1]) & 0xff;
-                d += 2;
-                return true;
-            }
-        }
+    const uint32_t v = uint32_t(f.field(i, 2));
+    const RailComSpec::PktId pkt_id = RailComSpec::PktId((v >> 8) & 0x0f);
+    if (pkt_id == RailComSpec::PktId::pkt_ahi) {
+        id = MsgId::ahi;
+        ahi.ahi = v & 0xff;
+    } else if (pkt_id == RailComSpec::PktId::pkt_alo) {
+        id = MsgId::alo;
+        alo.alo = v & 0xff;
+    } else {
+        return false;
     }
-    return false;
+    i += 2;
+    return true;
 }
 
 
 // channel 2 messages
-bool RailComMsg::parse2(const uint8_t *&d, const uint8_t *d_end) // called in interrupt context
+bool RailComMsg::parse2(const RailComSpec::Frame &f, int &i, int end) // called in interrupt context
 {
-    int len = d_end - d; // 6-bit datum available
-    if (len < 1) {
+    if ((end - i) < 1)
         return false;
-    }
 
-    uint8_t b0 = d[0];
-    if (b0 == RailComSpec::DecId::dec_ack) {
-        id = MsgId::ack;
-        d += 1;
-        return true;
-    } else if (b0 == RailComSpec::DecId::dec_nak) {
-        id = MsgId::nak;
-        d += 1;
-        return true;
+    if (!f.all_valid(i, 1)) {
+        const uint8_t b0 = f.dec[i];
+        if (b0 == RailComSpec::DecId::dec_ack) {
+            id = MsgId::ack;
 #if RAILCOMSPEC_VERSION == 2012
-    } else if (b0 == RailComSpec::DecId::dec_bsy) {
-        id = MsgId::bsy;
-        d += 1;
-        return true;
+        } else if (b0 == RailComSpec::DecId::dec_bsy) {
+            id = MsgId::bsy;
 #endif
-    } else if (b0 < RailComSpec::DecId::dec_max) {
-        // b0 was successfully decoded to 6 bits of data
-        RailComSpec::PktId pkt_id = RailComSpec::PktId((b0 >> 2) & 0x0f);
-        if (pkt_id == RailComSpec::PktId::pkt_pom) {
-            // 12 bit (2 byte) message
-            if (len >= 2) {
-                uint8_t b1 = d[1];
-                if (b1 < RailComSpec::DecId::dec_max) {
-                    id = MsgId::pom;
-                    pom.val = ((b0 << 6) | b1) & 0xff;
-                    d += 2;
-                    return true;
-                }
-            }
-            // it looks like ahi and alo are allowed in either channel
-        } else if (pkt_id == RailComSpec::PktId::pkt_ahi) {
-            // 12 bit (2 byte) message
-            if (len >= 2) {
-                uint8_t b1 = d[1];
-                if (b1 < RailComSpec::DecId::dec_max) {
-                    id = MsgId::ahi;
-                    ahi.ahi = ((b0 << 6) | b1) & 0xff;
-                    d += 2;
-                    return true;
-                }
-            }
-        } else if (pkt_id == RailComSpec::PktId::pkt_alo) {
-            // 12 bit (2 byte) message
-            if (len >= 2) {
-                uint8_t b1 = d[1];
-                if (b1 < RailComSpec::DecId::dec_max) {
-                    id = MsgId::alo;
-                    alo.alo = ((b0 << 6) | b1) & 0xff;
-                    d += 2;
-                    return true;
-                }
-            }
-        } else if (pkt_id == RailComSpec::PktId::pkt_ext) {
-            // 18 bit (3 byte) message
-            if (len >= 3) {
-                uint8_t b1 = d[1];
-                uint8_t b2 = d[2];
-                if (b1 < RailComSpec::DecId::dec_max &&
-                    b2 < RailComSpec::DecId::dec_max) {
-                    id = MsgId::ext;
-                    ext.typ = ((b0 << 4) & 0x30) | ((b1 >> 2) & 0x0f);
-                    ext.pos = ((b1 << 6) & 0xc0) | b2;
-                    d += 3;
-                    return true;
-                }
-            }
-        } else if (pkt_id == RailComSpec::PktId::pkt_dyn) {
-            // 18 bit (3 byte) message
-            if (len >= 3) {
-                uint8_t b1 = d[1];
-                uint8_t b2 = d[2];
-                if (b1 < RailComSpec::DecId::dec_max &&
-                    b2 < RailComSpec::DecId::dec_max) {
-                    id = MsgId::dyn;
-                    dyn.val = ((b0 << 6) | b1) & 0xff;
-                    dyn.id = RailComSpec::DynId(b2);
-                    d += 3;
-                    return true;
-                }
-            }
-        } else if ((pkt_id & 0x0c) == RailComSpec::PktId::pkt_xpom) {
-            // xpom 8, 9, 10, 11 (0x08, 0x09, 0x0a, 0x0b)
-            // 36 bit (6 byte) message
-            if (len >= 6) {
-                uint8_t b1 = d[1];
-                uint8_t b2 = d[2];
-                uint8_t b3 = d[3];
-                uint8_t b4 = d[4];
-                uint8_t b5 = d[5];
-                if (b1 < RailComSpec::DecId::dec_max &&
-                    b2 < RailComSpec::DecId::dec_max &&
-                    b3 < RailComSpec::DecId::dec_max &&
-                    b4 < RailComSpec::DecId::dec_max &&
-                    b5 < RailComSpec::DecId::dec_max) {
-                    // [ d0 ] [ d1 ] [ d2 ] [ d3 ] [ d4 ] [ d5 ]
-                    // IIII00 000000 111111 112222 222233 333333
-                    //     [ val0  ] [ val1  ][ val2  ][ val3  ]
-                    id = MsgId::xpom;
-                    xpom.ss = pkt_id & 0x03;
-                    xpom.val[0] = (b0 << 6) | b1;
-                    xpom.val[1] = (b2 << 2) | (b3 >> 4);
-                    xpom.val[2] = (b3 << 4) | (b4 >> 2);
-                    xpom.val[3] = (b4 << 6) | b5;
-                    d += 6;
-                    return true;
-                }
-            }
+        } else if (b0 == RailComSpec::DecId::dec_nak) {
+            id = MsgId::nak;
+        } else {
+            return false;
         }
+        i += 1;
+        return true;
+    }
+
+    const RailComSpec::PktId pkt_id =
+        RailComSpec::PktId((f.field(i, 1) >> 2) & 0x0f);
+
+    // message length in bytes (6 bits each)
+    int n;
+    if (pkt_id == RailComSpec::PktId::pkt_pom ||
+        pkt_id == RailComSpec::PktId::pkt_ahi || // it looks like ahi and alo
+        pkt_id == RailComSpec::PktId::pkt_alo) { // are allowed in either channel
+        n = 2;
+    } else if (pkt_id == RailComSpec::PktId::pkt_ext ||
+               pkt_id == RailComSpec::PktId::pkt_dyn) {
+        n = 3;
+    } else if ((pkt_id & 0x0c) == RailComSpec::PktId::pkt_xpom) {
+        // xpom 8, 9, 10, 11 (0x08, 0x09, 0x0a, 0x0b)
+        n = 6;
+    } else {
+        return false;
+    }
+
+    if ((end - i) < n || !f.all_valid(i, n))
+        return false;
+
+    const uint64_t v = f.field(i, n);
+
+    if (pkt_id == RailComSpec::PktId::pkt_pom) {
+        // IIIIVV VVVVVV
+        id = MsgId::pom;
+        pom.val = v & 0xff;
+    } else if (pkt_id == RailComSpec::PktId::pkt_ahi) {
+        id = MsgId::ahi;
+        ahi.ahi = v & 0xff;
+    } else if (pkt_id == RailComSpec::PktId::pkt_alo) {
+        id = MsgId::alo;
+        alo.alo = v & 0xff;
+    } else if (pkt_id == RailComSpec::PktId::pkt_ext) {
+        // IIIITT TTTTPP PPPPPP
+        id = MsgId::ext;
+        ext.typ = (v >> 8) & 0x3f;
+        ext.pos = v & 0xff;
+    } else if (pkt_id == RailComSpec::PktId::pkt_dyn) {
+        // IIIIVV VVVVVV DDDDDD
+        id = MsgId::dyn;
+        dyn.val = (v >> 6) & 0xff;
+        dyn.id = RailComSpec::DynId(v & 0x3f);
+    } else {
+        // [ d0 ] [ d1 ] [ d2 ] [ d3 ] [ d4 ] [ d5 ]
+        // IIII00 000000 111111 112222 222233 333333
+        //     [ val0  ] [ val1  ][ val2  ][ val3  ]
+        id = MsgId::xpom;
+        xpom.ss = pkt_id & 0x03;
+        xpom.val[0] = (v >> 24) & 0xff;
+        xpom.val[1] = (v >> 16) & 0xff;
+        xpom.val[2] = (v >> 8) & 0xff;
+        xpom.val[3] = v & 0xff;
     }
-    return false;
+    i += n;
+    return true;
 }
 
 
@@ -70,6 +70,55 @@ const uint8_t decode[UINT8_MAX + 1] = {
     _INV, _INV, _INV, _INV, _INV, _INV, _INV, _INV, // 0xf8-0xff
 };
 
+void decode_frame_scalar(const uint8_t *enc, int len, Frame &f)
+{
+    assert(0 <= len && len <= Frame::len_max);
+    f.data = 0;
+    f.valid = 0;
+    f.len = len;
+    for (int i = 0; i < Frame::len_max; i++) {
+        uint8_t d = (i < len) ? decode[enc[i]] : uint8_t(DecId::dec_inv);
+        f.dec[i] = d;
+        f.data <<= 6;
+        if (d < DecId::dec_max) {
+            f.data |= d;
+            f.valid |= (1 << i);
+        }
+    }
+}
+
+
+void decode_frame_swar(const uint8_t *enc, int len, Frame &f)
+{
+    assert(0 <= len && len <= Frame::len_max);
+
+    // all eight decoded bytes in one word, dec[0] in the top byte
+    uint64_t x = 0;
+    for (int i = 0; i < Frame::len_max; i++) {
+        uint8_t d = (i < len) ? decode[enc[i]] : uint8_t(DecId::dec_inv);
+        f.dec[i] = d;
+        x = (x << 8) | d;
+    }
+
+    // data bytes are the ones with the top two bits clear (< dec_max);
+    // ok has bit 0 of each data byte set
+    uint64_t ok = (~(x | (x << 1)) & 0x8080808080808080) >> 7;
+
+    // gather those bits, top byte (dec[0]) to bit 0
+    f.valid = (ok * 0x8040201008040201) >> 56;
+
+    // drop non-data bytes, then squeeze out the two top bits of each byte:
+    // bytes to 12-bit pairs, to 24-bit quads, to all 48 bits
+    uint64_t y = x & (ok * 0xff) & 0x3f3f3f3f3f3f3f3f;
+    y = ((y & 0x3f003f003f003f00) >> 2) | (y & 0x003f003f003f003f);
+    y = ((y & 0x0fff00000fff0000) >> 4) | (y & 0x00000fff00000fff);
+    y = ((y & 0x00ffffff00000000) >> 8) | (y & 0x0000000000ffffff);
+
+    f.data = y;
+    f.len = len;
+}
+
+
 const char *dyn_name(DynId id)
 {
     static constexpr int name_max = 8;
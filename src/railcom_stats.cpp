@@ -0,0 +1,63 @@
+#include "dcc/railcom_stats.h"
+
+#include <cassert>
+#include <cstdint>
+
+
+static constexpr uint32_t RailComStats::*fields[RailComStats::cnt] = {
+    &RailComStats::cutout,
+    &RailComStats::empty,
+    &RailComStats::bytes,
+    &RailComStats::inv,
+    &RailComStats::short_frame,
+    &RailComStats::ch1,
+    &RailComStats::ch2,
+    &RailComStats::ch2_full,
+    &RailComStats::ch2_part,
+    &RailComStats::ch2_rej,
+    &RailComStats::ack,
+    &RailComStats::nak,
+    &RailComStats::pom,
+    &RailComStats::ch2_heur,
+};
+
+
+static const char *const names[RailComStats::cnt] = {
+    "cutout", "empty", "bytes", "inv", "short", "ch1", "ch2",
+    "ch2_full", "ch2_part", "ch2_rej", "ack", "nak", "pom", "ch2_heur",
+};
+
+
+uint32_t RailComStats::get(int i) const
+{
+    assert(0 <= i && i < cnt);
+    return this->*fields[i];
+}
+
+
+void RailComStats::set(int i, uint32_t v)
+{
+    assert(0 <= i && i < cnt);
+    this->*fields[i] = v;
+}
+
+
+const char *RailComStats::name(int i)
+{
+    assert(0 <= i && i < cnt);
+    return names[i];
+}
+
+
+void RailComStats::add(const RailComStats &s) // called in interrupt context
+{
+    for (int i = 0; i < cnt; i++)
+        this->*fields[i] += s.*fields[i];
+}
+
+
+void RailComStats::reset()
+{
+    for (int i = 0; i < cnt; i++)
+        this->*fields[i] = 0;
+}
@@ -0,0 +1,173 @@
+// Ack detector bench
+//
+// Replays ADC traces (see dcc/dcc_adc_trace.h) through the service mode ack
+// detection for a range of short average lengths and threshold increments,
+// and prints detection results and latency for each combination, with the
+// fixed threshold (f) and the adaptive one (a, where inc is the maximum).
+//
+// Get a trace from the target by starting the adc log ("D 2 S 1" in dcc_cmd),
+// doing some CV reads, and capturing the console output. Or make a synthetic
+// one with -g.
+//
+// Usage:
+//   dcc_ack_bench [-s <short_cnt,...>] [-i <inc_ma,...>] [-l <long_cnt>]
+//                 <trace> ...
+//   dcc_ack_bench -g [-a <ack_ma>] [-n <noise_ma>] [-c <cv_val>] [-r <seed>]
+//
+//   dcc_ack_bench -x <trace>
+//
+// -g writes a synthetic trace (a CV read) to stdout.
+// -x writes a trace (e.g. a binary capture) to stdout in text format.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "dcc/dcc_ack.h"
+#include "dcc/dcc_adc.h"
+#include "dcc/dcc_adc_avg.h"
+#include "ack_replay.h"
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-s short_cnt,...] [-i inc_ma,...] [-l long_cnt] "
+            "trace ...\n"
+            "       %s -g [-a ack_ma] [-n noise_ma] [-c cv_val] [-r seed]\n"
+            "       %s -x trace\n",
+            prog, prog, prog);
+}
+
+
+// "4,8,16" -> {4, 8, 16}
+static bool parse_list(const char *s, std::vector<int> &v)
+{
+    v.clear();
+    while (*s != '\0') {
+        char *end;
+        long n = strtol(s, &end, 0);
+        if (end == s || n <= 0)
+            return false;
+        v.push_back(int(n));
+        s = end;
+        if (*s == ',')
+            s++;
+    }
+    return !v.empty();
+}
+
+
+int main(int argc, char *argv[])
+{
+    std::vector<int> short_cnts = {4, 8, 16, 32, 64};
+    std::vector<int> inc_mas = {20, 30, 40, 60, 80, 100};
+    int long_cnt = DccAdc::sample_rate / 60;
+    bool gen = false;
+    bool text = false;
+    AckSynth synth;
+
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        const char *opt = argv[i];
+        if (strcmp(opt, "-g") == 0) {
+            gen = true;
+            continue;
+        }
+        if (strcmp(opt, "-x") == 0) {
+            text = true;
+            continue;
+        }
+        if ((i + 1) >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *arg = argv[++i];
+        bool ok = true;
+        if (strcmp(opt, "-s") == 0) {
+            ok = parse_list(arg, short_cnts);
+            for (int c : short_cnts)
+                ok = ok && c <= DccAdcAvg::win_max;
+        } else if (strcmp(opt, "-i") == 0) {
+            ok = parse_list(arg, inc_mas);
+        } else if (strcmp(opt, "-l") == 0) {
+            long_cnt = atoi(arg);
+            ok = long_cnt > 0 && long_cnt <= DccAdcAvg::win_max;
+        } else if (strcmp(opt, "-a") == 0) {
+            synth.ack_ma = atoi(arg);
+        } else if (strcmp(opt, "-n") == 0) {
+            synth.noise_ma = atoi(arg);
+        } else if (strcmp(opt, "-c") == 0) {
+            synth.cv_val = strtol(arg, nullptr, 0);
+        } else if (strcmp(opt, "-r") == 0) {
+            synth.seed = strtoul(arg, nullptr, 0);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (gen) {
+        AckTrace t;
+        ack_trace_synth(t, synth);
+        ack_trace_write(stdout, t);
+        return 0;
+    }
+
+    if (i >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<AckTrace> traces;
+    for (; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (f == nullptr) {
+            perror(argv[i]);
+            return 1;
+        }
+        traces.emplace_back();
+        bool ok = ack_trace_read(f, traces.back());
+        fclose(f);
+        if (!ok) {
+            fprintf(stderr, "%s: bad trace\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (text) {
+        for (const AckTrace &t : traces)
+            ack_trace_write(stdout, t);
+        return 0;
+    }
+
+    // latency is printed in msec, using the first trace's sample rate
+    const double ms_per_sample = 1000.0 / traces[0].rate;
+
+    printf("short  inc thr   tp   fp   fn   tn  unk  lat_avg  lat_max\n");
+    //     "----- ---- --- ---- ---- ---- ---- ---- -------- --------"
+
+    for (int short_cnt : short_cnts) {
+        for (int inc_ma : inc_mas) {
+            for (bool adapt : {false, true}) {
+                AckParams p = {short_cnt, long_cnt, uint16_t(inc_ma), adapt};
+                AckResult r;
+                for (const AckTrace &t : traces)
+                    r.add(ack_replay(t, p));
+                double lat_avg = 0;
+                if (r.lat_cnt > 0)
+                    lat_avg = double(r.lat_sum) / r.lat_cnt * ms_per_sample;
+                double lat_max = r.lat_max * ms_per_sample;
+                printf("%5d %4d %3c %4d %4d %4d %4d %4d %8.1f %8.1f\n",
+                       short_cnt, inc_ma, adapt ? 'a' : 'f', r.tp, r.fp, r.fn,
+                       r.tn, r.unk, lat_avg, lat_max);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,397 @@
+#include "ack_replay.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "dcc/dcc_ack.h"
+#include "dcc/dcc_adc.h"
+#include "dcc/dcc_adc_avg.h"
+#include "dcc/dcc_adc_trace.h"
+#include "dcc/dcc_spec.h"
+
+
+// Lines before the header are skipped, so a console capture can be used
+// without editing. Lines after "end" are ignored.
+static bool trace_read_text(FILE *f, AckTrace &t)
+{
+    char line[80];
+    int line_num = 0;
+    bool header = false;
+
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        line_num++;
+
+        if (!header) {
+            int version;
+            if (sscanf(line, "dcc_adc_trace %d %d", &version, &t.rate) == 2) {
+                if (version < 1 || version > DccAdcTrace::version) {
+                    fprintf(stderr, "line %d: unknown version %d\n", line_num,
+                            version);
+                    return false;
+                }
+                header = true;
+            }
+            continue;
+        }
+
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+            continue;
+
+        if (strncmp(line, "end", 3) == 0)
+            return true;
+
+        char mark;
+        int a, b;
+        unsigned raw;
+        if (sscanf(line, "%u", &raw) == 1) {
+            t.raw.push_back(raw & 0x0fff);
+        } else if (sscanf(line, "%c %d %d", &mark, &a, &b) == 3 &&
+                   (mark == DccAdcTrace::mark_win ||
+                    mark == DccAdcTrace::mark_res ||
+                    mark == DccAdcTrace::mark_gap)) {
+            t.marks.push_back({int(t.raw.size()), mark, a, b});
+        } else {
+            fprintf(stderr, "line %d: can't parse: %s", line_num, line);
+            return false;
+        }
+    }
+
+    if (!header) {
+        fprintf(stderr, "no dcc_adc_trace header\n");
+        return false;
+    }
+
+    return true; // missing "end" is okay (truncated capture)
+
+} // trace_read_text
+
+
+// Is there a whole block at buf[i]?
+static bool blk_at(const std::vector<uint8_t> &buf, size_t i,
+                   DccAdcTrace::Blk &blk)
+{
+    if ((i + sizeof(blk)) > buf.size() || buf[i] != DccAdcTrace::blk_sync)
+        return false;
+    memcpy(&blk, &buf[i], sizeof(blk));
+    if (blk.type == DccAdcTrace::blk_samples)
+        return blk.cnt <= DccAdcTrace::blk_samples_max;
+    return blk.type == DccAdcTrace::blk_start ||
+           blk.type == DccAdcTrace::blk_mark || blk.type == DccAdcTrace::blk_end;
+}
+
+
+// Binary blocks, starting at the first start block. Anything that is not a
+// block (console text) is skipped. Only the first log in the capture is read.
+static bool trace_read_bin(const std::vector<uint8_t> &buf, size_t i,
+                           AckTrace &t)
+{
+    DccAdcTrace::Blk blk;
+    bool started = false;
+    uint16_t seq = 0; // expected
+
+    while (i < buf.size()) {
+
+        if (!blk_at(buf, i, blk)) {
+            i++;
+            continue;
+        }
+        i += sizeof(blk);
+
+        if (blk.type == DccAdcTrace::blk_start) {
+            if (started)
+                break; // another log
+            int version = blk.data[0];
+            if (version < 2 || version > DccAdcTrace::version) {
+                fprintf(stderr, "unknown version %d\n", version);
+                return false;
+            }
+            t.rate = DccAdcTrace::blk_u32_get(blk, 1);
+            started = true;
+            seq = blk.seq + 1;
+            continue;
+        }
+
+        if (!started)
+            continue;
+
+        if (blk.seq != seq) {
+            uint16_t lost = blk.seq - seq;
+            t.marks.push_back({int(t.raw.size()), DccAdcTrace::mark_gap, lost, 0});
+        }
+        seq = blk.seq + 1;
+
+        if (blk.type == DccAdcTrace::blk_samples) {
+            for (int s = 0; s < blk.cnt; s++)
+                t.raw.push_back(DccAdcTrace::blk_get(blk, s));
+        } else if (blk.type == DccAdcTrace::blk_mark) {
+            int a = int16_t(DccAdcTrace::blk_u16_get(blk, 1));
+            int b = int16_t(DccAdcTrace::blk_u16_get(blk, 3));
+            t.marks.push_back({int(t.raw.size()), char(blk.data[0]), a, b});
+        } else {
+            // blk_end
+            uint32_t drop_cnt = DccAdcTrace::blk_u32_get(blk, 8);
+            if (drop_cnt != 0)
+                fprintf(stderr, "%u blocks dropped on target\n",
+                        unsigned(drop_cnt));
+            break;
+        }
+    }
+
+    return started; // missing end block is okay (truncated capture)
+
+} // trace_read_bin
+
+
+// Text, or binary if there's a start block in there
+bool ack_trace_read(FILE *f, AckTrace &t)
+{
+    t.clear();
+
+    std::vector<uint8_t> buf;
+    uint8_t tmp[4096];
+    size_t n;
+    while ((n = fread(tmp, 1, sizeof(tmp), f)) > 0)
+        buf.insert(buf.end(), tmp, tmp + n);
+
+    DccAdcTrace::Blk blk;
+    for (size_t i = 0; i < buf.size(); i++)
+        if (blk_at(buf, i, blk) && blk.type == DccAdcTrace::blk_start)
+            return trace_read_bin(buf, i, t);
+
+    FILE *m = fmemopen(buf.data(), buf.size(), "r");
+    if (m == nullptr) {
+        fprintf(stderr, "empty trace\n");
+        return false;
+    }
+    bool ok = trace_read_text(m, t);
+    fclose(m);
+    return ok;
+
+} // ack_trace_read
+
+
+void ack_trace_write(FILE *f, const AckTrace &t)
+{
+    fprintf(f, "dcc_adc_trace %d %d\n", DccAdcTrace::version, t.rate);
+    size_t m = 0;
+    for (size_t i = 0; i <= t.raw.size(); i++) {
+        while (m < t.marks.size() && t.marks[m].idx == int(i)) {
+            fprintf(f, "%c %d %d\n", t.marks[m].mark, t.marks[m].a,
+                    t.marks[m].b);
+            m++;
+        }
+        if (i < t.raw.size())
+            fprintf(f, "%u\n", t.raw[i]);
+    }
+    fprintf(f, "end\n");
+}
+
+
+// Should the window have had an ack, given the operation's result?
+static int window_expect(int verify, int val, int ok, int cv_val)
+{
+    if (!ok)
+        return -1;
+    if (verify >= 0 && verify <= 7)
+        return ((cv_val >> verify) & 1) == val ? 1 : 0;
+    if (verify == DccAdcTrace::verify_byte)
+        return val == cv_val ? 1 : 0;
+    return -1; // write
+}
+
+
+std::vector<AckWindow> ack_windows(const AckTrace &t)
+{
+    std::vector<AckWindow> win;
+    std::vector<const AckTrace::Mark *> win_mark; // 'w' mark for each window
+    size_t op_start = 0; // first window of the current operation
+    bool gap = false;    // samples lost in the current operation
+
+    for (size_t m = 0; m < t.marks.size(); m++) {
+        const AckTrace::Mark &mk = t.marks[m];
+
+        // any mark ends the open window
+        if (!win.empty() && win.back().end < 0)
+            win.back().end = mk.idx;
+
+        if (mk.mark == DccAdcTrace::mark_win) {
+            win.push_back({mk.idx, -1, -1, win.size() == op_start});
+            win_mark.push_back(&mk);
+        } else if (mk.mark == DccAdcTrace::mark_gap) {
+            gap = true;
+        } else {
+            // result for the windows since the last result
+            for (size_t w = op_start; w < win.size(); w++)
+                if (!gap)
+                    win[w].expect = window_expect(
+                        win_mark[w]->a, win_mark[w]->b, mk.a, mk.b);
+            op_start = win.size();
+            gap = false;
+        }
+    }
+
+    if (!win.empty() && win.back().end < 0)
+        win.back().end = int(t.raw.size());
+
+    return win;
+
+} // ack_windows
+
+
+void AckResult::add(const AckResult &r)
+{
+    tp += r.tp;
+    fp += r.fp;
+    fn += r.fn;
+    tn += r.tn;
+    unk += r.unk;
+    lat_cnt += r.lat_cnt;
+    lat_sum += r.lat_sum;
+    if (lat_max < r.lat_max)
+        lat_max = r.lat_max;
+}
+
+
+static void window_done(AckResult &r, const AckWindow &w, int det)
+{
+    if (w.expect < 0) {
+        r.unk++;
+    } else if (w.expect == 1) {
+        if (det >= 0) {
+            r.tp++;
+            r.lat_cnt++;
+            r.lat_sum += det;
+            if (r.lat_max < det)
+                r.lat_max = det;
+        } else {
+            r.fn++;
+        }
+    } else {
+        if (det >= 0)
+            r.fp++;
+        else
+            r.tn++;
+    }
+}
+
+
+AckResult ack_replay(const AckTrace &t, const AckParams &p)
+{
+    AckResult r;
+
+    std::vector<AckWindow> win = ack_windows(t);
+
+    DccAdcAvg avg(p.short_cnt, p.long_cnt);
+    DccAck ack(p.inc_ma);
+
+    size_t w = 0;   // next window to start
+    int cur = -1;   // window in progress
+    int det = -1;   // samples from arm to ack in current window
+
+    const int n = t.raw.size();
+    const int learn_n = t.rate * ack_learn_ms / 1000;
+
+    for (int i = 0; i <= n; i++) {
+
+        // learning before the first window of an operation?
+        bool learn = false;
+        if (p.adapt && w < win.size() && win[w].first) {
+            int learn_beg = win[w].start - learn_n;
+            if (i == learn_beg || (i == 0 && learn_beg < 0))
+                ack.learn_reset();
+            learn = i >= learn_beg && i < win[w].start;
+        }
+
+        if (cur >= 0 && win[cur].end == i) {
+            window_done(r, win[cur], det);
+            ack.reset();
+            cur = -1;
+        }
+
+        if (w < win.size() && win[w].start == i) {
+            ack.arm(DccAdc::raw_to_ma(avg.long_avg_raw()));
+            cur = w++;
+            det = -1;
+        }
+
+        if (i == n)
+            break;
+
+        avg.add(t.raw[i]);
+
+        if (learn)
+            ack.learn(DccAdc::raw_to_ma(avg.short_avg_raw()));
+
+        if (ack.check(DccAdc::raw_to_ma(avg.short_avg_raw())) && cur >= 0)
+            det = i - win[cur].start;
+    }
+
+    return r;
+
+} // ack_replay
+
+
+// Repeatable pseudo-random, [-1, 1]
+static double synth_rand(unsigned &seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return double((seed >> 16) & 0x7fff) / 0x3fff - 1.0;
+}
+
+
+// Append samples for 'ms' msec, with an ack pulse from ack_beg to ack_end
+// msec (relative to the start) if ack_end > ack_beg
+static void synth_run(AckTrace &t, const AckSynth &s, unsigned &seed, int ms,
+                      int ack_beg = 0, int ack_end = 0)
+{
+    const int per_ms = t.rate / 1000;
+    for (int i = 0; i < ms * per_ms; i++) {
+        double sec = double(t.raw.size()) / t.rate;
+        double ma = s.base_ma + s.hum_ma * sin(2 * M_PI * 60 * sec) +
+                    s.noise_ma * synth_rand(seed);
+        if (i >= ack_beg * per_ms && i < ack_end * per_ms)
+            ma += s.ack_ma;
+        if (!t.marks.empty())
+            ma += s.drift_ma * double(t.raw.size() - t.marks[0].idx) / t.rate;
+        // inverse of DccAdc::raw_to_ma()
+        long raw = lround(ma * 4096 * 1.1 / 3300);
+        if (raw < 0)
+            raw = 0;
+        if (raw > 4095)
+            raw = 4095;
+        t.raw.push_back(uint16_t(raw));
+    }
+}
+
+
+// Follows DccCommand::get_packet_svc_read_cv(): reset packets, then for each
+// of bits 7..0 and the byte verify, arm and send 10 packets (verifies and
+// resets), then the result.
+void ack_trace_synth(AckTrace &t, const AckSynth &s)
+{
+    t.clear();
+    t.rate = DccAdc::sample_rate;
+
+    unsigned seed = s.seed;
+
+    synth_run(t, s, seed, (DccSpec::svc_reset1_cnt - 1) * s.pkt_ms);
+
+    for (int verify = 7; verify >= -1; verify--) {
+        int v = verify >= 0 ? verify : DccAdcTrace::verify_byte;
+        int val = verify >= 0 ? 1 : s.cv_val;
+        t.marks.push_back({int(t.raw.size()), DccAdcTrace::mark_win, v, val});
+        bool acks = window_expect(v, val, 1, s.cv_val) == 1;
+        int ack_beg = s.ack_pkt * s.pkt_ms;
+        int ack_end = acks ? ack_beg + s.ack_ms : 0;
+        int pkts = DccSpec::svc_command_cnt + DccSpec::svc_reset2_cnt;
+        synth_run(t, s, seed, pkts * s.pkt_ms, ack_beg, ack_end);
+    }
+
+    t.marks.push_back({int(t.raw.size()), DccAdcTrace::mark_res, 1, s.cv_val});
+
+    synth_run(t, s, seed, 2 * s.pkt_ms);
+
+} // ack_trace_synth
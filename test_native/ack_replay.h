@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Replay recorded (or synthetic) ADC traces through the service mode ack
+// detection (DccAdcAvg + DccAck), to see how well a set of parameters works.
+// Trace format is described in dcc/dcc_adc_trace.h.
+
+struct AckTrace {
+
+    struct Mark {
+        int idx; // mark is just before this sample
+        char mark;
+        int a;
+        int b;
+    };
+
+    int rate;
+    std::vector<uint16_t> raw;
+    std::vector<Mark> marks;
+
+    AckTrace() : rate(0) {}
+
+    void clear()
+    {
+        rate = 0;
+        raw.clear();
+        marks.clear();
+    }
+};
+
+// Read trace in text or binary format; false (and message on stderr) if bad.
+// Binary is the adc log blocks, with any console text in between.
+bool ack_trace_read(FILE *f, AckTrace &t);
+
+// Write trace in text format
+void ack_trace_write(FILE *f, const AckTrace &t);
+
+// One window where the detector was looking for an ack
+struct AckWindow {
+    int start;  // sample index where ack was armed
+    int end;    // sample index of next mark (or end of trace)
+    int expect; // 1 = should ack, 0 = should not, -1 = don't know
+    bool first; // first window of a service mode operation
+};
+
+// Get the windows in a trace, and work out which should have an ack from the
+// result marks
+std::vector<AckWindow> ack_windows(const AckTrace &t);
+
+// Detection parameters
+struct AckParams {
+    int short_cnt;
+    int long_cnt;
+    uint16_t inc_ma;
+    bool adapt; // learn the noise before the first window (DccAck::learn())
+};
+
+// With adapt, learn over this much of the trace before the first window of
+// each operation (about DccCommand::svc_learn_cnt resets)
+constexpr int ack_learn_ms = 50;
+
+// Totals from replaying a trace
+struct AckResult {
+    int tp;  // ack expected, ack detected
+    int fp;  // no ack expected, ack detected
+    int fn;  // ack expected, none detected
+    int tn;  // no ack expected, none detected
+    int unk; // don't know (writes, failed reads)
+    int lat_cnt;
+    int lat_sum; // samples from arm to detect, for tp
+    int lat_max;
+
+    AckResult() : tp(0), fp(0), fn(0), tn(0), unk(0), lat_cnt(0), lat_sum(0),
+                  lat_max(0) {}
+
+    void add(const AckResult &r);
+};
+
+// Run the detector over a trace. Each sample is checked as it's added to the
+// averages; on the target it's checked once per DCC bit (one or two samples),
+// so this is the best case for latency.
+AckResult ack_replay(const AckTrace &t, const AckParams &p);
+
+// Synthetic service mode CV read: baseline current with 60 Hz hum and noise,
+// and an ack pulse in each window where the decoder would send one.
+struct AckSynth {
+    uint8_t cv_val;
+    int base_ma;    // steady track current
+    int ack_ma;     // ack pulse height above base
+    int ack_ms;     // ack pulse width
+    int hum_ma;     // 60 Hz hum amplitude
+    int noise_ma;   // random noise (peak)
+    int drift_ma;   // rise per second, from the first window on
+    int pkt_ms;     // time for one packet
+    int ack_pkt;    // ack starts this many packets after the window starts
+    unsigned seed;
+
+    AckSynth() :
+        cv_val(0xa5),
+        base_ma(50),
+        ack_ma(80),
+        ack_ms(6),
+        hum_ma(5),
+        noise_ma(10),
+        drift_ma(0),
+        pkt_ms(6),
+        ack_pkt(3),
+        seed(1)
+    {
+    }
+};
+
+void ack_trace_synth(AckTrace &t, const AckSynth &s);
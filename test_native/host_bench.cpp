@@ -0,0 +1,365 @@
+// DccApi bench on the host
+//
+// Runs dcc_srv ("core 1") on a thread, with another thread standing in for
+// the bitstream interrupt (host_irq.cpp), and this one as core 0 calling
+// DccApi the way an application would. Turns the track on, creates some
+// locos, then times requests end to end (from calling DccApi to having the
+// result) and prints percentiles for each kind:
+//
+//   speed_set   binary, DccApi::loco_speed_set()
+//   speed_get   binary, DccApi::loco_speed_get()
+//   func_set    binary, DccApi::loco_func_set()
+//   batch       binary, DccApi::loco_batch() for all the locos
+//   current     ASCII, DccApi::track_current_get()
+//   loco_list   binary, DccApi::loco_list() for all the locos, checked
+//               (result in a block, dcc_msg.h)
+//   rc_stats    binary, DccApi::railcom_stats_get() (result in a block)
+//   pipelined   loco_speed_set_start() with a done function, keeping
+//               <depth> outstanding; time from start to done function
+//
+// Then the speed sets, speed gets and function sets again, each one as
+// binary and as text (DccApi::raw_req() and raw_rsp(), "L <addr> S S
+// <speed>" etc.) in turn, for comparing the two forms (dcc_msg.h), and
+// dcc_srv's time to handle each form (debug codes 5 and 6) over just those.
+// raw_req() skips DccApi's request ids, so the text round trips there are a
+// little short; dcc_srv's times are the like-for-like ones.
+//
+// Then it prints dcc_srv's latency to the track (dcc_lat.h, debug codes
+// 10-12) for the speed sets, function sets and batches, by stage.
+//
+// -s 0 has dcc_srv spin instead of sleep when idle (debug code 8), for
+// comparing the two.
+//
+// Latencies here include the host's thread scheduling, so they're for
+// comparing changes on the same machine, not for predicting the RP2040.
+//
+// Usage:
+//   dcc_host_bench [-n <requests>] [-l <locos>] [-d <depth>] [-s 0|1]
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#include "dcc/dcc_api.h"
+#include "hardware/timer.h"
+
+using DccApi::Status;
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n requests] [-l locos] [-d depth] [-s 0|1]\n",
+            prog);
+}
+
+
+// Latencies for one kind of request, usec
+struct Lat {
+    const char *name;
+    std::vector<uint32_t> us;
+    int err = 0;
+
+    Lat(const char *n) :
+        name(n)
+    {
+    }
+
+    void add(uint64_t start_us, Status s)
+    {
+        if (s == Status::Ok)
+            us.push_back(uint32_t(time_us_64() - start_us));
+        else
+            err++;
+    }
+
+    void print()
+    {
+        if (us.empty()) {
+            printf("%-10s %8d %6d\n", name, 0, err);
+            return;
+        }
+        std::sort(us.begin(), us.end());
+        auto pct = [this](int p10) { // tenths of a percent
+            return us[(us.size() - 1) * p10 / 1000];
+        };
+        printf("%-10s %8zu %6d %7u %7u %7u %7u %7u\n", name, us.size(), err,
+               pct(500), pct(900), pct(990), pct(999), us.back());
+    }
+};
+
+
+// Text request and its response, which must start with "OK"
+static Status text_req(const char *req)
+{
+    char rsp[rsp_msg_len_max];
+    Status s = DccApi::raw_req(req, 100'000);
+    if (s == Status::Ok)
+        s = DccApi::raw_rsp(rsp, sizeof(rsp), 100'000);
+    if (s == Status::Ok && strncmp(rsp, "OK", 2) != 0)
+        s = Status::Error;
+    return s;
+}
+
+
+// dcc_srv's time to handle requests, "OK <cnt> <avg_ns> <max_us>" in rsp
+static void srv_time_get(int code, char *rsp, int rsp_max)
+{
+    char req[16];
+    snprintf(req, sizeof(req), "D %d G", code);
+    if (DccApi::raw_req(req, 100'000) != Status::Ok ||
+        DccApi::raw_rsp(rsp, rsp_max, 100'000) != Status::Ok)
+        snprintf(rsp, rsp_max, "error");
+}
+
+
+// Pipelined requests: the done function times each one and starts the next
+static Lat pipe_lat("pipelined");
+static int pipe_left;      // still to start
+static int pipe_out;       // outstanding
+static int pipe_loco_cnt;
+static uint64_t pipe_start_us[65536]; // by request id
+
+
+static bool pipe_start(int n);
+
+static void pipe_done(intptr_t arg, DccApi::ReqId id, Status s)
+{
+    (void)arg;
+    if (s == Status::Ok)
+        s = DccApi::loco_speed_set_check(0, id);
+    pipe_lat.add(pipe_start_us[id], s);
+    pipe_out--;
+    pipe_start(pipe_left);
+}
+
+static bool pipe_start(int n)
+{
+    if (pipe_left == 0)
+        return false;
+    const uint64_t start_us = time_us_64();
+    const int addr = 3 + n % pipe_loco_cnt;
+    if (DccApi::loco_speed_set_start(addr, n % 100, time_us_32() + 100'000) !=
+        Status::Ok) {
+        pipe_lat.err++;
+        pipe_left--;
+        return false;
+    }
+    const DccApi::ReqId id = DccApi::req_id();
+    pipe_start_us[id] = start_us;
+    DccApi::done(id, pipe_done, 0, 1'000'000);
+    pipe_out++;
+    pipe_left--;
+    return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+    int req_cnt = 10'000;
+    int loco_cnt = 8;
+    int depth = 8;
+    int sleep = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:d:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                req_cnt = atoi(optarg);
+                break;
+            case 'l':
+                loco_cnt = atoi(optarg);
+                break;
+            case 'd':
+                depth = atoi(optarg);
+                break;
+            case 's':
+                sleep = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (req_cnt < 1 || loco_cnt < 1 || loco_cnt > DccApi::loco_batch_max ||
+        depth < 1 || depth > DccApi::req_out_max) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    DccApi::init(0, 1, 26, -1, nullptr);
+
+    if (DccApi::debug_set(8, sleep, 1'000'000) != Status::Ok ||
+        DccApi::track_set(true, 1'000'000) != Status::Ok) {
+        fprintf(stderr, "dcc_srv not answering\n");
+        _exit(1);
+    }
+    for (int i = 0; i < loco_cnt; i++) {
+        if (DccApi::loco_create(3 + i) != Status::Ok) {
+            fprintf(stderr, "loco_create(%d) failed\n", 3 + i);
+            _exit(1);
+        }
+    }
+
+    Lat speed_set("speed_set");
+    Lat speed_get("speed_get");
+    Lat func_set("func_set");
+    Lat batch("batch");
+    Lat current("current");
+    Lat loco_list("loco_list");
+    Lat rc_stats("rc_stats");
+
+    std::vector<DccApi::LocoUpdate> upd(loco_cnt);
+    std::vector<DccApi::LocoStatus> ls(loco_cnt);
+    RailComStats st;
+
+    for (int n = 0; n < req_cnt; n++) {
+        const int addr = 3 + n % loco_cnt;
+        int speed;
+        bool on = (n & 1) != 0;
+        int ma;
+        uint64_t start_us;
+
+        start_us = time_us_64();
+        speed_set.add(start_us, DccApi::loco_speed_set(addr, n % 100));
+
+        start_us = time_us_64();
+        speed_get.add(start_us, DccApi::loco_speed_get(addr, speed));
+
+        start_us = time_us_64();
+        func_set.add(start_us, DccApi::loco_func_set(addr, n % 29, on));
+
+        for (int i = 0; i < loco_cnt; i++)
+            upd[i] = {3 + i, n % 100, DccApi::loco_func_none, false};
+        start_us = time_us_64();
+        batch.add(start_us, DccApi::loco_batch(upd.data(), loco_cnt));
+
+        start_us = time_us_64();
+        current.add(start_us, DccApi::track_current_get(ma));
+
+        // the batch just set every loco's speed
+        int cnt;
+        start_us = time_us_64();
+        Status s = DccApi::loco_list(ls.data(), loco_cnt, cnt);
+        if (s == Status::Ok && cnt != loco_cnt)
+            s = Status::Error;
+        for (int i = 0; s == Status::Ok && i < cnt; i++)
+            if (ls[i].addr != 3 + i || ls[i].speed != n % 100)
+                s = Status::Error;
+        loco_list.add(start_us, s);
+
+        start_us = time_us_64();
+        rc_stats.add(start_us, DccApi::railcom_stats_get(st));
+    }
+
+    // the same requests as binary and as text
+    Lat speed_set_b("speed_set");
+    Lat speed_get_b("speed_get");
+    Lat func_set_b("func_set");
+    Lat speed_set_t("speed_set");
+    Lat speed_get_t("speed_get");
+    Lat func_set_t("func_set");
+    DccApi::debug_set(6, 0, 1'000'000); // (counted as text)
+    DccApi::debug_set(5, 0, 1'000'000); // (counts itself, once)
+    // interleaved, so neither form gets the warmer caches
+    for (int n = 0; n < req_cnt; n++) {
+        const int addr = 3 + n % loco_cnt;
+        const int func = n % 29;
+        const bool on = (n & 1) != 0;
+        char req[req_msg_len_max];
+        int speed;
+        uint64_t start_us;
+
+        start_us = time_us_64();
+        speed_set_b.add(start_us, DccApi::loco_speed_set(addr, n % 100));
+
+        snprintf(req, sizeof(req), "L %d S S %d", addr, n % 100);
+        start_us = time_us_64();
+        speed_set_t.add(start_us, text_req(req));
+
+        start_us = time_us_64();
+        speed_get_b.add(start_us, DccApi::loco_speed_get(addr, speed));
+
+        snprintf(req, sizeof(req), "L %d S G", addr);
+        start_us = time_us_64();
+        speed_get_t.add(start_us, text_req(req));
+
+        start_us = time_us_64();
+        func_set_b.add(start_us, DccApi::loco_func_set(addr, func, on));
+
+        snprintf(req, sizeof(req), "L %d F %d S %d", addr, func, int(on));
+        start_us = time_us_64();
+        func_set_t.add(start_us, text_req(req));
+    }
+    // "D 5 G" is itself a text request, but is only counted after answering
+    char srv_text[rsp_msg_len_max];
+    char srv_bin[rsp_msg_len_max];
+    srv_time_get(5, srv_text, sizeof(srv_text));
+    srv_time_get(6, srv_bin, sizeof(srv_bin));
+
+    pipe_left = req_cnt;
+    pipe_loco_cnt = loco_cnt;
+    for (int i = 0; i < depth; i++)
+        pipe_start(i);
+    while (pipe_out > 0 || pipe_left > 0) {
+        DccApi::loop();
+        if (pipe_out == 0)
+            pipe_start(pipe_left);
+    }
+
+    printf("dcc_srv %s when idle, %d locos, pipeline depth %d\n",
+           sleep ? "sleeps" : "spins", loco_cnt, depth);
+    printf("%-10s %8s %6s %7s %7s %7s %7s %7s  (usec)\n", "request", "ok",
+           "err", "p50", "p90", "p99", "p99.9", "max");
+    speed_set.print();
+    speed_get.print();
+    func_set.print();
+    batch.print();
+    current.print();
+    loco_list.print();
+    rc_stats.print();
+    pipe_lat.print();
+
+    printf("\nbinary\n");
+    speed_set_b.print();
+    speed_get_b.print();
+    func_set_b.print();
+    printf("text\n");
+    speed_set_t.print();
+    speed_get_t.print();
+    func_set_t.print();
+    printf("dcc_srv binary %s  (cnt avg_ns max_us)\n", srv_bin);
+    printf("dcc_srv text   %s  (cnt avg_ns max_us)\n", srv_text);
+
+    // let the last changes go out, so each one is on the track (whole) or
+    // missed, not still waiting
+    usleep(1'000'000);
+
+    static const char *const kind_names[DccLat::kind_cnt] = {
+        "speed_set", "func_set", "batch"};
+    static const char *const stage_names[DccLat::stage_cnt] = {
+        "srv", "pick", "track", "whole"};
+    printf("\nto track   %-6s %8s %7s %7s %7s %7s  (usec)\n", "stage", "cnt",
+           "p50", "p99", "max", "missed");
+    for (int k = 0; k < DccLat::kind_cnt; k++) {
+        for (int st = 0; st < DccLat::stage_cnt; st++) {
+            DccApi::LatStats l;
+            if (DccApi::lat_get(DccLat::Kind(k), DccLat::Stage(st), l) !=
+                Status::Ok) {
+                printf("%-10s %-6s error\n", kind_names[k], stage_names[st]);
+                continue;
+            }
+            printf("%-10s %-6s %8u %7u %7u %7u %7u\n", kind_names[k],
+                   stage_names[st], l.cnt, l.p50_us, l.p99_us, l.max_us,
+                   l.missed);
+        }
+    }
+
+    fflush(stdout);
+
+    // core 1 and the interrupt thread never return
+    _exit(0);
+}
@@ -0,0 +1,70 @@
+// Bitstream interrupt for the host bench
+//
+// Stands in for stub_pwm_irq_mux.c: the first handler set starts a thread
+// that calls it at the start of every bit, like the PWM wrap interrupt,
+// while the slice and its interrupt are enabled. Each bit's period is the
+// slice's wrap + 1 usec (DccBitstream sets the wrap for the next bit in the
+// handler), so the bitstream sets the pace. The handler runs with
+// "interrupts off" (hardware/sync.h stub) so it doesn't overlap core 1's
+// critical sections, and an __sev() after it wakes core 1 the way an
+// interrupt would.
+//
+// The thread sleeps until each bit is due and then spins the last bit of the
+// way, so bits come close to on time without using a whole cpu. Only one
+// slice is supported, which is all DccBitstream uses.
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "hardware/pwm.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "misc/pwm_extra.h"
+
+static uint irq_slice;
+static void (*irq_func)(intptr_t) = nullptr;
+static intptr_t irq_arg;
+
+
+static void irq_thread()
+{
+    const uint s = irq_slice % host_pwm_slice_cnt;
+    uint64_t bit_us = time_us_64();
+    while (true) {
+        save_and_disable_interrupts();
+        const bool en = host_pwm_en[s] && host_pwm_irq_en[s];
+        if (en) {
+            host_pwm_bit_us[s] = bit_us;
+            irq_func(irq_arg);
+        }
+        restore_interrupts(0);
+        __sev();
+
+        // (look again every 100 usec while it's off)
+        bit_us += en ? host_pwm_wrap[s] + 1 : 100;
+        const int64_t wait_us = int64_t(bit_us - time_us_64());
+        if (wait_us > 50)
+            std::this_thread::sleep_for(std::chrono::microseconds(wait_us - 50));
+        while (int64_t(bit_us - time_us_64()) > 0)
+            ;
+        // far behind (e.g. descheduled): start over from now
+        if (int64_t(time_us_64() - bit_us) > 10'000)
+            bit_us = time_us_64();
+    }
+}
+
+
+void pwmx_irqn_set_slice_handler(uint irqn, uint slice, //
+                                 void (*func)(intptr_t), intptr_t arg)
+{
+    (void)irqn;
+    save_and_disable_interrupts();
+    const bool first = (irq_func == nullptr);
+    irq_slice = slice;
+    irq_func = func;
+    irq_arg = arg;
+    restore_interrupts(0);
+    if (first)
+        std::thread(irq_thread).detach();
+}
@@ -0,0 +1,292 @@
+// RailCom channel 2 bench
+//
+// Simulates ops mode CV reads on dirty track and compares the channel 2
+// parse modes (RailCom::Ch2Mode): Full, where any bad byte throws away all
+// of channel 2, and Partial, where the messages before the first bad byte
+// are used.
+//
+// The decoder answers the second and later read packets with a POM followed
+// by four ACKs of filler (like ESU LokSound 5), and channel 1 has its ALO.
+// Each byte is corrupted with the given probability by turning on one of
+// its zero bits (as seen on real track: the decoder's current pulse doesn't
+// get through). A read that gives up (DccLoco sends the packet up to its
+// send count) is tried again, up to the same number of attempts as
+// DccApi::loco_cv_val_get.
+//
+// For each corruption rate and mode, with DccLoco's send count fixed and
+// tuned (DccLoco::ops_tune_set), prints the reads that succeeded, the
+// average DCC packets sent per successful read, and the send count at the
+// end.
+//
+// With -t, instead times the frame decoders (RailComSpec::decode_frame_*)
+// on that many random full frames.
+//
+// Usage:
+//   dcc_railcom_bench [-p <pct,...>] [-n <reads>] [-a <attempts>] [-r <seed>]
+//   dcc_railcom_bench -t <frames> [-r <seed>]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "dcc/dcc_loco.h"
+#include "dcc/dcc_pkt.h"
+#include "dcc/railcom.h"
+#include "dcc/railcom_msg.h"
+#include "dcc/railcom_spec.h"
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-p pct,...] [-n reads] [-a attempts] [-r seed]\n"
+            "       %s -t frames [-r seed]\n",
+            prog, prog);
+}
+
+
+// "5,10,20" -> {5, 10, 20}
+static bool parse_list(const char *s, std::vector<int> &v)
+{
+    v.clear();
+    while (*s != '\0') {
+        char *end;
+        long n = strtol(s, &end, 0);
+        if (end == s || n < 0 || n > 100)
+            return false;
+        v.push_back(int(n));
+        s = end;
+        if (*s == ',')
+            s++;
+    }
+    return !v.empty();
+}
+
+
+// Repeatable pseudo-random, [0, 0x7fff]
+static unsigned bench_rand(unsigned &seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+
+// 4/8 encoding of a decoded value (6-bit data, or a DecId)
+static uint8_t enc(uint8_t dec)
+{
+    for (int e = 0; e <= UINT8_MAX; e++)
+        if (RailComSpec::decode[e] == dec)
+            return e;
+    return 0; // not reached for valid dec
+}
+
+
+// With probability pct, turn on one of the zero bits
+static uint8_t dirty(uint8_t e, int pct, unsigned &seed)
+{
+    if (int(bench_rand(seed) % 100) >= pct)
+        return e;
+    int zeros = 8 - __builtin_popcount(e);
+    int z = bench_rand(seed) % zeros;
+    for (uint8_t m = 0x01; m != 0; m <<= 1) {
+        if ((e & m) == 0 && z-- == 0)
+            return e | m;
+    }
+    return e;
+}
+
+
+static constexpr uint8_t cv_val = 0x95;
+static constexpr uint32_t cutout_us = 1000000;
+
+
+// One cutout: decoder's answer to the packet just sent (answered says
+// whether it has seen the read twice yet), through RailCom to the loco
+static void cutout(RailCom &rc, DccLoco &loco, bool answered, int pct,
+                   unsigned &seed)
+{
+    rc.cutout_start(cutout_us);
+
+    uint8_t b[RailComSpec::ch1_bytes + RailComSpec::ch2_bytes];
+    int n = 0;
+    b[n++] = enc((RailComSpec::pkt_alo << 2) | 0);
+    b[n++] = enc(loco.get_address() & 0x3f);
+    if (answered) {
+        b[n++] = enc((RailComSpec::pkt_pom << 2) | (cv_val >> 6));
+        b[n++] = enc(cv_val & 0x3f);
+    }
+    while (n < int(sizeof(b)))
+        b[n++] = enc(RailComSpec::dec_ack);
+
+    for (int i = 0; i < n; i++) {
+        uint32_t us = (i < RailComSpec::ch1_bytes) ? (120 + i * 40) //
+                                                   : (240 + (i - 2) * 40);
+        rc.rx(dirty(b[i], pct, seed), cutout_us + us);
+    }
+
+    rc.read();
+    rc.parse();
+
+    loco.railcom(rc, loco.last_req_id());
+}
+
+
+struct BenchResult {
+    int ok;
+    int bad;     // read value wrong
+    long pkts;   // sent for all reads (successful or not)
+    int send_cnt; // DccLoco's, at the end
+    RailComStats rc;
+};
+
+
+static BenchResult bench(RailCom::Ch2Mode mode, bool tune, int pct,
+                         int reads, int attempts, unsigned seed)
+{
+    BenchResult r = {0, 0, 0, 0, {}};
+
+    RailCom rc(nullptr, -1);
+    rc.ch2_mode(mode);
+
+    DccLoco loco(3);
+    loco.ops_tune_set(tune);
+
+    for (int n = 0; n < reads; n++) {
+        for (int a = 0; a < attempts; a++) {
+            loco.read_cv(8, nullptr);
+            bool result = false;
+            uint8_t value = 0;
+            int read_pkts = 0;
+            while (!loco.ops_done(result, value)) {
+                loco.next_packet();
+                r.pkts++;
+                if (loco.ops_done(result, value))
+                    break; // gave up; that packet was not a read
+                read_pkts++;
+                cutout(rc, loco, read_pkts >= 2, pct, seed);
+            }
+            if (result) {
+                if (value == cv_val)
+                    r.ok++;
+                else
+                    r.bad++;
+                break;
+            }
+        }
+    }
+
+    r.send_cnt = loco.ops_tune_get().send_cnt;
+    r.rc = loco.rc_stats();
+
+    return r;
+}
+
+
+// Decode frames with each decoder, printing nsec per frame
+static void time_decode(int frames, unsigned seed)
+{
+    // mostly good bytes, like real cutouts
+    std::vector<uint8_t> e(size_t(frames) * RailComSpec::Frame::len_max);
+    for (uint8_t &b : e) {
+        b = enc(bench_rand(seed) & 0x3f);
+        b = dirty(b, 10, seed);
+    }
+
+    struct {
+        const char *name;
+        void (*func)(const uint8_t *, int, RailComSpec::Frame &);
+    } decoders[] = {
+        {"scalar", RailComSpec::decode_frame_scalar},
+        {"swar", RailComSpec::decode_frame_swar},
+    };
+
+    for (auto &d : decoders) {
+        uint64_t sum = 0; // so the work isn't optimized away
+        RailComSpec::Frame f;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            d.func(&e[size_t(i) * RailComSpec::Frame::len_max],
+                   RailComSpec::Frame::len_max, f);
+            sum += f.data + f.valid;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        printf("%-6s %6.2f ns/frame (%016llx)\n", d.name, ns / frames,
+               (unsigned long long)sum);
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    std::vector<int> pcts = {0, 2, 5, 10, 15, 20, 30};
+    int reads = 1000;
+    int attempts = 5; // DccApi::loco_cv_val_get default
+    unsigned seed = 1;
+    int frames = 0;
+
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        const char *opt = argv[i];
+        if ((i + 1) >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *arg = argv[++i];
+        bool ok = true;
+        if (strcmp(opt, "-p") == 0) {
+            ok = parse_list(arg, pcts);
+        } else if (strcmp(opt, "-n") == 0) {
+            reads = atoi(arg);
+            ok = reads > 0;
+        } else if (strcmp(opt, "-a") == 0) {
+            attempts = atoi(arg);
+            ok = attempts > 0;
+        } else if (strcmp(opt, "-t") == 0) {
+            frames = atoi(arg);
+            ok = frames > 0;
+        } else if (strcmp(opt, "-r") == 0) {
+            seed = strtoul(arg, nullptr, 0);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (i != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (frames > 0) {
+        time_decode(frames, seed);
+        return 0;
+    }
+
+    printf("pct mode  tune     ok  bad  pkts/ok send     full  partial rejected\n");
+    //     "--- ---- ----- ------ ---- -------- ---- -------- -------- --------"
+
+    for (int pct : pcts) {
+        for (RailCom::Ch2Mode mode :
+             {RailCom::Ch2Mode::Full, RailCom::Ch2Mode::Partial}) {
+            for (bool tune : {false, true}) {
+                BenchResult r = bench(mode, tune, pct, reads, attempts, seed);
+                double per_ok = r.ok > 0 ? double(r.pkts) / r.ok : 0;
+                printf("%3d %-4s %-5s %6d %4d %8.2f %4d %8lu %8lu %8lu\n", pct,
+                       mode == RailCom::Ch2Mode::Full ? "full" : "part",
+                       tune ? "tuned" : "fixed", r.ok, r.bad, per_ok,
+                       r.send_cnt, (unsigned long)r.rc.ch2_full,
+                       (unsigned long)r.rc.ch2_part,
+                       (unsigned long)r.rc.ch2_rej);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -6,24 +6,28 @@
 // Controllable stub state
 static uint16_t _stub_short_avg_ma = 0;
 static uint16_t _stub_long_avg_ma = 100;
+static uint16_t _stub_fast_avg_ma = 0;
 static int _stub_loop_result = 0;
 // Control functions for tests
 void stub_adc_set_short_avg_ma(uint16_t val) { _stub_short_avg_ma = val; }
 void stub_adc_set_long_avg_ma(uint16_t val) { _stub_long_avg_ma = val; }
+void stub_adc_set_fast_avg_ma(uint16_t val) { _stub_fast_avg_ma = val; }
 void stub_adc_set_loop_result(int val) { _stub_loop_result = val; }
 
 // DccAdc implementation stubs
 DccAdc::DccAdc(int gpio) :
     _gpio(gpio),
-    _avg_idx(0),
+    _avg(short_cnt, long_cnt),
+    _dma_chan(-1),
+    _ring_rd(0),
     _err_cnt(0),
-    _log_max(0),
-    _log_idx(0),
-    _log(nullptr),
+    _ovr_cnt(0),
+    _log_queue(nullptr),
+    _log_seq(0),
+    _log_blk_cnt(0),
+    _log_drop_cnt(0),
     _dbg_loop_gpio(-1)
 {
-    for (int i = 0; i < avg_max; i++)
-        _avg[i] = 0;
 }
 
 DccAdc::~DccAdc() {}
@@ -35,9 +39,12 @@ int DccAdc::loop() { return _stub_loop_result; }
 
 uint16_t DccAdc::short_avg_ma() const { return _stub_short_avg_ma; }
 uint16_t DccAdc::long_avg_ma() const { return _stub_long_avg_ma; }
+uint16_t DccAdc::fast_avg_ma() const { return _stub_fast_avg_ma; }
 
-uint16_t DccAdc::avg_raw(int cnt) const { (void)cnt; return 0; }
+void DccAdc::dma_start() {}
+void DccAdc::block(const uint16_t *raw, int cnt) { (void)raw; (void)cnt; }
 
-void DccAdc::log_init(int samples) { (void)samples; }
-void DccAdc::log_reset() {}
-void DccAdc::log_show() const {}
+void DccAdc::log_start(queue_t *q) { _log_queue = q; }
+void DccAdc::log_stop() { _log_queue = nullptr; }
+void DccAdc::log_mark(uint8_t mark, int a, int b) { (void)mark; (void)a; (void)b; }
+void DccAdc::log_send() {}
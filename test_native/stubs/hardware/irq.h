@@ -1,2 +1,30 @@
 #pragma once
-// Stub for native build — no IRQ support needed
+// Stub for native build — handlers are never called
+
+#include <cstdint>
+
+#include "pico/types.h"
+
+#define PICO_HIGHEST_IRQ_PRIORITY 0x00
+
+typedef void (*irq_handler_t)(void);
+
+inline void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    (void)num; (void)handler;
+}
+
+inline void irq_remove_handler(uint num, irq_handler_t handler)
+{
+    (void)num; (void)handler;
+}
+
+inline void irq_set_priority(uint num, uint8_t priority)
+{
+    (void)num; (void)priority;
+}
+
+inline void irq_set_enabled(uint num, bool enabled)
+{
+    (void)num; (void)enabled;
+}
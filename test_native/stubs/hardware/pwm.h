@@ -18,6 +18,19 @@ typedef struct pwm_config {
 
 #ifdef __cplusplus
 
+#include <atomic>
+
+#include "hardware/timer.h"
+
+// The host bench's interrupt thread (host_irq.cpp) starts each bit when the
+// last one's period (wrap + 1 usec) is up, so the counter is usec since then.
+// It calls the handler only while the slice and its interrupt are enabled.
+constexpr int host_pwm_slice_cnt = 8;
+inline std::atomic<uint16_t> host_pwm_wrap[host_pwm_slice_cnt];
+inline std::atomic<bool> host_pwm_en[host_pwm_slice_cnt];
+inline std::atomic<bool> host_pwm_irq_en[host_pwm_slice_cnt];
+inline uint64_t host_pwm_bit_us[host_pwm_slice_cnt];
+
 inline uint pwm_gpio_to_slice_num(uint gpio) { return gpio / 2; }
 inline uint pwm_gpio_to_channel(uint gpio) { return gpio % 2; }
 
@@ -27,14 +40,28 @@ inline void pwm_init(uint slice, const pwm_config *c, bool start)
 {
     (void)slice; (void)c; (void)start;
 }
-inline void pwm_set_enabled(uint slice, bool en) { (void)slice; (void)en; }
-inline void pwm_set_wrap(uint slice, uint16_t wrap) { (void)slice; (void)wrap; }
+inline void pwm_set_enabled(uint slice, bool en)
+{
+    host_pwm_en[slice % host_pwm_slice_cnt] = en;
+}
+inline void pwm_set_wrap(uint slice, uint16_t wrap)
+{
+    host_pwm_wrap[slice % host_pwm_slice_cnt] = wrap;
+}
 inline void pwm_set_chan_level(uint slice, uint chan, uint16_t level)
 {
     (void)slice; (void)chan; (void)level;
 }
 inline void pwm_clear_irq(uint slice) { (void)slice; }
-inline void pwm_set_irq_enabled(uint slice, bool en) { (void)slice; (void)en; }
+inline void pwm_set_irq_enabled(uint slice, bool en)
+{
+    host_pwm_irq_en[slice % host_pwm_slice_cnt] = en;
+}
+inline uint16_t pwm_get_counter(uint slice)
+{
+    const uint s = slice % host_pwm_slice_cnt;
+    return uint16_t(time_us_64() - host_pwm_bit_us[s]);
+}
 
 #else
 
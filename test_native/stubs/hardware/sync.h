@@ -1,2 +1,70 @@
 #pragma once
-// Stub for native build — not currently needed, but included by some SDK headers
+// Stub for native build
+//
+// The tests are single-threaded, but the host bench (host_bench.cpp) runs
+// dcc_srv and the bitstream interrupt on their own threads (host_irq.cpp).
+// "Interrupts off" is a lock the interrupt thread also takes around each
+// handler, and the event register is a flag with a condition variable.
+// These are never destroyed, since core 1 and the interrupt thread are
+// still running when the program exits.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+inline std::recursive_mutex &host_irq_lock()
+{
+    static std::recursive_mutex *m = new std::recursive_mutex;
+    return *m;
+}
+
+inline uint32_t save_and_disable_interrupts()
+{
+    host_irq_lock().lock();
+    return 0;
+}
+
+inline void restore_interrupts(uint32_t status)
+{
+    (void)status;
+    host_irq_lock().unlock();
+}
+
+struct HostEvent {
+    std::mutex m;
+    std::condition_variable cv;
+    bool set = false;
+};
+
+inline HostEvent &host_event()
+{
+    static HostEvent *e = new HostEvent;
+    return *e;
+}
+
+inline void __dmb()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+inline void __sev()
+{
+    HostEvent &e = host_event();
+    {
+        std::lock_guard<std::mutex> lk(e.m);
+        e.set = true;
+    }
+    e.cv.notify_all();
+}
+
+// Returns on an event (or "interrupt"), or after a while anyway; the real
+// one can return early too.
+inline void __wfe()
+{
+    HostEvent &e = host_event();
+    std::unique_lock<std::mutex> lk(e.m);
+    e.cv.wait_for(lk, std::chrono::milliseconds(1), [&e] { return e.set; });
+    e.set = false;
+}
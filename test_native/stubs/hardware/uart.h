@@ -24,3 +24,21 @@ inline uint8_t uart_getc(uart_inst_t *uart)
     (void)uart;
     return 0;
 }
+
+inline void uart_set_fifo_enabled(uart_inst_t *uart, bool enabled)
+{
+    (void)uart; (void)enabled;
+}
+
+inline void uart_set_irq_enables(uart_inst_t *uart, bool rx, bool tx)
+{
+    (void)uart; (void)rx; (void)tx;
+}
+
+inline uint uart_get_index(uart_inst_t *uart)
+{
+    (void)uart;
+    return 0;
+}
+
+#define UART_IRQ_NUM(uart) 20
@@ -0,0 +1,9 @@
+#pragma once
+// Stub for native build — core 1 is a thread (see host_bench.cpp)
+
+#include <thread>
+
+inline void multicore_launch_core1(void (*entry)(void))
+{
+    std::thread(entry).detach();
+}
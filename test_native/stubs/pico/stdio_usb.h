@@ -0,0 +1,2 @@
+#pragma once
+// Stub for native build — nothing used
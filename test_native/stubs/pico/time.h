@@ -0,0 +1,3 @@
+#pragma once
+// Stub for native build — pull in timer for time_us_32/time_us_64
+#include "hardware/timer.h"
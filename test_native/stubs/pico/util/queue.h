@@ -0,0 +1,64 @@
+#pragma once
+// Stub for native build — single-threaded ring with the pico-sdk queue API
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "pico/types.h"
+
+typedef struct {
+    uint8_t *data;
+    uint element_size;
+    uint element_count; // capacity
+    uint wr;
+    uint rd;
+} queue_t;
+
+inline void queue_init(queue_t *q, uint element_size, uint element_count)
+{
+    q->data = (uint8_t *)calloc(element_count + 1, element_size);
+    q->element_size = element_size;
+    q->element_count = element_count;
+    q->wr = 0;
+    q->rd = 0;
+}
+
+inline void queue_free(queue_t *q)
+{
+    free(q->data);
+    q->data = nullptr;
+}
+
+inline uint queue_get_level(queue_t *q)
+{
+    return (q->wr + q->element_count + 1 - q->rd) % (q->element_count + 1);
+}
+
+inline bool queue_is_empty(queue_t *q)
+{
+    return q->wr == q->rd;
+}
+
+inline bool queue_is_full(queue_t *q)
+{
+    return queue_get_level(q) == q->element_count;
+}
+
+inline bool queue_try_add(queue_t *q, const void *data)
+{
+    if (queue_is_full(q))
+        return false;
+    memcpy(q->data + q->wr * q->element_size, data, q->element_size);
+    q->wr = (q->wr + 1) % (q->element_count + 1);
+    return true;
+}
+
+inline bool queue_try_remove(queue_t *q, void *data)
+{
+    if (queue_is_empty(q))
+        return false;
+    memcpy(data, q->data + q->rd * q->element_size, q->element_size);
+    q->rd = (q->rd + 1) % (q->element_count + 1);
+    return true;
+}
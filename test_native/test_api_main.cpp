@@ -0,0 +1,44 @@
+#include <cstdio>
+#include <unistd.h>
+
+#include "dcc/dcc_api.h"
+#include "test.h"
+
+// DccApi tests, with dcc_srv ("core 1") on a thread and another standing in
+// for the bitstream interrupt (host_irq.cpp), like dcc_host_bench. They
+// can't share dcc_tests, whose bitstream tests call the interrupt handler
+// themselves (stub_pwm_irq_mux.c), and dcc_srv can only be started once, so
+// the tests leave it the way they found it (track off, no locos).
+
+// Defined in test_dcc_api.cpp
+extern const Test tests_dcc_api[];
+extern const int tests_dcc_api_cnt;
+
+static int run_suite(const char *suite_name, const Test *tests, int count)
+{
+    int fail = 0;
+    for (int i = 0; i < count; i++) {
+        bool ok = tests[i].func();
+        printf("  %s %s\n", ok ? "PASS" : "FAIL", tests[i].name);
+        if (!ok)
+            fail++;
+    }
+    printf("%s: %d/%d passed\n\n", suite_name, count - fail, count);
+    return fail;
+}
+
+int main()
+{
+    printf("=== DccApi Native Tests ===\n\n");
+
+    DccApi::init(0, 1, 26, -1, nullptr);
+
+    int fail = 0;
+    fail += run_suite("dcc_api", tests_dcc_api, tests_dcc_api_cnt);
+
+    printf("=== %s ===\n", fail == 0 ? "ALL PASSED" : "FAILURES");
+    fflush(stdout);
+
+    // core 1 and the interrupt thread never return
+    _exit(fail == 0 ? 0 : 1);
+}
@@ -0,0 +1,425 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include "dcc/dcc_ack.h"
+#include "dcc/dcc_adc_trace.h"
+#include "ack_replay.h"
+#include "test.h"
+
+// --- DccAck ---
+
+static bool test_ack_not_armed()
+{
+    DccAck ack;
+    if (ack.armed()) return false;
+    if (ack.check(1000)) return false;
+    if (ack.ack()) return false;
+    return true;
+}
+
+static bool test_ack_threshold()
+{
+    DccAck ack;
+    ack.arm(100);
+    if (!ack.armed()) return false;
+    if (ack.ack_ma() != 100 + DccAck::inc_ma_def) return false;
+    if (ack.check(100 + DccAck::inc_ma_def - 1)) return false;
+    if (ack.ack()) return false;
+    if (!ack.check(100 + DccAck::inc_ma_def)) return false;
+    // disarmed after triggering, so it only triggers once
+    if (ack.armed()) return false;
+    if (ack.check(1000)) return false;
+    // ack() sees it once
+    if (!ack.ack()) return false;
+    if (ack.ack()) return false;
+    return true;
+}
+
+static bool test_ack_inc()
+{
+    DccAck ack(30);
+    ack.arm(50);
+    if (ack.check(79)) return false;
+    if (!ack.check(80)) return false;
+    ack.inc_ma(10);
+    ack.arm(50);
+    if (!ack.check(60)) return false;
+    return true;
+}
+
+// Re-arming clears an ack that hasn't been seen
+static bool test_ack_rearm()
+{
+    DccAck ack;
+    ack.arm(0);
+    if (!ack.check(1000)) return false;
+    ack.arm(0);
+    if (ack.ack()) return false;
+    return true;
+}
+
+// Nothing learned: fixed threshold over the given baseline
+static bool test_ack_learn_none()
+{
+    DccAck ack;
+    for (int i = 0; i < DccAck::learn_min - 1; i++)
+        ack.learn(100);
+    if (ack.learned()) return false;
+    ack.arm(50);
+    if (ack.ack_ma() != 50 + DccAck::inc_ma_def) return false;
+    return true;
+}
+
+static bool test_ack_learn_stats()
+{
+    DccAck ack;
+    // alternating 90, 110: mean 100, sd 10
+    for (int i = 0; i < 100; i++)
+        ack.learn((i & 1) ? 110 : 90);
+    if (!ack.learned()) return false;
+    if (ack.noise_mean_ma() != 100) return false;
+    if (ack.noise_sd_ma() != 10) return false;
+    ack.learn_reset();
+    if (ack.learned()) return false;
+    return true;
+}
+
+// Learned: baseline is the long average but at least the mean, threshold
+// sd_mul sd over it, limited to [inc_min_ma, inc_ma]
+static bool test_ack_learn_threshold()
+{
+    DccAck ack;
+    // quiet: sd 0, so inc_min_ma
+    for (int i = 0; i < 100; i++)
+        ack.learn(100);
+    ack.arm(130); // drifted up since learning
+    if (ack.ack_ma() != 130 + DccAck::inc_min_ma) return false;
+    ack.arm(70); // under the mean
+    if (ack.ack_ma() != 100 + DccAck::inc_min_ma) return false;
+    // sd 6: 5 * 6 = 30
+    ack.learn_reset();
+    for (int i = 0; i < 100; i++)
+        ack.learn((i & 1) ? 106 : 94);
+    ack.arm(0);
+    if (ack.ack_ma() != 100 + DccAck::sd_mul * 6) return false;
+    // noisy: sd 20, limited to inc_ma
+    ack.learn_reset();
+    for (int i = 0; i < 100; i++)
+        ack.learn((i & 1) ? 120 : 80);
+    ack.arm(0);
+    if (ack.ack_ma() != 100 + DccAck::inc_ma_def) return false;
+    return true;
+}
+
+// After the first ack, the threshold is at least half the pulse height
+static bool test_ack_learn_pulse()
+{
+    DccAck ack;
+    for (int i = 0; i < 100; i++)
+        ack.learn(100);
+    ack.arm(0);
+    if (!ack.check(130)) return false;
+    ack.check(150);
+    ack.check(180);
+    ack.check(160);
+    if (ack.pulse_ma() != 0) return false; // still in the pulse
+    ack.check(120);
+    if (ack.pulse_ma() != 80) return false;
+    ack.arm(0);
+    if (ack.ack_ma() != 100 + 40) return false;
+    return true;
+}
+
+// --- Trace replay ---
+
+// Windows and expected acks come from the marks
+static bool test_trace_windows()
+{
+    AckTrace t;
+    AckSynth s;
+    s.cv_val = 0xa5; // 1010 0101
+    ack_trace_synth(t, s);
+    std::vector<AckWindow> win = ack_windows(t);
+    if (win.size() != 9) return false;
+    const int expect[9] = {1, 0, 1, 0, 0, 1, 0, 1, 1}; // bits 7..0, byte
+    for (int i = 0; i < 9; i++) {
+        if (win[i].expect != expect[i]) return false;
+        if (win[i].end <= win[i].start) return false;
+    }
+    return true;
+}
+
+// Failed read: nothing is known about the windows
+static bool test_trace_windows_failed()
+{
+    AckTrace t;
+    AckSynth s;
+    ack_trace_synth(t, s);
+    t.marks.back().a = 0;
+    std::vector<AckWindow> win = ack_windows(t);
+    for (const AckWindow &w : win)
+        if (w.expect != -1) return false;
+    return true;
+}
+
+static bool test_trace_round_trip()
+{
+    AckTrace t1, t2;
+    AckSynth s;
+    ack_trace_synth(t1, s);
+    FILE *f = tmpfile();
+    if (f == nullptr) return false;
+    fprintf(f, "some console output first\n");
+    ack_trace_write(f, t1);
+    rewind(f);
+    bool ok = ack_trace_read(f, t2);
+    fclose(f);
+    if (!ok) return false;
+    if (t2.rate != t1.rate) return false;
+    if (t2.raw != t1.raw) return false;
+    if (t2.marks.size() != t1.marks.size()) return false;
+    for (size_t i = 0; i < t1.marks.size(); i++) {
+        if (t2.marks[i].idx != t1.marks[i].idx) return false;
+        if (t2.marks[i].mark != t1.marks[i].mark) return false;
+        if (t2.marks[i].a != t1.marks[i].a) return false;
+        if (t2.marks[i].b != t1.marks[i].b) return false;
+    }
+    return true;
+}
+
+static bool test_trace_blk_pack()
+{
+    DccAdcTrace::Blk b;
+    DccAdcTrace::blk_init(b, DccAdcTrace::blk_samples, 0);
+    for (int i = 0; i < DccAdcTrace::blk_samples_max; i++)
+        DccAdcTrace::blk_put(b, i, uint16_t((i * 0x123 + 0xabc) & 0xfff));
+    for (int i = 0; i < DccAdcTrace::blk_samples_max; i++)
+        if (DccAdcTrace::blk_get(b, i) != ((i * 0x123 + 0xabc) & 0xfff))
+            return false;
+    // neighbors don't disturb each other
+    DccAdcTrace::blk_put(b, 4, 0xfff);
+    DccAdcTrace::blk_put(b, 5, 0x000);
+    if (DccAdcTrace::blk_get(b, 4) != 0xfff) return false;
+    if (DccAdcTrace::blk_get(b, 5) != 0x000) return false;
+    if (DccAdcTrace::blk_get(b, 3) != ((3 * 0x123 + 0xabc) & 0xfff)) return false;
+    if (DccAdcTrace::blk_get(b, 6) != ((6 * 0x123 + 0xabc) & 0xfff)) return false;
+    return true;
+}
+
+// Write a trace as adc log blocks, the way DccAdc does, with console text
+// between some of them. Block number 'drop' (if >= 0) is left out, as if the
+// queue was full.
+static void trace_write_bin(FILE *f, const AckTrace &t, int drop)
+{
+    DccAdcTrace::Blk b;
+    uint16_t seq = 0;
+    auto send = [&]() {
+        if (seq != drop)
+            fwrite(&b, sizeof(b), 1, f);
+        if ((seq % 7) == 3)
+            fprintf(f, "notify: \"T I 100\"\n");
+        seq++;
+        DccAdcTrace::blk_init(b, DccAdcTrace::blk_samples, seq);
+    };
+
+    DccAdcTrace::blk_init(b, DccAdcTrace::blk_start, seq);
+    b.data[0] = DccAdcTrace::version;
+    DccAdcTrace::blk_u32_put(b, 1, t.rate);
+    send();
+
+    size_t m = 0;
+    for (size_t i = 0; i <= t.raw.size(); i++) {
+        while (m < t.marks.size() && t.marks[m].idx == int(i)) {
+            if (b.cnt > 0)
+                send();
+            DccAdcTrace::blk_init(b, DccAdcTrace::blk_mark, seq);
+            b.data[0] = t.marks[m].mark;
+            DccAdcTrace::blk_u16_put(b, 1, t.marks[m].a);
+            DccAdcTrace::blk_u16_put(b, 3, t.marks[m].b);
+            send();
+            m++;
+        }
+        if (i < t.raw.size()) {
+            DccAdcTrace::blk_put(b, b.cnt++, t.raw[i]);
+            if (b.cnt == DccAdcTrace::blk_samples_max)
+                send();
+        }
+    }
+    if (b.cnt > 0)
+        send();
+    DccAdcTrace::blk_init(b, DccAdcTrace::blk_end, seq);
+    send();
+}
+
+static bool test_trace_bin()
+{
+    AckTrace t1, t2;
+    AckSynth s;
+    ack_trace_synth(t1, s);
+    FILE *f = tmpfile();
+    if (f == nullptr) return false;
+    fprintf(f, "D 2 S 1\ndebug_set ... [Ok]\n");
+    trace_write_bin(f, t1, -1);
+    rewind(f);
+    bool ok = ack_trace_read(f, t2);
+    fclose(f);
+    if (!ok) return false;
+    if (t2.rate != t1.rate) return false;
+    if (t2.raw != t1.raw) return false;
+    if (t2.marks.size() != t1.marks.size()) return false;
+    for (size_t i = 0; i < t1.marks.size(); i++) {
+        if (t2.marks[i].idx != t1.marks[i].idx) return false;
+        if (t2.marks[i].mark != t1.marks[i].mark) return false;
+        if (t2.marks[i].a != t1.marks[i].a) return false;
+        if (t2.marks[i].b != t1.marks[i].b) return false;
+    }
+    AckResult r = ack_replay(t2, {16, 166, DccAck::inc_ma_def, false});
+    if (r.tp != 5 || r.tn != 4) return false;
+    return true;
+}
+
+// A dropped block shows up as a gap mark, and the operation it's in can't be
+// scored
+static bool test_trace_bin_drop()
+{
+    AckTrace t1, t2;
+    AckSynth s;
+    ack_trace_synth(t1, s);
+    FILE *f = tmpfile();
+    if (f == nullptr) return false;
+    trace_write_bin(f, t1, 20);
+    rewind(f);
+    bool ok = ack_trace_read(f, t2);
+    fclose(f);
+    if (!ok) return false;
+    if (t2.raw.size() + DccAdcTrace::blk_samples_max != t1.raw.size())
+        return false;
+    int gaps = 0;
+    for (const AckTrace::Mark &mk : t2.marks)
+        if (mk.mark == DccAdcTrace::mark_gap && mk.a == 1)
+            gaps++;
+    if (gaps != 1) return false;
+    std::vector<AckWindow> win = ack_windows(t2);
+    if (win.size() != 9) return false;
+    for (const AckWindow &w : win)
+        if (w.expect != -1) return false;
+    return true;
+}
+
+// Clean trace with the default parameters: all correct
+static bool test_replay_clean()
+{
+    AckTrace t;
+    AckSynth s;
+    ack_trace_synth(t, s);
+    AckResult r = ack_replay(t, {16, 166, DccAck::inc_ma_def, false});
+    if (r.tp != 5 || r.tn != 4) return false;
+    if (r.fp != 0 || r.fn != 0 || r.unk != 0) return false;
+    // ack starts 3 packets (18 msec) into the window
+    int ack_beg = s.ack_pkt * s.pkt_ms * (t.rate / 1000);
+    if (r.lat_sum / r.lat_cnt < ack_beg) return false;
+    if (r.lat_max > ack_beg + s.ack_ms * (t.rate / 1000)) return false;
+    return true;
+}
+
+// Ack pulse smaller than the threshold increment is missed
+static bool test_replay_weak_ack()
+{
+    AckTrace t;
+    AckSynth s;
+    s.ack_ma = 40;
+    s.noise_ma = 0;
+    ack_trace_synth(t, s);
+    AckResult r = ack_replay(t, {16, 166, 60, false});
+    if (r.tp != 0 || r.fn != 5) return false;
+    r = ack_replay(t, {16, 166, 30, false});
+    if (r.tp != 5 || r.fn != 0) return false;
+    return true;
+}
+
+// Short average too short with a low threshold: noise looks like an ack
+static bool test_replay_noise()
+{
+    AckTrace t;
+    AckSynth s;
+    s.noise_ma = 40;
+    ack_trace_synth(t, s);
+    AckResult r = ack_replay(t, {1, 166, 20, false});
+    if (r.fp == 0) return false;
+    r = ack_replay(t, {32, 166, 40, false});
+    if (r.fp != 0 || r.fn != 0) return false;
+    return true;
+}
+
+// Weak ack missed by the fixed threshold, found with the learned one
+static bool test_replay_adapt_weak_ack()
+{
+    AckTrace t;
+    AckSynth s;
+    s.ack_ma = 40;
+    s.noise_ma = 2;
+    ack_trace_synth(t, s);
+    AckResult r = ack_replay(t, {16, 166, 60, false});
+    if (r.tp != 0 || r.fn != 5) return false;
+    r = ack_replay(t, {16, 166, 60, true});
+    if (r.tp != 5 || r.fn != 0 || r.fp != 0) return false;
+    return true;
+}
+
+// With a strong ack, the learned threshold is lower so it triggers sooner
+static bool test_replay_adapt_latency()
+{
+    AckTrace t;
+    AckSynth s;
+    s.ack_ma = 100;
+    s.noise_ma = 5;
+    ack_trace_synth(t, s);
+    AckResult rf = ack_replay(t, {16, 166, 60, false});
+    AckResult ra = ack_replay(t, {16, 166, 60, true});
+    if (rf.tp != 5 || ra.tp != 5) return false;
+    if (ra.fp != 0) return false;
+    if (ra.lat_sum >= rf.lat_sum) return false;
+    return true;
+}
+
+// Current drifting up through the read: the learned mean as the baseline
+// would see the drift as acks on the bits that are 0
+static bool test_replay_adapt_drift()
+{
+    AckTrace t;
+    AckSynth s;
+    s.ack_ma = 40;
+    s.noise_ma = 2;
+    s.drift_ma = 50; // about 25 mA by the byte verify
+    ack_trace_synth(t, s);
+    AckResult r = ack_replay(t, {16, 166, 60, true});
+    if (r.tp != 5 || r.fn != 0 || r.fp != 0) return false;
+    return true;
+}
+
+extern const Test tests_dcc_ack[] = {
+    {"ack_not_armed", test_ack_not_armed},
+    {"ack_threshold", test_ack_threshold},
+    {"ack_inc", test_ack_inc},
+    {"ack_rearm", test_ack_rearm},
+    {"ack_learn_none", test_ack_learn_none},
+    {"ack_learn_stats", test_ack_learn_stats},
+    {"ack_learn_threshold", test_ack_learn_threshold},
+    {"ack_learn_pulse", test_ack_learn_pulse},
+    {"trace_windows", test_trace_windows},
+    {"trace_windows_failed", test_trace_windows_failed},
+    {"trace_round_trip", test_trace_round_trip},
+    {"trace_blk_pack", test_trace_blk_pack},
+    {"trace_bin", test_trace_bin},
+    {"trace_bin_drop", test_trace_bin_drop},
+    {"replay_clean", test_replay_clean},
+    {"replay_weak_ack", test_replay_weak_ack},
+    {"replay_noise", test_replay_noise},
+    {"replay_adapt_weak_ack", test_replay_adapt_weak_ack},
+    {"replay_adapt_latency", test_replay_adapt_latency},
+    {"replay_adapt_drift", test_replay_adapt_drift},
+};
+
+extern const int tests_dcc_ack_cnt =
+    sizeof(tests_dcc_ack) / sizeof(tests_dcc_ack[0]);
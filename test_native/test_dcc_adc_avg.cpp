@@ -0,0 +1,111 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include "dcc/dcc_adc_avg.h"
+#include "test.h"
+
+// --- Window averages ---
+
+static bool test_avg_empty()
+{
+    DccAdcAvg avg(16, 166);
+    if (avg.short_avg_raw() != 0) return false;
+    if (avg.long_avg_raw() != 0) return false;
+    return true;
+}
+
+static bool test_avg_constant()
+{
+    DccAdcAvg avg(16, 166);
+    for (int i = 0; i < 1000; i++)
+        avg.add(1234);
+    if (avg.short_avg_raw() != 1234) return false;
+    if (avg.long_avg_raw() != 1234) return false;
+    return true;
+}
+
+// Short window follows a step before the long window does
+static bool test_avg_step()
+{
+    DccAdcAvg avg(16, 166);
+    for (int i = 0; i < 200; i++)
+        avg.add(100);
+    for (int i = 0; i < 16; i++)
+        avg.add(500);
+    if (avg.short_avg_raw() != 500) return false;
+    // long: 150 * 100 + 16 * 500 = 23000 / 166 = 138.55
+    if (avg.long_avg_raw() != 139) return false;
+    return true;
+}
+
+// Adding a block is the same as adding one at a time, including when the
+// block is longer than the history
+static bool test_avg_block()
+{
+    DccAdcAvg avg1(16, 166);
+    DccAdcAvg avg2(16, 166);
+    uint16_t blk[600];
+    for (int i = 0; i < 600; i++)
+        blk[i] = (i * 37) % 4096;
+    for (int i = 0; i < 600; i++)
+        avg1.add(blk[i]);
+    avg2.add(blk, 100);
+    avg2.add(blk + 100, 500);
+    if (avg1.short_avg_raw() != avg2.short_avg_raw()) return false;
+    if (avg1.long_avg_raw() != avg2.long_avg_raw()) return false;
+    return true;
+}
+
+// Error bit and anything above 12 bits are ignored
+static bool test_avg_mask()
+{
+    DccAdcAvg avg(4, 8);
+    for (int i = 0; i < 8; i++)
+        avg.add(0x8000 | 100);
+    if (avg.short_avg_raw() != 100) return false;
+    if (avg.long_avg_raw() != 100) return false;
+    return true;
+}
+
+static bool test_avg_short_cnt_change()
+{
+    DccAdcAvg avg(16, 166);
+    for (int i = 0; i < 100; i++)
+        avg.add(100);
+    for (int i = 0; i < 8; i++)
+        avg.add(300);
+    // 8 * 100 + 8 * 300 = 3200 / 16 = 200
+    if (avg.short_avg_raw() != 200) return false;
+    avg.short_cnt(8);
+    if (avg.short_avg_raw() != 300) return false;
+    avg.add(100);
+    // 7 * 300 + 100 = 2200 / 8 = 275
+    if (avg.short_avg_raw() != 275) return false;
+    return true;
+}
+
+static bool test_avg_full_window()
+{
+    DccAdcAvg avg(DccAdcAvg::win_max, DccAdcAvg::win_max);
+    for (int i = 0; i < DccAdcAvg::win_max; i++)
+        avg.add(10);
+    for (int i = 0; i < DccAdcAvg::win_max; i++)
+        avg.add(20);
+    if (avg.short_avg_raw() != 20) return false;
+    if (avg.long_avg_raw() != 20) return false;
+    return true;
+}
+
+extern const Test tests_dcc_adc_avg[] = {
+    {"avg_empty", test_avg_empty},
+    {"avg_constant", test_avg_constant},
+    {"avg_step", test_avg_step},
+    {"avg_block", test_avg_block},
+    {"avg_mask", test_avg_mask},
+    {"avg_short_cnt_change", test_avg_short_cnt_change},
+    {"avg_full_window", test_avg_full_window},
+};
+
+extern const int tests_dcc_adc_avg_cnt =
+    sizeof(tests_dcc_adc_avg) / sizeof(tests_dcc_adc_avg[0]);
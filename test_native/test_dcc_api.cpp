@@ -0,0 +1,397 @@
+#include <cstdint>
+
+#include "dcc/dcc_api.h"
+#include "hardware/timer.h"
+#include "test.h"
+
+// DccApi end to end, with dcc_srv and the bitstream interrupt running on
+// their own threads (test_api_main.cpp starts them). Service mode operations
+// are the slow ones: with nothing answering on the host, each takes until
+// dcc_srv gives up on the ack, which is what holds things up here.
+//
+// These run in real time on a host that may be busy, so they wait for
+// things to happen with generous limits rather than for set times.
+
+using DccApi::ReqId;
+using DccApi::Status;
+
+static constexpr int32_t wait_us = 1'000'000;
+static constexpr int32_t svc_wait_us = 4 * DccApi::cv_get_timeout_us;
+
+static int32_t end_in(int32_t us)
+{
+    return time_us_32() + us;
+}
+
+// Wait for the response to id without taking it
+static bool wait_ready(ReqId id, int32_t timeout_us)
+{
+    const int32_t end_us = end_in(timeout_us);
+    while (!DccApi::ready(id))
+        if ((int32_t(time_us_32()) - end_us) >= 0)
+            return false;
+    return true;
+}
+
+// A service mode read is answered after a loco speed set sent after it
+static bool test_api_out_of_order()
+{
+    if (DccApi::loco_create(3) != Status::Ok) return false;
+
+    if (DccApi::cv_val_get_start(1, end_in(wait_us)) != Status::Ok)
+        return false;
+    const ReqId cv_id = DccApi::req_id();
+    if (DccApi::loco_speed_set_start(3, 10, end_in(wait_us)) != Status::Ok)
+        return false;
+    const ReqId speed_id = DccApi::req_id();
+
+    bool ok = DccApi::loco_speed_set_check(end_in(wait_us), speed_id) ==
+                  Status::Ok &&
+              !DccApi::ready(cv_id);
+
+    // nothing answers on the host, so the read fails, but it is answered
+    int cv_val;
+    ok = ok && DccApi::cv_val_get_check(cv_val, end_in(svc_wait_us), cv_id) ==
+                   Status::Error;
+
+    int speed;
+    ok = ok && DccApi::loco_speed_get(3, speed) == Status::Ok && speed == 10;
+
+    return DccApi::loco_delete(3) == Status::Ok && ok;
+}
+
+// An id that was never sent, or was already checked, is an error; a
+// response that comes after its request timed out is thrown away, and
+// doesn't show up as some other request's
+static bool test_api_unknown_late_id()
+{
+    if (DccApi::loco_create(3) != Status::Ok) return false;
+
+    bool ok = DccApi::loco_speed_set_start(3, 20, end_in(wait_us)) ==
+              Status::Ok;
+    const ReqId id = DccApi::req_id();
+    ok = ok && DccApi::loco_speed_set_check(end_in(wait_us), id) == Status::Ok;
+    ok = ok && DccApi::loco_speed_set_check(end_in(1000), id) == Status::Error;
+    ok = ok && DccApi::loco_speed_set_check(end_in(1000), ReqId(id + 1000)) ==
+                   Status::Error;
+
+    // gives up on the service mode read right away...
+    ok = ok && DccApi::cv_val_get_start(1, end_in(wait_us)) == Status::Ok;
+    const ReqId cv_id = DccApi::req_id();
+    int cv_val;
+    ok = ok && DccApi::cv_val_get_check(cv_val, end_in(1000), cv_id) ==
+                   Status::Timeout;
+
+    // ...forgets it with a done function that times out
+    static int late_calls;
+    static Status late_status;
+    late_calls = 0;
+    ok = ok && DccApi::done(cv_id, [](intptr_t, ReqId, Status s) {
+        late_calls++;
+        late_status = s;
+    }, 0, 0) == Status::Ok;
+    DccApi::loop();
+    ok = ok && late_calls == 1 && late_status == Status::Timeout;
+
+    // ...and its answer comes while a speed get is outstanding
+    ok = ok && DccApi::loco_speed_get_start(3, end_in(wait_us)) == Status::Ok;
+    const ReqId speed_id = DccApi::req_id();
+    int speed = 0;
+    ok = ok && DccApi::loco_speed_get_check(speed, end_in(wait_us),
+                                            speed_id) == Status::Ok &&
+         speed == 20;
+
+    // (a track set waits for the read to finish, so the read's answer has
+    // come and gone by the time the track set's is in)
+    ok = ok && DccApi::track_set(false, svc_wait_us) == Status::Ok;
+    ok = ok && !DccApi::ready(cv_id) &&
+         DccApi::cv_val_get_check(cv_val, end_in(1000), cv_id) ==
+             Status::Error &&
+         late_calls == 1;
+
+    return DccApi::loco_delete(3) == Status::Ok && ok;
+}
+
+// With waiting[] full (a service mode read running and four more put aside
+// behind it), dcc_srv answers another one with an error right away, and
+// the others are still done in turn
+static bool test_api_waiting_full()
+{
+    constexpr int cnt = 1 + 4; // running, and dcc_srv's waiting_max
+    ReqId cv_id[cnt];
+    bool ok = true;
+    for (int i = 0; i < cnt; i++) {
+        ok = ok && DccApi::cv_val_get_start(1 + i, end_in(wait_us)) ==
+                       Status::Ok;
+        cv_id[i] = DccApi::req_id();
+    }
+
+    ok = ok && DccApi::cv_val_get_start(8, end_in(wait_us)) == Status::Ok;
+    const ReqId full_id = DccApi::req_id();
+    int cv_val;
+    ok = ok && DccApi::cv_val_get_check(cv_val, end_in(wait_us), full_id) ==
+                   Status::Error;
+    ok = ok && !DccApi::ready(cv_id[0]);
+
+    // in order
+    for (int i = 0; i < cnt; i++) {
+        ok = ok && wait_ready(cv_id[i], svc_wait_us);
+        for (int j = i + 1; j < cnt; j++)
+            ok = ok && !DccApi::ready(cv_id[j]);
+        ok = ok && DccApi::cv_val_get_check(cv_val, end_in(1000),
+                                            cv_id[i]) == Status::Error;
+    }
+    return ok;
+}
+
+// What done functions were called with
+struct DoneRec {
+    int calls;
+    intptr_t arg;
+    ReqId id;
+    Status s;
+    Status check; // loco_speed_get_check() in the done function
+    int speed;
+    Status start; // loco_speed_get_start() in done_start_first()
+};
+
+static DoneRec done_rec[DccApi::req_out_max];
+
+static void done_speed(intptr_t arg, ReqId id, Status s)
+{
+    DoneRec &r = done_rec[arg];
+    r.calls++;
+    r.arg = arg;
+    r.id = id;
+    r.s = s;
+    r.check = Status::Error;
+    if (s == Status::Ok)
+        r.check = DccApi::loco_speed_get_check(r.speed, 0, id);
+}
+
+static void done_reset()
+{
+    for (DoneRec &r : done_rec)
+        r = {0, -1, 0, Status::Error, Status::Error, 0, Status::Error};
+}
+
+// Call loop() until the first cnt done functions have been called (false
+// if that takes too long), then a little longer
+static bool loop_done(int cnt)
+{
+    const int32_t end_us = end_in(wait_us);
+    for (int i = 0; i < cnt; i++) {
+        while (done_rec[i].calls == 0) {
+            if ((int32_t(time_us_32()) - end_us) >= 0)
+                return false;
+            DccApi::loop();
+        }
+    }
+    for (int i = 0; i < 1000; i++)
+        DccApi::loop();
+    return true;
+}
+
+// A done function is called once, from loop(), with the response in (and
+// its *_check gets it), for a request that worked and one that didn't
+static bool test_api_done_ok_error()
+{
+    if (DccApi::loco_create(3) != Status::Ok) return false;
+    bool ok = DccApi::loco_speed_set(3, 30) == Status::Ok;
+
+    done_reset();
+    ok = ok && DccApi::loco_speed_get_start(3, end_in(wait_us)) == Status::Ok;
+    const ReqId good_id = DccApi::req_id();
+    ok = ok && DccApi::done(good_id, done_speed, 0, wait_us) == Status::Ok;
+    ok = ok && DccApi::loco_speed_get_start(99, end_in(wait_us)) == Status::Ok;
+    const ReqId bad_id = DccApi::req_id();
+    ok = ok && DccApi::done(bad_id, done_speed, 1, wait_us) == Status::Ok;
+    ok = ok && done_rec[0].calls == 0 && done_rec[1].calls == 0;
+
+    ok = ok && loop_done(2);
+    const DoneRec &g = done_rec[0];
+    ok = ok && g.calls == 1 && g.arg == 0 && g.id == good_id &&
+         g.s == Status::Ok && g.check == Status::Ok && g.speed == 30;
+    const DoneRec &b = done_rec[1];
+    ok = ok && b.calls == 1 && b.arg == 1 && b.id == bad_id &&
+         b.s == Status::Ok && b.check == Status::Error;
+
+    // and both are gone
+    int speed;
+    ok = ok && DccApi::loco_speed_get_check(speed, end_in(1000), good_id) ==
+                   Status::Error;
+
+    return DccApi::loco_delete(3) == Status::Ok && ok;
+}
+
+// A done function is called once with Timeout if the response doesn't come
+// in time, and not again when it does
+static bool test_api_done_timeout()
+{
+    done_reset();
+    bool ok = DccApi::cv_val_get_start(1, end_in(wait_us)) == Status::Ok;
+    const ReqId id = DccApi::req_id();
+    ok = ok && DccApi::done(id, done_speed, 0, 10'000) == Status::Ok;
+    ok = ok && loop_done(1);
+    const DoneRec &r = done_rec[0];
+    ok = ok && r.calls == 1 && r.id == id && r.s == Status::Timeout;
+
+    // the read's response comes before the track set's
+    ok = ok && DccApi::track_set(false, svc_wait_us) == Status::Ok;
+    for (int i = 0; i < 1000; i++)
+        DccApi::loop();
+    return ok && r.calls == 1;
+}
+
+// Once its done function has been called a request's slot is free again:
+// req_out_max with done functions outstanding is all there can be, but
+// after loop() calls them there can be that many again
+static bool test_api_done_reuse()
+{
+    if (DccApi::loco_create(3) != Status::Ok) return false;
+
+    bool ok = true;
+    for (int round = 0; round < 3 && ok; round++) {
+        done_reset();
+        for (int i = 0; i < DccApi::req_out_max && ok; i++) {
+            ok = DccApi::loco_speed_get_start(3, end_in(wait_us)) ==
+                     Status::Ok &&
+                 DccApi::done(DccApi::req_id(), done_speed, i, wait_us) ==
+                     Status::Ok;
+        }
+        ok = ok && DccApi::loco_speed_get_start(3, end_in(wait_us)) ==
+                       Status::Error;
+        ok = ok && loop_done(DccApi::req_out_max);
+        for (int i = 0; i < DccApi::req_out_max && ok; i++)
+            ok = done_rec[i].calls == 1 && done_rec[i].s == Status::Ok &&
+                 done_rec[i].check == Status::Ok;
+    }
+
+    return DccApi::loco_delete(3) == Status::Ok && ok;
+}
+
+// Starts another request before checking its own
+static void done_start_first(intptr_t arg, ReqId id, Status s)
+{
+    DoneRec &r = done_rec[arg];
+    r.start = DccApi::loco_speed_get_start(3, end_in(wait_us));
+    done_speed(arg, id, s);
+}
+
+// A done function that starts a request with the table full: the new one
+// takes the oldest entry without a done function, which must not be the
+// one whose done function is running (it's the oldest, and its done
+// function is cleared by then)
+static bool test_api_done_start_full()
+{
+    if (DccApi::loco_create(3) != Status::Ok) return false;
+    bool ok = DccApi::loco_speed_set(3, 33) == Status::Ok;
+
+    done_reset();
+    ok = ok && DccApi::loco_speed_get_start(3, end_in(wait_us)) == Status::Ok;
+    ok = ok && DccApi::done(DccApi::req_id(), done_start_first, 0, wait_us) ==
+                   Status::Ok;
+    // fill the rest of the table with ones that are never checked
+    for (int i = 1; i < DccApi::req_out_max && ok; i++)
+        ok = DccApi::loco_speed_get_start(3, end_in(wait_us)) == Status::Ok;
+    ok = ok && wait_ready(DccApi::req_id(), wait_us);
+
+    ok = ok && loop_done(1);
+    const DoneRec &r = done_rec[0];
+    ok = ok && r.calls == 1 && r.start == Status::Ok && r.s == Status::Ok &&
+         r.check == Status::Ok && r.speed == 33;
+
+    return DccApi::loco_delete(3) == Status::Ok && ok;
+}
+
+// Whether locos 3, 4 and 5 have speeds 3 + s, 4 + s, 5 + s and F5 on
+static bool batch_locos_are(int s, bool on)
+{
+    for (int addr = 3; addr <= 5; addr++) {
+        int speed;
+        bool f5;
+        if (DccApi::loco_speed_get(addr, speed) != Status::Ok ||
+            speed != addr + s ||
+            DccApi::loco_func_get(addr, 5, f5) != Status::Ok || f5 != on)
+            return false;
+    }
+    return true;
+}
+
+// A batch with one bad entry in the middle (no such loco, speed out of
+// range, function out of range) changes none of the locos, not even the
+// ones before it
+static bool test_api_batch_all_or_nothing()
+{
+    bool ok = true;
+    for (int addr = 3; addr <= 5; addr++)
+        ok = ok && DccApi::loco_create(addr) == Status::Ok &&
+             DccApi::loco_speed_set(addr, addr) == Status::Ok;
+    ok = ok && batch_locos_are(0, false);
+
+    static const DccApi::LocoUpdate bad[3] = {
+        {99, 50, 5, true},                       // no loco 99
+        {4, 200, 5, true},                       // speed
+        {4, 50, DccPkt::function_max + 1, true}, // function
+    };
+    for (const DccApi::LocoUpdate &b : bad) {
+        const DccApi::LocoUpdate upd[3] = {
+            {3, 53, 5, true},
+            b,
+            {5, 55, 5, true},
+        };
+        ok = ok && DccApi::loco_batch(upd, 3) == Status::Error;
+        ok = ok && batch_locos_are(0, false);
+    }
+
+    // and with that one fixed, all of it
+    const DccApi::LocoUpdate good[3] = {
+        {3, 53, 5, true},
+        {4, 54, 5, true},
+        {5, 55, 5, true},
+    };
+    ok = ok && DccApi::loco_batch(good, 3) == Status::Ok;
+    ok = ok && batch_locos_are(50, true);
+
+    for (int addr = 3; addr <= 5; addr++)
+        ok = DccApi::loco_delete(addr) == Status::Ok && ok;
+    return ok;
+}
+
+// A loco listed twice in one batch is one change to the track, so it's
+// timed once (dcc_lat.h)
+static bool test_api_batch_lat_once()
+{
+    bool ok = DccApi::loco_create(3) == Status::Ok &&
+              DccApi::loco_create(4) == Status::Ok;
+    ok = ok && DccApi::lat_reset() == Status::Ok;
+
+    const DccApi::LocoUpdate upd[3] = {
+        {3, 10, DccApi::loco_func_none, false},
+        {4, 20, DccApi::loco_func_none, false},
+        {3, 30, 2, true},
+    };
+    ok = ok && DccApi::loco_batch(upd, 3) == Status::Ok;
+    DccApi::LatStats l;
+    ok = ok && DccApi::lat_get(DccLat::Kind::Batch, DccLat::Stage::Srv, l) ==
+                   Status::Ok;
+    ok = ok && l.cnt == 2;
+
+    ok = DccApi::loco_delete(3) == Status::Ok && ok;
+    ok = DccApi::loco_delete(4) == Status::Ok && ok;
+    return ok;
+}
+
+extern const Test tests_dcc_api[] = {
+    {"api_out_of_order", test_api_out_of_order},
+    {"api_unknown_late_id", test_api_unknown_late_id},
+    {"api_waiting_full", test_api_waiting_full},
+    {"api_done_ok_error", test_api_done_ok_error},
+    {"api_done_timeout", test_api_done_timeout},
+    {"api_done_reuse", test_api_done_reuse},
+    {"api_done_start_full", test_api_done_start_full},
+    {"api_batch_all_or_nothing", test_api_batch_all_or_nothing},
+    {"api_batch_lat_once", test_api_batch_lat_once},
+};
+
+extern const int tests_dcc_api_cnt = sizeof(tests_dcc_api) / sizeof(tests_dcc_api[0]);
@@ -4,9 +4,14 @@
 
 #include "dcc/dcc_adc.h"
 #include "dcc/dcc_command.h"
+#include "dcc/dcc_lat.h"
+#include "dcc/dcc_loco.h"
 #include "dcc/dcc_pkt.h"
 #include "dcc/dcc_pkt2.h"
 #include "dcc/dcc_spec.h"
+#include "dcc/railcom.h"
+#include "dcc/railcom_spec.h"
+#include "hardware/timer.h"
 #include "test.h"
 
 // Helper: get packet type by decoding bytes (works for ops packets)
@@ -35,6 +40,7 @@ static bool is_not_reset(DccPkt2 &pkt)
 extern void stub_adc_set_short_avg_ma(uint16_t val);
 extern void stub_adc_set_long_avg_ma(uint16_t val);
 extern void stub_adc_set_loop_result(int val);
+extern void stub_adc_set_fast_avg_ma(uint16_t val);
 
 // Helper: create a DccCommand with stub ADC
 // sig_gpio=0, pwr_gpio=1 satisfies DccBitstream assertion (same slice, different channels)
@@ -42,7 +48,7 @@ struct CmdFixture {
     DccAdc adc;
     DccCommand cmd;
 
-    CmdFixture() : adc(26), cmd(0, 1, -1, adc) {}
+    CmdFixture() : adc(26), cmd(0, 1, -1, &adc) {}
 
     ~CmdFixture()
     {
@@ -50,6 +56,7 @@ struct CmdFixture {
         stub_adc_set_short_avg_ma(0);
         stub_adc_set_long_avg_ma(100);
         stub_adc_set_loop_result(0);
+        stub_adc_set_fast_avg_ma(0);
     }
 };
 
@@ -185,6 +192,390 @@ static bool test_ops_round_robin()
     return true;
 }
 
+// Helper: a POM response with val in channel 2 of a cutout, to the loco
+static void loco_pom(DccLoco *loco, uint8_t val, uint16_t req_id)
+{
+    // 4/8 encodings of the two POM bytes
+    auto enc = [](uint8_t dec) -> uint8_t {
+        for (int e = 0; e <= UINT8_MAX; e++)
+            if (RailComSpec::decode[e] == dec)
+                return e;
+        return 0;
+    };
+    const uint32_t cutout_us = 1000000;
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(cutout_us);
+    rc.rx(enc((RailComSpec::pkt_pom << 2) | (val >> 6)), cutout_us + 240);
+    rc.rx(enc(val & 0x3f), cutout_us + 280);
+    rc.read();
+    rc.parse();
+    loco->railcom(rc, req_id);
+}
+
+// Ops CV reads to two locos at once: each packet is tagged with its loco and
+// request, and a response only completes the request it came after
+static bool test_ops_cv_reads_interleaved()
+{
+    CmdFixture f;
+
+    DccLoco *l3 = f.cmd.create_loco(3);
+    DccLoco *l5 = f.cmd.create_loco(5);
+    f.cmd.set_mode_ops();
+
+    l3->read_cv(1, nullptr);
+    l5->read_cv(2, nullptr);
+
+    DccPkt2 pkt;
+    uint16_t id3 = 0, id5 = 0;
+    uint8_t val = 0;
+    bool result;
+    uint8_t value;
+
+    // two packets each (the decoder needs two before it answers)
+    for (int i = 0; i < 4; i++) {
+        f.cmd.get_packet(pkt);
+        DccLoco *loco = pkt.get_loco();
+        if (pkt.get_req_id() == 0) return false;
+        if (loco == l3) {
+            if (id3 != 0 && pkt.get_req_id() != id3) return false;
+            id3 = pkt.get_req_id();
+            val = 33;
+        } else if (loco == l5) {
+            if (id5 != 0 && pkt.get_req_id() != id5) return false;
+            id5 = pkt.get_req_id();
+            val = 55;
+        } else {
+            return false;
+        }
+        if (i >= 2)
+            loco_pom(loco, val, pkt.get_req_id());
+    }
+
+    if (!l3->ops_done(result, value) || !result || value != 33) return false;
+    if (!l5->ops_done(result, value) || !result || value != 55) return false;
+
+    // both go right back to speed packets
+    f.cmd.get_packet(pkt);
+    if (pkt.get_req_id() != 0) return false;
+    f.cmd.get_packet(pkt);
+    if (pkt.get_req_id() != 0) return false;
+
+    return true;
+}
+
+static int cv_done_cnt;
+static DccLoco::OpsCvDone cv_done[8];
+
+static void cv_done_cb(DccLoco *, const DccLoco::OpsCvDone &done)
+{
+    if (cv_done_cnt < 8)
+        cv_done[cv_done_cnt] = done;
+    cv_done_cnt++;
+}
+
+// Queued cv accesses on one loco are done in order, each reported with its
+// id; one with no response fails and the next one starts
+static bool test_ops_cv_queue()
+{
+    CmdFixture f;
+
+    DccLoco *loco = f.cmd.create_loco(3);
+    f.cmd.set_mode_ops();
+
+    cv_done_cnt = 0;
+
+    if (!loco->read_cv(1, cv_done_cb, 11)) return false;
+    if (!loco->write_cv(2, 0x22, cv_done_cb, 12)) return false;
+    if (!loco->read_cv(3, cv_done_cb, 13)) return false;
+    if (!loco->read_cv(4, cv_done_cb, 14)) return false;
+    if (loco->read_cv(5, cv_done_cb, 15)) return false; // full
+    if (loco->ops_cv_pending() != 4) return false;
+
+    DccPkt2 pkt;
+
+    // read cv 1: answered after the second packet
+    f.cmd.get_packet(pkt);
+    uint16_t req = pkt.get_req_id();
+    f.cmd.get_packet(pkt);
+    loco_pom(loco, 0x11, pkt.get_req_id());
+    if (pkt.get_req_id() != req) return false;
+    if (cv_done_cnt != 1 || cv_done[0].id != 11) return false;
+    if (!cv_done[0].success || cv_done[0].cv_val != 0x11) return false;
+
+    // write cv 2: never answered; fails after 5 packets
+    int sent = 0;
+    while (cv_done_cnt == 1 && sent < 20) {
+        f.cmd.get_packet(pkt);
+        if (pkt.get_req_id() != 0)
+            sent++;
+    }
+    if (sent != 5) return false;
+    if (cv_done_cnt != 2 || cv_done[1].id != 12 || cv_done[1].success)
+        return false;
+
+    // read cv 3 starts right away (no lockout after a failure)
+    f.cmd.get_packet(pkt);
+    if (pkt.get_req_id() == 0 || pkt.get_req_id() == req) return false;
+    if (loco->ops_cv_pending() != 2) return false;
+
+    return true;
+}
+
+// Deleting a loco fails its cv accesses, the one in progress and the queued
+// ones, each once
+static bool test_ops_cv_delete()
+{
+    CmdFixture f;
+
+    DccLoco *loco = f.cmd.create_loco(3);
+    f.cmd.create_loco(5);
+    f.cmd.set_mode_ops();
+
+    cv_done_cnt = 0;
+
+    if (!loco->read_cv(1, cv_done_cb, 21)) return false;
+    if (!loco->write_cv(2, 0x22, cv_done_cb, 22)) return false;
+    if (!loco->read_cv(3, nullptr)) return false;
+
+    // get the first one going
+    DccPkt2 pkt;
+    for (int n = 0; n < 4 && pkt.get_req_id() == 0; n++)
+        f.cmd.get_packet(pkt);
+    if (pkt.get_req_id() == 0 || loco->ops_cv_pending() != 3) return false;
+
+    f.cmd.delete_loco(loco);
+    if (cv_done_cnt != 2) return false;
+    if (cv_done[0].id != 21 || cv_done[0].success) return false;
+    if (cv_done[1].id != 22 || cv_done[1].success) return false;
+    if (f.cmd.find_loco(3) != nullptr) return false;
+
+    // and nothing more for it
+    for (int n = 0; n < 20; n++)
+        f.cmd.get_packet(pkt);
+    return cv_done_cnt == 2;
+}
+
+// Deleting a loco with changes not out yet counts them as missed
+static bool test_delete_loco_lat()
+{
+    CmdFixture f;
+    DccLat lat;
+
+    DccLoco *loco = f.cmd.create_loco(3);
+    const uint32_t now_us = time_us_32();
+    loco->set_speed(10);
+    loco->lat_start(&lat, {1, DccLat::Kind::Speed, now_us, now_us, 0, 0});
+    loco->lat_start(&lat, {2, DccLat::Kind::Speed, now_us, now_us, 0, 0});
+    f.cmd.delete_loco(loco);
+
+    const DccLat::Pct p = lat.get(DccLat::Kind::Speed, DccLat::Stage::Whole);
+    return p.cnt == 0 && p.missed == 2;
+}
+
+// Helper: send the loco's packets until its cv access is done, answering
+// after the at'th packet of it (0 never answers). Returns how many of the
+// access's packets were sent, and how many others went before the first.
+static int ops_run(DccLoco &loco, int at, int *wait = nullptr)
+{
+    bool result;
+    uint8_t value;
+    int sent = 0;
+    if (wait != nullptr)
+        *wait = 0;
+    for (int n = 0; n < 100 && !loco.ops_done(result, value); n++) {
+        loco.next_packet();
+        uint16_t req_id = loco.last_req_id();
+        if (req_id == 0) {
+            if (sent == 0 && wait != nullptr)
+                (*wait)++;
+            continue;
+        }
+        if (++sent == at)
+            loco_pom(&loco, 0x42, req_id);
+    }
+    return sent;
+}
+
+// A loco that answers the second packet gets its send count brought down,
+// a step after each run of answers; one not answered puts it back up
+static bool test_ops_tune_send_cnt()
+{
+    DccLoco loco(3);
+    DccLoco::OpsTune t = loco.ops_tune_get();
+    if (t.send_cnt != DccLoco::ops_send_cnt_def) return false;
+    if (t.lockout != DccLoco::ops_lockout_def) return false;
+
+    for (int i = 0; i < 8; i++) {
+        loco.read_cv(8, nullptr);
+        if (ops_run(loco, 2) != 2) return false;
+        if (i == 3 && loco.ops_tune_get().send_cnt != 4) return false;
+    }
+    if (loco.ops_tune_get().send_cnt != 3) return false;
+
+    // the least it goes is one more than it takes
+    for (int i = 0; i < 8; i++) {
+        loco.read_cv(8, nullptr);
+        ops_run(loco, 2);
+    }
+    if (loco.ops_tune_get().send_cnt != 3) return false;
+
+    // not answered: gives up after 3, next time sends 5
+    loco.read_cv(8, nullptr);
+    if (ops_run(loco, 0) != 3) return false;
+    t = loco.ops_tune_get();
+    if (t.send_cnt != 5 || t.ok != 16 || t.fail != 1) return false;
+    if (t.read_cnt != 16 || t.read_us_max < t.read_us_avg) return false;
+
+    // never above the max
+    for (int i = 0; i < 8; i++) {
+        loco.read_cv(8, nullptr);
+        ops_run(loco, 0);
+    }
+    if (loco.ops_tune_get().send_cnt != DccLoco::ops_send_cnt_max)
+        return false;
+    return true;
+}
+
+// The access right after a write's lockout says whether the lockout can be
+// shorter; with tuning off, nothing changes
+static bool test_ops_tune_lockout()
+{
+    DccLoco loco(3);
+    int wait;
+
+    loco.write_cv(2, 0x22, nullptr);
+    if (ops_run(loco, 2) != 2) return false;
+    loco.read_cv(8, nullptr);
+    if (ops_run(loco, 2, &wait) != 2) return false;
+    if (wait != DccLoco::ops_lockout_def) return false;
+    if (loco.ops_tune_get().lockout != DccLoco::ops_lockout_def - 1)
+        return false;
+
+    // answered late: longer
+    loco.write_cv(2, 0x22, nullptr);
+    ops_run(loco, 2);
+    loco.read_cv(8, nullptr);
+    if (ops_run(loco, 4, &wait) != 4) return false;
+    if (wait != DccLoco::ops_lockout_def - 1) return false;
+    if (loco.ops_tune_get().lockout != DccLoco::ops_lockout_def + 3)
+        return false;
+
+    // nothing right after the lockout: no change
+    loco.write_cv(2, 0x22, nullptr);
+    ops_run(loco, 2);
+    for (int i = 0; i < 20; i++)
+        loco.next_packet();
+    loco.read_cv(8, nullptr);
+    ops_run(loco, 0);
+    if (loco.ops_tune_get().lockout != DccLoco::ops_lockout_def + 3)
+        return false;
+
+    // tuning off: defaults, and they stay
+    loco.ops_tune_set(false);
+    DccLoco::OpsTune t = loco.ops_tune_get();
+    if (t.send_cnt != DccLoco::ops_send_cnt_def) return false;
+    if (t.lockout != DccLoco::ops_lockout_def || t.ok != 0) return false;
+    loco.write_cv(2, 0x22, nullptr);
+    ops_run(loco, 2);
+    loco.read_cv(8, nullptr);
+    if (ops_run(loco, 0) != DccLoco::ops_send_cnt_def) return false;
+    t = loco.ops_tune_get();
+    if (t.send_cnt != DccLoco::ops_send_cnt_def) return false;
+    if (t.lockout != DccLoco::ops_lockout_def) return false;
+    if (t.ok != 1 || t.fail != 1) return false;
+    return true;
+}
+
+// --- Ops mode current tests ---
+
+static int cur_cb_cnt;
+static DccCommand::CurrentEvent cur_cb_ev;
+
+static void cur_cb(DccCommand::CurrentEvent ev, uint16_t)
+{
+    cur_cb_cnt++;
+    cur_cb_ev = ev;
+}
+
+static bool test_ops_overcurrent_trip()
+{
+    CmdFixture f;
+    cur_cb_cnt = 0;
+    f.cmd.current_cb_set(cur_cb);
+    f.cmd.set_mode_ops();
+    if (!f.cmd.bitstream().power()) return false;
+
+    // under the limit, nothing happens
+    stub_adc_set_loop_result(1);
+    stub_adc_set_fast_avg_ma(DccTrip::limit_ma_def - 1);
+    f.cmd.loop();
+    if (!f.cmd.bitstream().power()) return false;
+    if (cur_cb_cnt != 0) return false;
+
+    // no new samples, nothing checked
+    stub_adc_set_loop_result(0);
+    stub_adc_set_fast_avg_ma(DccTrip::limit_ma_def);
+    f.cmd.loop();
+    if (!f.cmd.bitstream().power()) return false;
+
+    // over the limit, power off
+    stub_adc_set_loop_result(1);
+    f.cmd.loop();
+    if (f.cmd.bitstream().power()) return false;
+    if (cur_cb_cnt != 1) return false;
+    if (cur_cb_ev != DccCommand::CurrentEvent::Trip) return false;
+    if (f.cmd.track_ma() != 0) return false;
+
+    // turning the track on again clears it
+    f.cmd.trip_reset();
+    if (!f.cmd.bitstream().power()) return false;
+
+    f.cmd.current_cb_set(nullptr);
+    return true;
+}
+
+// Helper: loop in ops mode for about us usec (real time), counting reports
+static int ops_reports(CmdFixture &f, uint32_t us)
+{
+    int reports = 0;
+    const uint32_t start_us = time_us_32();
+    while ((time_us_32() - start_us) < us) {
+        cur_cb_cnt = 0;
+        f.cmd.loop();
+        if (cur_cb_cnt != 0 && cur_cb_ev == DccCommand::CurrentEvent::Report)
+            reports++;
+    }
+    return reports;
+}
+
+// A report interval too long to time in 32-bit usec is taken as the
+// longest one there is, not wrapped around to a short one
+static bool test_ops_current_report_max()
+{
+    CmdFixture f;
+    f.cmd.current_cb_set(cur_cb);
+    f.cmd.set_mode_ops();
+    stub_adc_set_loop_result(1);
+    stub_adc_set_fast_avg_ma(0);
+
+    // reports every ms
+    f.cmd.current_report(1);
+    if (ops_reports(f, 3'000) == 0) return false;
+
+    // 4294968 ms is 704 usec after wrapping to 32 bits
+    f.cmd.current_report(DccCommand::report_ms_max + 1);
+    if (f.cmd.current_report() != DccCommand::report_ms_max) return false;
+    if (ops_reports(f, 3'000) != 0) return false;
+
+    f.cmd.current_report(UINT32_MAX);
+    if (f.cmd.current_report() != DccCommand::report_ms_max) return false;
+    if (ops_reports(f, 3'000) != 0) return false;
+
+    f.cmd.current_report(0);
+    f.cmd.current_cb_set(nullptr);
+    return true;
+}
+
 // --- Service mode write tests ---
 
 // Verify write CV sequence: 20 resets + 5 commands + 5 resets, no ack → error
@@ -405,6 +796,63 @@ static bool test_svc_read_cv_with_acks()
     return true;
 }
 
+// Read CV 0x80 with the ack detector learning the idle current during the
+// initial resets: the ack for bit 7 cuts that bit short
+static bool test_svc_read_cv_ack_cut()
+{
+    CmdFixture f;
+
+    stub_adc_set_loop_result(0);
+    stub_adc_set_long_avg_ma(100);
+
+    f.cmd.read_cv(1);
+
+    DccPkt2 pkt;
+
+    // Phase 1: 20 resets, with steady current samples in the last half
+    stub_adc_set_loop_result(1);
+    stub_adc_set_short_avg_ma(100);
+    for (int i = 0; i < DccSpec::svc_reset1_cnt; i++) {
+        f.cmd.get_packet(pkt);
+        if (!is_reset(pkt)) return false;
+        for (int j = 0; j < 4; j++)
+            f.cmd.loop();
+    }
+    stub_adc_set_loop_result(0);
+    stub_adc_set_short_avg_ma(0);
+
+    // Bit 7: ack on the first verify
+    f.cmd.get_packet(pkt);
+    if (!is_not_reset(pkt)) return false;
+    inject_ack(f.cmd);
+
+    // Just 3 resets, then bit 6
+    for (int i = 0; i < 3; i++) {
+        f.cmd.get_packet(pkt);
+        if (!is_reset(pkt)) return false;
+    }
+    f.cmd.get_packet(pkt);
+    if (!is_not_reset(pkt)) return false;
+
+    // Rest of bit 6, and bits 5..0, no acks
+    pump(f.cmd, DccSpec::svc_command_cnt - 1 + DccSpec::svc_reset2_cnt);
+    pump(f.cmd, 6 * (DccSpec::svc_command_cnt + DccSpec::svc_reset2_cnt));
+
+    // Final byte verify
+    f.cmd.get_packet(pkt);
+    if (!is_not_reset(pkt)) return false;
+    inject_ack(f.cmd);
+    f.cmd.get_packet(pkt);
+
+    bool result;
+    uint8_t val;
+    if (!f.cmd.svc_done(result, val)) return false;
+    if (result != true) return false;
+    if (val != 0x80) return false;
+
+    return true;
+}
+
 // Read single bit: first tries 0 (no ack), then tries 1 (ack) → success, val=1
 static bool test_svc_read_bit()
 {
@@ -466,11 +914,20 @@ extern const Test tests_dcc_command[] = {
     {"cmd_create_invalid_address", test_create_invalid_address},
     {"cmd_ops_idle_no_locos", test_ops_idle_no_locos},
     {"cmd_ops_round_robin", test_ops_round_robin},
+    {"cmd_ops_cv_reads_interleaved", test_ops_cv_reads_interleaved},
+    {"cmd_ops_cv_queue", test_ops_cv_queue},
+    {"cmd_ops_cv_delete", test_ops_cv_delete},
+    {"cmd_delete_loco_lat", test_delete_loco_lat},
+    {"cmd_ops_tune_send_cnt", test_ops_tune_send_cnt},
+    {"cmd_ops_tune_lockout", test_ops_tune_lockout},
+    {"cmd_ops_overcurrent_trip", test_ops_overcurrent_trip},
+    {"cmd_ops_current_report_max", test_ops_current_report_max},
     {"cmd_svc_write_cv_no_ack", test_svc_write_cv_no_ack},
     {"cmd_svc_write_cv_with_ack", test_svc_write_cv_with_ack},
     {"cmd_svc_write_bit_no_ack", test_svc_write_bit_no_ack},
     {"cmd_svc_read_cv_all_zeros", test_svc_read_cv_all_zeros},
     {"cmd_svc_read_cv_with_acks", test_svc_read_cv_with_acks},
+    {"cmd_svc_read_cv_ack_cut", test_svc_read_cv_ack_cut},
     {"cmd_svc_read_bit", test_svc_read_bit},
     {"cmd_mode_transitions", test_mode_transitions},
 };
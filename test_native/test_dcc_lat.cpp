@@ -0,0 +1,177 @@
+#include <cstdint>
+
+#include "dcc/dcc_lat.h"
+#include "dcc/dcc_loco.h"
+#include "hardware/timer.h"
+#include "test.h"
+
+typedef DccLat::Hist Hist;
+typedef DccLat::Kind Kind;
+typedef DccLat::Stage Stage;
+
+// Every time goes in a bucket whose top is at least it, and no more than 25%
+// over it, up to the last bucket (which has everything from there on)
+static bool test_lat_buckets()
+{
+    const uint32_t last_us = Hist::bucket_top(Hist::bucket_cnt - 2);
+    int prev = 0;
+    for (uint32_t us = 0; us <= last_us; us += 1 + us / 64) {
+        const int b = Hist::bucket(us);
+        if (b < prev || b >= Hist::bucket_cnt - 1)
+            return false;
+        const uint32_t top = Hist::bucket_top(b);
+        if (top < us || top > us + us / 4)
+            return false;
+        if (b > 0 && Hist::bucket_top(b - 1) >= us)
+            return false;
+        prev = b;
+    }
+    return Hist::bucket(last_us + 1) == Hist::bucket_cnt - 1 &&
+           Hist::bucket(1u << Hist::pow_max) == Hist::bucket_cnt - 1 &&
+           Hist::bucket(UINT32_MAX) == Hist::bucket_cnt - 1;
+}
+
+// Percentiles come from the buckets, but never over the max
+static bool test_lat_pct()
+{
+    Hist h;
+    if (h.cnt() != 0 || h.pct(50) != 0 || h.max() != 0) return false;
+
+    for (uint32_t us = 1; us <= 100; us++)
+        h.add(us);
+    if (h.cnt() != 100 || h.max() != 100) return false;
+    // 50 is in 48...55, 99 in 96...111 (which tops out at the max)
+    if (h.pct(50) != 55 || h.pct(99) != 100 || h.pct(100) != 100)
+        return false;
+
+    h.add(5'000'000);
+    if (h.pct(100) != 5'000'000 || h.pct(50) != 55) return false;
+
+    h.reset();
+    h.add(3);
+    return h.cnt() == 1 && h.pct(1) == 3 && h.pct(99) == 3;
+}
+
+// A change is picked with the loco's next speed/function packet, and counted
+// when that goes out; going out before it's picked doesn't count
+static bool test_lat_loco()
+{
+    DccLat lat;
+    DccLoco loco(3);
+
+    const uint32_t now_us = time_us_32();
+    loco.set_speed(10);
+    loco.lat_start(&lat, {1, Kind::Speed, now_us - 100, now_us - 40, 0, 0});
+    loco.lat_on_track(); // some packet picked before the change
+    if (lat.get(Kind::Speed, Stage::Whole).cnt != 0) return false;
+
+    loco.next_packet();
+    loco.lat_on_track();
+    loco.lat_on_track(); // only once
+    DccLat::Pct p = lat.get(Kind::Speed, Stage::Srv);
+    if (p.cnt != 1 || p.max != 60) return false;
+    p = lat.get(Kind::Speed, Stage::Whole);
+    if (p.cnt != 1 || p.max < 100) return false;
+    if (lat.get(Kind::Speed, Stage::Pick).cnt != 1 ||
+        lat.get(Kind::Speed, Stage::Track).cnt != 1)
+        return false;
+    if (lat.get(Kind::Func, Stage::Whole).cnt != 0) return false;
+
+    // every change waiting for a packet is timed with it, including ones
+    // made while an earlier packet is going out
+    loco.set_function(0, true);
+    loco.lat_start(&lat, {2, Kind::Func, now_us, now_us, 0, 0}, 0);
+    loco.next_packet(); // f0-f4
+    loco.lat_start(&lat, {3, Kind::Batch, now_us, now_us, 0, 0});
+    loco.lat_start(&lat, {4, Kind::Batch, now_us, now_us, 0, 0});
+    loco.lat_on_track();
+    if (lat.get(Kind::Func, Stage::Whole).cnt != 1 ||
+        lat.get(Kind::Batch, Stage::Whole).cnt != 0)
+        return false;
+    loco.next_packet(); // speed
+    loco.lat_on_track();
+    if (lat.get(Kind::Batch, Stage::Whole).cnt != 2) return false;
+
+    // a speed and a function at once: the function packet goes first, and
+    // the change isn't all out until the speed packet after it
+    lat.reset();
+    loco.set_speed(20);
+    loco.set_function(5, true);
+    loco.lat_start(&lat, {5, Kind::Batch, now_us, now_us, 0, 0});
+    loco.next_packet(); // f5-f8
+    loco.lat_on_track();
+    if (lat.get(Kind::Batch, Stage::Whole).cnt != 0) return false;
+    loco.next_packet(); // speed
+    loco.lat_on_track();
+    if (lat.get(Kind::Batch, Stage::Whole).cnt != 1) return false;
+
+    // any number of changes between packets are all timed
+    lat.reset();
+    const int n = 1000;
+    for (int i = 0; i < n; i++) {
+        loco.set_speed(i % 100);
+        loco.lat_start(&lat, {uint16_t(10 + i), Kind::Speed, now_us, now_us,
+                              0, 0});
+    }
+    if (lat.get(Kind::Speed, Stage::Srv).cnt != uint32_t(n)) return false;
+    loco.next_packet();
+    loco.lat_on_track();
+    DccLat::Pct p2 = lat.get(Kind::Speed, Stage::Track);
+    if (p2.cnt != uint32_t(n) || p2.missed != 0) return false;
+
+    // any left when the track goes off are missed
+    for (int i = 0; i < 3; i++)
+        loco.lat_start(&lat, {uint16_t(20 + i), Kind::Speed, now_us, now_us,
+                              0, 0});
+    loco.set_function(9, true);
+    loco.lat_start(&lat, {23, Kind::Func, now_us, now_us, 0, 0}, 9);
+    loco.lat_clear();
+    loco.next_packet();
+    loco.lat_on_track();
+    p2 = lat.get(Kind::Speed, Stage::Whole);
+    if (p2.cnt != uint32_t(n) || p2.missed != 3) return false;
+    p2 = lat.get(Kind::Func, Stage::Whole);
+    if (p2.cnt != 0 || p2.missed != 1) return false;
+
+    lat.reset();
+    return lat.get(Kind::Speed, Stage::Whole).cnt == 0 &&
+           lat.get(Kind::Speed, Stage::Whole).missed == 0 &&
+           lat.get(Kind::Func, Stage::Whole).cnt == 0 &&
+           lat.get(Kind::Batch, Stage::Whole).cnt == 0;
+}
+
+// With many changes waiting for each packet, the one kept is any of them
+// with the same chance, so the times aren't skewed toward the oldest (or
+// newest): ten changes per packet, made 0, 100, ... 900 usec before it's
+// picked, should give a median deq to pick time around 450 usec
+static bool test_lat_loco_even()
+{
+    DccLat lat;
+    DccLoco loco(3);
+
+    const int rounds = 400;
+    for (int r = 0; r < rounds; r++) {
+        const uint32_t now_us = time_us_32();
+        for (int i = 0; i < 10; i++) {
+            const uint32_t us = now_us - 900 + i * 100;
+            loco.set_speed(i);
+            loco.lat_start(&lat, {uint16_t(1 + i), Kind::Speed, us, us, 0, 0});
+        }
+        loco.next_packet();
+        loco.lat_on_track();
+    }
+
+    const DccLat::Pct p = lat.get(Kind::Speed, Stage::Pick);
+    if (p.cnt != uint32_t(rounds * 10)) return false;
+    // (buckets are up to 25% wide, and the host adds a little)
+    return 300 <= p.p50 && p.p50 <= 700 && p.p99 >= 800;
+}
+
+extern const Test tests_dcc_lat[] = {
+    {"lat_buckets", test_lat_buckets},
+    {"lat_pct", test_lat_pct},
+    {"lat_loco", test_lat_loco},
+    {"lat_loco_even", test_lat_loco_even},
+};
+
+extern const int tests_dcc_lat_cnt = sizeof(tests_dcc_lat) / sizeof(tests_dcc_lat[0]);
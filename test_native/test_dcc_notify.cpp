@@ -0,0 +1,162 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "dcc/dcc_msg.h"
+#include "dcc/dcc_notify.h"
+#include "dcc/dcc_srv.h"
+#include "test.h"
+
+typedef DccNotify::Kind Kind;
+
+// Take the next one from q, checking its seq; false if q is empty
+static bool take(NotRing &q, uint16_t seq, char *msg)
+{
+    char buf[not_msg_len_max];
+    if (!q.get(buf))
+        return false;
+    uint16_t s;
+    if (!DccMsg::not_seq(buf, s) || s != seq)
+        return false;
+    strcpy(msg, DccMsg::text(buf));
+    return true;
+}
+
+// Events go in as they are, with a seq; a dropped one uses up its seq
+static bool test_notify_events()
+{
+    static NotRing q;
+    static DccNotify n(q);
+    char msg[not_msg_len_max];
+
+    n.event("T O T 3000");
+    n.event("R A 3 1");
+    if (!take(q, 0, msg) || strcmp(msg, "T O T 3000") != 0) return false;
+    if (!take(q, 1, msg) || strcmp(msg, "R A 3 1") != 0) return false;
+
+    for (int i = 0; i < not_msg_cnt_max + 2; i++)
+        n.event("R A 3 1");
+    if (n.sent() != 2 + not_msg_cnt_max || n.dropped() != 2) return false;
+    for (int i = 0; i < not_msg_cnt_max; i++)
+        if (!take(q, 2 + i, msg)) return false;
+    // the seq shows the two dropped
+    n.event("R A 3 0");
+    if (!take(q, 2 + not_msg_cnt_max + 2, msg)) return false;
+
+    n.stats_reset();
+    return n.sent() == 0 && n.dropped() == 0 && n.coalesced() == 0;
+}
+
+// A value report waits while its last one is still in the queue, and the
+// latest value is what's sent
+static bool test_notify_coalesce()
+{
+    static NotRing q;
+    static DccNotify n(q);
+    char msg[not_msg_len_max];
+
+    n.report(Kind::Speed, 3, 0, "L 3 S 10 T 1");
+    n.report(Kind::Speed, 3, 0, "L 3 S 20 T 2");
+    n.report(Kind::Speed, 3, 0, "L 3 S 30 T 3");
+    n.report(Kind::Speed, 4, 0, "L 4 S 5 T 3");
+    if (q.level() != 2 || n.coalesced() != 1) return false;
+
+    n.flush(); // first speed for 3 still there
+    if (q.level() != 2) return false;
+
+    if (!take(q, 0, msg) || strcmp(msg, "L 3 S 10 T 1") != 0) return false;
+    n.flush();
+    if (!take(q, 1, msg) || strcmp(msg, "L 4 S 5 T 3") != 0) return false;
+    if (!take(q, 2, msg) || strcmp(msg, "L 3 S 30 T 3") != 0) return false;
+    n.flush();
+    if (q.level() != 0) return false;
+
+    // dyn ids are separate keys
+    n.report(Kind::Dyn, 3, 1, "L 3 Y 1 V 7 T 4");
+    n.report(Kind::Dyn, 3, 2, "L 3 Y 2 V 8 T 4");
+    return q.level() == 2 && n.coalesced() == 1;
+}
+
+// A waiting report is sent once there's room in the queue
+static bool test_notify_full()
+{
+    static NotRing q;
+    static DccNotify n(q);
+    char msg[not_msg_len_max];
+
+    for (int i = 0; i < not_msg_cnt_max; i++)
+        n.event("T O T 3000");
+    n.report(Kind::Current, 0, 0, "T I 100");
+    n.report(Kind::Current, 0, 0, "T I 200");
+    if (n.dropped() != 0 || n.coalesced() != 1) return false;
+
+    if (!take(q, 0, msg)) return false;
+    n.flush();
+    for (int i = 1; i < not_msg_cnt_max; i++)
+        if (!take(q, i, msg)) return false;
+    if (!take(q, not_msg_cnt_max, msg) || strcmp(msg, "T I 200") != 0)
+        return false;
+    return q.level() == 0;
+}
+
+// Reports for a deleted loco are forgotten
+static bool test_notify_forget()
+{
+    static NotRing q;
+    static DccNotify n(q);
+    char msg[not_msg_len_max];
+
+    n.report(Kind::Speed, 3, 0, "L 3 S 10 T 1");
+    n.report(Kind::Speed, 3, 0, "L 3 S 20 T 2");
+    n.report(Kind::Current, 0, 0, "T I 100");
+    n.report(Kind::Current, 0, 0, "T I 200");
+    n.forget(3);
+    if (!take(q, 0, msg) || !take(q, 1, msg)) return false;
+    n.flush();
+    if (!take(q, 2, msg) || strcmp(msg, "T I 200") != 0) return false;
+    return q.level() == 0;
+}
+
+// With every entry held, a report for a new key is sent like an event
+static bool test_notify_table_full()
+{
+    static NotRing q;
+    static DccNotify n(q);
+    char msg[not_msg_len_max];
+
+    // first report for each goes in the queue, second one waits
+    for (int a = 1; a <= DccNotify::val_max; a++) {
+        char m[not_msg_len_max];
+        snprintf(m, sizeof(m), "L %d S 1 T 1", a);
+        n.report(Kind::Speed, a, 0, m);
+        snprintf(m, sizeof(m), "L %d S 2 T 2", a);
+        n.report(Kind::Speed, a, 0, m);
+    }
+    int level = q.level();
+    int dropped = n.dropped();
+    n.report(Kind::Speed, 100, 0, "L 100 S 1 T 3");
+    if (q.level() + int(n.dropped()) != level + dropped + 1) return false;
+
+    // the held ones all still come out, the latest value for each
+    int got = 0;
+    while (true) {
+        while (q.get(msg))
+            if (strstr(msg, " S 2 ") != nullptr)
+                got++;
+        n.flush();
+        if (q.level() == 0)
+            break;
+    }
+    return got == DccNotify::val_max;
+}
+
+extern const Test tests_dcc_notify[] = {
+    {"notify_events", test_notify_events},
+    {"notify_coalesce", test_notify_coalesce},
+    {"notify_full", test_notify_full},
+    {"notify_forget", test_notify_forget},
+    {"notify_table_full", test_notify_table_full},
+};
+
+extern const int tests_dcc_notify_cnt =
+    sizeof(tests_dcc_notify) / sizeof(tests_dcc_notify[0]);
@@ -0,0 +1,177 @@
+#include <cstdio>
+#include <cstdint>
+
+#include "dcc/dcc_trip.h"
+#include "test.h"
+
+static const uint32_t ms = 1000; // usec
+
+static bool test_trip_under_limit()
+{
+    DccTrip trip;
+    trip.reset(0);
+    if (!trip.power()) return false;
+    if (trip.check(DccTrip::limit_ma_def - 1, 100) != DccTrip::Event::None)
+        return false;
+    if (!trip.power()) return false;
+    if (trip.trip_cnt() != 0) return false;
+    return true;
+}
+
+static bool test_trip_at_limit()
+{
+    DccTrip trip;
+    trip.reset(0);
+    if (trip.check(DccTrip::limit_ma_def, 100) != DccTrip::Event::Trip)
+        return false;
+    if (trip.power()) return false;
+    if (trip.locked_out()) return false;
+    if (trip.trip_cnt() != 1) return false;
+    return true;
+}
+
+// Power comes back after retry_ms, whatever the current reads while off
+static bool test_trip_retry()
+{
+    DccTrip trip;
+    trip.reset(0);
+    uint32_t t = 10 * ms;
+    if (trip.check(3000, t) != DccTrip::Event::Trip) return false;
+    t += DccTrip::retry_ms_def * ms - 1;
+    if (trip.check(3000, t) != DccTrip::Event::None) return false;
+    if (trip.power()) return false;
+    t += 1;
+    if (trip.check(3000, t) != DccTrip::Event::Retry) return false;
+    if (!trip.power()) return false;
+    return true;
+}
+
+// Tripping again soon after a retry doubles the wait
+static bool test_trip_backoff()
+{
+    DccTrip trip;
+    trip.reset(0);
+    uint32_t t = 10 * ms;
+    uint32_t wait_ms = DccTrip::retry_ms_def;
+    for (int i = 0; i < DccTrip::retry_max_def; i++) {
+        if (trip.check(3000, t) != DccTrip::Event::Trip) return false;
+        if (trip.check(3000, t + wait_ms * ms - 1) != DccTrip::Event::None)
+            return false;
+        t += wait_ms * ms;
+        if (trip.check(0, t) != DccTrip::Event::Retry) return false;
+        t += 1 * ms;
+        wait_ms *= 2;
+    }
+    return true;
+}
+
+static bool test_trip_lockout()
+{
+    DccTrip trip;
+    trip.config(1000, 100, 2);
+    trip.reset(0);
+    uint32_t t = 1 * ms;
+    if (trip.check(1000, t) != DccTrip::Event::Trip) return false;
+    t += 100 * ms;
+    if (trip.check(0, t) != DccTrip::Event::Retry) return false;
+    t += 1 * ms;
+    if (trip.check(1000, t) != DccTrip::Event::Trip) return false;
+    t += 200 * ms;
+    if (trip.check(0, t) != DccTrip::Event::Retry) return false;
+    t += 1 * ms;
+    if (trip.check(1000, t) != DccTrip::Event::Lockout) return false;
+    if (!trip.locked_out()) return false;
+    if (trip.power()) return false;
+    // stays off
+    t += DccTrip::retry_ms_max * ms;
+    if (trip.check(0, t) != DccTrip::Event::None) return false;
+    if (trip.power()) return false;
+    // until reset
+    trip.reset(t);
+    if (!trip.power()) return false;
+    if (trip.locked_out()) return false;
+    if (trip.check(1000, t + 1) != DccTrip::Event::Trip) return false;
+    if (trip.trip_cnt() != 4) return false;
+    return true;
+}
+
+// Running clean for clear_ms after a retry forgets the earlier trips
+static bool test_trip_clear()
+{
+    DccTrip trip;
+    trip.config(1000, 100, 1);
+    trip.reset(0);
+    uint32_t t = 1 * ms;
+    if (trip.check(1000, t) != DccTrip::Event::Trip) return false;
+    t += 100 * ms;
+    if (trip.check(0, t) != DccTrip::Event::Retry) return false;
+    t += DccTrip::clear_ms * ms;
+    if (trip.check(1000, t) != DccTrip::Event::Trip) return false;
+    // wait is back to retry_ms
+    if (trip.check(0, t + 100 * ms) != DccTrip::Event::Retry) return false;
+    return true;
+}
+
+// Wait is capped at retry_ms_max
+static bool test_trip_backoff_max()
+{
+    DccTrip trip;
+    trip.config(1000, DccTrip::retry_ms_max / 2 + 1, 3);
+    trip.reset(0);
+    uint32_t t = 1 * ms;
+    if (trip.check(1000, t) != DccTrip::Event::Trip) return false;
+    t += (DccTrip::retry_ms_max / 2 + 1) * ms;
+    if (trip.check(0, t) != DccTrip::Event::Retry) return false;
+    t += 1 * ms;
+    if (trip.check(1000, t) != DccTrip::Event::Trip) return false;
+    t += DccTrip::retry_ms_max * ms;
+    if (trip.check(0, t) != DccTrip::Event::Retry) return false;
+    return true;
+}
+
+// Wraparound of time_us_32() does not matter
+static bool test_trip_wrap()
+{
+    DccTrip trip;
+    uint32_t t = UINT32_MAX - 50 * ms;
+    trip.reset(t);
+    if (trip.check(3000, t) != DccTrip::Event::Trip) return false;
+    t += DccTrip::retry_ms_def * ms;
+    if (trip.check(0, t) != DccTrip::Event::Retry) return false;
+    return true;
+}
+
+static bool test_trip_config()
+{
+    DccTrip trip;
+    if (trip.config(0, 100, 2)) return false;
+    if (trip.config(1000, 0, 2)) return false;
+    if (trip.config(1000, DccTrip::retry_ms_max + 1, 2)) return false;
+    if (trip.config(1000, 100, -1)) return false;
+    if (trip.limit_ma() != DccTrip::limit_ma_def) return false;
+    if (trip.retry_ms() != DccTrip::retry_ms_def) return false;
+    if (trip.retry_max() != DccTrip::retry_max_def) return false;
+    if (!trip.config(1500, 500, 0)) return false;
+    if (trip.limit_ma() != 1500) return false;
+    if (trip.retry_ms() != 500) return false;
+    if (trip.retry_max() != 0) return false;
+    // retry_max 0: first trip locks out
+    trip.reset(0);
+    if (trip.check(1500, 1) != DccTrip::Event::Lockout) return false;
+    return true;
+}
+
+extern const Test tests_dcc_trip[] = {
+    {"trip_under_limit", test_trip_under_limit},
+    {"trip_at_limit", test_trip_at_limit},
+    {"trip_retry", test_trip_retry},
+    {"trip_backoff", test_trip_backoff},
+    {"trip_lockout", test_trip_lockout},
+    {"trip_clear", test_trip_clear},
+    {"trip_backoff_max", test_trip_backoff_max},
+    {"trip_wrap", test_trip_wrap},
+    {"trip_config", test_trip_config},
+};
+
+extern const int tests_dcc_trip_cnt =
+    sizeof(tests_dcc_trip) / sizeof(tests_dcc_trip[0]);
@@ -14,6 +14,38 @@ extern const int tests_dcc_bit_cnt;
 extern const Test tests_dcc_command[];
 extern const int tests_dcc_command_cnt;
 
+// Defined in test_dcc_adc_avg.cpp
+extern const Test tests_dcc_adc_avg[];
+extern const int tests_dcc_adc_avg_cnt;
+
+// Defined in test_dcc_ack.cpp
+extern const Test tests_dcc_ack[];
+extern const int tests_dcc_ack_cnt;
+
+// Defined in test_dcc_trip.cpp
+extern const Test tests_dcc_trip[];
+extern const int tests_dcc_trip_cnt;
+
+// Defined in test_railcom.cpp
+extern const Test tests_railcom[];
+extern const int tests_railcom_cnt;
+
+// Defined in test_railcom_addr_map.cpp
+extern const Test tests_railcom_addr_map[];
+extern const int tests_railcom_addr_map_cnt;
+
+// Defined in test_msg_ring.cpp
+extern const Test tests_msg_ring[];
+extern const int tests_msg_ring_cnt;
+
+// Defined in test_dcc_notify.cpp
+extern const Test tests_dcc_notify[];
+extern const int tests_dcc_notify_cnt;
+
+// Defined in test_dcc_lat.cpp
+extern const Test tests_dcc_lat[];
+extern const int tests_dcc_lat_cnt;
+
 static int run_suite(const char *suite_name, const Test *tests, int count)
 {
     int fail = 0;
@@ -35,6 +67,15 @@ int main()
     fail += run_suite("dcc_pkt", tests_dcc_pkt, tests_dcc_pkt_cnt);
     fail += run_suite("dcc_bit", tests_dcc_bit, tests_dcc_bit_cnt);
     fail += run_suite("dcc_command", tests_dcc_command, tests_dcc_command_cnt);
+    fail += run_suite("dcc_adc_avg", tests_dcc_adc_avg, tests_dcc_adc_avg_cnt);
+    fail += run_suite("dcc_ack", tests_dcc_ack, tests_dcc_ack_cnt);
+    fail += run_suite("dcc_trip", tests_dcc_trip, tests_dcc_trip_cnt);
+    fail += run_suite("railcom", tests_railcom, tests_railcom_cnt);
+    fail += run_suite("railcom_addr_map", tests_railcom_addr_map,
+                      tests_railcom_addr_map_cnt);
+    fail += run_suite("msg_ring", tests_msg_ring, tests_msg_ring_cnt);
+    fail += run_suite("dcc_notify", tests_dcc_notify, tests_dcc_notify_cnt);
+    fail += run_suite("dcc_lat", tests_dcc_lat, tests_dcc_lat_cnt);
 
     printf("=== %s ===\n", fail == 0 ? "ALL PASSED" : "FAILURES");
     return fail == 0 ? 0 : 1;
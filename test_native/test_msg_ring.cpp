@@ -0,0 +1,193 @@
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#include "dcc/blk_pool.h"
+#include "dcc/msg_ring.h"
+#include "test.h"
+
+typedef MsgRing<32, 8> Ring;
+typedef BlkPool<256, 4> Pool;
+
+// Messages come out in order, with their lengths
+static bool test_ring_order()
+{
+    Ring r;
+    char msg[32];
+    int len;
+    if (r.get(msg, len) || r.level() != 0) return false;
+    if (!r.put("T G", 4) || !r.put("L 3 S S 10", 11)) return false;
+    if (r.level() != 2) return false;
+    if (!r.get(msg, len) || len != 4 || strcmp(msg, "T G") != 0) return false;
+    if (!r.get(msg, len) || len != 11 || strcmp(msg, "L 3 S S 10") != 0)
+        return false;
+    if (r.get(msg, len) || r.level() != 0) return false;
+    // too long
+    char big[33] = {};
+    if (r.put(big, sizeof(big))) return false;
+    return true;
+}
+
+// Full at cnt_max, and keeps going around
+static bool test_ring_full()
+{
+    Ring r;
+    uint32_t v;
+    for (uint32_t i = 0; i < 8; i++)
+        if (!r.put(&i, sizeof(i))) return false;
+    if (r.put(&v, sizeof(v)) || r.claim() != nullptr) return false;
+    uint32_t next = 0;
+    for (uint32_t i = 8; i < 1000; i++) {
+        if (!r.get(&v) || v != next++) return false;
+        if (!r.put(&i, sizeof(i))) return false;
+        if (r.level() != 8) return false;
+    }
+    while (r.get(&v))
+        if (v != next++) return false;
+    return next == 1000;
+}
+
+// Built and used in place
+static bool test_ring_in_place()
+{
+    Ring r;
+    char *p = (char *)r.claim();
+    if (p == nullptr) return false;
+    strcpy(p, "L 3 Y 0 V 7 T 100");
+    if (r.level() != 0) return false; // not there until commit
+    r.commit(strlen(p) + 1);
+    int len;
+    const char *q = (const char *)r.peek(len);
+    if (q != p || len != 18) return false;
+    if (r.peek(len) != q) return false; // still there
+    r.release();
+    if (r.peek(len) != nullptr) return false;
+    return true;
+}
+
+// One thread adds, one takes (as core 1 and core 0 would); every message
+// arrives once, in order, and intact
+static bool test_ring_threads()
+{
+    static constexpr uint32_t msg_cnt = 200'000;
+    Ring r;
+    bool ok = true;
+
+    std::thread producer([&r]() {
+        for (uint32_t seq = 0; seq < msg_cnt; seq++) {
+            uint8_t *p;
+            while ((p = (uint8_t *)r.claim()) == nullptr)
+                std::this_thread::yield();
+            // sequence number, then a varying number of bytes from it
+            int len = 4 + seq % 28;
+            memcpy(p, &seq, 4);
+            for (int i = 4; i < len; i++)
+                p[i] = uint8_t(seq + i);
+            r.commit(len);
+        }
+    });
+
+    std::thread consumer([&r, &ok]() {
+        for (uint32_t seq = 0; seq < msg_cnt; seq++) {
+            uint8_t msg[32];
+            int len;
+            while (!r.get(msg, len))
+                std::this_thread::yield();
+            // keep taking after a bad one, so the producer can finish
+            uint32_t got;
+            memcpy(&got, msg, 4);
+            if (got != seq || len != int(4 + seq % 28))
+                ok = false;
+            for (int i = 4; i < len; i++)
+                if (msg[i] != uint8_t(seq + i))
+                    ok = false;
+        }
+    });
+
+    producer.join();
+    consumer.join();
+    return ok && r.level() == 0;
+}
+
+// Blocks are handed out until there are none, and come back when released
+static bool test_blk_pool_alloc()
+{
+    Pool pool;
+    int h[4];
+    for (int i = 0; i < 4; i++) {
+        h[i] = pool.alloc();
+        if (!pool.valid(h[i]) || pool.blk(h[i]) == nullptr) return false;
+        for (int j = 0; j < i; j++)
+            if (h[j] == h[i]) return false;
+    }
+    if (pool.alloc() != -1 || pool.busy_cnt() != 4) return false;
+    pool.release(h[2]);
+    if (pool.alloc() != h[2]) return false;
+    for (int i = 0; i < 4; i++)
+        pool.release(h[i]);
+    pool.release(-1); // ignored
+    return pool.busy_cnt() == 0 && pool.blk(4) == nullptr;
+}
+
+// One thread fills blocks and sends their handles through a ring, the other
+// reads them and gives them back (as core 1 and core 0 would); every block
+// arrives intact
+static bool test_blk_pool_threads()
+{
+    static constexpr uint32_t msg_cnt = 100'000;
+    Ring r;
+    Pool pool;
+    bool ok = true;
+
+    std::thread producer([&r, &pool]() {
+        for (uint32_t seq = 0; seq < msg_cnt; seq++) {
+            int h;
+            while ((h = pool.alloc()) < 0)
+                std::this_thread::yield();
+            uint32_t *b = (uint32_t *)pool.blk(h);
+            for (int i = 0; i < Pool::len / 4; i++)
+                b[i] = seq + i;
+            uint8_t msg[8];
+            memcpy(msg, &seq, 4);
+            msg[4] = uint8_t(h);
+            while (!r.put(msg, 5))
+                std::this_thread::yield();
+        }
+    });
+
+    std::thread consumer([&r, &pool, &ok]() {
+        for (uint32_t seq = 0; seq < msg_cnt; seq++) {
+            uint8_t msg[32];
+            int len;
+            while (!r.get(msg, len))
+                std::this_thread::yield();
+            uint32_t got;
+            memcpy(&got, msg, 4);
+            const uint32_t *b = (const uint32_t *)pool.blk(msg[4]);
+            if (got != seq || len != 5 || b == nullptr) {
+                ok = false;
+                continue;
+            }
+            for (int i = 0; i < Pool::len / 4; i++)
+                if (b[i] != seq + i)
+                    ok = false;
+            pool.release(msg[4]);
+        }
+    });
+
+    producer.join();
+    consumer.join();
+    return ok && pool.busy_cnt() == 0;
+}
+
+extern const Test tests_msg_ring[] = {
+    {"ring_order", test_ring_order},
+    {"ring_full", test_ring_full},
+    {"ring_in_place", test_ring_in_place},
+    {"ring_threads", test_ring_threads},
+    {"blk_pool_alloc", test_blk_pool_alloc},
+    {"blk_pool_threads", test_blk_pool_threads},
+};
+
+extern const int tests_msg_ring_cnt =
+    sizeof(tests_msg_ring) / sizeof(tests_msg_ring[0]);
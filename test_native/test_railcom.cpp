@@ -0,0 +1,698 @@
+#include <cstdio>
+#include <cstdint>
+
+#include "dcc/dcc_loco.h"
+#include "dcc/railcom.h"
+#include "dcc/railcom_msg.h"
+#include "dcc/railcom_spec.h"
+#include "dcc/railcom_stats.h"
+#include "hardware/timer.h"
+#include "test.h"
+
+// 4/8 encoding of a decoded value (6-bit data, or a DecId)
+static uint8_t enc(uint8_t dec)
+{
+    for (int e = 0; e <= UINT8_MAX; e++)
+        if (RailComSpec::decode[e] == dec)
+            return e;
+    return 0; // not reached for valid dec
+}
+
+static const uint32_t cutout_us = 1000000;
+
+// channel 1 ALO for address 3, then channel 2 all ACK, at the middle of
+// their slots in the cutout
+static void rx_clean(RailCom &rc)
+{
+    rc.rx(enc((RailComSpec::pkt_alo << 2) | 0), cutout_us + 120);
+    rc.rx(enc(3), cutout_us + 160);
+    for (int i = 0; i < RailComSpec::ch2_bytes; i++)
+        rc.rx(enc(RailComSpec::dec_ack), cutout_us + 240 + i * 40);
+}
+
+static bool test_railcom_rx_times()
+{
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(cutout_us);
+    rx_clean(rc);
+    rc.read();
+    if (rc.pkt_len() != 8) return false;
+    if (rc.pkt_us(0) != 120) return false;
+    if (rc.pkt_us(1) != 160) return false;
+    if (rc.pkt_us(7) != 240 + 5 * 40) return false;
+    return true;
+}
+
+// Times relative to the cutout work across time_us_32() wrapping
+static bool test_railcom_rx_wrap()
+{
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(UINT32_MAX - 50);
+    rc.rx(enc(RailComSpec::dec_ack), UINT32_MAX - 50 + 100);
+    rc.read();
+    if (rc.pkt_len() != 1) return false;
+    if (rc.pkt_us(0) != 100) return false;
+    return true;
+}
+
+// Bytes received between cutouts are dropped
+static bool test_railcom_rx_between()
+{
+    RailCom rc(nullptr, -1);
+    rc.rx(enc(RailComSpec::dec_ack), cutout_us - 500);
+    rc.cutout_start(cutout_us);
+    rc.read();
+    if (rc.pkt_len() != 0) return false;
+
+    // after read(), before the next cutout
+    rc.rx(enc(RailComSpec::dec_ack), cutout_us + 2000);
+    rc.cutout_start(cutout_us + 10000);
+    rc.rx(enc(RailComSpec::dec_nak), cutout_us + 10100);
+    rc.read();
+    if (rc.pkt_len() != 1) return false;
+    if (rc.pkt_us(0) != 100) return false;
+    return true;
+}
+
+static bool test_railcom_rx_ovr()
+{
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(cutout_us);
+    rx_clean(rc);
+    rc.rx(enc(RailComSpec::dec_ack), cutout_us + 480);
+    if (rc.rx_ovr_cnt() != 1) return false;
+    rc.read();
+    if (rc.pkt_len() != 8) return false;
+    return true;
+}
+
+static bool test_railcom_parse_clean()
+{
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(cutout_us);
+    rx_clean(rc);
+    rc.read();
+    rc.parse();
+    const RailComMsg *msg;
+    int cnt = rc.get_ch2_msgs(msg);
+    if (cnt != RailComSpec::ch2_bytes) return false;
+    for (int i = 0; i < cnt; i++)
+        if (msg[i].id != RailComMsg::MsgId::ack) return false;
+    return true;
+}
+
+// Two locos both sending channel 1: junk. Channel 2 is still good, which the
+// old method can't see.
+static bool test_railcom_ch1_junk()
+{
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(cutout_us);
+    rc.rx(0x00, cutout_us + 120); // not a 4/8 code
+    rc.rx(enc(3), cutout_us + 160);
+    for (int i = 0; i < RailComSpec::ch2_bytes; i++)
+        rc.rx(enc(RailComSpec::dec_ack), cutout_us + 240 + i * 40);
+    rc.read();
+    rc.parse();
+    const RailComMsg *msg;
+    if (rc.get_ch2_msgs(msg) != RailComSpec::ch2_bytes) return false;
+    if (rc.stats().cutout != 1 || rc.stats().empty != 0) return false;
+    if (rc.stats().ch1 != 0) return false;
+    if (rc.stats().ch2 != 1) return false;
+    if (rc.stats().ch2_heur != 0) return false;
+    return true;
+}
+
+// Channel 1 with a good first byte and a junk second one isn't an address
+static bool test_railcom_ch1_bad_second()
+{
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(cutout_us);
+    rc.rx(enc((RailComSpec::pkt_alo << 2) | 0), cutout_us + 120);
+    rc.rx(0x00, cutout_us + 160); // not a 4/8 code
+    rc.read();
+    rc.parse();
+    if (rc.stats().ch1 != 0) return false;
+
+    // or anything else that isn't data
+    const uint8_t e[] = {enc((RailComSpec::pkt_ahi << 2) | 0),
+                         enc(RailComSpec::dec_ack)};
+    RailComSpec::Frame f;
+    RailComSpec::decode_frame(e, 2, f);
+    int i = 0;
+    RailComMsg msg;
+    if (msg.parse1(f, i, 2) || i != 0) return false;
+    return true;
+}
+
+// No channel 1 (turned off in the decoder): both methods get channel 2
+static bool test_railcom_no_ch1()
+{
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(cutout_us);
+    for (int i = 0; i < RailComSpec::ch2_bytes; i++)
+        rc.rx(enc(RailComSpec::dec_ack), cutout_us + 240 + i * 40);
+    rc.read();
+    rc.parse();
+    const RailComMsg *msg;
+    if (rc.get_ch2_msgs(msg) != RailComSpec::ch2_bytes) return false;
+    if (rc.stats().ch2 != 1 || rc.stats().ch2_heur != 1) return false;
+    return true;
+}
+
+// Channel 2 shorter than 6 bytes (a POM, then nothing)
+static bool test_railcom_ch2_short()
+{
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(cutout_us);
+    rc.rx(enc((RailComSpec::pkt_alo << 2) | 0), cutout_us + 120);
+    rc.rx(enc(3), cutout_us + 160);
+    rc.rx(enc((RailComSpec::pkt_pom << 2) | 2), cutout_us + 240);
+    rc.rx(enc(0x15), cutout_us + 280);
+    rc.read();
+    rc.parse();
+    const RailComMsg *msg;
+    if (rc.get_ch2_msgs(msg) != 1) return false;
+    if (msg[0].id != RailComMsg::MsgId::pom) return false;
+    if (msg[0].pom.val != 0x95) return false;
+    if (rc.stats().ch1 != 1) return false;
+    if (rc.stats().ch2 != 1 || rc.stats().ch2_heur != 0) return false;
+    return true;
+}
+
+// Only channel 1
+static bool test_railcom_ch1_only()
+{
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(cutout_us);
+    rc.rx(enc((RailComSpec::pkt_ahi << 2) | 0), cutout_us + 120);
+    rc.rx(enc(0), cutout_us + 160);
+    rc.read();
+    rc.parse();
+    const RailComMsg *msg;
+    if (rc.get_ch2_msgs(msg) != 0) return false;
+    if (rc.stats().ch1 != 1 || rc.stats().ch2 != 0) return false;
+    return true;
+}
+
+// POM (0x95) in channel 2, then a corrupted byte, then filler ACKs
+static void rx_pom_junk(RailCom &rc)
+{
+    rc.rx(enc((RailComSpec::pkt_alo << 2) | 0), cutout_us + 120);
+    rc.rx(enc(3), cutout_us + 160);
+    rc.rx(enc((RailComSpec::pkt_pom << 2) | 2), cutout_us + 240);
+    rc.rx(enc(0x15), cutout_us + 280);
+    rc.rx(0x00, cutout_us + 320); // not a 4/8 code
+    for (int i = 3; i < RailComSpec::ch2_bytes; i++)
+        rc.rx(enc(RailComSpec::dec_ack), cutout_us + 240 + i * 40);
+}
+
+// Partial mode (the default) keeps the POM ahead of the junk
+static bool test_railcom_ch2_partial()
+{
+    RailCom rc(nullptr, -1);
+    if (rc.ch2_mode() != RailCom::Ch2Mode::Partial) return false;
+    rc.cutout_start(cutout_us);
+    rx_pom_junk(rc);
+    rc.read();
+    rc.parse();
+    const RailComMsg *msg;
+    if (rc.get_ch2_msgs(msg) != 1) return false;
+    if (msg[0].id != RailComMsg::MsgId::pom) return false;
+    if (msg[0].pom.val != 0x95) return false;
+    if (rc.ch2_frame() != RailCom::Ch2Frame::Partial) return false;
+    if (rc.stats().ch2 != 1 || rc.stats().ch2_part != 1) return false;
+    return true;
+}
+
+// Full mode drops all of channel 2 for the same bytes
+static bool test_railcom_ch2_full_mode()
+{
+    RailCom rc(nullptr, -1);
+    rc.ch2_mode(RailCom::Ch2Mode::Full);
+    rc.cutout_start(cutout_us);
+    rx_pom_junk(rc);
+    rc.read();
+    rc.parse();
+    const RailComMsg *msg;
+    if (rc.get_ch2_msgs(msg) != 0) return false;
+    if (rc.ch2_frame() != RailCom::Ch2Frame::Partial) return false;
+    if (rc.stats().ch2 != 0 || rc.stats().ch2_part != 1) return false;
+
+    // a clean frame is the same in either mode
+    rc.cutout_start(cutout_us);
+    rx_clean(rc);
+    rc.read();
+    rc.parse();
+    if (rc.get_ch2_msgs(msg) != RailComSpec::ch2_bytes) return false;
+    if (rc.ch2_frame() != RailCom::Ch2Frame::Full) return false;
+    return true;
+}
+
+// All 8 bytes after the split (a late channel 1, say), all ACK: more than
+// channel 2 can hold, so the first ch2_bytes are used and the rest is junk
+static bool test_railcom_ch2_overfull()
+{
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(cutout_us);
+    for (int i = 0; i < RailComSpec::ch1_bytes + RailComSpec::ch2_bytes; i++)
+        rc.rx(enc(RailComSpec::dec_ack),
+              cutout_us + RailComSpec::ch_split_us + 1 + i * 30);
+    rc.read();
+    rc.parse();
+    const RailComMsg *msg;
+    if (rc.get_ch2_msgs(msg) != RailComSpec::ch2_bytes) return false;
+    for (int m = 0; m < RailComSpec::ch2_bytes; m++)
+        if (msg[m].id != RailComMsg::MsgId::ack) return false;
+    if (rc.ch2_frame() != RailCom::Ch2Frame::Partial) return false;
+    if (rc.stats().ch1 != 0 || rc.stats().ch2_part != 1) return false;
+    if (rc.stats().ack != uint32_t(RailComSpec::ch2_bytes)) return false;
+    return true;
+}
+
+// Junk in the first byte: nothing is used, and nothing after it is trusted
+// (the good ACKs might not be where a message starts)
+static bool test_railcom_ch2_rejected()
+{
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(cutout_us);
+    rc.rx(0x00, cutout_us + 240);
+    for (int i = 1; i < RailComSpec::ch2_bytes; i++)
+        rc.rx(enc(RailComSpec::dec_ack), cutout_us + 240 + i * 40);
+    rc.read();
+    rc.parse();
+    const RailComMsg *msg;
+    if (rc.get_ch2_msgs(msg) != 0) return false;
+    if (rc.ch2_frame() != RailCom::Ch2Frame::Rejected) return false;
+
+    // channel 1 only is no channel 2 frame at all
+    rc.cutout_start(cutout_us);
+    rc.rx(enc((RailComSpec::pkt_alo << 2) | 0), cutout_us + 120);
+    rc.rx(enc(3), cutout_us + 160);
+    rc.read();
+    rc.parse();
+    if (rc.ch2_frame() != RailCom::Ch2Frame::None) return false;
+    return true;
+}
+
+// A POM from a partial frame completes an ops-mode CV read, and the loco
+// counts each kind of frame
+static bool test_railcom_loco_partial()
+{
+    DccLoco loco(3);
+    RailCom rc(nullptr, -1);
+
+    bool result;
+    uint8_t value;
+
+    loco.read_cv(8, nullptr);
+    loco.next_packet(); // read cv packet
+
+    rc.cutout_start(cutout_us);
+    rc.rx(0x00, cutout_us + 240);
+    rc.read();
+    rc.parse();
+    loco.railcom(rc, loco.last_req_id());
+    if (loco.ops_done(result, value)) return false;
+
+    loco.next_packet(); // read cv packet again
+
+    rc.cutout_start(cutout_us);
+    rx_pom_junk(rc);
+    rc.read();
+    rc.parse();
+    loco.railcom(rc, loco.last_req_id());
+    if (!loco.ops_done(result, value)) return false;
+    if (!result || value != 0x95) return false;
+
+    rc.cutout_start(cutout_us);
+    rx_clean(rc);
+    rc.read();
+    rc.parse();
+    loco.railcom(rc, loco.last_req_id());
+
+    RailComStats st = loco.rc_stats();
+    if (st.ch2_full != 1 || st.ch2_part != 1 || st.ch2_rej != 1) return false;
+    loco.rc_stats_reset();
+    st = loco.rc_stats();
+    if (st.ch2_full != 0 || st.ch2_part != 0 || st.ch2_rej != 0) return false;
+    return true;
+}
+
+// POM 0x95 alone in channel 2
+static void rx_pom(RailCom &rc)
+{
+    rc.cutout_start(cutout_us);
+    rc.rx(enc((RailComSpec::pkt_pom << 2) | 2), cutout_us + 240);
+    rc.rx(enc(0x15), cutout_us + 280);
+    rc.read();
+    rc.parse();
+}
+
+// A POM is only a response if it comes after the request's second or later
+// packet: one after the first packet, or after a speed or function packet,
+// is left over from something earlier
+static bool test_railcom_loco_req_match()
+{
+    DccLoco loco(3);
+    RailCom rc(nullptr, -1);
+
+    bool result;
+    uint8_t value;
+
+    loco.next_packet(); // speed
+    if (loco.last_req_id() != 0) return false;
+
+    loco.read_cv(8, nullptr);
+    loco.next_packet(); // read cv packet
+    uint16_t req_id = loco.last_req_id();
+    if (req_id == 0) return false;
+
+    // stale, after the first packet
+    rx_pom(rc);
+    loco.railcom(rc, loco.last_req_id());
+    if (loco.ops_done(result, value)) return false;
+
+    // after a packet that isn't part of the request
+    loco.railcom(rc, 0);
+    if (loco.ops_done(result, value)) return false;
+
+    loco.next_packet(); // read cv packet again
+    if (loco.last_req_id() != req_id) return false;
+    loco.railcom(rc, loco.last_req_id());
+    if (!loco.ops_done(result, value)) return false;
+    if (!result || value != 0x95) return false;
+
+    // No lockout: the next read goes out right away, with a new ID, and
+    // repeats of the old response don't complete it
+    loco.read_cv(29, nullptr);
+    loco.next_packet();
+    if (loco.last_req_id() == 0 || loco.last_req_id() == req_id) return false;
+    loco.railcom(rc, req_id);
+    loco.next_packet();
+    loco.railcom(rc, req_id);
+    if (loco.ops_done(result, value)) return false;
+    return true;
+}
+
+// Scalar and swar frame decodes agree, for every length and a spread of
+// good, special, and junk bytes
+static bool test_railcom_frame_decode()
+{
+    unsigned seed = 1;
+    for (int n = 0; n < 20000; n++) {
+        uint8_t e[RailComSpec::Frame::len_max];
+        seed = seed * 1103515245 + 12345;
+        int len = (seed >> 16) % (RailComSpec::Frame::len_max + 1);
+        for (int i = 0; i < RailComSpec::Frame::len_max; i++) {
+            seed = seed * 1103515245 + 12345;
+            e[i] = seed >> 16;
+        }
+        RailComSpec::Frame f1, f2;
+        RailComSpec::decode_frame_scalar(e, len, f1);
+        RailComSpec::decode_frame_swar(e, len, f2);
+        if (f1.data != f2.data || f1.valid != f2.valid || f1.len != f2.len)
+            return false;
+        for (int i = 0; i < RailComSpec::Frame::len_max; i++) {
+            if (f1.dec[i] != f2.dec[i]) return false;
+            bool v = f1.dec[i] < RailComSpec::dec_max;
+            if (v != f1.all_valid(i, 1)) return false;
+            if (f1.field(i, 1) != (v ? f1.dec[i] : 0)) return false;
+        }
+    }
+    return true;
+}
+
+// Messages out of a frame by shift and mask
+static bool test_railcom_frame_field()
+{
+    // ALO 3, then POM 0x95, then junk, then ACK
+    uint8_t e[] = {
+        enc((RailComSpec::pkt_alo << 2) | 0), enc(3),
+        enc((RailComSpec::pkt_pom << 2) | 2), enc(0x15),
+        0x00, enc(RailComSpec::dec_ack),
+    };
+    RailComSpec::Frame f;
+    RailComSpec::decode_frame(e, sizeof(e), f);
+    if (f.len != sizeof(e)) return false;
+    if (f.valid != 0x0f) return false;
+    if (!f.all_valid(0, 4) || f.all_valid(2, 3)) return false;
+    if (f.field(0, 2) != ((RailComSpec::pkt_alo << 8) | 3)) return false;
+    if (f.field(2, 2) != ((RailComSpec::pkt_pom << 8) | 0x95)) return false;
+    if (f.field(4, 2) != 0) return false;
+    if (f.dec[5] != RailComSpec::dec_ack) return false;
+    return true;
+}
+
+// Channel 2 messages' values come out of the frame's fields
+static bool test_railcom_msg_fields()
+{
+    RailComSpec::Frame f;
+    RailComMsg msg;
+    int i = 0;
+
+    // EXT typ 0x1b pos 0x7a, then DYN 7 = 0x95
+    const uint8_t e1[] = {
+        enc((RailComSpec::pkt_ext << 2) | 1), enc(0x2d), enc(0x3a),
+        enc((RailComSpec::pkt_dyn << 2) | 2), enc(0x15), enc(7),
+    };
+    RailComSpec::decode_frame(e1, sizeof(e1), f);
+    if (!msg.parse2(f, i, sizeof(e1)) || i != 3) return false;
+    if (msg.id != RailComMsg::MsgId::ext || msg.ext.typ != 0x1b ||
+        msg.ext.pos != 0x7a)
+        return false;
+    if (!msg.parse2(f, i, sizeof(e1)) || i != 6) return false;
+    if (msg.id != RailComMsg::MsgId::dyn || msg.dyn.val != 0x95 ||
+        msg.dyn.id != RailComSpec::DynId(7))
+        return false;
+
+    // XPOM ss 2, 2a c4 c9 7f
+    const uint8_t e2[] = {
+        enc(0x0a << 2), enc(0x2a), enc(0x31), enc(0x0c), enc(0x25), enc(0x3f),
+    };
+    RailComSpec::decode_frame(e2, sizeof(e2), f);
+    i = 0;
+    if (!msg.parse2(f, i, sizeof(e2)) || i != 6) return false;
+    if (msg.id != RailComMsg::MsgId::xpom || msg.xpom.ss != 2 ||
+        msg.xpom.val[0] != 0x2a || msg.xpom.val[1] != 0xc4 ||
+        msg.xpom.val[2] != 0xc9 || msg.xpom.val[3] != 0x7f)
+        return false;
+
+    // any byte of it not data, or not all there: no message
+    RailComSpec::decode_frame(e2, sizeof(e2) - 1, f);
+    i = 0;
+    if (msg.parse2(f, i, sizeof(e2) - 1) || i != 0) return false;
+    uint8_t e3[sizeof(e2)];
+    for (unsigned j = 0; j < sizeof(e2); j++)
+        e3[j] = e2[j];
+    e3[4] = enc(RailComSpec::dec_ack);
+    RailComSpec::decode_frame(e3, sizeof(e3), f);
+    if (msg.parse2(f, i, sizeof(e3)) || i != 0) return false;
+    return true;
+}
+
+// DYN message alone in channel 2, to the loco
+static void loco_dyn(DccLoco &loco, RailComSpec::DynId id, uint8_t val)
+{
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(cutout_us);
+    rc.rx(enc((RailComSpec::pkt_dyn << 2) | (val >> 6)), cutout_us + 240);
+    rc.rx(enc(val & 0x3f), cutout_us + 280);
+    rc.rx(enc(id), cutout_us + 320);
+    rc.read();
+    rc.parse();
+    loco.railcom(rc, 0);
+}
+
+// Empty cutout, to the loco
+static void loco_empty(DccLoco &loco)
+{
+    RailCom rc(nullptr, -1);
+    rc.cutout_start(cutout_us);
+    rc.read();
+    rc.parse();
+    loco.railcom(rc, 0);
+}
+
+// dyn reports received, most recent last
+static int dyn_cnt;
+static int dyn_id[8];
+static uint8_t dyn_val[8];
+
+static void dyn_cb(DccLoco *, int id, uint8_t val, uint32_t)
+{
+    if (dyn_cnt < 8) {
+        dyn_id[dyn_cnt] = id;
+        dyn_val[dyn_cnt] = val;
+    }
+    dyn_cnt++;
+}
+
+// Every defined DYN id is kept; reserved ones are not
+static bool test_railcom_loco_dyn_get()
+{
+    DccLoco loco(3);
+    uint8_t val;
+    uint32_t rx_ms;
+    if (loco.dyn_get(RailComSpec::dyn_cont_1, val, rx_ms)) return false;
+    loco_dyn(loco, RailComSpec::dyn_cont_1, 42);
+    loco_dyn(loco, RailComSpec::dyn_time, 7);
+    loco_dyn(loco, RailComSpec::DynId(30), 1);
+    if (!loco.dyn_get(RailComSpec::dyn_cont_1, val, rx_ms) || val != 42)
+        return false;
+    if (!loco.dyn_get(RailComSpec::dyn_time, val, rx_ms) || val != 7)
+        return false;
+    if (loco.dyn_get(30, val, rx_ms)) return false;
+    if (loco.dyn_report(DccLoco::dyn_id_max, true)) return false;
+    return true;
+}
+
+// Reports on changes only, for ids with reports on
+static bool test_railcom_loco_dyn_report()
+{
+    DccLoco loco(3);
+    loco.dyn_cb_set(dyn_cb);
+    dyn_cnt = 0;
+    loco_dyn(loco, RailComSpec::dyn_speed_2, 10);
+    if (dyn_cnt != 0) return false;
+    // turning it on reports the current value
+    loco.dyn_report(RailComSpec::dyn_speed_2, true);
+    loco_empty(loco);
+    if (dyn_cnt != 1 || dyn_val[0] != 10) return false;
+    loco_dyn(loco, RailComSpec::dyn_speed_2, 10);
+    if (dyn_cnt != 1) return false;
+    loco_dyn(loco, RailComSpec::dyn_speed_2, 11);
+    if (dyn_cnt != 2 || dyn_id[1] != RailComSpec::dyn_speed_2) return false;
+    if (dyn_val[1] != 11) return false;
+    loco_dyn(loco, RailComSpec::dyn_cont_2, 5); // not on
+    if (dyn_cnt != 2) return false;
+    loco.dyn_report(RailComSpec::dyn_speed_2, false);
+    loco_dyn(loco, RailComSpec::dyn_speed_2, 12);
+    if (dyn_cnt != 2) return false;
+    return true;
+}
+
+// Changes inside min_ms are held, then the latest goes out
+static bool test_railcom_loco_dyn_rate()
+{
+    const uint16_t min_ms = 30;
+    DccLoco loco(3);
+    loco.dyn_cb_set(dyn_cb);
+    dyn_cnt = 0;
+    loco.dyn_report(RailComSpec::dyn_cont_3, true, min_ms);
+    uint32_t start_us = time_us_32();
+    loco_dyn(loco, RailComSpec::dyn_cont_3, 1);
+    if (dyn_cnt != 1) return false;
+    loco_dyn(loco, RailComSpec::dyn_cont_3, 2);
+    loco_dyn(loco, RailComSpec::dyn_cont_3, 3);
+    if ((time_us_32() - start_us) >= min_ms * 1000u)
+        return true; // too slow to tell
+    if (dyn_cnt != 1) return false;
+    while ((time_us_32() - start_us) < (min_ms + 2) * 1000u)
+        ;
+    loco_empty(loco);
+    if (dyn_cnt != 2 || dyn_val[1] != 3) return false;
+    return true;
+}
+
+// Each cutout is counted into the cutout's stats, and added to the totals
+static bool test_railcom_stats_cutout()
+{
+    RailCom rc(nullptr, -1);
+
+    rc.cutout_start(cutout_us);
+    rx_pom_junk(rc);
+    rc.read();
+    rc.parse();
+    const RailComStats &c = rc.cutout_stats();
+    if (c.cutout != 1 || c.empty != 0 || c.bytes != 8) return false;
+    if (c.inv != 1 || c.short_frame != 0) return false;
+    if (c.ch1 != 1 || c.ch2 != 1 || c.ch2_part != 1) return false;
+    if (c.pom != 1 || c.ack != 0) return false;
+
+    rc.cutout_start(cutout_us);
+    rc.rx(enc(RailComSpec::dec_nak), cutout_us + 240);
+    rc.read();
+    rc.parse();
+    if (c.cutout != 1 || c.bytes != 1 || c.short_frame != 1) return false;
+    if (c.ch1 != 0 || c.nak != 1 || c.pom != 0 || c.ch2_full != 1)
+        return false;
+
+    rc.cutout_start(cutout_us);
+    rc.read();
+    rc.parse();
+    if (c.empty != 1 || c.bytes != 0 || c.short_frame != 0) return false;
+
+    RailComStats st = rc.stats();
+    if (st.cutout != 3 || st.empty != 1 || st.bytes != 9) return false;
+    if (st.inv != 1 || st.short_frame != 1) return false;
+    if (st.ch2 != 2 || st.ch2_full != 1 || st.ch2_part != 1) return false;
+    if (st.pom != 1 || st.nak != 1) return false;
+    for (int i = 0; i < RailComStats::cnt; i++)
+        if (RailComStats::name(i) == nullptr) return false;
+    if (st.get(0) != st.cutout || st.get(RailComStats::cnt - 1) != st.ch2_heur)
+        return false;
+
+    rc.stats_reset();
+    st = rc.stats();
+    for (int i = 0; i < RailComStats::cnt; i++)
+        if (st.get(i) != 0) return false;
+    return true;
+}
+
+// A loco's stats only have the cutouts after its packets
+static bool test_railcom_stats_loco()
+{
+    RailCom rc(nullptr, -1);
+    DccLoco loco3(3);
+    DccLoco loco4(4);
+
+    for (int i = 0; i < 3; i++) {
+        rc.cutout_start(cutout_us);
+        rx_clean(rc);
+        rc.read();
+        rc.parse();
+        loco3.railcom(rc, 0);
+    }
+    rc.cutout_start(cutout_us);
+    rx_pom_junk(rc);
+    rc.read();
+    rc.parse();
+    loco4.railcom(rc, 0);
+
+    RailComStats st3 = loco3.rc_stats();
+    RailComStats st4 = loco4.rc_stats();
+    if (st3.cutout != 3 || st3.ack != 3 * 6 || st3.inv != 0) return false;
+    if (st4.cutout != 1 || st4.inv != 1 || st4.pom != 1) return false;
+    if (rc.stats().cutout != 4 || rc.stats().inv != 1) return false;
+    return true;
+}
+
+extern const Test tests_railcom[] = {
+    {"railcom_rx_times", test_railcom_rx_times},
+    {"railcom_rx_wrap", test_railcom_rx_wrap},
+    {"railcom_rx_between", test_railcom_rx_between},
+    {"railcom_rx_ovr", test_railcom_rx_ovr},
+    {"railcom_parse_clean", test_railcom_parse_clean},
+    {"railcom_ch1_junk", test_railcom_ch1_junk},
+    {"railcom_ch1_bad_second", test_railcom_ch1_bad_second},
+    {"railcom_no_ch1", test_railcom_no_ch1},
+    {"railcom_ch2_short", test_railcom_ch2_short},
+    {"railcom_ch1_only", test_railcom_ch1_only},
+    {"railcom_ch2_partial", test_railcom_ch2_partial},
+    {"railcom_ch2_full_mode", test_railcom_ch2_full_mode},
+    {"railcom_ch2_overfull", test_railcom_ch2_overfull},
+    {"railcom_ch2_rejected", test_railcom_ch2_rejected},
+    {"railcom_loco_partial", test_railcom_loco_partial},
+    {"railcom_loco_req_match", test_railcom_loco_req_match},
+    {"railcom_frame_decode", test_railcom_frame_decode},
+    {"railcom_frame_field", test_railcom_frame_field},
+    {"railcom_msg_fields", test_railcom_msg_fields},
+    {"railcom_loco_dyn_get", test_railcom_loco_dyn_get},
+    {"railcom_loco_dyn_report", test_railcom_loco_dyn_report},
+    {"railcom_loco_dyn_rate", test_railcom_loco_dyn_rate},
+    {"railcom_stats_cutout", test_railcom_stats_cutout},
+    {"railcom_stats_loco", test_railcom_stats_loco},
+};
+
+extern const int tests_railcom_cnt =
+    sizeof(tests_railcom) / sizeof(tests_railcom[0]);
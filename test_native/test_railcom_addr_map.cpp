@@ -0,0 +1,232 @@
+#include <cstdio>
+#include <cstdint>
+
+#include "dcc/railcom.h"
+#include "dcc/railcom_addr_map.h"
+#include "dcc/railcom_msg.h"
+#include "dcc/railcom_spec.h"
+#include "test.h"
+
+static const uint32_t ms = 1000; // usec
+
+// one cutout every ~7 msec, about what a loco's speed and function packets
+// mixed with others give
+static const uint32_t cutout_us = 7 * ms;
+
+static RailComMsg ahi(uint8_t v)
+{
+    RailComMsg m;
+    m.id = RailComMsg::MsgId::ahi;
+    m.ahi.ahi = v;
+    return m;
+}
+
+static RailComMsg alo(uint8_t v)
+{
+    RailComMsg m;
+    m.id = RailComMsg::MsgId::alo;
+    m.alo.alo = v;
+    return m;
+}
+
+// events from the map, most recent last
+static int ev_cnt;
+static uint16_t ev_addr[8];
+static bool ev_present[8];
+
+static void event_cb(uint16_t addr, bool present)
+{
+    if (ev_cnt < 8) {
+        ev_addr[ev_cnt] = addr;
+        ev_present[ev_cnt] = present;
+    }
+    ev_cnt++;
+}
+
+// Send AHI/ALO for addr, alternating, in cnt cutouts starting at t
+static uint32_t send_addr(RailComAddrMap &map, uint16_t addr, int cnt,
+                          uint32_t t)
+{
+    uint8_t hi = addr > 127 ? (0xc0 | (addr >> 8)) : 0;
+    uint8_t lo = addr & 0xff;
+    for (int i = 0; i < cnt; i++) {
+        RailComMsg m = (i & 1) == 0 ? ahi(hi) : alo(lo);
+        map.update(&m, t);
+        t += cutout_us;
+    }
+    return t;
+}
+
+static bool test_addr_decode()
+{
+    if (RailComAddrMap::addr(0x00, 3) != 3) return false;
+    if (RailComAddrMap::addr(0x00, 127) != 127) return false;
+    if (RailComAddrMap::addr(0x00, 0) != 0) return false;
+    if (RailComAddrMap::addr(0x00, 128) != 0) return false;
+    if (RailComAddrMap::addr(0xc0 | 0x04, 0xd2) != 1234) return false;
+    if (RailComAddrMap::addr(0xe7, 0xff) != 10239) return false;
+    if (RailComAddrMap::addr(0xe8, 0x00) != 0) return false; // 10240
+    if (RailComAddrMap::addr(0x80, 0x03) != 0) return false; // not loco
+    return true;
+}
+
+// Present after conf_min sightings, and an event then
+static bool test_addr_present()
+{
+    RailComAddrMap map;
+    ev_cnt = 0;
+    map.event_cb_set(event_cb);
+    // n cutouts give n-1 sightings (each AHI/ALO pairs with the one before)
+    send_addr(map, 1234, RailComAddrMap::conf_min, 0);
+    if (map.present_cnt() != 0 || ev_cnt != 0) return false;
+    map = RailComAddrMap();
+    map.event_cb_set(event_cb);
+    send_addr(map, 1234, RailComAddrMap::conf_min + 1, 0);
+    if (map.present_cnt() != 1) return false;
+    if (ev_cnt != 1 || ev_addr[0] != 1234 || !ev_present[0]) return false;
+    RailComAddrMap::Entry e;
+    if (!map.present_get(0, e)) return false;
+    if (e.addr != 1234 || e.conf != RailComAddrMap::conf_min) return false;
+    if (map.present_get(1, e)) return false;
+    return true;
+}
+
+// AHI and ALO too far apart don't pair up
+static bool test_addr_pair_time()
+{
+    RailComAddrMap map;
+    uint32_t t = 0;
+    for (int i = 0; i < 10; i++) {
+        RailComMsg m = (i & 1) == 0 ? ahi(0) : alo(3);
+        map.update(&m, t);
+        t += RailComAddrMap::pair_us;
+    }
+    if (map.present_cnt() != 0) return false;
+    // missing channel 1 in between is okay if it's not too long
+    RailComMsg m = ahi(0);
+    for (int i = 0; i < 10; i++) {
+        map.update(i == 0 ? &m : nullptr, t);
+        m = (i & 1) == 0 ? alo(3) : ahi(0);
+        map.update(&m, t + cutout_us);
+        t += 2 * cutout_us;
+    }
+    if (map.present_cnt() != 1) return false;
+    return true;
+}
+
+// Dropped (with an event) gone_ms after last seen
+static bool test_addr_gone()
+{
+    RailComAddrMap map;
+    ev_cnt = 0;
+    map.event_cb_set(event_cb);
+    uint32_t t = send_addr(map, 3, 10, 0);
+    uint32_t last_us = t - cutout_us;
+    if (map.present_cnt() != 1 || ev_cnt != 1) return false;
+    // cutouts with nothing in channel 1
+    for (; (t - last_us) < RailComAddrMap::gone_ms * ms; t += cutout_us)
+        map.update(nullptr, t);
+    if (map.present_cnt() != 1) return false;
+    map.update(nullptr, t);
+    if (map.present_cnt() != 0) return false;
+    if (ev_cnt != 2 || ev_addr[1] != 3 || ev_present[1]) return false;
+    return true;
+}
+
+// A bogus pairing seen once goes away quietly
+static bool test_addr_bogus()
+{
+    RailComAddrMap map;
+    ev_cnt = 0;
+    map.event_cb_set(event_cb);
+    RailComMsg m1 = ahi(0xc4);
+    RailComMsg m2 = alo(0x03);
+    map.update(&m1, 0);
+    map.update(&m2, cutout_us);
+    if (map.present_cnt() != 0) return false;
+    map.update(nullptr, RailComAddrMap::gone_ms * ms + cutout_us);
+    if (ev_cnt != 0) return false;
+    // and a real one still shows up after
+    send_addr(map, 5, 10, RailComAddrMap::gone_ms * ms + 2 * cutout_us);
+    if (map.present_cnt() != 1 || ev_cnt != 1 || ev_addr[0] != 5)
+        return false;
+    return true;
+}
+
+// Full table: the least sure entry goes
+static bool test_addr_full()
+{
+    RailComAddrMap map;
+    ev_cnt = 0;
+    map.event_cb_set(event_cb);
+    uint32_t t = 0;
+    // one present address, then fill the rest seen once
+    t = send_addr(map, 3, 10, t);
+    for (int a = 100; a < 100 + RailComAddrMap::addr_max - 1; a++)
+        t = send_addr(map, a, 2, t);
+    if (map.present_cnt() != 1) return false;
+    // another one pushes out a once-seen one, not the present one
+    t = send_addr(map, 4, 10, t);
+    if (map.present_cnt() != 2) return false;
+    if (ev_cnt != 2 || ev_addr[1] != 4 || !ev_present[1]) return false;
+    return true;
+}
+
+// clear() reports everything present as gone
+static bool test_addr_clear()
+{
+    RailComAddrMap map;
+    ev_cnt = 0;
+    map.event_cb_set(event_cb);
+    uint32_t t = send_addr(map, 3, 10, 0);
+    send_addr(map, 4000, 10, t);
+    if (map.present_cnt() != 2 || ev_cnt != 2) return false;
+    map.clear();
+    if (map.present_cnt() != 0) return false;
+    if (ev_cnt != 4 || ev_present[2] || ev_present[3]) return false;
+    return true;
+}
+
+// 4/8 encoding of a decoded value (6-bit data, or a DecId)
+static uint8_t enc(uint8_t dec)
+{
+    for (int e = 0; e <= UINT8_MAX; e++)
+        if (RailComSpec::decode[e] == dec)
+            return e;
+    return 0; // not reached for valid dec
+}
+
+// Channel 1 from the uart through RailCom::parse() to the map
+static bool test_addr_railcom()
+{
+    RailCom rc(nullptr, -1);
+    uint32_t t = 1000 * ms;
+    for (int i = 0; i < 10; i++) {
+        rc.cutout_start(t);
+        // long address 1234: AHI 0xc4, ALO 0xd2
+        uint8_t id = (i & 1) == 0 ? RailComSpec::pkt_ahi : RailComSpec::pkt_alo;
+        uint8_t v = (i & 1) == 0 ? 0xc4 : 0xd2;
+        rc.rx(enc((id << 2) | (v >> 6)), t + 120);
+        rc.rx(enc(v & 0x3f), t + 160);
+        rc.read();
+        rc.parse();
+        t += cutout_us;
+    }
+    RailComAddrMap::Entry e;
+    if (!rc.addr_map().present_get(0, e) || e.addr != 1234) return false;
+    return true;
+}
+
+extern const Test tests_railcom_addr_map[] = {
+    {"addr_decode", test_addr_decode},
+    {"addr_present", test_addr_present},
+    {"addr_pair_time", test_addr_pair_time},
+    {"addr_gone", test_addr_gone},
+    {"addr_bogus", test_addr_bogus},
+    {"addr_full", test_addr_full},
+    {"addr_clear", test_addr_clear},
+    {"addr_railcom", test_addr_railcom},
+};
+
+extern const int tests_railcom_addr_map_cnt =
+    sizeof(tests_railcom_addr_map) / sizeof(tests_railcom_addr_map[0]);